@@ -0,0 +1,427 @@
+#include "autosave.h"
+#include "cmd.h"
+#include "exception.h"
+#include "file_native.h"
+#include "layer.h"
+#include "project.h"
+#include "serialise.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <new>
+
+static const char MAGIC[8] = {'E','V','J','R','N','L','\r','\n'};
+static const uint32_t VERSION = 1;
+
+static std::string checkpointName(std::string const& dir, int generation)
+{
+    return JoinPath(dir, "checkpoint-" + std::to_string(generation) + ".evp");
+}
+
+static std::string journalName(std::string const& dir, int generation)
+{
+    return JoinPath(dir, "journal-" + std::to_string(generation));
+}
+
+// Pull the generation number out of a filename (0 if it's not one of ours).
+static int parseName(std::string const& name, std::string const& prefix, std::string const& suffix)
+{
+    if (name.size() <= prefix.size() + suffix.size() ||
+        name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+        return 0;
+    }
+    std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+    if (digits.find_first_not_of("0123456789") != std::string::npos) {
+        return 0;
+    }
+    return atoi(digits.c_str());
+}
+
+// Call fn(path, generation) for each of our files in dir.
+template <typename FN>
+static void forEachFile(std::string const& dir, FN fn)
+{
+    std::vector<std::filesystem::path> found;
+    std::error_code ec;
+    for (auto const& ent : std::filesystem::directory_iterator(dir, ec)) {
+        found.push_back(ent.path());
+    }
+    for (auto const& path : found) {
+        std::string name = path.filename().string();
+        int gen = parseName(name, "checkpoint-", ".evp");
+        if (!gen) {
+            gen = parseName(name, "checkpoint-", ".evp.tmp");
+        }
+        if (!gen) {
+            gen = parseName(name, "journal-", "");
+        }
+        if (gen) {
+            fn(path.string(), gen);
+        }
+    }
+}
+
+// The most recent complete checkpoint in dir (or 0).
+static int latestCheckpoint(std::string const& dir)
+{
+    int latest = 0;
+    std::error_code ec;
+    for (auto const& ent : std::filesystem::directory_iterator(dir, ec)) {
+        int gen = parseName(ent.path().filename().string(), "checkpoint-", ".evp");
+        latest = std::max(latest, gen);
+    }
+    return latest;
+}
+
+// FNV-1a, to spot partly-written entries.
+static uint32_t checksum(uint8_t const* p, size_t n)
+{
+    uint32_t h = 2166136261u;
+    while (n--) {
+        h = (h ^ *p++) * 16777619u;
+    }
+    return h;
+}
+
+static void flip(Cmd& cmd)
+{
+    if (cmd.State() == Cmd::DONE) {
+        cmd.Undo();
+    } else {
+        cmd.Do();
+    }
+}
+
+
+Autosave::Job::~Job()
+{
+    delete snapshot;
+    delete settings;
+}
+
+Autosave::Autosave(Project& proj, std::string const& dir) :
+    m_Proj(proj),
+    m_Dir(dir),
+    m_Generation(0),
+    m_JournalBytes(0),
+    m_JournalEntries(0),
+    m_Busy(false),
+    m_Quit(false),
+    m_Failed(false),
+    m_Journal(nullptr)
+{
+    m_Thread = std::thread(&Autosave::run, this);
+}
+
+Autosave::~Autosave()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Quit = true;
+    }
+    m_Cond.notify_one();
+    m_Thread.join();
+    for (Job* job : m_Queue) {
+        delete job;
+    }
+    if (m_Journal) {
+        fclose(m_Journal);
+    }
+    Remove(m_Dir);
+}
+
+bool Autosave::Record(Cmd const& cmd)
+{
+    BinWriter out;
+    if (!cmd.Save(out)) {
+        return false;
+    }
+    // The project is still in the state the entry applies to.
+    if (m_Generation == 0 || m_JournalBytes >= MAX_JOURNAL_BYTES ||
+        m_JournalEntries >= MAX_JOURNAL_ENTRIES) {
+        Checkpoint();
+    }
+    queueEntry(out.Data());
+    return true;
+}
+
+void Autosave::RecordApplied(Cmd& cmd)
+{
+    if (m_Generation == 0) {
+        // The first checkpoint will include it.
+        Checkpoint();
+        return;
+    }
+    // Need the cmd as it was before it was applied, so briefly unapply it.
+    BinWriter out;
+    m_Proj.MuteNotifications(true);
+    flip(cmd);
+    bool saved = cmd.Save(out);
+    flip(cmd);
+    m_Proj.MuteNotifications(false);
+    if (!saved) {
+        Checkpoint();
+        return;
+    }
+    queueEntry(out.Data());
+    if (m_JournalBytes >= MAX_JOURNAL_BYTES || m_JournalEntries >= MAX_JOURNAL_ENTRIES) {
+        Checkpoint();
+    }
+}
+
+void Autosave::Checkpoint()
+{
+    Job* job = new Job();
+    job->snapshot = CopyNode(m_Proj.mRoot);
+    job->settings = new ProjSettings(m_Proj.mSettings);
+    job->filename = m_Proj.mFilename;
+    job->generation = ++m_Generation;
+    m_JournalBytes = 0;
+    m_JournalEntries = 0;
+    queue(job);
+}
+
+void Autosave::Resync()
+{
+    if (m_Generation > 0) {
+        Checkpoint();
+    }
+}
+
+void Autosave::Flush()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_IdleCond.wait(lock, [&] {return m_Queue.empty() && !m_Busy;});
+}
+
+bool Autosave::Failed()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Failed;
+}
+
+std::string Autosave::TakeError()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::string err;
+    err.swap(m_Error);
+    return err;
+}
+
+// Called by the worker.
+void Autosave::fail(std::string const& msg)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (!m_Failed) {
+        m_Failed = true;
+        m_Error = msg;
+    }
+}
+
+void Autosave::queue(Job* job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Queue.push_back(job);
+    }
+    m_Cond.notify_one();
+}
+
+// Entries are stored as: length, checksum, data.
+void Autosave::queueEntry(std::vector<uint8_t> const& data)
+{
+    BinWriter out;
+    out.U32((uint32_t)data.size());
+    out.U32(checksum(data.data(), data.size()));
+    out.Bytes(data.data(), data.size());
+    Job* job = new Job();
+    job->entry = out.Data();
+    m_JournalBytes += job->entry.size();
+    ++m_JournalEntries;
+    queue(job);
+}
+
+// The worker thread.
+void Autosave::run()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (true) {
+        m_Cond.wait(lock, [&] {return m_Quit || !m_Queue.empty();});
+        if (m_Quit) {
+            break;
+        }
+        // Grab everything queued up so far.
+        std::deque<Job*> jobs;
+        jobs.swap(m_Queue);
+        m_Busy = true;
+        lock.unlock();
+
+        // Anything before the last checkpoint is superseded by it.
+        size_t first = 0;
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            if (jobs[i]->snapshot) {
+                first = i;
+            }
+        }
+        std::vector<uint8_t> buf;
+        for (size_t i = first; i < jobs.size(); ++i) {
+            Job const& job = *jobs[i];
+            if (job.snapshot) {
+                writeEntries(buf);
+                buf.clear();
+                writeCheckpoint(job);
+            } else {
+                buf.insert(buf.end(), job.entry.begin(), job.entry.end());
+            }
+        }
+        writeEntries(buf);
+        for (Job* job : jobs) {
+            delete job;
+        }
+
+        lock.lock();
+        m_Busy = false;
+        m_IdleCond.notify_all();
+    }
+}
+
+// Append to the journal in one go.
+// The data only needs to reach the OS to survive the program dying, so
+// there's no syncing to disk.
+void Autosave::writeEntries(std::vector<uint8_t> const& buf)
+{
+    if (!m_Journal || buf.empty()) {
+        return;
+    }
+    if (fwrite(buf.data(), 1, buf.size(), m_Journal) != buf.size() ||
+        fflush(m_Journal) != 0) {
+        // Stop journalling until the next checkpoint - later entries
+        // would be no use without this lot.
+        fail(std::string("Autosave failed: ") + strerror(errno));
+        fclose(m_Journal);
+        m_Journal = nullptr;
+    }
+}
+
+void Autosave::writeCheckpoint(Job const& job)
+{
+    if (m_Journal) {
+        fclose(m_Journal);
+        m_Journal = nullptr;
+    }
+    try {
+        NativeFile* native = nullptr;
+        SaveNative(*job.snapshot->ToStackConst(), *job.settings,
+            checkpointName(m_Dir, job.generation), native);
+        delete native;
+    } catch (Exception const& e) {
+        fail(std::string("Autosave failed: ") + e.what());
+        return;
+    } catch (std::bad_alloc const&) {
+        fail("Autosave failed: Out of memory");
+        return;
+    }
+
+    BinWriter header;
+    header.Bytes(MAGIC, sizeof(MAGIC));
+    header.U32(VERSION);
+    header.String(job.filename);
+    FILE* fp = fopen(journalName(m_Dir, job.generation).c_str(), "wb");
+    if (!fp || fwrite(header.Data().data(), 1, header.Data().size(), fp) != header.Data().size() ||
+        fflush(fp) != 0) {
+        fail(std::string("Autosave failed: ") + strerror(errno));
+        if (fp) {
+            fclose(fp);
+        }
+        return;
+    }
+    m_Journal = fp;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Failed = false;
+    }
+
+    // The older files are no longer needed.
+    forEachFile(m_Dir, [&](std::string const& path, int gen) {
+        if (gen < job.generation) {
+            remove(path.c_str());
+        }
+    });
+}
+
+
+bool Autosave::Recoverable(std::string const& dir)
+{
+    return latestCheckpoint(dir) > 0;
+}
+
+Project* Autosave::Recover(std::string const& dir)
+{
+    int gen = latestCheckpoint(dir);
+    if (gen == 0) {
+        throw Exception("Nothing to recover.");
+    }
+    std::unique_ptr<Project> proj(new Project(checkpointName(dir, gen)));
+    // It's not really from that file.
+    delete proj->mNative;
+    proj->mNative = nullptr;
+    proj->mFilename.clear();
+    proj->SetModifiedFlag(true);
+
+    std::vector<uint8_t> data;
+    FILE* fp = fopen(journalName(dir, gen).c_str(), "rb");
+    if (fp) {
+        uint8_t tmp[65536];
+        size_t n;
+        while ((n = fread(tmp, 1, sizeof(tmp), fp)) > 0) {
+            data.insert(data.end(), tmp, tmp + n);
+        }
+        fclose(fp);
+    }
+
+    // Stop at the first bad entry - there's nothing to be done with
+    // anything after it.
+    try {
+        BinReader in(data.data(), data.size());
+        char magic[sizeof(MAGIC)];
+        in.Bytes(magic, sizeof(magic));
+        if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || in.U32() != VERSION) {
+            return proj.release();
+        }
+        proj->mFilename = in.String();
+        while (!in.AtEnd()) {
+            uint32_t len = in.U32();
+            uint32_t sum = in.U32();
+            if (len > in.Remaining()) {
+                break;
+            }
+            std::vector<uint8_t> entry(len);
+            in.Bytes(entry.data(), len);
+            if (checksum(entry.data(), len) != sum) {
+                break;
+            }
+            BinReader entryIn(entry.data(), entry.size());
+            std::unique_ptr<Cmd> cmd(Cmd::Load(*proj, entryIn));
+            if (!entryIn.AtEnd() || !cmd->Applicable()) {
+                break;
+            }
+            flip(*cmd);
+        }
+    } catch (Exception const&) {
+    } catch (std::bad_alloc const&) {
+    }
+    return proj.release();
+}
+
+void Autosave::Remove(std::string const& dir)
+{
+    forEachFile(dir, [&](std::string const& path, int) {
+        remove(path.c_str());
+    });
+}
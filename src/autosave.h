@@ -0,0 +1,137 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class BaseNode;
+class Cmd;
+class Project;
+struct ProjSettings;
+
+// Crash recovery for a project.
+//
+// Every change made through the Editor is appended to a journal, and every
+// so often a checkpoint of the whole project is written out (in native
+// format, see file_native.h), starting a fresh journal. If EvilPixie dies,
+// the files are left behind, and Recover() can rebuild the project by
+// replaying the journal onto the checkpoint.
+//
+// A journal entry is just a cmd, serialised in the state it was in before
+// it was applied (see Cmd::Save()). Replaying it means loading it back and
+// applying it again (Do() or Undo(), whichever flips its state).
+//
+// Entries are serialised by the caller, but the file writing is done on a
+// worker thread, which writes out everything queued up in one go. The
+// snapshots for checkpoints share their images with the project
+// (copy-on-write), so they're cheap to take.
+//
+// Files in the autosave directory:
+//   checkpoint-N.evp   - project, in native format
+//   journal-N          - changes since checkpoint N
+class Autosave
+{
+public:
+    // dir must exist, and should be used by only this Autosave.
+    // Nothing is written until the first change is recorded.
+    Autosave(Project& proj, std::string const& dir);
+    // Removes the autosave files (a clean shutdown has nothing to recover).
+    ~Autosave();
+
+    // Record a cmd which is about to be applied (Do() or Undo()).
+    // Returns false if the cmd can't be serialised, in which case the caller
+    // should call Checkpoint() once the cmd has been applied.
+    bool Record(Cmd const& cmd);
+
+    // Record a cmd which has already been applied (or one which has been
+    // changed in-place, eg by Cmd_PaletteModify::Merge()).
+    void RecordApplied(Cmd& cmd);
+
+    // Take a fresh checkpoint (eg after applying a cmd which couldn't be
+    // recorded).
+    void Checkpoint();
+
+    // The project has been changed without a cmd (eg frames coming in
+    // from a LayerLoader). Checkpoints, unless nothing's been recorded yet.
+    void Resync();
+
+    // Wait for all the queued writes to be done.
+    void Flush();
+
+    // Has writing anything out failed since the last good checkpoint?
+    // (if so, the recent changes aren't recoverable).
+    bool Failed();
+
+    // Description of a failure which hasn't been reported yet, or empty.
+    // Only the first failure after a good checkpoint is reported, so the
+    // user isn't nagged about every write while (say) the disk is full.
+    std::string TakeError();
+
+    // Is there anything in dir to recover?
+    static bool Recoverable(std::string const& dir);
+
+    // Rebuild a project from the autosave files in dir. Replaying the
+    // journal stops at the first entry which is garbage (eg partly written)
+    // or doesn't fit the project.
+    // Throws an Exception if there's no usable checkpoint.
+    static Project* Recover(std::string const& dir);
+
+    // Remove the autosave files in dir.
+    static void Remove(std::string const& dir);
+
+    // Checkpoint when the journal gets this big (bytes) or long (entries).
+    static const size_t MAX_JOURNAL_BYTES = 64 * 1024 * 1024;
+    static const int MAX_JOURNAL_ENTRIES = 1000;
+
+private:
+    Autosave(Autosave const&) = delete;
+    Autosave& operator=(Autosave const&) = delete;
+
+    // A job for the worker: either a journal entry or a checkpoint.
+    struct Job {
+        std::vector<uint8_t> entry;
+        BaseNode* snapshot {nullptr};   // for checkpoints
+        ProjSettings* settings {nullptr};
+        std::string filename;           // the project's
+        int generation {0};
+        ~Job();
+    };
+
+    void queue(Job* job);
+    void queueEntry(std::vector<uint8_t> const& data);
+    void run();
+    void writeEntries(std::vector<uint8_t> const& buf);
+    void writeCheckpoint(Job const& job);
+    void fail(std::string const& msg);
+
+    Project& m_Proj;
+    std::string m_Dir;
+
+    // Only touched by the calling thread.
+    int m_Generation;           // current checkpoint (0 for none yet)
+    size_t m_JournalBytes;      // since the checkpoint
+    int m_JournalEntries;
+
+    // Shared with the worker thread.
+    std::mutex m_Mutex;
+    std::condition_variable m_Cond;       // work to do
+    std::condition_variable m_IdleCond;   // work done
+    std::deque<Job*> m_Queue;
+    bool m_Busy;
+    bool m_Quit;
+    bool m_Failed;
+    std::string m_Error;        // not yet reported
+
+    // Only touched by the worker thread.
+    FILE* m_Journal;            // null if broken (until next checkpoint)
+
+    std::thread m_Thread;
+};
+
+#endif // AUTOSAVE_H
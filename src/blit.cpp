@@ -1,4 +1,5 @@
 #include "blit.h"
+#include "blit_kernels.h"
 
 #include "img.h"
 #include "palette.h"
@@ -127,67 +128,46 @@ void BlitSwap(
 }
 
 
-#if 0
+//----
+// Alpha blending
 
-// blit src upon dest, blending with src.alpha
-static void scan_RGBA8_RGBX8(RGBA8 const* src, RGBX8* dest, int w)
+// Blend src onto dest using src alpha.
+template<typename DEST>
+class BlendRGBA8
 {
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        RGBX8 out = Blend(*src++, *dest);
-        *dest++ = out;
-    }
-}
-
-// blit src upon dest, blending with src.alpha
-static void scan_RGBA8_RGBA8(RGBA8 const* src, RGBA8* dest, int w)
+public:
+    bool Visible(RGBA8 s) const
+        { return s.a != 0; }
+    DEST Apply(RGBA8 s, DEST d) const
+        { return Blend(s, d); }
+
+    void Row(RGBA8 const* src, DEST* dest, int w) const
+        { ScanRow(*this, src, dest, w); }
+};
+
+// Only RGBA8 sources blended onto RGB dests are supported.
+template<typename SRC, typename DEST>
+class AlphaBlendOp
 {
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        RGBA8 out = Blend(*src++, *dest);
-        *dest++ = out;
-    }
-}
+public:
+    AlphaBlendOp()
+        { assert(false); }  // not implemented
+    void Row(SRC const*, DEST*, int) const
+        {}
+};
+
+template<> class AlphaBlendOp<RGBA8, RGBX8> : public BlendRGBA8<RGBX8> {};
+template<> class AlphaBlendOp<RGBA8, RGBA8> : public BlendRGBA8<RGBA8> {};
 
 
 // blit an RGBA img, blending with src alpha onto the dest (must be RGBX8 or RGBA8)
-void BlitRGBA8( Img const& srcimg, Box const& srcbox, Img& destimg, Box& destbox )
+void BlitRGBA8(Img const& srcimg, Box const& srcbox, Img& destimg, Box& destbox)
 {
-    assert(srcimg.Fmt()==FMT_RGBA8);
-    assert(destimg.Fmt()!=FMT_I8);
-
-    Box destclipped( destbox );
-    Box srcclipped( srcbox );
-    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped );
-
-    const int w = destclipped.w;
-    int y;
-    for( y=0; y<destclipped.h; ++y )
-    {
-        RGBA8 const* src = srcimg.PtrConst_RGBA8( srcclipped.x+0, srcclipped.y+y );
-        switch(destimg.Fmt())
-        {
-            case FMT_I8:
-                assert(false);  // not implemented
-                break;
-            case FMT_RGBX8:
-                scan_RGBA8_RGBX8(src, destimg.Ptr_RGBX8(destclipped.x+0,destclipped.y+y), w);
-                break;
-            case FMT_RGBA8:
-                scan_RGBA8_RGBA8(src, destimg.Ptr_RGBA8(destclipped.x+0,destclipped.y+y), w);
-                break;
-            default:
-                assert(false);
-                break;
-        }
-    }
-    destbox = destclipped;
+    assert(srcimg.Fmt() == FMT_RGBA8);
+    assert(destimg.Fmt() != FMT_I8);
+    BlitOp<AlphaBlendOp>(srcimg, srcbox, destimg, destbox);
 }
 
-#endif
-
 
 //----------------------------------------------
 
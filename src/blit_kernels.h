@@ -0,0 +1,199 @@
+#ifndef BLIT_KERNELS_H_INCLUDED
+#define BLIT_KERNELS_H_INCLUDED
+
+// Framework for blitters which need a version for every combination of
+// source and dest formats.
+//
+// An operation is a class template OP<SRC,DEST> (SRC and DEST are raw pixel
+// types: I8, RGBX8 or RGBA8) with a constructor and a method to do one row:
+//
+//   void Row(SRC const* src, DEST* dest, int w) const;
+//
+// BlitOp() clips the blit, then instantiates the right OP for the formats
+// and runs it over each row. Per-blit setup (lookup tables etc) goes in the
+// constructor, so the inner loop only has to deal with pixels.
+// FillOp() is the same for operations with no source image (OP<DEST>, with
+// Row(DEST* dest, int w)).
+//
+// Ops which map onto the SIMD kernels in blit_simd.h use them, otherwise
+// ScanRow() gives a plain loop over the op's per-pixel functions.
+
+#include "blit.h"
+#include "blit_simd.h"
+#include "box.h"
+#include "colours.h"
+#include "img.h"
+
+#include <cassert>
+#include <type_traits>
+
+
+template<typename P> inline P* RowPtr(Img& img, int x, int y)
+    { return (P*)img.Ptr(x, y); }
+template<typename P> inline P const* RowPtrConst(Img const& img, int x, int y)
+    { return (P const*)img.PtrConst(x, y); }
+
+template<typename P> constexpr PixelFormat FormatOf();
+template<> constexpr PixelFormat FormatOf<I8>() { return FMT_I8; }
+template<> constexpr PixelFormat FormatOf<RGBX8>() { return FMT_RGBX8; }
+template<> constexpr PixelFormat FormatOf<RGBA8>() { return FMT_RGBA8; }
+
+// Convert a pen to a pixel of the given format.
+template<typename P> P PenPixel(PenColour const& pen);
+template<> inline I8 PenPixel<I8>(PenColour const& pen) { return (I8)pen.idx(); }
+template<> inline RGBX8 PenPixel<RGBX8>(PenColour const& pen) { return pen.toRGBX8(); }
+template<> inline RGBA8 PenPixel<RGBA8>(PenColour const& pen) { return pen.toRGBA8(); }
+
+inline uint32_t RawPixel(I8 c) { return c; }
+
+
+// Recognises transparent pixels in a source image.
+// For 32bit formats, a pixel is transparent if (raw & Mask) == Key
+// (as used by the BlitKernels).
+template<typename SRC> struct SrcKey
+{
+    uint32_t Mask;
+    uint32_t Key;
+
+    // Keyed on the pen. RGBX8 only compares rgb, RGBA8 compares everything.
+    explicit SrcKey(PenColour const& transparent) :
+        Mask(std::is_same<SRC, RGBX8>::value ? 0x00ffffff : 0xffffffff),
+        Key(RawPixel(PenPixel<SRC>(transparent)) & Mask)
+        {}
+    // Keyed on zero alpha.
+    SrcKey() :
+        Mask(0xff000000),
+        Key(0)
+        {}
+    bool Transparent(SRC c) const
+        { return (RawPixel(c) & Mask) == Key; }
+};
+
+template<> struct SrcKey<I8>
+{
+    I8 Key;
+
+    explicit SrcKey(PenColour const& transparent) :
+        Key((I8)transparent.idx())
+        {}
+    bool Transparent(I8 c) const
+        { return c == Key; }
+};
+
+// The usual keying used for brushes: by pen for I8 and RGBX8, by alpha
+// for RGBA8.
+template<typename SRC> inline SrcKey<SRC> BrushKey(PenColour const& transparent)
+    { return SrcKey<SRC>(transparent); }
+template<> inline SrcKey<RGBA8> BrushKey<RGBA8>(PenColour const&)
+    { return SrcKey<RGBA8>(); }
+
+
+// Generic inner loop, for ops providing:
+//   bool Visible(SRC s) const;
+//   DEST Apply(SRC s, DEST d) const;
+template<typename OP, typename SRC, typename DEST>
+inline void ScanRow(OP const& op, SRC const* src, DEST* dest, int w)
+{
+    for (int x = 0; x < w; ++x) {
+        if (op.Visible(src[x])) {
+            dest[x] = op.Apply(src[x], dest[x]);
+        }
+    }
+}
+
+
+template<typename SRC, typename DEST, typename OP>
+void BlitRows(Img const& srcimg, Box const& srcclipped,
+    Img& destimg, Box const& destclipped, OP const& op)
+{
+    for (int y = 0; y < destclipped.h; ++y) {
+        SRC const* src = RowPtrConst<SRC>(srcimg, srcclipped.x, srcclipped.y + y);
+        DEST* dest = RowPtr<DEST>(destimg, destclipped.x, destclipped.y + y);
+        op.Row(src, dest, destclipped.w);
+    }
+}
+
+template<template<typename, typename> class OP, typename SRC, typename... ARGS>
+void BlitOpFrom(Img const& srcimg, Box const& srcclipped,
+    Img& destimg, Box const& destclipped, ARGS const&... args)
+{
+    switch (destimg.Fmt()) {
+        case FMT_I8:
+            BlitRows<SRC, I8>(srcimg, srcclipped, destimg, destclipped, OP<SRC, I8>(args...));
+            break;
+        case FMT_RGBX8:
+            BlitRows<SRC, RGBX8>(srcimg, srcclipped, destimg, destclipped, OP<SRC, RGBX8>(args...));
+            break;
+        case FMT_RGBA8:
+            BlitRows<SRC, RGBA8>(srcimg, srcclipped, destimg, destclipped, OP<SRC, RGBA8>(args...));
+            break;
+        default:
+            assert(false);
+            break;
+    }
+}
+
+// destbox is changed to reflect the final clipped area on the dest Img.
+// args are passed on to the OP constructor.
+template<template<typename, typename> class OP, typename... ARGS>
+void BlitOp(Img const& srcimg, Box const& srcbox,
+    Img& destimg, Box& destbox, ARGS const&... args)
+{
+    Box destclipped(destbox);
+    Box srcclipped(srcbox);
+    clip_blit(srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped);
+    destbox = destclipped;
+    if (destclipped.Empty()) {
+        return;
+    }
+
+    switch (srcimg.Fmt()) {
+        case FMT_I8:
+            BlitOpFrom<OP, I8>(srcimg, srcclipped, destimg, destclipped, args...);
+            break;
+        case FMT_RGBX8:
+            BlitOpFrom<OP, RGBX8>(srcimg, srcclipped, destimg, destclipped, args...);
+            break;
+        case FMT_RGBA8:
+            BlitOpFrom<OP, RGBA8>(srcimg, srcclipped, destimg, destclipped, args...);
+            break;
+        default:
+            assert(false);
+            break;
+    }
+}
+
+
+template<typename DEST, typename OP>
+void FillRows(Img& destimg, Box const& rect, OP const& op)
+{
+    for (int y = 0; y < rect.h; ++y) {
+        op.Row(RowPtr<DEST>(destimg, rect.x, rect.y + y), rect.w);
+    }
+}
+
+// rect is clipped to destimg.
+template<template<typename> class OP, typename... ARGS>
+void FillOp(Img& destimg, Box& rect, ARGS const&... args)
+{
+    rect.ClipAgainst(destimg.Bounds());
+    if (rect.Empty()) {
+        return;
+    }
+    switch (destimg.Fmt()) {
+        case FMT_I8:
+            FillRows<I8>(destimg, rect, OP<I8>(args...));
+            break;
+        case FMT_RGBX8:
+            FillRows<RGBX8>(destimg, rect, OP<RGBX8>(args...));
+            break;
+        case FMT_RGBA8:
+            FillRows<RGBA8>(destimg, rect, OP<RGBA8>(args...));
+            break;
+        default:
+            assert(false);
+            break;
+    }
+}
+
+#endif // BLIT_KERNELS_H_INCLUDED
@@ -1,47 +1,49 @@
 #include "blit_keyed.h"
-#include "blit.h"
+#include "blit_kernels.h"
 #include "img.h"
 #include "palette.h"
 
-// Keyed blits - blit I8 to dest, with a single transparent colour.
+#include <type_traits>
 
-static void scan_I8_I8_keyed(I8 const* src, I8* dest, int w, I8 transparent)
-{
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        I8 c = *src++;
-        if( c != transparent)
-            *dest = c;
-        ++dest;
-    }
-}
+// Keyed blits - blit to dest, with a single transparent colour.
 
-static void scan_I8_RGBX8_keyed(I8 const* src, Palette const& pal, RGBX8* dest, int w, I8 transparent)
+// Every format combination maps onto one of the SIMD kernels.
+template<typename SRC, typename DEST>
+class KeyedOp
 {
-    int x;
-    for( x=0; x<w; ++x )
+public:
+    // pal is only needed for I8 sources onto RGB dests.
+    KeyedOp(PenColour const& transparent, Palette const* pal) :
+        m_Key(BrushKey<SRC>(transparent))
     {
-        I8 c = *src++;
-        if( c != transparent)
-            *dest = pal.GetColour(c);
-        ++dest;
+        if constexpr (std::is_same<SRC, I8>::value && !std::is_same<DEST, I8>::value) {
+            assert(pal);
+            ExpandPalette(*pal, FormatOf<DEST>(), m_Table);
+        }
     }
-}
 
-static void scan_I8_RGBA8_keyed(I8 const* src, Palette const& pal, RGBA8* dest, int w, I8 transparent)
-{
-    int x;
-    for( x=0; x<w; ++x )
+    void Row(SRC const* src, DEST* dest, int w) const
     {
-        I8 c = *src++;
-        if( c != transparent)
-            *dest = pal.GetColour(c);
-        ++dest;
+        BlitKernels const& k = CurrentBlitKernels();
+        if constexpr (std::is_same<SRC, I8>::value) {
+            if constexpr (std::is_same<DEST, I8>::value) {
+                k.keyed8(src, dest, w, m_Key.Key);
+            } else {
+                k.lookup8(src, m_Table, (uint32_t*)dest, w, m_Key.Key);
+            }
+        } else if constexpr (std::is_same<DEST, I8>::value) {
+            k.matte32to8((uint32_t const*)src, dest, w, m_Key.Mask, m_Key.Key, 1);   // TODO:!!!!
+        } else {
+            // RGBX8<->RGBA8 needs the top byte set (to alpha or pad)
+            const uint32_t orBits = std::is_same<SRC, DEST>::value ? 0 : 0xff000000;
+            k.keyed32((uint32_t const*)src, (uint32_t*)dest, w, m_Key.Mask, m_Key.Key, orBits);
+        }
     }
-}
-
 
+private:
+    SrcKey<SRC> m_Key;
+    uint32_t m_Table[256];  // palette expanded to DEST, for I8 sources
+};
 
 
 // blit from an I8 source to any target, with colourkey transparency
@@ -52,154 +54,21 @@ void BlitI8Keyed(
     int transparentIdx )
 {
     assert(srcimg.Fmt()==FMT_I8);
-
-    Box destclipped( destbox );
-    Box srcclipped( srcbox );
-    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped );
-
-    const int w = destclipped.w;
-
-    int y;
-    for( y=0; y<destclipped.h; ++y )
-    {
-        I8 const* src = srcimg.PtrConst_I8( srcclipped.x+0, srcclipped.y+y );
-        switch(destimg.Fmt())
-        {
-        case FMT_I8:
-            scan_I8_I8_keyed(src, destimg.Ptr_I8(destclipped.x+0,destclipped.y+y), w, transparentIdx);
-            break;
-        case FMT_RGBX8:
-            scan_I8_RGBX8_keyed(src, srcpalette, destimg.Ptr_RGBX8(destclipped.x+0,destclipped.y+y), w, transparentIdx);
-            break;
-        case FMT_RGBA8:
-            scan_I8_RGBA8_keyed(src, srcpalette, destimg.Ptr_RGBA8(destclipped.x+0,destclipped.y+y), w, transparentIdx);
-            break;
-        default:
-            assert(false);
-            break;
-        }
-    }
-
-    destbox = destclipped;
+    BlitOp<KeyedOp>(srcimg, srcbox, destimg, destbox,
+        PenColour(Colour(), transparentIdx), &srcpalette);
 }
 
 
-static void scan_RGBA8_I8_keyed(RGBA8 const* src, I8* dest, int w )
-{
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        RGBA8 c = *src++;
-        if( c.a > 0)
-            *dest = 1;      // TODO:!!!!
-        ++dest;
-    }
-}
-
-static void scan_RGBA8_RGBX8_keyed(RGBA8 const* src, RGBX8* dest, int w ) 
-{
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        RGBA8 c = *src++;
-        if( c.a > 0)
-            *dest = RGBX8(c.r, c.g, c.b);
-        ++dest;
-    }
-}
-
-static void scan_RGBA8_RGBA8_keyed(RGBA8 const* src, RGBA8* dest, int w )
-{
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        RGBA8 c = *src++;
-        if( c.a > 0)
-            *dest = c;
-        ++dest;
-    }
-}
-
-
-
-
-// blit from an RGBX8 source to any target, with colourkey transparency
+// blit from an RGBA8 source to any target, keyed on alpha
 void BlitRGBA8Keyed(
     Img const& srcimg, Box const& srcbox,
     Img& destimg, Box& destbox )
 {
     assert(srcimg.Fmt()==FMT_RGBA8);
-
-    Box destclipped( destbox );
-    Box srcclipped( srcbox );
-    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped );
-
-    const int w = destclipped.w;
-
-    int y;
-    for( y=0; y<destclipped.h; ++y )
-    {
-        RGBA8 const* src = srcimg.PtrConst_RGBA8( srcclipped.x+0, srcclipped.y+y );
-        switch(destimg.Fmt())
-        {
-        case FMT_I8:
-            scan_RGBA8_I8_keyed(src, destimg.Ptr_I8(destclipped.x+0,destclipped.y+y), w );
-            break;
-        case FMT_RGBX8:
-            scan_RGBA8_RGBX8_keyed(src, destimg.Ptr_RGBX8(destclipped.x+0,destclipped.y+y), w );
-            break;
-        case FMT_RGBA8:
-            scan_RGBA8_RGBA8_keyed(src, destimg.Ptr_RGBA8(destclipped.x+0,destclipped.y+y), w );
-            break;
-        default:
-            assert(false);
-            break;
-        }
-    }
-
-    destbox = destclipped;
+    Palette const* nopalette = nullptr;
+    BlitOp<KeyedOp>(srcimg, srcbox, destimg, destbox, PenColour(), nopalette);
 }
 
-//-------------------------------------------------------------------
-
-static void scan_RGBX8_I8_keyed(RGBX8 const* src, I8* dest, int w, RGBX8 transparent)
-{
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        RGBX8 c = *src++;
-        if( c != transparent)
-            *dest = 1;      // TODO:!!!!
-        ++dest;
-    }
-}
-
-static void scan_RGBX8_RGBX8_keyed(RGBX8 const* src, RGBX8* dest, int w, RGBX8 transparent)
-{
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        RGBX8 c = *src++;
-        if( c != transparent)
-            *dest = c;
-        ++dest;
-    }
-}
-
-static void scan_RGBX8_RGBA8_keyed(RGBX8 const* src, RGBA8* dest, int w, RGBX8 transparent)
-{
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        RGBX8 c = *src++;
-        if( c != transparent)
-            *dest = c;
-        ++dest;
-    }
-}
-
-
-
 
 // blit from an RGBX8 source to any target, with colourkey transparency
 void BlitRGBX8Keyed(
@@ -208,35 +77,9 @@ void BlitRGBX8Keyed(
     RGBX8 transparent )
 {
     assert(srcimg.Fmt()==FMT_RGBX8);
-
-    Box destclipped( destbox );
-    Box srcclipped( srcbox );
-    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped );
-
-    const int w = destclipped.w;
-
-    int y;
-    for( y=0; y<destclipped.h; ++y )
-    {
-        RGBX8 const* src = srcimg.PtrConst_RGBX8( srcclipped.x+0, srcclipped.y+y );
-        switch(destimg.Fmt())
-        {
-        case FMT_I8:
-            scan_RGBX8_I8_keyed(src, destimg.Ptr_I8(destclipped.x+0,destclipped.y+y), w, transparent);
-            break;
-        case FMT_RGBX8:
-            scan_RGBX8_RGBX8_keyed(src, destimg.Ptr_RGBX8(destclipped.x+0,destclipped.y+y), w, transparent);
-            break;
-        case FMT_RGBA8:
-            scan_RGBX8_RGBA8_keyed(src, destimg.Ptr_RGBA8(destclipped.x+0,destclipped.y+y), w, transparent);
-            break;
-        default:
-            assert(false);
-            break;
-        }
-    }
-
-    destbox = destclipped;
+    Palette const* nopalette = nullptr;
+    BlitOp<KeyedOp>(srcimg, srcbox, destimg, destbox,
+        PenColour(Colour(transparent)), nopalette);
 }
 
 // TODO: - temporary?
@@ -14,24 +14,5 @@ struct Palette;
 void BlitMatte( Img const& srcimg, Box const& srcbox, Img& destimg, Box& destbox,
     PenColour const& transparentcolour, PenColour const& mattecolour );
 
-/*
-// Blit matte of an I8 img onto another img, colourkeyed.
-void BlitMatteI8Keyed(
-    Img const& srcimg, Box const& srcbox,
-    Img& destimg, Box& destbox,
-    int transparentIdx,
-    PenColour const& mattecolour );
-
-void BlitMatteRGBX8Keyed(
-    Img const& srcimg, Box const& srcbox,
-    Img& destimg, Box& destbox,
-    RGBX8 transparent,
-    RGBA8 matte );
-
-void BlitMatteRGBA8(
-    Img const& srcimg, Box const& srcbox,
-    Img& destimg, Box& destbox,
-    RGBA8 matte );
-*/
 
 #endif // BLIT_MATTE_H_INCLUDED
@@ -1,559 +1,124 @@
 #include "blit_range.h"
-#include "blit.h"
+#include "blit_kernels.h"
 
 #include "box.h"
 #include "img.h"
 
-#include <algorithm>
+#include <type_traits>
 
 //----
-// range inc/dec, using a src img as key.
-
-static void scan_rangeinc_keyed_I8_I8(I8 const* src, I8* dest, int w, I8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        I8 c = *src++;
-        if( c != transparent) {
-            I8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.idx() == pix;});
-            if (it < range.end()-1) {
-                *dest = (it+1)->idx();
-            }
-        }
-        ++dest;
-    }
-}
-
-
-static void scan_rangedec_keyed_I8_I8(I8 const* src, I8* dest, int w, I8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        I8 c = *src++;
-        if( c != transparent) {
-            I8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.idx() == pix;});
-
-            if (it != range.end() && it > range.begin()) {
-                *dest = (it-1)->idx();
-            }
-        }
-        ++dest;
-    }
-}
-
-
-static void scan_rangeinc_keyed_I8_RGBX8(I8 const* src, RGBX8* dest, int w, I8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        I8 c = *src++;
-        if( c != transparent) {
-            RGBX8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.toRGBX8() == pix;});
-            if (it < range.end()-1) {
-                *dest = (it+1)->toRGBX8();
-            }
-        }
-        ++dest;
-    }
-}
-
-
-static void scan_rangedec_keyed_I8_RGBX8(I8 const* src, RGBX8* dest, int w, I8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        I8 c = *src++;
-        if( c != transparent) {
-            RGBX8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.toRGBX8() == pix;});
-
-            if (it != range.end() && it > range.begin()) {
-                *dest = (it-1)->toRGBX8();
-            }
-        }
-        ++dest;
-    }
-}
-
-
-static void scan_rangeinc_keyed_I8_RGBA8(I8 const* src, RGBA8* dest, int w, I8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        I8 c = *src++;
-        if( c != transparent) {
-            RGBA8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.toRGBA8() == pix;});
-            if (it < range.end()-1) {
-                *dest = (it+1)->toRGBA8();
-            }
-        }
-        ++dest;
-    }
-}
-
-
-static void scan_rangedec_keyed_I8_RGBA8(I8 const* src, RGBA8* dest, int w, I8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        I8 c = *src++;
-        if( c != transparent) {
-            RGBA8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.toRGBA8() == pix;});
-
-            if (it != range.end() && it > range.begin()) {
-                *dest = (it-1)->toRGBA8();
-            }
-        }
-        ++dest;
-    }
-}
-
-
-static void blit_rangeshift_keyed_I8(Img const& srcimg, Box const& srcbox,
-    Img& destimg, Box& destbox,
-    PenColour const& transparentPen,
-    std::vector<PenColour> const& range,
-    int direction)
-{
-    assert(srcimg.Fmt() == FMT_I8);
-    assert(transparentPen.IdxValid());
-    assert(!range.empty());
-
-    Box srcclipped(srcbox);
-    clip_blit(srcimg.Bounds(), srcclipped, destimg.Bounds(), destbox);
-
-    const int w = destbox.w;
-    int y;
-    const int x0 = destbox.x;
-    const int y0 = destbox.y;
-    for (y = 0; y < destbox.h; ++y)
+// Range inc/dec - shift pixels up or down a colour range.
+// Pixels not in the range are left alone, as are pixels already at the
+// end of the range.
+
+// Maps pixels to their shifted values.
+// A pixel can appear in the range more than once, in which case the first
+// occurrence is the one that counts.
+template<typename DEST>
+class RangeShift
+{
+public:
+    RangeShift(std::vector<PenColour> const& range, int direction) :
+        m_Mask(std::is_same<DEST, RGBX8>::value ? 0x00ffffff : 0xffffffff)
     {
-        I8 const* src = srcimg.PtrConst_I8(srcclipped.x + 0, srcclipped.y + y);
-        if (direction > 0) {
-            // Increment along range.
-            switch(destimg.Fmt())
-            {
-                case FMT_I8:
-                    scan_rangeinc_keyed_I8_I8(src, destimg.Ptr_I8(x0, y0 + y),
-                        w, transparentPen.idx(), range);
-                    break;
-                case FMT_RGBX8:
-                    scan_rangeinc_keyed_I8_RGBX8(src, destimg.Ptr_RGBX8(x0, y0 + y),
-                        w, transparentPen.idx(), range);
-                    break;
-                case FMT_RGBA8:
-                    scan_rangeinc_keyed_I8_RGBA8(src, destimg.Ptr_RGBA8(x0, y0 + y),
-                        w, transparentPen.idx(), range);
-                    break;
-                default:
-                    assert(false);
-                    break;
-            }
-        } else {
-            // Decrement along range.
-            switch(destimg.Fmt())
-            {
-                case FMT_I8:
-                    scan_rangedec_keyed_I8_I8(src, destimg.Ptr_I8(x0, y0 + y),
-                        w, transparentPen.idx(), range);
-                    break;
-                case FMT_RGBX8:
-                    scan_rangedec_keyed_I8_RGBX8(src, destimg.Ptr_RGBX8(x0, y0 + y),
-                        w, transparentPen.idx(), range);
-                    break;
-                case FMT_RGBA8:
-                    scan_rangedec_keyed_I8_RGBA8(src, destimg.Ptr_RGBA8(x0, y0 + y),
-                        w, transparentPen.idx(), range);
-                    break;
-                default:
-                    assert(false);
-                    break;
-            }
-        }
-    }
-}
-
-
-// RGBX8 -> ...
-
-static void scan_rangeinc_keyed_RGBX8_I8(RGBX8 const* src, I8* dest, int w, RGBX8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        RGBX8 c = *src++;
-        if( c != transparent) {
-            I8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.idx() == pix;});
-            if (it < range.end()-1) {
-                *dest = (it+1)->idx();
-            }
+        assert(!range.empty());
+        for (auto const& pen : range) {
+            m_Pens.push_back(PenPixel<DEST>(pen));
+            m_Keys.push_back(RawPixel(m_Pens.back()) & m_Mask);
         }
-        ++dest;
+        m_Step = (direction > 0) ? 1 : -1;
     }
-}
-
-
-static void scan_rangedec_keyed_RGBX8_I8(RGBX8 const* src, I8* dest, int w, RGBX8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        RGBX8 c = *src++;
-        if( c != transparent) {
-            I8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.idx() == pix;});
 
-            if (it != range.end() && it > range.begin()) {
-                *dest = (it-1)->idx();
-            }
-        }
-        ++dest;
-    }
-}
-
-
-static void scan_rangeinc_keyed_RGBX8_RGBX8(RGBX8 const* src, RGBX8* dest, int w, RGBX8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        RGBX8 c = *src++;
-        if( c != transparent) {
-            RGBX8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.toRGBX8() == pix;});
-            if (it < range.end()-1) {
-                *dest = (it+1)->toRGBX8();
-            }
-        }
-        ++dest;
-    }
-}
-
-
-static void scan_rangedec_keyed_RGBX8_RGBX8(RGBX8 const* src, RGBX8* dest, int w, RGBX8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        RGBX8 c = *src++;
-        if( c != transparent) {
-            RGBX8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.toRGBX8() == pix;});
-
-            if (it != range.end() && it > range.begin()) {
-                *dest = (it-1)->toRGBX8();
-            }
+    DEST Shift(DEST pix) const
+    {
+        // compare raw values - much quicker than going through the pens
+        const uint32_t raw = RawPixel(pix) & m_Mask;
+        const int n = (int)m_Keys.size();
+        int i = 0;
+        while (i < n && m_Keys[i] != raw) {
+            ++i;
         }
-        ++dest;
-    }
-}
-
-
-static void scan_rangeinc_keyed_RGBX8_RGBA8(RGBX8 const* src, RGBA8* dest, int w, RGBX8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        RGBX8 c = *src++;
-        if( c != transparent) {
-            RGBA8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.toRGBA8() == pix;});
-            if (it < range.end()-1) {
-                *dest = (it+1)->toRGBA8();
-            }
+        if (i == n) {
+            return pix;
         }
-        ++dest;
-    }
-}
-
-
-static void scan_rangedec_keyed_RGBX8_RGBA8(RGBX8 const* src, RGBA8* dest, int w, RGBX8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        RGBX8 c = *src++;
-        if( c != transparent) {
-            RGBA8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.toRGBA8() == pix;});
-
-            if (it != range.end() && it > range.begin()) {
-                *dest = (it-1)->toRGBA8();
-            }
+        i += m_Step;
+        if (i < 0 || i >= n) {
+            return pix;
         }
-        ++dest;
+        return m_Pens[i];
     }
-}
-
-
-static void blit_rangeshift_keyed_RGBX8(Img const& srcimg, Box const& srcbox,
-    Img& destimg, Box& destbox,
-    PenColour const& transparentPen,
-    std::vector<PenColour> const& range,
-    int direction)
-{
-    assert(srcimg.Fmt() == FMT_RGBX8);
-    assert(!range.empty());
-
-    Box srcclipped(srcbox);
-    clip_blit(srcimg.Bounds(), srcclipped, destimg.Bounds(), destbox);
 
-    const int w = destbox.w;
-    int y;
-    const int x0 = destbox.x;
-    const int y0 = destbox.y;
-    for (y = 0; y < destbox.h; ++y)
+    void Row(DEST* dest, int w) const
     {
-        RGBX8 const* src = srcimg.PtrConst_RGBX8(srcclipped.x + 0, srcclipped.y + y);
-        if (direction > 0) {
-            // Increment along range.
-            switch(destimg.Fmt())
-            {
-                case FMT_I8:
-                    scan_rangeinc_keyed_RGBX8_I8(src, destimg.Ptr_I8(x0, y0 + y),
-                        w, transparentPen.toRGBX8(), range);
-                    break;
-                case FMT_RGBX8:
-                    scan_rangeinc_keyed_RGBX8_RGBX8(src, destimg.Ptr_RGBX8(x0, y0 + y),
-                        w, transparentPen.toRGBX8(), range);
-                    break;
-                case FMT_RGBA8:
-                    scan_rangeinc_keyed_RGBX8_RGBA8(src, destimg.Ptr_RGBA8(x0, y0 + y),
-                        w, transparentPen.toRGBX8(), range);
-                    break;
-                default:
-                    assert(false);
-                    break;
-            }
-        } else {
-            // Decrement along range.
-            switch(destimg.Fmt())
-            {
-                case FMT_I8:
-                    scan_rangedec_keyed_RGBX8_I8(src, destimg.Ptr_I8(x0, y0 + y),
-                        w, transparentPen.toRGBX8(), range);
-                    break;
-                case FMT_RGBX8:
-                    scan_rangedec_keyed_RGBX8_RGBX8(src, destimg.Ptr_RGBX8(x0, y0 + y),
-                        w, transparentPen.toRGBX8(), range);
-                    break;
-                case FMT_RGBA8:
-                    scan_rangedec_keyed_RGBX8_RGBA8(src, destimg.Ptr_RGBA8(x0, y0 + y),
-                        w, transparentPen.toRGBX8(), range);
-                    break;
-                default:
-                    assert(false);
-                    break;
-            }
-        }
-    }
-}
-
-
-// RGBA8 -> ...
-
-static void scan_rangeinc_keyed_RGBA8_I8(RGBA8 const* src, I8* dest, int w, RGBA8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        RGBA8 c = *src++;
-        if( c != transparent) {
-            I8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.idx() == pix;});
-            if (it < range.end()-1) {
-                *dest = (it+1)->idx();
-            }
+        for (int x = 0; x < w; ++x) {
+            dest[x] = Shift(dest[x]);
         }
-        ++dest;
     }
-}
 
+private:
+    uint32_t m_Mask;
+    std::vector<uint32_t> m_Keys;
+    std::vector<DEST> m_Pens;
+    int m_Step;
+};
 
-static void scan_rangedec_keyed_RGBA8_I8(RGBA8 const* src, I8* dest, int w, RGBA8 transparent, std::vector<PenColour> const& range)
+// For I8 the whole mapping fits in a table.
+template<>
+class RangeShift<I8>
 {
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        RGBA8 c = *src++;
-        if( c != transparent) {
-            I8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.idx() == pix;});
-
-            if (it != range.end() && it > range.begin()) {
-                *dest = (it-1)->idx();
-            }
+public:
+    RangeShift(std::vector<PenColour> const& range, int direction)
+    {
+        assert(!range.empty());
+        for (int i = 0; i < 256; ++i) {
+            m_Table[i] = (I8)i;
         }
-        ++dest;
-    }
-}
-
-
-static void scan_rangeinc_keyed_RGBA8_RGBX8(RGBA8 const* src, RGBX8* dest, int w, RGBA8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        RGBA8 c = *src++;
-        if( c != transparent) {
-            RGBX8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.toRGBX8() == pix;});
-            if (it < range.end()-1) {
-                *dest = (it+1)->toRGBX8();
-            }
+        // go backward, so earlier entries take precedence
+        const int n = (int)range.size();
+        for (int i = n - 1; i >= 0; --i) {
+            int j = (direction > 0) ? i + 1 : i - 1;
+            I8 pix = (I8)range[i].idx();
+            m_Table[pix] = (j >= 0 && j < n) ? (I8)range[j].idx() : pix;
         }
-        ++dest;
     }
-}
 
+    I8 Shift(I8 pix) const
+        { return m_Table[pix]; }
 
-static void scan_rangedec_keyed_RGBA8_RGBX8(RGBA8 const* src, RGBX8* dest, int w, RGBA8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        RGBA8 c = *src++;
-        if( c != transparent) {
-            RGBX8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.toRGBX8() == pix;});
-
-            if (it != range.end() && it > range.begin()) {
-                *dest = (it-1)->toRGBX8();
-            }
+    void Row(I8* dest, int w) const
+    {
+        for (int x = 0; x < w; ++x) {
+            dest[x] = m_Table[dest[x]];
         }
-        ++dest;
     }
-}
 
-
-static void scan_rangeinc_keyed_RGBA8_RGBA8(RGBA8 const* src, RGBA8* dest, int w, RGBA8 transparent, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        RGBA8 c = *src++;
-        if( c != transparent) {
-            RGBA8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.toRGBA8() == pix;});
-            if (it < range.end()-1) {
-                *dest = (it+1)->toRGBA8();
-            }
-        }
-        ++dest;
-    }
-}
+private:
+    I8 m_Table[256];
+};
 
 
-static void scan_rangedec_keyed_RGBA8_RGBA8(RGBA8 const* src, RGBA8* dest, int w, RGBA8 transparent, std::vector<PenColour> const& range)
+// Range shift, using a src img as a mask.
+template<typename SRC, typename DEST>
+class RangeShiftOp
 {
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        RGBA8 c = *src++;
-        if( c != transparent) {
-            RGBA8 pix = *dest;
-            auto it = std::find_if(range.begin(), range.end(),
-                [pix](PenColour const& pen) -> bool { return pen.toRGBA8() == pix;});
+public:
+    RangeShiftOp(PenColour const& transparent, std::vector<PenColour> const& range, int direction) :
+        m_Key(transparent),
+        m_Shift(range, direction)
+        {}
 
-            if (it != range.end() && it > range.begin()) {
-                *dest = (it-1)->toRGBA8();
-            }
-        }
-        ++dest;
-    }
-}
-
-static void blit_rangeshift_keyed_RGBA8(Img const& srcimg, Box const& srcbox,
-    Img& destimg, Box& destbox,
-    PenColour const& transparentPen,
-    std::vector<PenColour> const& range,
-    int direction)
-{
-    assert(srcimg.Fmt() == FMT_RGBA8);
-    assert(!range.empty());
+    bool Visible(SRC s) const
+        { return !m_Key.Transparent(s); }
+    DEST Apply(SRC, DEST d) const
+        { return m_Shift.Shift(d); }
 
-    Box srcclipped(srcbox);
-    clip_blit(srcimg.Bounds(), srcclipped, destimg.Bounds(), destbox);
+    void Row(SRC const* src, DEST* dest, int w) const
+        { ScanRow(*this, src, dest, w); }
 
-    const int w = destbox.w;
-    int y;
-    const int x0 = destbox.x;
-    const int y0 = destbox.y;
-    for (y = 0; y < destbox.h; ++y)
-    {
-        RGBA8 const* src = srcimg.PtrConst_RGBA8(srcclipped.x + 0, srcclipped.y + y);
-        if (direction > 0) {
-            // Increment along range.
-            switch(destimg.Fmt())
-            {
-                case FMT_I8:
-                    scan_rangeinc_keyed_RGBA8_I8(src, destimg.Ptr_I8(x0, y0 + y),
-                        w, transparentPen.toRGBA8(), range);
-                    break;
-                case FMT_RGBX8:
-                    scan_rangeinc_keyed_RGBA8_RGBX8(src, destimg.Ptr_RGBX8(x0, y0 + y),
-                        w, transparentPen.toRGBA8(), range);
-                    break;
-                case FMT_RGBA8:
-                    scan_rangeinc_keyed_RGBA8_RGBA8(src, destimg.Ptr_RGBA8(x0, y0 + y),
-                        w, transparentPen.toRGBA8(), range);
-                    break;
-                default:
-                    assert(false);
-                    break;
-            }
-        } else {
-            // Decrement along range.
-            switch(destimg.Fmt())
-            {
-                case FMT_I8:
-                    scan_rangedec_keyed_RGBA8_I8(src, destimg.Ptr_I8(x0, y0 + y),
-                        w, transparentPen.toRGBA8(), range);
-                    break;
-                case FMT_RGBX8:
-                    scan_rangedec_keyed_RGBA8_RGBX8(src, destimg.Ptr_RGBX8(x0, y0 + y),
-                        w, transparentPen.toRGBA8(), range);
-                    break;
-                case FMT_RGBA8:
-                    scan_rangedec_keyed_RGBA8_RGBA8(src, destimg.Ptr_RGBA8(x0, y0 + y),
-                        w, transparentPen.toRGBA8(), range);
-                    break;
-                default:
-                    assert(false);
-                    break;
-            }
-        }
-    }
-}
+private:
+    SrcKey<SRC> m_Key;
+    RangeShift<DEST> m_Shift;
+};
 
 
 // Uses the srcimg as a mask, incrementing or decrementing pixels on destimg
@@ -569,118 +134,13 @@ void BlitRangeShiftKeyed(Img const& srcimg, Box const& srcbox,
         destbox.h = 0;
         return;
     }
-    switch(srcimg.Fmt()) {
-        case FMT_I8:
-            blit_rangeshift_keyed_I8(srcimg, srcbox, destimg, destbox, transparentPen, range, direction);
-            break;
-        case FMT_RGBX8:
-            blit_rangeshift_keyed_RGBX8(srcimg, srcbox, destimg, destbox, transparentPen, range, direction);
-            break;
-        case FMT_RGBA8:
-            blit_rangeshift_keyed_RGBA8(srcimg, srcbox, destimg, destbox, transparentPen, range, direction);
-            break;
-    }
+    BlitOp<RangeShiftOp>(srcimg, srcbox, destimg, destbox, transparentPen, range, direction);
 }
 
 
 //-------
 // Range inc/dec for solid regions (no keying)
 
-
-static void scan_rangeinc_keyed_I8(I8* dest, int w, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for( x=0; x<w; ++x ) {
-        I8 pix = *dest;
-        auto it = std::find_if(range.begin(), range.end(),
-            [pix](PenColour const& pen) -> bool { return pen.idx() == pix;});
-        if (it < range.end()-1) {
-            *dest = (it+1)->idx();
-        }
-        ++dest;
-    }
-}
-
-static void scan_rangedec_keyed_I8(I8* dest, int w, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for (x=0; x < w; ++x) {
-        I8 pix = *dest;
-        auto it = std::find_if(range.begin(), range.end(),
-            [pix](PenColour const& pen) -> bool { return pen.idx() == pix;});
-
-        if (it != range.end() && it > range.begin()) {
-            *dest = (it-1)->idx();
-        }
-        ++dest;
-    }
-}
-
-static void scan_rangeinc_keyed_RGBX8(RGBX8* dest, int w, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for (x = 0; x < w; ++x) {
-        RGBX8 pix = *dest;
-        auto it = std::find_if(range.begin(), range.end(),
-            [pix](PenColour const& pen) -> bool {return pen.toRGBX8() == pix;});
-        if (it < range.end()-1) {
-            *dest = (it+1)->toRGBX8();
-        }
-        ++dest;
-    }
-}
-
-static void scan_rangedec_keyed_RGBX8(RGBX8* dest, int w, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for (x = 0; x < w; ++x) {
-        RGBX8 pix = *dest;
-        auto it = std::find_if(range.begin(), range.end(),
-            [pix](PenColour const& pen) -> bool { return pen.toRGBX8() == pix;});
-
-        if (it != range.end() && it > range.begin()) {
-            *dest = (it-1)->toRGBX8();
-        }
-        ++dest;
-    }
-}
-
-static void scan_rangeinc_keyed_RGBA8(RGBA8* dest, int w, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for (x = 0; x < w; ++x) {
-        RGBA8 pix = *dest;
-        auto it = std::find_if(range.begin(), range.end(),
-            [pix](PenColour const& pen) -> bool { return pen.toRGBA8() == pix;});
-        if (it < range.end()-1) {
-            *dest = (it+1)->toRGBA8();
-        }
-        ++dest;
-    }
-}
-
-static void scan_rangedec_keyed_RGBA8(RGBA8* dest, int w, std::vector<PenColour> const& range)
-{
-    assert(!range.empty());
-    int x;
-    for (x = 0; x < w; ++x) {
-        RGBA8 pix = *dest;
-        auto it = std::find_if(range.begin(), range.end(),
-            [pix](PenColour const& pen) -> bool { return pen.toRGBA8() == pix;});
-
-        if (it != range.end() && it > range.begin()) {
-            *dest = (it-1)->toRGBA8();
-        }
-        ++dest;
-    }
-}
-
-
 void DrawRectRangeShift(Img& destimg, Box& rect, std::vector<PenColour> const& range, int direction)
 {
     if (range.empty()) {
@@ -688,50 +148,5 @@ void DrawRectRangeShift(Img& destimg, Box& rect, std::vector<PenColour> const& r
         rect.h = 0;
         return;
     }
-
-    rect.ClipAgainst(destimg.Bounds());
-
-    const int w = rect.w;
-    const int x0 = rect.x;
-    const int y0 = rect.y;
-    int y;
-    for (y = 0; y < rect.h; ++y)
-    {
-        if (direction > 0) {
-            // Increment along range.
-            switch(destimg.Fmt())
-            {
-                case FMT_I8:
-                    scan_rangeinc_keyed_I8(destimg.Ptr_I8(x0, y0 + y), w, range);
-                    break;
-                case FMT_RGBX8:
-                    scan_rangeinc_keyed_RGBX8(destimg.Ptr_RGBX8(x0, y0 + y), w, range);
-                    break;
-                case FMT_RGBA8:
-                    scan_rangeinc_keyed_RGBA8(destimg.Ptr_RGBA8(x0, y0 + y), w, range);
-                    break;
-                default:
-                    assert(false);
-                    break;
-            }
-        } else {
-            // Decrement along range.
-            switch(destimg.Fmt())
-            {
-                case FMT_I8:
-                    scan_rangedec_keyed_I8(destimg.Ptr_I8(x0, y0 + y), w, range);
-                    break;
-                case FMT_RGBX8:
-                    scan_rangedec_keyed_RGBX8(destimg.Ptr_RGBX8(x0, y0 + y), w, range);
-                    break;
-                case FMT_RGBA8:
-                    scan_rangedec_keyed_RGBA8(destimg.Ptr_RGBA8(x0, y0 + y), w, range);
-                    break;
-                default:
-                    assert(false);
-                    break;
-            }
-        }
-    }
+    FillOp<RangeShift>(destimg, rect, range, direction);
 }
-
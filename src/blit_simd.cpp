@@ -0,0 +1,470 @@
+#include "blit_simd.h"
+#include "palette.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#define BLIT_SSE2
+#include <emmintrin.h>
+// AVX2 code is compiled via target attributes, so needs gcc or clang.
+#if defined(__GNUC__)
+#define BLIT_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+
+//-------------------------------------------------------------------
+// plain C++ versions (also used to finish off the ends of rows for the
+// SIMD versions).
+
+static void keyed8_scalar(I8 const* src, I8* dest, int w, I8 key)
+{
+    for (int x = 0; x < w; ++x) {
+        if (src[x] != key) {
+            dest[x] = src[x];
+        }
+    }
+}
+
+static void lookup8_scalar(I8 const* src, uint32_t const* table, uint32_t* dest, int w, I8 key)
+{
+    for (int x = 0; x < w; ++x) {
+        if (src[x] != key) {
+            dest[x] = table[src[x]];
+        }
+    }
+}
+
+static void keyed32_scalar(uint32_t const* src, uint32_t* dest, int w, uint32_t cmpMask, uint32_t key, uint32_t orBits)
+{
+    for (int x = 0; x < w; ++x) {
+        if ((src[x] & cmpMask) != key) {
+            dest[x] = src[x] | orBits;
+        }
+    }
+}
+
+static void matte8_scalar(I8 const* src, I8* dest, int w, I8 key, I8 matte)
+{
+    for (int x = 0; x < w; ++x) {
+        if (src[x] != key) {
+            dest[x] = matte;
+        }
+    }
+}
+
+static void matte8to32_scalar(I8 const* src, uint32_t* dest, int w, I8 key, uint32_t matte)
+{
+    for (int x = 0; x < w; ++x) {
+        if (src[x] != key) {
+            dest[x] = matte;
+        }
+    }
+}
+
+static void matte32to8_scalar(uint32_t const* src, I8* dest, int w, uint32_t cmpMask, uint32_t key, I8 matte)
+{
+    for (int x = 0; x < w; ++x) {
+        if ((src[x] & cmpMask) != key) {
+            dest[x] = matte;
+        }
+    }
+}
+
+static void matte32_scalar(uint32_t const* src, uint32_t* dest, int w, uint32_t cmpMask, uint32_t key, uint32_t matte)
+{
+    for (int x = 0; x < w; ++x) {
+        if ((src[x] & cmpMask) != key) {
+            dest[x] = matte;
+        }
+    }
+}
+
+static const BlitKernels scalarKernels = {
+    "scalar",
+    keyed8_scalar,
+    lookup8_scalar,
+    keyed32_scalar,
+    matte8_scalar,
+    matte8to32_scalar,
+    matte32to8_scalar,
+    matte32_scalar
+};
+
+
+//-------------------------------------------------------------------
+// SSE2 versions.
+// The masks from the compares are set for transparent pixels, so the new
+// value is blended in where the mask is clear. Whole blocks which are
+// entirely transparent (common in brushes) skip the store altogether.
+
+#ifdef BLIT_SSE2
+
+static inline __m128i blend_sse2(__m128i transparent, __m128i d, __m128i s)
+{
+    return _mm_or_si128(_mm_and_si128(transparent, d), _mm_andnot_si128(transparent, s));
+}
+
+static void keyed8_sse2(I8 const* src, I8* dest, int w, I8 key)
+{
+    const __m128i k = _mm_set1_epi8((char)key);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i s = _mm_loadu_si128((__m128i const*)(src + x));
+        __m128i t = _mm_cmpeq_epi8(s, k);
+        int bits = _mm_movemask_epi8(t);
+        if (bits == 0xffff) {
+            continue;
+        }
+        if (bits != 0) {
+            __m128i d = _mm_loadu_si128((__m128i const*)(dest + x));
+            s = blend_sse2(t, d, s);
+        }
+        _mm_storeu_si128((__m128i*)(dest + x), s);
+    }
+    keyed8_scalar(src + x, dest + x, w - x, key);
+}
+
+static void matte8_sse2(I8 const* src, I8* dest, int w, I8 key, I8 matte)
+{
+    const __m128i k = _mm_set1_epi8((char)key);
+    const __m128i m = _mm_set1_epi8((char)matte);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i t = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const*)(src + x)), k);
+        int bits = _mm_movemask_epi8(t);
+        if (bits == 0xffff) {
+            continue;
+        }
+        __m128i out = m;
+        if (bits != 0) {
+            __m128i d = _mm_loadu_si128((__m128i const*)(dest + x));
+            out = blend_sse2(t, d, m);
+        }
+        _mm_storeu_si128((__m128i*)(dest + x), out);
+    }
+    matte8_scalar(src + x, dest + x, w - x, key, matte);
+}
+
+static void keyed32_sse2(uint32_t const* src, uint32_t* dest, int w, uint32_t cmpMask, uint32_t key, uint32_t orBits)
+{
+    const __m128i cm = _mm_set1_epi32((int)cmpMask);
+    const __m128i k = _mm_set1_epi32((int)key);
+    const __m128i ob = _mm_set1_epi32((int)orBits);
+    int x = 0;
+    for (; x + 4 <= w; x += 4) {
+        __m128i s = _mm_loadu_si128((__m128i const*)(src + x));
+        __m128i t = _mm_cmpeq_epi32(_mm_and_si128(s, cm), k);
+        int bits = _mm_movemask_epi8(t);
+        if (bits == 0xffff) {
+            continue;
+        }
+        s = _mm_or_si128(s, ob);
+        if (bits != 0) {
+            __m128i d = _mm_loadu_si128((__m128i const*)(dest + x));
+            s = blend_sse2(t, d, s);
+        }
+        _mm_storeu_si128((__m128i*)(dest + x), s);
+    }
+    keyed32_scalar(src + x, dest + x, w - x, cmpMask, key, orBits);
+}
+
+static void matte8to32_sse2(I8 const* src, uint32_t* dest, int w, I8 key, uint32_t matte)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i k = _mm_set1_epi32(key);
+    const __m128i m = _mm_set1_epi32((int)matte);
+    int x = 0;
+    for (; x + 4 <= w; x += 4) {
+        int32_t four;
+        memcpy(&four, src + x, 4);
+        __m128i s = _mm_cvtsi32_si128(four);
+        s = _mm_unpacklo_epi16(_mm_unpacklo_epi8(s, zero), zero);
+        __m128i t = _mm_cmpeq_epi32(s, k);
+        int bits = _mm_movemask_epi8(t);
+        if (bits == 0xffff) {
+            continue;
+        }
+        __m128i out = m;
+        if (bits != 0) {
+            __m128i d = _mm_loadu_si128((__m128i const*)(dest + x));
+            out = blend_sse2(t, d, m);
+        }
+        _mm_storeu_si128((__m128i*)(dest + x), out);
+    }
+    matte8to32_scalar(src + x, dest + x, w - x, key, matte);
+}
+
+// 16 pixels at a time, so the compare masks can be packed down to bytes.
+static void matte32to8_sse2(uint32_t const* src, I8* dest, int w, uint32_t cmpMask, uint32_t key, I8 matte)
+{
+    const __m128i cm = _mm_set1_epi32((int)cmpMask);
+    const __m128i k = _mm_set1_epi32((int)key);
+    const __m128i m = _mm_set1_epi8((char)matte);
+    int x = 0;
+    for (; x + 16 <= w; x += 16) {
+        __m128i t0 = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((__m128i const*)(src + x)), cm), k);
+        __m128i t1 = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((__m128i const*)(src + x + 4)), cm), k);
+        __m128i t2 = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((__m128i const*)(src + x + 8)), cm), k);
+        __m128i t3 = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((__m128i const*)(src + x + 12)), cm), k);
+        __m128i t = _mm_packs_epi16(_mm_packs_epi32(t0, t1), _mm_packs_epi32(t2, t3));
+        int bits = _mm_movemask_epi8(t);
+        if (bits == 0xffff) {
+            continue;
+        }
+        __m128i out = m;
+        if (bits != 0) {
+            __m128i d = _mm_loadu_si128((__m128i const*)(dest + x));
+            out = blend_sse2(t, d, m);
+        }
+        _mm_storeu_si128((__m128i*)(dest + x), out);
+    }
+    matte32to8_scalar(src + x, dest + x, w - x, cmpMask, key, matte);
+}
+
+static void matte32_sse2(uint32_t const* src, uint32_t* dest, int w, uint32_t cmpMask, uint32_t key, uint32_t matte)
+{
+    const __m128i cm = _mm_set1_epi32((int)cmpMask);
+    const __m128i k = _mm_set1_epi32((int)key);
+    const __m128i m = _mm_set1_epi32((int)matte);
+    int x = 0;
+    for (; x + 4 <= w; x += 4) {
+        __m128i s = _mm_loadu_si128((__m128i const*)(src + x));
+        __m128i t = _mm_cmpeq_epi32(_mm_and_si128(s, cm), k);
+        int bits = _mm_movemask_epi8(t);
+        if (bits == 0xffff) {
+            continue;
+        }
+        __m128i out = m;
+        if (bits != 0) {
+            __m128i d = _mm_loadu_si128((__m128i const*)(dest + x));
+            out = blend_sse2(t, d, m);
+        }
+        _mm_storeu_si128((__m128i*)(dest + x), out);
+    }
+    matte32_scalar(src + x, dest + x, w - x, cmpMask, key, matte);
+}
+
+// No gather in SSE2, so the palette lookup stays scalar (the table still
+// saves a lot over going through Palette::GetColour()).
+static const BlitKernels sse2Kernels = {
+    "sse2",
+    keyed8_sse2,
+    lookup8_scalar,
+    keyed32_sse2,
+    matte8_sse2,
+    matte8to32_sse2,
+    matte32to8_sse2,
+    matte32_sse2
+};
+
+#endif // BLIT_SSE2
+
+
+//-------------------------------------------------------------------
+// AVX2 versions. Same as SSE2, but twice as wide, and with a gather for
+// palette lookups.
+
+#ifdef BLIT_AVX2
+
+#define AVX2_FN __attribute__((target("avx2")))
+
+AVX2_FN static void keyed8_avx2(I8 const* src, I8* dest, int w, I8 key)
+{
+    const __m256i k = _mm256_set1_epi8((char)key);
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i s = _mm256_loadu_si256((__m256i const*)(src + x));
+        __m256i t = _mm256_cmpeq_epi8(s, k);
+        unsigned bits = (unsigned)_mm256_movemask_epi8(t);
+        if (bits == 0xffffffff) {
+            continue;
+        }
+        if (bits != 0) {
+            __m256i d = _mm256_loadu_si256((__m256i const*)(dest + x));
+            s = _mm256_blendv_epi8(s, d, t);
+        }
+        _mm256_storeu_si256((__m256i*)(dest + x), s);
+    }
+    keyed8_scalar(src + x, dest + x, w - x, key);
+}
+
+AVX2_FN static void matte8_avx2(I8 const* src, I8* dest, int w, I8 key, I8 matte)
+{
+    const __m256i k = _mm256_set1_epi8((char)key);
+    const __m256i m = _mm256_set1_epi8((char)matte);
+    int x = 0;
+    for (; x + 32 <= w; x += 32) {
+        __m256i t = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const*)(src + x)), k);
+        unsigned bits = (unsigned)_mm256_movemask_epi8(t);
+        if (bits == 0xffffffff) {
+            continue;
+        }
+        __m256i out = m;
+        if (bits != 0) {
+            __m256i d = _mm256_loadu_si256((__m256i const*)(dest + x));
+            out = _mm256_blendv_epi8(m, d, t);
+        }
+        _mm256_storeu_si256((__m256i*)(dest + x), out);
+    }
+    matte8_scalar(src + x, dest + x, w - x, key, matte);
+}
+
+AVX2_FN static void lookup8_avx2(I8 const* src, uint32_t const* table, uint32_t* dest, int w, I8 key)
+{
+    const __m256i k = _mm256_set1_epi32(key);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const*)(src + x)));
+        __m256i t = _mm256_cmpeq_epi32(idx, k);
+        unsigned bits = (unsigned)_mm256_movemask_epi8(t);
+        if (bits == 0xffffffff) {
+            continue;
+        }
+        __m256i c = _mm256_i32gather_epi32((int const*)table, idx, 4);
+        if (bits != 0) {
+            __m256i d = _mm256_loadu_si256((__m256i const*)(dest + x));
+            c = _mm256_blendv_epi8(c, d, t);
+        }
+        _mm256_storeu_si256((__m256i*)(dest + x), c);
+    }
+    lookup8_scalar(src + x, table, dest + x, w - x, key);
+}
+
+AVX2_FN static void keyed32_avx2(uint32_t const* src, uint32_t* dest, int w, uint32_t cmpMask, uint32_t key, uint32_t orBits)
+{
+    const __m256i cm = _mm256_set1_epi32((int)cmpMask);
+    const __m256i k = _mm256_set1_epi32((int)key);
+    const __m256i ob = _mm256_set1_epi32((int)orBits);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m256i s = _mm256_loadu_si256((__m256i const*)(src + x));
+        __m256i t = _mm256_cmpeq_epi32(_mm256_and_si256(s, cm), k);
+        unsigned bits = (unsigned)_mm256_movemask_epi8(t);
+        if (bits == 0xffffffff) {
+            continue;
+        }
+        s = _mm256_or_si256(s, ob);
+        if (bits != 0) {
+            __m256i d = _mm256_loadu_si256((__m256i const*)(dest + x));
+            s = _mm256_blendv_epi8(s, d, t);
+        }
+        _mm256_storeu_si256((__m256i*)(dest + x), s);
+    }
+    keyed32_scalar(src + x, dest + x, w - x, cmpMask, key, orBits);
+}
+
+AVX2_FN static void matte8to32_avx2(I8 const* src, uint32_t* dest, int w, I8 key, uint32_t matte)
+{
+    const __m256i k = _mm256_set1_epi32(key);
+    const __m256i m = _mm256_set1_epi32((int)matte);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m256i s = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const*)(src + x)));
+        __m256i t = _mm256_cmpeq_epi32(s, k);
+        unsigned bits = (unsigned)_mm256_movemask_epi8(t);
+        if (bits == 0xffffffff) {
+            continue;
+        }
+        __m256i out = m;
+        if (bits != 0) {
+            __m256i d = _mm256_loadu_si256((__m256i const*)(dest + x));
+            out = _mm256_blendv_epi8(m, d, t);
+        }
+        _mm256_storeu_si256((__m256i*)(dest + x), out);
+    }
+    matte8to32_scalar(src + x, dest + x, w - x, key, matte);
+}
+
+AVX2_FN static void matte32_avx2(uint32_t const* src, uint32_t* dest, int w, uint32_t cmpMask, uint32_t key, uint32_t matte)
+{
+    const __m256i cm = _mm256_set1_epi32((int)cmpMask);
+    const __m256i k = _mm256_set1_epi32((int)key);
+    const __m256i m = _mm256_set1_epi32((int)matte);
+    int x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m256i s = _mm256_loadu_si256((__m256i const*)(src + x));
+        __m256i t = _mm256_cmpeq_epi32(_mm256_and_si256(s, cm), k);
+        unsigned bits = (unsigned)_mm256_movemask_epi8(t);
+        if (bits == 0xffffffff) {
+            continue;
+        }
+        __m256i out = m;
+        if (bits != 0) {
+            __m256i d = _mm256_loadu_si256((__m256i const*)(dest + x));
+            out = _mm256_blendv_epi8(m, d, t);
+        }
+        _mm256_storeu_si256((__m256i*)(dest + x), out);
+    }
+    matte32_scalar(src + x, dest + x, w - x, cmpMask, key, matte);
+}
+
+static const BlitKernels avx2Kernels = {
+    "avx2",
+    keyed8_avx2,
+    lookup8_avx2,
+    keyed32_avx2,
+    matte8_avx2,
+    matte8to32_avx2,
+    matte32to8_sse2,
+    matte32_avx2
+};
+
+#endif // BLIT_AVX2
+
+
+//-------------------------------------------------------------------
+
+BlitKernels const* BlitKernelsFor(SimdLevel level)
+{
+    switch (level) {
+        case SIMD_NONE:
+            return &scalarKernels;
+        case SIMD_SSE2:
+#ifdef BLIT_SSE2
+            return &sse2Kernels;
+#else
+            return nullptr;
+#endif
+        case SIMD_AVX2:
+#ifdef BLIT_AVX2
+            if (__builtin_cpu_supports("avx2")) {
+                return &avx2Kernels;
+            }
+#endif
+            return nullptr;
+    }
+    return nullptr;
+}
+
+static BlitKernels const* pickKernels()
+{
+    const SimdLevel levels[] = {SIMD_AVX2, SIMD_SSE2, SIMD_NONE};
+    for (SimdLevel l : levels) {
+        BlitKernels const* k = BlitKernelsFor(l);
+        if (k) {
+            return k;
+        }
+    }
+    return &scalarKernels;
+}
+
+BlitKernels const& CurrentBlitKernels()
+{
+    static BlitKernels const* current = pickKernels();
+    return *current;
+}
+
+
+void ExpandPalette(Palette const& pal, PixelFormat destFmt, uint32_t table[256])
+{
+    for (int i = 0; i < 256; ++i) {
+        Colour c = pal.GetColour(i);
+        if (destFmt == FMT_RGBA8) {
+            table[i] = RawPixel((RGBA8)c);
+        } else {
+            table[i] = RawPixel((RGBX8)c);
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef BLIT_SIMD_H_INCLUDED
+#define BLIT_SIMD_H_INCLUDED
+
+#include "colours.h"
+
+#include <cstdint>
+
+struct Palette;
+
+// Inner loops for the keyed and matte blitters.
+// There are SSE2 and AVX2 versions, picked at runtime to suit the CPU, with
+// plain C++ as a fallback.
+//
+// 32bit pixels are handled as uint32_t, so they can be treated the same
+// whatever the format. A 32bit source pixel is transparent if
+// (src & cmpMask) == key (eg cmpMask=0x00ffffff for RGBX8, or
+// cmpMask=0xff000000,key=0 for "alpha is zero" with RGBA8).
+// Transparent pixels leave dest untouched.
+struct BlitKernels
+{
+    const char* name;
+
+    // dest = src
+    void (*keyed8)(I8 const* src, I8* dest, int w, I8 key);
+    // dest = table[src]
+    void (*lookup8)(I8 const* src, uint32_t const* table, uint32_t* dest, int w, I8 key);
+    // dest = src | orBits
+    void (*keyed32)(uint32_t const* src, uint32_t* dest, int w, uint32_t cmpMask, uint32_t key, uint32_t orBits);
+
+    // dest = matte
+    void (*matte8)(I8 const* src, I8* dest, int w, I8 key, I8 matte);
+    void (*matte8to32)(I8 const* src, uint32_t* dest, int w, I8 key, uint32_t matte);
+    void (*matte32to8)(uint32_t const* src, I8* dest, int w, uint32_t cmpMask, uint32_t key, I8 matte);
+    void (*matte32)(uint32_t const* src, uint32_t* dest, int w, uint32_t cmpMask, uint32_t key, uint32_t matte);
+};
+
+enum SimdLevel { SIMD_NONE=0, SIMD_SSE2, SIMD_AVX2 };
+
+// The best kernels for the CPU we're running on.
+BlitKernels const& CurrentBlitKernels();
+
+// A specific set of kernels (for testing/benchmarking).
+// Returns null if not supported by the build or the CPU.
+BlitKernels const* BlitKernelsFor(SimdLevel level);
+
+// Expand a palette out to 256 raw 32bit pixels, for lookup8.
+void ExpandPalette(Palette const& pal, PixelFormat destFmt, uint32_t table[256]);
+
+// Raw pixel values, for passing to the kernels.
+inline uint32_t RawPixel(RGBX8 c)
+    { return (uint32_t)c.b | ((uint32_t)c.g << 8) | ((uint32_t)c.r << 16) | ((uint32_t)c.pad << 24); }
+inline uint32_t RawPixel(RGBA8 c)
+    { return (uint32_t)c.b | ((uint32_t)c.g << 8) | ((uint32_t)c.r << 16) | ((uint32_t)c.a << 24); }
+
+#endif // BLIT_SIMD_H_INCLUDED
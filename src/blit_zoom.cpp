@@ -1,178 +1,294 @@
 #include "blit_zoom.h"
 #include "blit.h"
+#include "blit_kernels.h"
 #include "img.h"
 #include "palette.h"
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#define ZOOM_SSE2
+#include <emmintrin.h>
+#endif
+
 
 // TODO: should probably kill most of these. Only needed because there's no
 // real integration between tools and view rendering.
 
 
-static void scan_zoom_keyed_I8_RGBX8(I8 const* src, Palette const& pal, RGBX8* dest, int w, I8 transparent, int xzoom)
+//----------------------------------------------------------------
+// Pixel replication.
+// Each of the repN() functions writes count whole src pixels, N times each,
+// and returns the new dest.
+
+template<int N, typename P>
+static inline P* repN(P const* src, P* dest, int count)
 {
-    int n=0;
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        if(*src != transparent)
-        {
-            RGBX8 c = pal.GetColour(*src);
-            *dest = c;
-        }
-        ++dest;
-        if( ++n >= xzoom )
-        {
-            ++src;
-            n=0;
+    for (int i = 0; i < count; ++i) {
+        P c = src[i];
+        for (int j = 0; j < N; ++j) {
+            *dest++ = c;
         }
     }
+    return dest;
 }
 
-static void scan_zoom_keyed_RGBX8_RGBX8(RGBX8 const* src, RGBX8* dest, int w, RGBX8 transparent, int xzoom)
+template<typename P>
+static inline P* rep(P const* src, P* dest, int count, int n)
 {
-    int n=0;
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        RGBX8 c=*src;
-        if( c != transparent)
-            *dest = c;
-        ++dest;
-        if( ++n >= xzoom )
-        {
-            ++src;
-            n=0;
-        }
+    for (int i = 0; i < count; ++i) {
+        dest = std::fill_n(dest, n, src[i]);
     }
+    return dest;
 }
 
-static void scan_zoom_keyed_RGBA8_RGBX8(RGBA8 const* src, RGBX8* dest, int w, int xzoom)
+#ifdef ZOOM_SSE2
+
+// 32bit versions, four src pixels at a time, shuffled into place.
+
+static uint32_t* rep2_sse2(uint32_t const* src, uint32_t* dest, int count)
 {
-    int n=0;
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        RGBA8 c = *src;
-        if( c.a>0 )
-            *dest = RGBX8(c.r, c.g, c.b);
-        ++dest;
-        if( ++n >= xzoom )  // on to next src pixel?
-        {
-            ++src;
-            n=0;
-        }
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((__m128i const*)(src + i));
+        _mm_storeu_si128((__m128i*)dest, _mm_unpacklo_epi32(v, v));
+        _mm_storeu_si128((__m128i*)(dest + 4), _mm_unpackhi_epi32(v, v));
+        dest += 8;
     }
+    return repN<2>(src + i, dest, count - i);
 }
 
-void BlitZoomKeyed(
-    Img const& srcimg, Box const& srcbox,
-    Palette const& srcpalette,
-    Img& destimg, Box& destbox,
-    int xzoom,
-    int yzoom,
-    PenColour const& transparentcolour)
+static uint32_t* rep3_sse2(uint32_t const* src, uint32_t* dest, int count)
 {
-    assert( destimg.Fmt()==FMT_RGBX8);
-    assert( srcimg.Bounds().Contains( srcbox ) );
-    assert( xzoom >= 1 );
-    assert( yzoom >= 1 );
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((__m128i const*)(src + i));
+        _mm_storeu_si128((__m128i*)dest, _mm_shuffle_epi32(v, _MM_SHUFFLE(1,0,0,0)));
+        _mm_storeu_si128((__m128i*)(dest + 4), _mm_shuffle_epi32(v, _MM_SHUFFLE(2,2,1,1)));
+        _mm_storeu_si128((__m128i*)(dest + 8), _mm_shuffle_epi32(v, _MM_SHUFFLE(3,3,3,2)));
+        dest += 12;
+    }
+    return repN<3>(src + i, dest, count - i);
+}
 
-    Box destclipped( destbox );
-    Box srcclipped( srcbox );
-    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped, xzoom, yzoom );
+static uint32_t* rep4_sse2(uint32_t const* src, uint32_t* dest, int count)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((__m128i const*)(src + i));
+        _mm_storeu_si128((__m128i*)dest, _mm_shuffle_epi32(v, 0x00));
+        _mm_storeu_si128((__m128i*)(dest + 4), _mm_shuffle_epi32(v, 0x55));
+        _mm_storeu_si128((__m128i*)(dest + 8), _mm_shuffle_epi32(v, 0xaa));
+        _mm_storeu_si128((__m128i*)(dest + 12), _mm_shuffle_epi32(v, 0xff));
+        dest += 16;
+    }
+    return repN<4>(src + i, dest, count - i);
+}
 
-    int y;
-    for( y=0; y<destclipped.H(); ++y )
-    {
-        RGBX8* dest = destimg.Ptr_RGBX8( destclipped.XMin() + 0, destclipped.YMin() + y );
-        switch(srcimg.Fmt())
-        {
-        case FMT_I8:
-            scan_zoom_keyed_I8_RGBX8(
-                srcimg.PtrConst_I8( srcclipped.XMin()+0, srcclipped.YMin()+y/yzoom ),
-                srcpalette,
-                dest,
-                destclipped.W(),
-                transparentcolour.idx(),
-                xzoom );
-            break;
-        case FMT_RGBX8:
-            scan_zoom_keyed_RGBX8_RGBX8(
-                srcimg.PtrConst_RGBX8( srcclipped.XMin()+0, srcclipped.YMin()+y/yzoom ),
-                    dest,
-                    destclipped.W(),
-                    transparentcolour.rgb(),
-                    xzoom );
+static uint32_t* rep8_sse2(uint32_t const* src, uint32_t* dest, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        __m128i c = _mm_set1_epi32((int)src[i]);
+        _mm_storeu_si128((__m128i*)dest, c);
+        _mm_storeu_si128((__m128i*)(dest + 4), c);
+        dest += 8;
+    }
+    return dest;
+}
+
+#endif // ZOOM_SSE2
+
+
+template<typename P>
+static void zoomRow(P const* src, P* dest, int w, int xzoom, int skip)
+{
+    assert(xzoom >= 1 && skip >= 0 && skip < xzoom);
+    // finish off any partial first pixel
+    if (skip > 0 && w > 0) {
+        int n = std::min(w, xzoom - skip);
+        dest = std::fill_n(dest, n, *src++);
+        w -= n;
+    }
+
+    int whole = w / xzoom;
+    switch (xzoom) {
+        case 1:
+            dest = std::copy(src, src + whole, dest);
             break;
+#ifdef ZOOM_SSE2
+        case 2:
+        case 3:
+        case 4:
+        case 8:
+            if constexpr (sizeof(P) == 4) {
+                uint32_t const* s = (uint32_t const*)src;
+                uint32_t* d = (uint32_t*)dest;
+                switch (xzoom) {
+                    case 2: d = rep2_sse2(s, d, whole); break;
+                    case 3: d = rep3_sse2(s, d, whole); break;
+                    case 4: d = rep4_sse2(s, d, whole); break;
+                    default: d = rep8_sse2(s, d, whole); break;
+                }
+                dest = (P*)d;
+                break;
+            }
+            [[fallthrough]];
+#endif
         default:
-            scan_zoom_keyed_RGBA8_RGBX8(
-                srcimg.PtrConst_RGBA8(srcclipped.XMin()+0, srcclipped.YMin()+y/yzoom),
-                    dest,
-                    destclipped.W(),
-                    xzoom );
+            switch (xzoom) {
+                case 2: dest = repN<2>(src, dest, whole); break;
+                case 3: dest = repN<3>(src, dest, whole); break;
+                case 4: dest = repN<4>(src, dest, whole); break;
+                case 8: dest = repN<8>(src, dest, whole); break;
+                default: dest = rep(src, dest, whole, xzoom); break;
+            }
             break;
-        }
     }
+    src += whole;
+
+    // partial last pixel
+    int rem = w - whole * xzoom;
+    if (rem > 0) {
+        std::fill_n(dest, rem, *src);
+    }
+}
+
+void ZoomRow(I8 const* src, I8* dest, int w, int xzoom, int skip)
+{
+    zoomRow(src, dest, w, xzoom, skip);
 }
 
+void ZoomRow(uint32_t const* src, uint32_t* dest, int w, int xzoom, int skip)
+{
+    zoomRow(src, dest, w, xzoom, skip);
+}
 
 
-//-----------------------------------------------------
-//
+//----------------------------------------------------------------
 
-static void scan_zoom_matte_keyed_RGBA8_RGBX8(RGBA8 const* src, RGBX8* dest, int w, int xzoom, RGBX8 matte)
+// Clip a zoomed blit. Unlike plain clip_blit(), this keeps track of where
+// the dest starts within the zoomed src pixels, so blits clipped at the
+// left or top edges still line up.
+// srcclipped.x,y is the first src pixel used, and srccount is the number of
+// src pixels needed for each row.
+// Returns false if there's nothing to draw.
+static bool clipZoomed(Img const& srcimg, Box const& srcbox,
+    Img const& destimg, Box const& destbox, int xzoom, int yzoom,
+    Box& srcclipped, Box& destclipped, int& xskip, int& yskip, int& srccount)
 {
-    int x=0;
-    while(x<w)
-    {
-        RGBA8 c = *src++;
-        if (c.a>0) {
-            int n;
-            for( n=0; n<xzoom && (x+n)<w; ++n )
-                *dest++ = matte;
-        } else {
-            dest += xzoom;
-        }
-        x += xzoom;
+    assert(srcimg.Bounds().Contains(srcbox));
+    assert(xzoom >= 1);
+    assert(yzoom >= 1);
+
+    destclipped = Box(destbox.x, destbox.y, srcbox.w * xzoom, srcbox.h * yzoom);
+    destclipped.ClipAgainst(destimg.Bounds());
+    if (destclipped.Empty()) {
+        return false;
     }
+    int dx = destclipped.x - destbox.x;
+    int dy = destclipped.y - destbox.y;
+    srcclipped = Box(srcbox.x + dx / xzoom, srcbox.y + dy / yzoom, 0, 0);
+    xskip = dx % xzoom;
+    yskip = dy % yzoom;
+    srccount = (xskip + destclipped.w + xzoom - 1) / xzoom;
+    return true;
 }
 
-static void scan_zoom_matte_keyed_RGBX8_RGBX8(RGBX8 const* src, RGBX8* dest, int w, int xzoom, RGBX8 transparent, RGBX8 matte)
+
+// Converts a src row into raw pixels with a transparency flag in the top
+// byte (0 = transparent), ready for the keyed32 kernel.
+// Either draws the src colours (table is used for I8 srcs), or the
+// matte colour.
+template<typename SRC>
+static void keyRow(SRC const* src, int n, SrcKey<SRC> const& key,
+    uint32_t const* table, bool useMatte, uint32_t matte, uint32_t* out)
 {
-    int x=0;
-    while(x<w)
-    {
-        RGBX8 c = *src++;
-        if (c!=transparent) {
-            int n;
-            for( n=0; n<xzoom && (x+n)<w; ++n )
-                *dest++ = matte;
+    for (int i = 0; i < n; ++i) {
+        SRC c = src[i];
+        if (key.Transparent(c)) {
+            out[i] = 0;
+        } else if (useMatte) {
+            out[i] = matte | 0xff000000;
+        } else if constexpr (std::is_same<SRC, I8>::value) {
+            out[i] = table[c] | 0xff000000;
         } else {
-            dest += xzoom;
+            out[i] = RawPixel(c) | 0xff000000;
         }
-        x += xzoom;
     }
 }
 
-
-static void scan_zoom_matte_keyed_I8_RGBX8(I8 const* src, RGBX8* dest, int w, int xzoom, I8 transparent, RGBX8 matte)
+// Common code for the keyed zoom blits (onto RGBX8 only).
+// Each src row is keyed and zoomed once, then applied to each of the dest
+// rows it covers.
+static void blitZoomKeyedRGBX8(Img const& srcimg, Box const& srcbox,
+    Palette const* srcpalette,
+    Img& destimg, Box const& destbox,
+    int xzoom, int yzoom,
+    PenColour const& transparentcolour,
+    PenColour const* mattecolour)
 {
-    int x=0;
-    while(x<w)
-    {
-        I8 c = *src++;
-        if (c!=transparent) {
-            int n;
-            for( n=0; n<xzoom && (x+n)<w; ++n )
-                *dest++ = matte;
-        } else {
-            dest += xzoom;
+    assert(destimg.Fmt() == FMT_RGBX8);
+    Box srcclipped, destclipped;
+    int xskip, yskip, srccount;
+    if (!clipZoomed(srcimg, srcbox, destimg, destbox, xzoom, yzoom,
+        srcclipped, destclipped, xskip, yskip, srccount)) {
+        return;
+    }
+
+    uint32_t table[256];
+    if (srcimg.Fmt() == FMT_I8 && !mattecolour) {
+        assert(srcpalette);
+        ExpandPalette(*srcpalette, FMT_RGBX8, table);
+    }
+    const bool useMatte = mattecolour != nullptr;
+    const uint32_t matte = useMatte ? RawPixel(mattecolour->toRGBX8()) : 0;
+
+    std::vector<uint32_t> keyed(srccount);
+    std::vector<uint32_t> zoomed(destclipped.w);
+    BlitKernels const& k = CurrentBlitKernels();
+    int prevSrcY = -1;
+    for (int y = 0; y < destclipped.h; ++y) {
+        int srcy = srcclipped.y + (yskip + y) / yzoom;
+        if (srcy != prevSrcY) {
+            switch (srcimg.Fmt()) {
+                case FMT_I8:
+                    keyRow(srcimg.PtrConst_I8(srcclipped.x, srcy), srccount,
+                        BrushKey<I8>(transparentcolour), table, useMatte, matte, keyed.data());
+                    break;
+                case FMT_RGBX8:
+                    keyRow(srcimg.PtrConst_RGBX8(srcclipped.x, srcy), srccount,
+                        BrushKey<RGBX8>(transparentcolour), table, useMatte, matte, keyed.data());
+                    break;
+                case FMT_RGBA8:
+                    keyRow(srcimg.PtrConst_RGBA8(srcclipped.x, srcy), srccount,
+                        BrushKey<RGBA8>(transparentcolour), table, useMatte, matte, keyed.data());
+                    break;
+                default:
+                    assert(false);
+                    return;
+            }
+            ZoomRow(keyed.data(), zoomed.data(), destclipped.w, xzoom, xskip);
+            prevSrcY = srcy;
         }
-        x += xzoom;
+        uint32_t* dest = (uint32_t*)destimg.Ptr_RGBX8(destclipped.x, destclipped.y + y);
+        k.keyed32(zoomed.data(), dest, destclipped.w, 0xff000000, 0, 0);
     }
 }
 
 
+void BlitZoomKeyed(
+    Img const& srcimg, Box const& srcbox,
+    Palette const& srcpalette,
+    Img& destimg, Box& destbox,
+    int xzoom,
+    int yzoom,
+    PenColour const& transparentcolour)
+{
+    blitZoomKeyedRGBX8(srcimg, srcbox, &srcpalette, destimg, destbox,
+        xzoom, yzoom, transparentcolour, nullptr);
+}
 
 
 void BlitZoomMatteKeyed(
@@ -183,104 +299,84 @@ void BlitZoomMatteKeyed(
     PenColour const& transparentcolour,
     PenColour const& mattecolour )
 {
-    assert( destimg.Fmt()==FMT_RGBX8);
-    assert( srcimg.Bounds().Contains( srcbox ) );
-    assert( xzoom >= 1 );
-    assert( yzoom >= 1 );
+    blitZoomKeyedRGBX8(srcimg, srcbox, nullptr, destimg, destbox,
+        xzoom, yzoom, transparentcolour, &mattecolour);
+}
 
-    Box destclipped( destbox );
-    Box srcclipped( srcbox );
-    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped, xzoom,yzoom );
 
-    int y;
-    for( y=0; y<destclipped.H(); ++y )
-    {
-        RGBX8* dest = destimg.Ptr_RGBX8( destclipped.XMin() + 0, destclipped.YMin() + y );
-        switch(srcimg.Fmt())
-        {
+// ***********************************************
+// Unkeyed zoom blits.
+// The first dest row for each src row is zoomed, and the rest are just
+// copies of it.
+
+// Convert a src row to 32bit dest pixels.
+static void convertRow(Img const& srcimg, int x, int y, int n,
+    PixelFormat destFmt, uint32_t const* table, uint32_t* out)
+{
+    switch (srcimg.Fmt()) {
         case FMT_I8:
-            scan_zoom_matte_keyed_I8_RGBX8(
-                srcimg.PtrConst_I8(srcclipped.XMin()+0, srcclipped.YMin()+y/yzoom),
-                dest,
-                destclipped.W(),
-                xzoom,
-                transparentcolour.idx(),
-                mattecolour.rgb() );
+            {
+                I8 const* src = srcimg.PtrConst_I8(x, y);
+                for (int i = 0; i < n; ++i) {
+                    out[i] = table[src[i]];
+                }
+            }
             break;
         case FMT_RGBX8:
-            scan_zoom_matte_keyed_RGBX8_RGBX8(
-                srcimg.PtrConst_RGBX8(srcclipped.XMin()+0, srcclipped.YMin()+y/yzoom),
-                dest,
-                destclipped.W(),
-                xzoom,
-                transparentcolour.rgb(),
-                mattecolour.rgb() );
-            break;
         case FMT_RGBA8:
-            scan_zoom_matte_keyed_RGBA8_RGBX8(
-                srcimg.PtrConst_RGBA8(srcclipped.XMin()+0, srcclipped.YMin()+y/yzoom),
-                dest,
-                destclipped.W(),
-                xzoom,
-                mattecolour.rgb() );
+            {
+                // RGBX8 pad and RGBA8 alpha both end up at 255 when
+                // converting between the two.
+                uint32_t const* src = (uint32_t const*)srcimg.PtrConst(x, y);
+                const uint32_t orBits = (srcimg.Fmt() == destFmt) ? 0 : 0xff000000;
+                for (int i = 0; i < n; ++i) {
+                    out[i] = src[i] | orBits;
+                }
+            }
             break;
         default:
             assert(false);
             break;
-        }
     }
 }
 
-
-
-// ***********************************************
-
-static void scan_zoom_I8_I8(I8 const* src, I8* dest, int w, int xzoom)
+static void blitZoomUnkeyed(Img const& srcimg, Box const& srcbox,
+    Img& destimg, Box const& destbox,
+    Palette const* srcpalette,
+    int xzoom, int yzoom)
 {
-    int n=0;
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        *dest++ = *src;
-        if( ++n >= xzoom )
-        {
-            ++src;
-            n=0;
-        }
+    Box srcclipped, destclipped;
+    int xskip, yskip, srccount;
+    if (!clipZoomed(srcimg, srcbox, destimg, destbox, xzoom, yzoom,
+        srcclipped, destclipped, xskip, yskip, srccount)) {
+        return;
     }
-}
 
-static void scan_zoom_I8_RGBX8(I8 const* src, Palette const& pal, RGBX8* dest, int w, int xzoom)
-{
-    int n=0;
-    int x;
-    RGBX8 c = pal.GetColour(*src);
-    for( x=0; x<w; ++x )
-    {
-        *dest++ = c;
-        if( ++n >= xzoom )
-        {
-            ++src;
-            c = pal.GetColour(*src);
-            n=0;
-        }
+    const PixelFormat destFmt = destimg.Fmt();
+    const size_t rowBytes = (size_t)destclipped.w * PixelSize(destFmt);
+    uint32_t table[256];
+    if (srcimg.Fmt() == FMT_I8 && destFmt != FMT_I8) {
+        assert(srcpalette);
+        ExpandPalette(*srcpalette, destFmt, table);
     }
-}
-
-static void scan_zoom_I8_RGBA8(I8 const* src, Palette const& pal, RGBA8* dest, int w, int xzoom)
-{
-    int n=0;
-    int x;
-    RGBA8 c = pal.GetColour(*src);
-    for( x=0; x<w; ++x )
-    {
-        *dest++ = c;
-        if( ++n >= xzoom )
-        {
-            ++src;
-            c = pal.GetColour(*src);
-            n=0;
+    std::vector<uint32_t> conv(srccount);
+    uint8_t const* prev = nullptr;
+    int prevSrcY = -1;
+    for (int y = 0; y < destclipped.h; ++y) {
+        int srcy = srcclipped.y + (yskip + y) / yzoom;
+        uint8_t* dest = destimg.Ptr(destclipped.x, destclipped.y + y);
+        if (srcy == prevSrcY) {
+            memcpy(dest, prev, rowBytes);
+        } else if (destFmt == FMT_I8) {
+            assert(srcimg.Fmt() == FMT_I8);
+            ZoomRow(srcimg.PtrConst_I8(srcclipped.x, srcy), (I8*)dest,
+                destclipped.w, xzoom, xskip);
+        } else {
+            convertRow(srcimg, srcclipped.x, srcy, srccount, destFmt, table, conv.data());
+            ZoomRow(conv.data(), (uint32_t*)dest, destclipped.w, xzoom, xskip);
         }
+        prev = dest;
+        prevSrcY = srcy;
     }
 }
 
@@ -293,84 +389,7 @@ void BlitZoomI8(
     int yzoom )
 {
     assert( srcimg.Fmt()==FMT_I8);
-    assert( srcimg.Bounds().Contains( srcbox ) );
-    assert( xzoom >= 1 );
-    assert( yzoom >= 1 );
-
-    Box destclipped( destbox );
-    Box srcclipped( srcbox );
-    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped, xzoom, yzoom );
-
-    int y;
-    for( y=0; y<destclipped.H(); ++y )
-    {
-        I8 const* src = srcimg.PtrConst_I8( srcclipped.XMin()+0, srcclipped.YMin()+y/yzoom );
-        switch(destimg.Fmt())
-        {
-        case FMT_I8:
-            scan_zoom_I8_I8(
-                src,
-                destimg.Ptr_I8( destclipped.XMin() + 0, destclipped.YMin() + y ),
-                destclipped.W(),
-                xzoom );
-            break;
-        case FMT_RGBX8:
-            scan_zoom_I8_RGBX8(
-                src,
-                pal,
-                destimg.Ptr_RGBX8( destclipped.XMin() + 0, destclipped.YMin() + y ),
-                destclipped.W(),
-                xzoom );
-            break;
-        case FMT_RGBA8:
-            scan_zoom_I8_RGBA8(
-                src,
-                pal,
-                destimg.Ptr_RGBA8( destclipped.XMin() + 0, destclipped.YMin() + y ),
-                destclipped.W(),
-                xzoom );
-            break;
-        default:
-            assert(false);
-            break;
-        }
-    }
-}
-
-
-// ***********************************************
-
-
-static void scan_zoom_RGBX8_RGBX8(RGBX8 const* src, RGBX8* dest, int w, int xzoom)
-{
-    int n=0;
-    int x;
-    RGBX8 c = *src++;
-    for( x=0; x<w; ++x )
-    {
-        *dest++ = c;
-        if( ++n >= xzoom )
-        {
-            c = *src++;
-            n=0;
-        }
-    }
-}
-
-static void scan_zoom_RGBX8_RGBA8(RGBX8 const* src, RGBA8* dest, int w, int xzoom)
-{
-    int n=0;
-    int x;
-    RGBX8 c = *src++;
-    for( x=0; x<w; ++x )
-    {
-        *dest++ = c;
-        if( ++n >= xzoom )
-        {
-            c = *src++;
-            n=0;
-        }
-    }
+    blitZoomUnkeyed(srcimg, srcbox, destimg, destbox, &pal, xzoom, yzoom);
 }
 
 
@@ -381,71 +400,8 @@ void BlitZoomRGBX8(
     int yzoom )
 {
     assert( srcimg.Fmt()==FMT_RGBX8);
-    assert( srcimg.Bounds().Contains( srcbox ) );
-    assert( xzoom >= 1 );
-    assert( yzoom >= 1 );
-
-    Box destclipped( destbox );
-    Box srcclipped( srcbox );
-    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped, xzoom, yzoom );
-
-    int y;
-    for( y=0; y<destclipped.H(); ++y )
-    {
-        RGBX8 const* src = srcimg.PtrConst_RGBX8( srcclipped.XMin()+0, srcclipped.YMin()+y/yzoom );
-        switch(destimg.Fmt())
-        {
-        case FMT_I8:
-            assert(false);  // not supported
-            break;
-        case FMT_RGBX8:
-            scan_zoom_RGBX8_RGBX8(
-                src,
-                destimg.Ptr_RGBX8( destclipped.XMin() + 0, destclipped.YMin() + y ),
-                destclipped.W(),
-                xzoom );
-            break;
-        case FMT_RGBA8:
-            scan_zoom_RGBX8_RGBA8(
-                src,
-                destimg.Ptr_RGBA8( destclipped.XMin() + 0, destclipped.YMin() + y ),
-                destclipped.W(),
-                xzoom );
-            break;
-        default:
-            assert(false);
-            break;
-        }
-    }
-}
-
-
-// ***********************************************
-
-
-static void scan_zoom_RGBA8_RGBX8(RGBA8 const* src, RGBX8* dest, int w, int xzoom)
-{
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        RGBA8 foo = *src++;
-        RGBX8 c(foo.r, foo.g, foo.b);
-        int n;
-        for( n=0; n<xzoom && (x+n)<w; ++n )
-            *dest++ = c;
-    }
-}
-
-static void scan_zoom_RGBA8_RGBA8(RGBA8 const* src, RGBA8* dest, int w, int xzoom)
-{
-    int x;
-    for( x=0; x<w; ++x )
-    {
-        RGBA8 c = *src++;
-        int n;
-        for( n=0; n<xzoom && (x+n)<w; ++n )
-            *dest++ = c;
-    }
+    assert( destimg.Fmt()!=FMT_I8);  // not supported
+    blitZoomUnkeyed(srcimg, srcbox, destimg, destbox, nullptr, xzoom, yzoom);
 }
 
 
@@ -456,42 +412,8 @@ void BlitZoomRGBA8(
     int yzoom )
 {
     assert( srcimg.Fmt()==FMT_RGBA8);
-    assert( srcimg.Bounds().Contains( srcbox ) );
-    assert( xzoom >= 1 );
-    assert( yzoom >= 1 );
-
-    Box destclipped( destbox );
-    Box srcclipped( srcbox );
-    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped, xzoom, yzoom );
-
-    int y;
-    for( y=0; y<destclipped.H(); ++y )
-    {
-        RGBA8 const* src = srcimg.PtrConst_RGBA8( srcclipped.XMin()+0, srcclipped.YMin()+y/yzoom );
-        switch(destimg.Fmt())
-        {
-        case FMT_I8:
-            assert(false);  // not supported
-            break;
-        case FMT_RGBX8:
-            scan_zoom_RGBA8_RGBX8(
-                src,
-                destimg.Ptr_RGBX8( destclipped.XMin() + 0, destclipped.YMin() + y ),
-                destclipped.W(),
-                xzoom );
-            break;
-        case FMT_RGBA8:
-            scan_zoom_RGBA8_RGBA8(
-                src,
-                destimg.Ptr_RGBA8( destclipped.XMin() + 0, destclipped.YMin() + y ),
-                destclipped.W(),
-                xzoom );
-            break;
-        default:
-            assert(false);
-            break;
-        }
-    }
+    assert( destimg.Fmt()!=FMT_I8);  // not supported
+    blitZoomUnkeyed(srcimg, srcbox, destimg, destbox, nullptr, xzoom, yzoom);
 }
 
 
@@ -519,4 +441,3 @@ void BlitZoom(
             break;
     }
 }
-
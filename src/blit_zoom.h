@@ -3,6 +3,8 @@
 
 #include "colours.h"
 
+#include <cstdint>
+
 class Img;
 struct Box;
 class Point;
@@ -38,5 +40,13 @@ void BlitZoomI8(
     int xzoom,
     int yzoom );
 
+
+// Pixel replication, for horizontal zooming.
+// Each src pixel is repeated xzoom times, to fill w dest pixels. The output
+// starts skip pixels into the first (zoomed) src pixel.
+// There are fast paths for zoom factors of 1, 2, 3, 4 and 8.
+void ZoomRow(I8 const* src, I8* dest, int w, int xzoom, int skip=0);
+void ZoomRow(uint32_t const* src, uint32_t* dest, int w, int xzoom, int skip=0);
+
 #endif // BLIT_ZOOM_H_INCLUDED
 
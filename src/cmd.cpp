@@ -1,39 +1,212 @@
 #include "cmd.h"
+#include "cmd_changefmt.h"
+#include "cmd_remap.h"
 #include "layer.h"
 #include "blit.h"
 #include "draw.h"
+#include "exception.h"
+#include "img_pack.h"
+#include "serialise.h"
 #include "sheet.h"
 #include "project.h"
 #include <assert.h>
 #include <cstdio>
+#include <memory>
 #include <utility>
 
+
+void Cmd::SaveHeader(BinWriter& out, CmdType type) const
+{
+    out.U8((uint8_t)type);
+    out.U8((uint8_t)m_State);
+}
+
+Cmd* Cmd::Load(Project& proj, BinReader& in)
+{
+    int type = in.U8();
+    int state = in.U8();
+    if (state != NOT_DONE && state != DONE) {
+        throw Exception("Bad cmd state (%d)", state);
+    }
+    Cmd* c = nullptr;
+    switch (type) {
+        case CMD_DRAW: c = Cmd_Draw::Load(proj, in); break;
+        case CMD_RESIZEFRAMES: c = Cmd_ResizeFrames::Load(proj, in); break;
+        case CMD_INSERTFRAMES: c = Cmd_InsertFrames::Load(proj, in); break;
+        case CMD_DELETEFRAMES: c = Cmd_DeleteFrames::Load(proj, in); break;
+        case CMD_TOSPRITESHEET: c = Cmd_ToSpriteSheet::Load(proj, in); break;
+        case CMD_FROMSPRITESHEET: c = Cmd_FromSpriteSheet::Load(proj, in); break;
+        case CMD_PALETTEMODIFY: c = Cmd_PaletteModify::Load(proj, in); break;
+        case CMD_PALETTEREPLACE: c = Cmd_PaletteReplace::Load(proj, in); break;
+        case CMD_BATCH: c = Cmd_Batch::Load(proj, in); break;
+        case CMD_RANGEEDIT: c = Cmd_RangeEdit::Load(proj, in); break;
+        case CMD_REMAP: c = Cmd_Remap::Load(proj, in); break;
+        case CMD_CHANGEFMT: c = Cmd_ChangeFmt::Load(proj, in); break;
+        default:
+            throw Exception("Bad cmd type (%d)", type);
+    }
+    c->SetState((CmdState)state);
+    return c;
+}
+
+
+// Does frame exist in l (which may be null)?
+static bool frameExists(Layer const* l, int frame)
+{
+    if (!l) {
+        return false;
+    }
+    if (frame == SPARE_FRAME) {
+        return l->mSpare != nullptr;
+    }
+    return frame >= 0 && frame < l->NumFrames();
+}
+
+// Do all the (packed) images suit layer l?
+static bool fmtMatches(Layer const* l, std::vector<PackedImg*> const& packed)
+{
+    for (auto p : packed) {
+        if (p->Fmt() != l->Fmt()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
 Cmd_Draw::Cmd_Draw(Project& proj, NodePath const& target, int frame, Box const& affected, Img const& undoimg) :
+    Cmd_Draw(proj, target, frame, std::vector<Box>(1, affected), undoimg)
+{
+}
+
+Cmd_Draw::Cmd_Draw(Project& proj, NodePath const& target, int frame, std::vector<Box> const& affected, Img const& undoimg) :
     Cmd(proj, DONE),
     m_Target(target),
     m_Frame(frame),
-    m_Img(undoimg, affected),
-    m_Affected( affected )
+    m_Affected(affected)
+{
+    for (Box const& b : m_Affected) {
+        m_Imgs.push_back(new Img(undoimg, b));
+    }
+}
+
+Cmd_Draw::~Cmd_Draw()
+{
+    for (auto img : m_Imgs) {
+        delete img;
+    }
+    for (auto packed : m_Packed) {
+        delete packed;
+    }
+}
+
+// Tiles still shared with the frame (eg when the whole frame was backed up)
+// cost nothing extra. The count isn't updated when the frame is drawn on
+// later and the tiles stop being shared, but Pack() makes the cmd recounted
+// while it's still near the top of the stack.
+size_t Cmd_Draw::MemUsage() const
+{
+    size_t total = sizeof(Cmd_Draw);
+    for (auto img : m_Imgs) {
+        total += img->UnsharedMemUsage();
+    }
+    for (auto packed : m_Packed) {
+        total += packed->MemUsage();
+    }
+    return total;
+}
+
+void Cmd_Draw::Pack()
+{
+    for (auto img : m_Imgs) {
+        m_Packed.push_back(new PackedImg(*img));
+        delete img;
+    }
+    m_Imgs.clear();
+}
+
+bool Cmd_Draw::Save(BinWriter& out) const
+{
+    SaveHeader(out, CMD_DRAW);
+    Write(out, m_Target);
+    out.I32(m_Frame);
+    out.U32((uint32_t)m_Affected.size());
+    for (size_t i = 0; i < m_Affected.size(); ++i) {
+        Write(out, m_Affected[i]);
+        if (!m_Packed.empty()) {
+            m_Packed[i]->Write(out);
+        } else {
+            PackedImg(*m_Imgs[i]).Write(out);
+        }
+    }
+    return true;
+}
+
+Cmd_Draw* Cmd_Draw::Load(Project& proj, BinReader& in)
+{
+    std::unique_ptr<Cmd_Draw> c(new Cmd_Draw(proj));
+    Read(in, c->m_Target);
+    c->m_Frame = in.I32();
+    uint32_t n = in.U32();
+    for (uint32_t i = 0; i < n; ++i) {
+        Box b;
+        Read(in, b);
+        c->m_Affected.push_back(b);
+        c->m_Packed.push_back(PackedImg::Read(in));
+        if (c->m_Packed.back()->W() != b.w || c->m_Packed.back()->H() != b.h) {
+            throw Exception("Bad draw data");
+        }
+    }
+    return c.release();
+}
+
+bool Cmd_Draw::Applicable() const
+{
+    Layer const* l = Proj().LookupLayer(m_Target);
+    if (!frameExists(l, m_Frame)) {
+        return false;
+    }
+    Img const& img = l->GetImgConst(m_Frame);
+    for (size_t i = 0; i < m_Affected.size(); ++i) {
+        PixelFormat fmt = m_Packed.empty() ? m_Imgs[i]->Fmt() : m_Packed[i]->Fmt();
+        if (fmt != img.Fmt() || !img.Bounds().Contains(m_Affected[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Cmd_Draw::unpack()
 {
+    for (auto packed : m_Packed) {
+        m_Imgs.push_back(packed->Unpack());
+        delete packed;
+    }
+    m_Packed.clear();
+}
+
+void Cmd_Draw::swap()
+{
+    unpack();
+    Img& targImg = Proj().GetImg(m_Target, m_Frame);
+    for (size_t i = 0; i < m_Imgs.size(); ++i) {
+        Box dirty( m_Affected[i] );
+        BlitSwap(*m_Imgs[i], m_Imgs[i]->Bounds(), targImg, dirty);
+        Proj().NotifyDamage(m_Target, m_Frame, dirty);
+    }
 }
 
 void Cmd_Draw::Do()
 {
     assert( State() == NOT_DONE );
-    Box dirty( m_Affected );
-    Img& targImg = Proj().GetImg(m_Target, m_Frame);
-    BlitSwap(m_Img, m_Img.Bounds(), targImg, dirty);
-    Proj().NotifyDamage(m_Target, m_Frame, dirty);
+    swap();
     SetState(DONE);
 }
 
 void Cmd_Draw::Undo()
 {
     assert( State() == DONE );
-    Box dirty( m_Affected );
-    Img& targImg = Proj().GetImg(m_Target, m_Frame);
-    BlitSwap( m_Img, m_Img.Bounds(), targImg, dirty );
-    Proj().NotifyDamage(m_Target, m_Frame, dirty);
+    swap();
     SetState( NOT_DONE );
 }
 
@@ -81,11 +254,58 @@ Cmd_ResizeFrames::~Cmd_ResizeFrames()
     for (auto frame : mFrameSwap) {
         delete frame;
     }
+    for (auto packed : mPacked) {
+        delete packed;
+    }
+}
+
+size_t Cmd_ResizeFrames::MemUsage() const
+{
+    return sizeof(Cmd_ResizeFrames) + FramesMemUsage(mFrameSwap, mPacked);
+}
+
+void Cmd_ResizeFrames::Pack()
+{
+    PackFrames(mFrameSwap, mPacked);
+}
+
+bool Cmd_ResizeFrames::Save(BinWriter& out) const
+{
+    SaveHeader(out, CMD_RESIZEFRAMES);
+    Write(out, mTarg);
+    out.I32(mFirstFrame);
+    out.I32(mNumFrames);
+    WriteFrames(out, mFrameSwap, mPacked);
+    return true;
+}
+
+Cmd_ResizeFrames* Cmd_ResizeFrames::Load(Project& proj, BinReader& in)
+{
+    std::unique_ptr<Cmd_ResizeFrames> c(new Cmd_ResizeFrames(proj));
+    Read(in, c->mTarg);
+    c->mFirstFrame = in.I32();
+    c->mNumFrames = in.I32();
+    ReadFrames(in, c->mFrameSwap, c->mPacked);
+    return c.release();
+}
+
+bool Cmd_ResizeFrames::Applicable() const
+{
+    Layer const* l = Proj().LookupLayer(mTarg);
+    if (!l || mNumFrames != (int)mFrameSwap.size() || !fmtMatches(l, mPacked)) {
+        return false;
+    }
+    if (mFirstFrame == SPARE_FRAME) {
+        return mNumFrames == 1 && l->mSpare;
+    }
+    return mFirstFrame >= 0 && mNumFrames >= 0 &&
+        mNumFrames <= l->NumFrames() - mFirstFrame;
 }
 
 
 void Cmd_ResizeFrames::Swap()
 {
+    UnpackFrames(mFrameSwap, mPacked);
     Layer& l = Proj().ResolveLayer(mTarg);
     if (mFirstFrame == SPARE_FRAME) {
         std::swap(l.mSpare, mFrameSwap[0]);
@@ -123,6 +343,37 @@ Cmd_InsertFrames::~Cmd_InsertFrames()
 {
 }
 
+bool Cmd_InsertFrames::Save(BinWriter& out) const
+{
+    SaveHeader(out, CMD_INSERTFRAMES);
+    Write(out, m_Target);
+    out.I32(m_Pos);
+    out.I32(m_NumFrames);
+    return true;
+}
+
+Cmd_InsertFrames* Cmd_InsertFrames::Load(Project& proj, BinReader& in)
+{
+    NodePath target;
+    Read(in, target);
+    int pos = in.I32();
+    int numFrames = in.I32();
+    return new Cmd_InsertFrames(proj, target, pos, numFrames);
+}
+
+bool Cmd_InsertFrames::Applicable() const
+{
+    Layer const* l = Proj().LookupLayer(m_Target);
+    if (!l || l->mFrames.empty() || m_Pos < 0 || m_NumFrames < 0) {
+        return false;
+    }
+    if (State() == DONE) {
+        // Undo() removes them again (leaving at least one frame).
+        return m_NumFrames < l->NumFrames() && m_Pos <= l->NumFrames() - m_NumFrames;
+    }
+    return m_Pos <= l->NumFrames();
+}
+
 void Cmd_InsertFrames::Do()
 {
     Layer& l = Proj().ResolveLayer(m_Target);
@@ -186,6 +437,59 @@ Cmd_DeleteFrames::~Cmd_DeleteFrames()
     for (auto f : m_FrameSwap) {
         delete f;
     }
+    for (auto packed : m_Packed) {
+        delete packed;
+    }
+}
+
+size_t Cmd_DeleteFrames::MemUsage() const
+{
+    return sizeof(Cmd_DeleteFrames) + FramesMemUsage(m_FrameSwap, m_Packed);
+}
+
+void Cmd_DeleteFrames::Pack()
+{
+    PackFrames(m_FrameSwap, m_Packed);
+}
+
+bool Cmd_DeleteFrames::Save(BinWriter& out) const
+{
+    SaveHeader(out, CMD_DELETEFRAMES);
+    Write(out, m_Target);
+    out.I32(m_Pos);
+    out.I32(m_NumFrames);
+    WriteFrames(out, m_FrameSwap, m_Packed);
+    return true;
+}
+
+Cmd_DeleteFrames* Cmd_DeleteFrames::Load(Project& proj, BinReader& in)
+{
+    NodePath target;
+    Read(in, target);
+    int pos = in.I32();
+    int numFrames = in.I32();
+    if (pos == SPARE_FRAME) {
+        throw Exception("Bad frame");
+    }
+    std::unique_ptr<Cmd_DeleteFrames> c(new Cmd_DeleteFrames(proj, target, pos, numFrames));
+    ReadFrames(in, c->m_FrameSwap, c->m_Packed);
+    return c.release();
+}
+
+bool Cmd_DeleteFrames::Applicable() const
+{
+    Layer const* l = Proj().LookupLayer(m_Target);
+    if (!l || m_Pos < 0 || m_NumFrames < 0) {
+        return false;
+    }
+    if (State() == DONE) {
+        // Undo() puts the frames back.
+        return m_Pos <= l->NumFrames() && m_NumFrames == (int)m_FrameSwap.size() &&
+            fmtMatches(l, m_Packed);
+    }
+    // Do() mustn't leave the layer empty.
+    return m_FrameSwap.empty() && m_NumFrames < l->NumFrames() &&
+        m_Pos <= l->NumFrames() - m_NumFrames;
 }
 
 
@@ -208,6 +512,7 @@ void Cmd_DeleteFrames::Do()
 
 void Cmd_DeleteFrames::Undo()
 {
+    UnpackFrames(m_FrameSwap, m_Packed);
     assert((int)m_FrameSwap.size() == m_NumFrames);
     Layer& l = Proj().ResolveLayer(m_Target);
     l.mFrames.insert( l.mFrames.begin() + m_Pos,
@@ -239,10 +544,48 @@ Cmd_ToSpriteSheet::~Cmd_ToSpriteSheet()
     for (auto frame: mFrameSwap) {
         delete frame;
     }
+    for (auto packed : mPacked) {
+        delete packed;
+    }
+}
+
+size_t Cmd_ToSpriteSheet::MemUsage() const
+{
+    return sizeof(Cmd_ToSpriteSheet) + FramesMemUsage(mFrameSwap, mPacked);
+}
+
+void Cmd_ToSpriteSheet::Pack()
+{
+    PackFrames(mFrameSwap, mPacked);
+}
+
+bool Cmd_ToSpriteSheet::Save(BinWriter& out) const
+{
+    SaveHeader(out, CMD_TOSPRITESHEET);
+    Write(out, mTarg);
+    Write(out, mGridSwap);
+    WriteFrames(out, mFrameSwap, mPacked);
+    return true;
+}
+
+Cmd_ToSpriteSheet* Cmd_ToSpriteSheet::Load(Project& proj, BinReader& in)
+{
+    std::unique_ptr<Cmd_ToSpriteSheet> c(new Cmd_ToSpriteSheet(proj));
+    Read(in, c->mTarg);
+    Read(in, c->mGridSwap);
+    ReadFrames(in, c->mFrameSwap, c->mPacked);
+    return c.release();
+}
+
+bool Cmd_ToSpriteSheet::Applicable() const
+{
+    Layer const* l = Proj().LookupLayer(mTarg);
+    return l && !mFrameSwap.empty() && fmtMatches(l, mPacked);
 }
 
 void Cmd_ToSpriteSheet::Swap()
 {
+    UnpackFrames(mFrameSwap, mPacked);
     Layer& l = Proj().ResolveLayer(mTarg);
 
     int delta = (int)mFrameSwap.size() - (int)l.mFrames.size();
@@ -296,10 +639,48 @@ Cmd_FromSpriteSheet::~Cmd_FromSpriteSheet()
     for (auto frame: mFrameSwap) {
         delete frame;
     }
+    for (auto packed : mPacked) {
+        delete packed;
+    }
+}
+
+size_t Cmd_FromSpriteSheet::MemUsage() const
+{
+    return sizeof(Cmd_FromSpriteSheet) + FramesMemUsage(mFrameSwap, mPacked);
+}
+
+void Cmd_FromSpriteSheet::Pack()
+{
+    PackFrames(mFrameSwap, mPacked);
+}
+
+bool Cmd_FromSpriteSheet::Save(BinWriter& out) const
+{
+    SaveHeader(out, CMD_FROMSPRITESHEET);
+    Write(out, mTarg);
+    Write(out, mGridSwap);
+    WriteFrames(out, mFrameSwap, mPacked);
+    return true;
+}
+
+Cmd_FromSpriteSheet* Cmd_FromSpriteSheet::Load(Project& proj, BinReader& in)
+{
+    std::unique_ptr<Cmd_FromSpriteSheet> c(new Cmd_FromSpriteSheet(proj));
+    Read(in, c->mTarg);
+    Read(in, c->mGridSwap);
+    ReadFrames(in, c->mFrameSwap, c->mPacked);
+    return c.release();
+}
+
+bool Cmd_FromSpriteSheet::Applicable() const
+{
+    Layer const* l = Proj().LookupLayer(mTarg);
+    return l && !mFrameSwap.empty() && fmtMatches(l, mPacked);
 }
 
 void Cmd_FromSpriteSheet::Swap()
 {
+    UnpackFrames(mFrameSwap, mPacked);
     Layer& l = Proj().ResolveLayer(mTarg);
 
     int delta = (int)mFrameSwap.size() - (int)l.mFrames.size();
@@ -348,6 +729,48 @@ Cmd_PaletteModify::~Cmd_PaletteModify()
     delete [] m_Colours;
 }
 
+size_t Cmd_PaletteModify::MemUsage() const
+{
+    return sizeof(Cmd_PaletteModify) + m_Cnt*sizeof(Colour);
+}
+
+bool Cmd_PaletteModify::Save(BinWriter& out) const
+{
+    SaveHeader(out, CMD_PALETTEMODIFY);
+    Write(out, m_Target);
+    out.I32(m_Frame);
+    out.I32(m_First);
+    out.I32(m_Cnt);
+    for (int i = 0; i < m_Cnt; ++i) {
+        Write(out, m_Colours[i]);
+    }
+    return true;
+}
+
+Cmd_PaletteModify* Cmd_PaletteModify::Load(Project& proj, BinReader& in)
+{
+    NodePath target;
+    Read(in, target);
+    int frame = in.I32();
+    int first = in.I32();
+    int cnt = in.I32();
+    if (cnt < 0 || (size_t)cnt * 4 > in.Remaining()) {
+        throw Exception("Bad colour count");
+    }
+    std::vector<Colour> colours(cnt);
+    for (auto& c : colours) {
+        Read(in, c);
+    }
+    return new Cmd_PaletteModify(proj, target, frame, first, cnt, colours.data());
+}
+
+bool Cmd_PaletteModify::Applicable() const
+{
+    Layer const* l = Proj().LookupLayer(m_Target);
+    return frameExists(l, m_Frame) && m_First >= 0 && m_Cnt >= 0 &&
+        m_Cnt <= l->mPalette.NColours - m_First;
+}
+
 
 void Cmd_PaletteModify::swap()
 {
@@ -422,6 +845,36 @@ Cmd_PaletteReplace::~Cmd_PaletteReplace()
 {
 }
 
+size_t Cmd_PaletteReplace::MemUsage() const
+{
+    return sizeof(Cmd_PaletteReplace) + mPalette.NColours*sizeof(Colour);
+}
+
+bool Cmd_PaletteReplace::Save(BinWriter& out) const
+{
+    SaveHeader(out, CMD_PALETTEREPLACE);
+    Write(out, mTarget);
+    out.I32(mFrame);
+    Write(out, mPalette);
+    Write(out, mRanges);
+    return true;
+}
+
+Cmd_PaletteReplace* Cmd_PaletteReplace::Load(Project& proj, BinReader& in)
+{
+    std::unique_ptr<Cmd_PaletteReplace> c(new Cmd_PaletteReplace(proj));
+    Read(in, c->mTarget);
+    c->mFrame = in.I32();
+    Read(in, c->mPalette);
+    Read(in, c->mRanges, c->mPalette.NColours);
+    return c.release();
+}
+
+bool Cmd_PaletteReplace::Applicable() const
+{
+    return frameExists(Proj().LookupLayer(mTarget), mFrame);
+}
+
 
 void Cmd_PaletteReplace::swap()
 {
@@ -470,6 +923,58 @@ Cmd_Batch::~Cmd_Batch()
 }
 
 
+size_t Cmd_Batch::MemUsage() const
+{
+    size_t total = sizeof(Cmd_Batch);
+    for (auto c : m_Cmds) {
+        total += c->MemUsage();
+    }
+    return total;
+}
+
+void Cmd_Batch::Pack()
+{
+    for (auto c : m_Cmds) {
+        c->Pack();
+    }
+}
+
+bool Cmd_Batch::Save(BinWriter& out) const
+{
+    SaveHeader(out, CMD_BATCH);
+    out.U32((uint32_t)m_Cmds.size());
+    for (auto c : m_Cmds) {
+        if (!c->Save(out)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Cmd_Batch* Cmd_Batch::Load(Project& proj, BinReader& in)
+{
+    std::unique_ptr<Cmd_Batch> batch(new Cmd_Batch(proj));
+    uint32_t n = in.U32();
+    for (uint32_t i = 0; i < n; ++i) {
+        batch->m_Cmds.push_back(Cmd::Load(proj, in));
+    }
+    return batch.release();
+}
+
+// Each cmd is checked against the project as it is now, rather than as the
+// cmds before it in the batch would leave it. That's fine for the batches
+// the tools build (draws to the same frame).
+bool Cmd_Batch::Applicable() const
+{
+    for (auto c : m_Cmds) {
+        if (c->State() != State() || !c->Applicable()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
 void Cmd_Batch::Append(Cmd* c)
 {
     assert(c->State() == State());
@@ -479,18 +984,22 @@ void Cmd_Batch::Append(Cmd* c)
 
 void Cmd_Batch::Do()
 {
+    assert(State() == NOT_DONE);
     std::vector<Cmd*>::iterator it;
     for (it=m_Cmds.begin(); it!=m_Cmds.end(); ++it) {
         (*it)->Do(); 
     }
+    SetState(DONE);
 }
 
 void Cmd_Batch::Undo()
 {
+    assert(State() == DONE);
     std::vector<Cmd*>::reverse_iterator it;
     for (it=m_Cmds.rbegin(); it!=m_Cmds.rend(); ++it) {
         (*it)->Undo(); 
     }
+    SetState(NOT_DONE);
 }
 
 
@@ -551,6 +1060,62 @@ Cmd_RangeEdit::Cmd_RangeEdit( Project& proj, NodePath const& target,
     assert(m_Extent.W() * m_Extent.H() == (int)penData.size());
 }
 
+size_t Cmd_RangeEdit::MemUsage() const
+{
+    return sizeof(Cmd_RangeEdit) + m_ExistData.size()/8 +
+        m_PenData.size()*sizeof(PenColour);
+}
+
+bool Cmd_RangeEdit::Save(BinWriter& out) const
+{
+    SaveHeader(out, CMD_RANGEEDIT);
+    Write(out, m_Target);
+    out.I32(m_Frame);
+    Write(out, m_Extent);
+    for (size_t i = 0; i < m_PenData.size(); ++i) {
+        out.U8(m_ExistData[i] ? 1 : 0);
+        Write(out, m_PenData[i]);
+    }
+    return true;
+}
+
+Cmd_RangeEdit* Cmd_RangeEdit::Load(Project& proj, BinReader& in)
+{
+    NodePath target;
+    Read(in, target);
+    int frame = in.I32();
+    Box extent;
+    Read(in, extent);
+    // (each entry is a flag plus a pen, 9 bytes)
+    if (extent.w < 0 || extent.h < 0 ||
+        (uint64_t)extent.w * extent.h > in.Remaining() / 9) {
+        throw Exception("Bad range extent");
+    }
+    size_t n = (size_t)extent.w * extent.h;
+    std::vector<bool> existData(n);
+    std::vector<PenColour> penData(n);
+    for (size_t i = 0; i < n; ++i) {
+        existData[i] = (in.U8() != 0);
+        Read(in, penData[i]);
+    }
+    return new Cmd_RangeEdit(proj, target, frame, extent, existData, penData);
+}
+
+bool Cmd_RangeEdit::Applicable() const
+{
+    Layer const* l = Proj().LookupLayer(m_Target);
+    if (!frameExists(l, m_Frame)) {
+        return false;
+    }
+    for (size_t i = 0; i < m_PenData.size(); ++i) {
+        if (m_ExistData[i] && m_PenData[i].IdxValid() &&
+            m_PenData[i].idx() >= l->mPalette.NColours) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void Cmd_RangeEdit::Do()
 {
     swap();
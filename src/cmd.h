@@ -12,6 +12,25 @@
 
 class Project;
 class Cmd_PaletteModify;
+class PackedImg;
+class BinWriter;
+class BinReader;
+
+// Type tags for serialised cmds.
+enum CmdType {
+    CMD_DRAW = 1,
+    CMD_RESIZEFRAMES,
+    CMD_INSERTFRAMES,
+    CMD_DELETEFRAMES,
+    CMD_TOSPRITESHEET,
+    CMD_FROMSPRITESHEET,
+    CMD_PALETTEMODIFY,
+    CMD_PALETTEREPLACE,
+    CMD_BATCH,
+    CMD_RANGEEDIT,
+    CMD_REMAP,
+    CMD_CHANGEFMT
+};
 
 class Cmd
 {
@@ -27,6 +46,34 @@ public:
     virtual void Do() = 0;
     virtual void Undo() = 0;
 
+    // Approximate memory held by the cmd, in bytes (used to limit the size
+    // of the undo stack).
+    virtual size_t MemUsage() const
+        { return sizeof(Cmd); }
+
+    // Compress any image data held by the cmd. Called by the Editor when
+    // the cmd is no longer one of the most recent on the undo stack.
+    // The data is unpacked again as needed by Do() or Undo().
+    virtual void Pack()
+        {}
+
+    // Serialise the cmd, so it can be paged out of memory (see UndoJournal).
+    // Returns false if the cmd doesn't support it (out may have been
+    // partially written to).
+    virtual bool Save(BinWriter& /*out*/) const
+        { return false; }
+
+    // Recreate a cmd written out by Save(). The cmd will be packed.
+    // Throws an Exception if the data is bad.
+    static Cmd* Load(Project& proj, BinReader& in);
+
+    // Can the cmd be applied (Do() or Undo(), as per its state) to the
+    // project as it is now? Cmds are built to fit the project, but a loaded
+    // one might not (eg replaying a journal onto the wrong checkpoint), and
+    // Do() and Undo() only assert.
+    virtual bool Applicable() const
+        { return false; }
+
     // cheesy RTTI for types that need it
     virtual Cmd_PaletteModify* ToPaletteModify() { return 0; }
 
@@ -34,9 +81,13 @@ public:
         { return m_State; }
     Project& Proj()
         { return m_Proj; }
+    Project const& Proj() const
+        { return m_Proj; }
 protected:
     void SetState( CmdState s )
         { m_State=s; }
+    // for Save() implementations
+    void SaveHeader(BinWriter& out, CmdType type) const;
 private:
     Project& m_Proj;
     CmdState m_State;
@@ -45,17 +96,31 @@ private:
 
 // A cmd to encapsulate an image modification which
 // has already been applied to the project.
+// Only the affected areas of undoimg are kept.
 class Cmd_Draw : public Cmd
 {
 public:
     Cmd_Draw( Project& proj, NodePath const& target, int frame, Box const& affected, Img const& undoimg );
+    // affected areas must not overlap
+    Cmd_Draw( Project& proj, NodePath const& target, int frame, std::vector<Box> const& affected, Img const& undoimg );
+    virtual ~Cmd_Draw();
     virtual void Do();
     virtual void Undo();
+    virtual size_t MemUsage() const;
+    virtual void Pack();
+    virtual bool Save(BinWriter& out) const;
+    static Cmd_Draw* Load(Project& proj, BinReader& in);
+    virtual bool Applicable() const;
 private:
+    Cmd_Draw( Project& proj ) : Cmd(proj, DONE) {}
+    void swap();
+    void unpack();
     NodePath m_Target;
     int m_Frame;
-    Img m_Img;
-    Box m_Affected;
+    // one saved image per affected area (m_Imgs empty if packed)
+    std::vector<Box> m_Affected;
+    std::vector<Img*> m_Imgs;
+    std::vector<PackedImg*> m_Packed;
 };
 
 
@@ -70,12 +135,19 @@ public:
     virtual ~Cmd_ResizeFrames();
     virtual void Do();
     virtual void Undo();
+    virtual size_t MemUsage() const;
+    virtual void Pack();
+    virtual bool Save(BinWriter& out) const;
+    static Cmd_ResizeFrames* Load(Project& proj, BinReader& in);
+    virtual bool Applicable() const;
 private:
+    Cmd_ResizeFrames(Project& proj) : Cmd(proj, NOT_DONE) {}
     Frame* Resize(Frame const* src,
         Box const& newArea, PenColour const& fillPen) const;
     void Swap();
     NodePath mTarg;
     std::vector<Frame*> mFrameSwap;
+    std::vector<PackedImg*> mPacked;
     int mFirstFrame;
     int mNumFrames;
 };
@@ -89,6 +161,9 @@ public:
     virtual ~Cmd_InsertFrames();
     virtual void Do();
     virtual void Undo();
+    virtual bool Save(BinWriter& out) const;
+    static Cmd_InsertFrames* Load(Project& proj, BinReader& in);
+    virtual bool Applicable() const;
 private:
     NodePath m_Target;
     int m_Pos;
@@ -104,11 +179,17 @@ public:
     virtual ~Cmd_DeleteFrames();
     virtual void Do();
     virtual void Undo();
+    virtual size_t MemUsage() const;
+    virtual void Pack();
+    virtual bool Save(BinWriter& out) const;
+    static Cmd_DeleteFrames* Load(Project& proj, BinReader& in);
+    virtual bool Applicable() const;
 private:
     NodePath m_Target;
     int m_Pos;
     int m_NumFrames;
     std::vector<Frame*> m_FrameSwap;
+    std::vector<PackedImg*> m_Packed;
 };
 
 
@@ -119,10 +200,17 @@ public:
     virtual ~Cmd_ToSpriteSheet();
     virtual void Do();
     virtual void Undo();
+    virtual size_t MemUsage() const;
+    virtual void Pack();
+    virtual bool Save(BinWriter& out) const;
+    static Cmd_ToSpriteSheet* Load(Project& proj, BinReader& in);
+    virtual bool Applicable() const;
 private:
+    Cmd_ToSpriteSheet(Project& proj) : Cmd(proj, NOT_DONE) {}
     void Swap();
     NodePath mTarg;
     std::vector<Frame*> mFrameSwap;
+    std::vector<PackedImg*> mPacked;
     SpriteGrid mGridSwap;
 };
 
@@ -133,10 +221,17 @@ public:
     virtual ~Cmd_FromSpriteSheet();
     virtual void Do();
     virtual void Undo();
+    virtual size_t MemUsage() const;
+    virtual void Pack();
+    virtual bool Save(BinWriter& out) const;
+    static Cmd_FromSpriteSheet* Load(Project& proj, BinReader& in);
+    virtual bool Applicable() const;
 private:
+    Cmd_FromSpriteSheet(Project& proj) : Cmd(proj, NOT_DONE) {}
     void Swap();
     NodePath mTarg;
     std::vector<Frame*> mFrameSwap;
+    std::vector<PackedImg*> mPacked;
     SpriteGrid mGridSwap;
 };
 
@@ -151,6 +246,11 @@ public:
     virtual void Do();
     virtual void Undo();
 
+    virtual size_t MemUsage() const;
+    virtual bool Save(BinWriter& out) const;
+    static Cmd_PaletteModify* Load(Project& proj, BinReader& in);
+    virtual bool Applicable() const;
+
     // cheesy RTTI
     virtual Cmd_PaletteModify* ToPaletteModify() { return this; }
 
@@ -172,8 +272,13 @@ public:
     virtual ~Cmd_PaletteReplace();
     virtual void Do();
     virtual void Undo();
+    virtual size_t MemUsage() const;
+    virtual bool Save(BinWriter& out) const;
+    static Cmd_PaletteReplace* Load(Project& proj, BinReader& in);
+    virtual bool Applicable() const;
 
 private:
+    Cmd_PaletteReplace(Project& proj) : Cmd(proj, NOT_DONE), mRanges(0, 0) {}
     void swap();
     NodePath mTarget;
     int mFrame;
@@ -189,6 +294,11 @@ public:
     virtual ~Cmd_Batch();
     virtual void Do();
     virtual void Undo();
+    virtual size_t MemUsage() const;
+    virtual void Pack();
+    virtual bool Save(BinWriter& out) const;
+    static Cmd_Batch* Load(Project& proj, BinReader& in);
+    virtual bool Applicable() const;
 
     // add another command to this batch - must be in same state as overall batch!
     void Append(Cmd* c);
@@ -217,6 +327,10 @@ public:
     Cmd_RangeEdit( Project& proj, NodePath const& target, int frame, Box const& extent, std::vector<bool> const& existData, std::vector<PenColour> const& penData);
     virtual void Do();
     virtual void Undo();
+    virtual size_t MemUsage() const;
+    virtual bool Save(BinWriter& out) const;
+    static Cmd_RangeEdit* Load(Project& proj, BinReader& in);
+    virtual bool Applicable() const;
 private:
     void swap();
     NodePath m_Target;
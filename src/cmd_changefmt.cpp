@@ -1,12 +1,18 @@
 #include "cmd_changefmt.h"
 #include "img_convert.h"
+#include "img_pack.h"
+#include "serialise.h"
 #include "project.h"
 #include "quantise.h"
 
-Cmd_ChangeFmt::Cmd_ChangeFmt(Project& proj, NodePath const& target, PixelFormat newFmt, int nColours) :
+#include <memory>
+
+Cmd_ChangeFmt::Cmd_ChangeFmt(Project& proj, NodePath const& target, PixelFormat newFmt, int nColours,
+    bool refinePalette, DitherMode dither, ProgressFn const& progress) :
     Cmd(proj,NOT_DONE),
     m_Target(target),
-    m_Other(nullptr)
+    m_Other(nullptr),
+    m_Cancelled(false)
 {
     Layer& srcLayer = proj.ResolveLayer(m_Target);
 
@@ -18,10 +24,16 @@ Cmd_ChangeFmt::Cmd_ChangeFmt(Project& proj, NodePath const& target, PixelFormat
     // TODO: handle palette policies.
     if (nColours > 0) {
        assert(!srcLayer.mFrames.empty());
-        // TODO: for global palette, need to take all frames into consideration!!!
-        // TODO: also SPARE_FRAME!!!
+        // Global palette, so take all frames (and the spare) into account.
+        std::vector<Img const*> srcImgs;
+        for (auto frame : srcLayer.mFrames) {
+            srcImgs.push_back(frame->mImg);
+        }
+        if (srcLayer.mSpare) {
+            srcImgs.push_back(srcLayer.mSpare->mImg);
+        }
         std::vector<Colour> quantised;
-        CalculatePalette(*srcLayer.mFrames[0]->mImg, quantised, nColours, &srcLayer.mPalette);
+        CalculatePalette(srcImgs, quantised, nColours, &srcLayer.mPalette, refinePalette);
 
         m_Other->mPalette.SetNumColours(nColours);
         for (int i=0; i<(int)quantised.size(); ++i) {
@@ -33,28 +45,63 @@ Cmd_ChangeFmt::Cmd_ChangeFmt(Project& proj, NodePath const& target, PixelFormat
     }
 
     // populate frameswap with the converted frames
-    // TODO: handle palette policies.
-    Palette const& srcPalette = srcLayer.mPalette;
-    Palette const& destPalette = m_Other->mPalette;
-    for (auto srcFrame : srcLayer.mFrames) {
-        Frame* destFrame = ConvertFrame(srcFrame, newFmt, srcPalette, destPalette);
-        m_Other->mFrames.push_back(destFrame);
-    }
-    // May also have SPARE_FRAME.
-    if (srcLayer.mSpare) {
-        m_Other->mSpare = ConvertFrame(srcLayer.mSpare, newFmt, srcPalette, destPalette);
-    }
+    m_Cancelled = !ConvertLayerFrames(srcLayer, *m_Other, newFmt, progress, dither);
 }
 
 
 Cmd_ChangeFmt::~Cmd_ChangeFmt()
 {
     delete m_Other;
+    for (auto packed : m_Packed) {
+        delete packed;
+    }
+}
+
+size_t Cmd_ChangeFmt::MemUsage() const
+{
+    return sizeof(Cmd_ChangeFmt) + LayerFramesMemUsage(*m_Other, m_Packed);
+}
+
+void Cmd_ChangeFmt::Pack()
+{
+    PackLayerFrames(*m_Other, m_Packed);
+}
+
+bool Cmd_ChangeFmt::Save(BinWriter& out) const
+{
+    SaveHeader(out, CMD_CHANGEFMT);
+    Write(out, m_Target);
+    WriteLayerProps(out, *m_Other);
+    WriteLayerFrames(out, *m_Other, m_Packed);
+    return true;
+}
+
+// for Load()
+Cmd_ChangeFmt::Cmd_ChangeFmt(Project& proj) :
+    Cmd(proj,NOT_DONE),
+    m_Other(new Layer()),
+    m_Cancelled(false)
+{
+}
+
+Cmd_ChangeFmt* Cmd_ChangeFmt::Load(Project& proj, BinReader& in)
+{
+    std::unique_ptr<Cmd_ChangeFmt> c(new Cmd_ChangeFmt(proj));
+    Read(in, c->m_Target);
+    ReadLayerProps(in, *c->m_Other);
+    ReadLayerFrames(in, *c->m_Other, c->m_Packed);
+    return c.release();
+}
+
+bool Cmd_ChangeFmt::Applicable() const
+{
+    return Proj().LookupLayer(m_Target) && !m_Other->mFrames.empty();
 }
 
 
 void Cmd_ChangeFmt::Swap()
 {
+    UnpackLayerFrames(*m_Other, m_Packed);
     Layer& l = Proj().ResolveLayer(m_Target);
     l.Replace(m_Other);
     m_Other = &l;
@@ -73,49 +120,3 @@ void Cmd_ChangeFmt::Undo()
     Swap();
     SetState( NOT_DONE );
 }
-
-
-Frame* Cmd_ChangeFmt::ConvertFrame(Frame const* srcFrame, PixelFormat newFmt,
-    Palette const& srcPalette, Palette const& destPalette) const
-{
-    Img const& srcImg = *srcFrame->mImg;
-    Img* destImg = nullptr;
-    switch (srcImg.Fmt()) {
-    case FMT_I8:
-        if (newFmt == FMT_I8) {
-            destImg = new Img(srcImg);
-            RemapI8(*destImg, srcPalette, destPalette);
-        } else if (newFmt == FMT_RGBX8) {
-            destImg = ConvertI8toRGBX8(srcImg, srcPalette);
-        } else if (newFmt == FMT_RGBA8) {
-            destImg = ConvertI8toRGBA8(srcImg, srcPalette);
-        }
-        break;
-    case FMT_RGBX8:
-        if(newFmt == FMT_I8) {
-            destImg = ConvertRGBX8toI8(srcImg, destPalette);
-        } else if (newFmt == FMT_RGBX8) {
-            destImg = new Img(srcImg);
-            RemapRGBX8(*destImg, destPalette);
-        } else if (newFmt == FMT_RGBA8) {
-            destImg = ConvertRGBX8toRGBA8(srcImg);
-        }
-        break;
-    case FMT_RGBA8:
-        if(newFmt == FMT_I8) {
-            destImg = ConvertRGBA8toI8(srcImg, destPalette);
-        } else if (newFmt == FMT_RGBX8) {
-            destImg = ConvertRGBA8toRGBX8(srcImg);
-        } else if (newFmt == FMT_RGBA8) {
-            destImg = new Img(srcImg);
-            RemapRGBA8(*destImg, destPalette);
-        }
-        break;
-    }
-    assert(destImg);
-
-    Frame* destFrame = new Frame();
-    destFrame->mDuration = srcFrame->mDuration;
-    destFrame->mImg = destImg;
-    return destFrame;
-}
@@ -2,24 +2,38 @@
 #define CMD_CHANGEFMT_H
 
 #include "cmd.h"
+#include "img_convert.h"
+#include "parallel.h"
 
 class Layer;
 
 // Change format of a layer
+// If nColours is set, a new palette is calculated (refinePalette gives
+// a better one, at the cost of some time).
 class Cmd_ChangeFmt : public Cmd
 {
 public:
-    Cmd_ChangeFmt(Project& proj, NodePath const& target, PixelFormat newFmt, int nColours);
+    Cmd_ChangeFmt(Project& proj, NodePath const& target, PixelFormat newFmt, int nColours,
+        bool refinePalette = false, DitherMode dither = DITHER_NONE,
+        ProgressFn const& progress = ProgressFn());
     virtual ~Cmd_ChangeFmt();
+    // true if the conversion was cancelled (via progress), in which case
+    // the cmd should just be deleted.
+    bool Cancelled() const { return m_Cancelled; }
     virtual void Do();
     virtual void Undo();
+    virtual size_t MemUsage() const;
+    virtual void Pack();
+    virtual bool Save(BinWriter& out) const;
+    static Cmd_ChangeFmt* Load(Project& proj, BinReader& in);
+    virtual bool Applicable() const;
 private:
+    Cmd_ChangeFmt(Project& proj);
     void Swap();
     NodePath m_Target;
     Layer* m_Other;
-
-    Frame* ConvertFrame(Frame const* srcFrame, PixelFormat newFmt,
-        Palette const& srcPalette, Palette const& destPalette) const;
+    std::vector<PackedImg*> m_Packed;   // m_Other frames, if packed
+    bool m_Cancelled;
 };
 
 #endif // CMD_CHANGEFMT_H
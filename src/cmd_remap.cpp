@@ -1,12 +1,18 @@
 #include "cmd_remap.h"
 #include "img_convert.h"
+#include "img_pack.h"
+#include "serialise.h"
 #include "project.h"
 //#include "quantise.h"
 
-Cmd_Remap::Cmd_Remap(Project& proj, NodePath const& target, PixelFormat newFmt, Palette const& destPalette) :
+#include <memory>
+
+Cmd_Remap::Cmd_Remap(Project& proj, NodePath const& target, PixelFormat newFmt, Palette const& destPalette,
+    ProgressFn const& progress) :
     Cmd(proj,NOT_DONE),
     m_Target(target),
-    m_Other(nullptr)
+    m_Other(nullptr),
+    m_Cancelled(false)
 {
     Layer& srcLayer = proj.ResolveLayer(m_Target);
 
@@ -19,27 +25,63 @@ Cmd_Remap::Cmd_Remap(Project& proj, NodePath const& target, PixelFormat newFmt,
     m_Other->mRanges.Remap(m_Other->mPalette);
 
     // populate frameswap with the converted frames
-    // TODO: handle palette policies.
-    Palette const& srcPalette = srcLayer.mPalette;
-    for (auto srcFrame : srcLayer.mFrames) {
-        Frame* destFrame = ConvertFrame(srcFrame, newFmt, srcPalette, destPalette);
-        m_Other->mFrames.push_back(destFrame);
-    }
-    // May also have SPARE_FRAME.
-    if (srcLayer.mSpare) {
-        m_Other->mSpare = ConvertFrame(srcLayer.mSpare, newFmt, srcPalette, destPalette);
-    }
+    m_Cancelled = !ConvertLayerFrames(srcLayer, *m_Other, newFmt, progress);
 }
 
 
 Cmd_Remap::~Cmd_Remap()
 {
     delete m_Other;
+    for (auto packed : m_Packed) {
+        delete packed;
+    }
+}
+
+size_t Cmd_Remap::MemUsage() const
+{
+    return sizeof(Cmd_Remap) + LayerFramesMemUsage(*m_Other, m_Packed);
+}
+
+void Cmd_Remap::Pack()
+{
+    PackLayerFrames(*m_Other, m_Packed);
+}
+
+bool Cmd_Remap::Save(BinWriter& out) const
+{
+    SaveHeader(out, CMD_REMAP);
+    Write(out, m_Target);
+    WriteLayerProps(out, *m_Other);
+    WriteLayerFrames(out, *m_Other, m_Packed);
+    return true;
+}
+
+// for Load()
+Cmd_Remap::Cmd_Remap(Project& proj) :
+    Cmd(proj,NOT_DONE),
+    m_Other(new Layer()),
+    m_Cancelled(false)
+{
+}
+
+Cmd_Remap* Cmd_Remap::Load(Project& proj, BinReader& in)
+{
+    std::unique_ptr<Cmd_Remap> c(new Cmd_Remap(proj));
+    Read(in, c->m_Target);
+    ReadLayerProps(in, *c->m_Other);
+    ReadLayerFrames(in, *c->m_Other, c->m_Packed);
+    return c.release();
+}
+
+bool Cmd_Remap::Applicable() const
+{
+    return Proj().LookupLayer(m_Target) && !m_Other->mFrames.empty();
 }
 
 
 void Cmd_Remap::Swap()
 {
+    UnpackLayerFrames(*m_Other, m_Packed);
     Layer& l = Proj().ResolveLayer(m_Target);
     l.Replace(m_Other);
     m_Other = &l;
@@ -59,49 +101,3 @@ void Cmd_Remap::Undo()
     Swap();
     SetState( NOT_DONE );
 }
-
-
-Frame* Cmd_Remap::ConvertFrame(Frame const* srcFrame, PixelFormat newFmt,
-    Palette const& srcPalette, Palette const& destPalette) const
-{
-    Img const& srcImg = *srcFrame->mImg;
-    Img* destImg = nullptr;
-    switch (srcImg.Fmt()) {
-    case FMT_I8:
-        if (newFmt == FMT_I8) {
-            destImg = new Img(srcImg);
-            RemapI8(*destImg, srcPalette, destPalette);
-        } else if (newFmt == FMT_RGBX8) {
-            destImg = ConvertI8toRGBX8(srcImg, srcPalette);
-        } else if (newFmt == FMT_RGBA8) {
-            destImg = ConvertI8toRGBA8(srcImg, srcPalette);
-        }
-        break;
-    case FMT_RGBX8:
-        if(newFmt == FMT_I8) {
-            destImg = ConvertRGBX8toI8(srcImg, destPalette);
-        } else if (newFmt == FMT_RGBX8) {
-            destImg = new Img(srcImg);
-            RemapRGBX8(*destImg, destPalette);
-        } else if (newFmt == FMT_RGBA8) {
-            destImg = ConvertRGBX8toRGBA8(srcImg);
-        }
-        break;
-    case FMT_RGBA8:
-        if(newFmt == FMT_I8) {
-            destImg = ConvertRGBA8toI8(srcImg, destPalette);
-        } else if (newFmt == FMT_RGBX8) {
-            destImg = ConvertRGBA8toRGBX8(srcImg);
-        } else if (newFmt == FMT_RGBA8) {
-            destImg = new Img(srcImg);
-            RemapRGBA8(*destImg, destPalette);
-        }
-        break;
-    }
-    assert(destImg);
-
-    Frame* destFrame = new Frame();
-    destFrame->mDuration = srcFrame->mDuration;
-    destFrame->mImg = destImg;
-    return destFrame;
-}
@@ -2,6 +2,7 @@
 #define CMD_REMAP_H
 
 #include "cmd.h"
+#include "parallel.h"
 
 class Layer;
 
@@ -9,17 +10,26 @@ class Layer;
 class Cmd_Remap : public Cmd
 {
 public:
-    Cmd_Remap(Project& proj, NodePath const& target, PixelFormat newFmt, Palette const& destPalette);
+    Cmd_Remap(Project& proj, NodePath const& target, PixelFormat newFmt, Palette const& destPalette,
+        ProgressFn const& progress = ProgressFn());
     virtual ~Cmd_Remap();
+    // true if the conversion was cancelled (via progress), in which case
+    // the cmd should just be deleted.
+    bool Cancelled() const { return m_Cancelled; }
     virtual void Do();
     virtual void Undo();
+    virtual size_t MemUsage() const;
+    virtual void Pack();
+    virtual bool Save(BinWriter& out) const;
+    static Cmd_Remap* Load(Project& proj, BinReader& in);
+    virtual bool Applicable() const;
 private:
+    Cmd_Remap(Project& proj);
     void Swap();
     NodePath m_Target;
     Layer* m_Other;
-
-    Frame* ConvertFrame(Frame const* srcFrame, PixelFormat newFmt,
-        Palette const& srcPalette, Palette const& destPalette) const;
+    std::vector<PackedImg*> m_Packed;   // m_Other frames, if packed
+    bool m_Cancelled;
 };
 
 #endif // CMD_CHANGEFMT_H
@@ -0,0 +1,82 @@
+#include "colour_map.h"
+
+#include <algorithm>
+
+// Open addressing, linear probing. Kept at most half full.
+
+static const size_t initialSize = 1024;
+
+ColourMap::ColourMap() :
+    m_Keys(initialSize),
+    m_Values(initialSize),
+    m_Used(initialSize, 0),
+    m_Count(0),
+    m_Mask(initialSize - 1)
+{
+}
+
+// First slot to look in for key.
+inline size_t ColourMap::Slot(uint32_t key) const
+{
+    return (size_t)((key * 2654435761u) ^ (key >> 15)) & m_Mask;
+}
+
+int& ColourMap::Get(uint32_t key, int init)
+{
+    size_t i = Slot(key);
+    while (m_Used[i]) {
+        if (m_Keys[i] == key) {
+            return m_Values[i];
+        }
+        i = (i + 1) & m_Mask;
+    }
+    if ((m_Count + 1) * 2 > m_Keys.size()) {
+        Grow();
+        return Get(key, init);
+    }
+    m_Used[i] = 1;
+    m_Keys[i] = key;
+    m_Values[i] = init;
+    ++m_Count;
+    return m_Values[i];
+}
+
+int const* ColourMap::Find(uint32_t key) const
+{
+    size_t i = Slot(key);
+    while (m_Used[i]) {
+        if (m_Keys[i] == key) {
+            return &m_Values[i];
+        }
+        i = (i + 1) & m_Mask;
+    }
+    return nullptr;
+}
+
+int* ColourMap::Find(uint32_t key)
+{
+    return const_cast<int*>(static_cast<ColourMap const*>(this)->Find(key));
+}
+
+void ColourMap::Clear()
+{
+    std::fill(m_Used.begin(), m_Used.end(), 0);
+    m_Count = 0;
+}
+
+void ColourMap::Grow()
+{
+    std::vector<uint32_t> keys(m_Keys.size() * 2);
+    std::vector<int> values(keys.size());
+    std::vector<uint8_t> used(keys.size(), 0);
+    keys.swap(m_Keys);
+    values.swap(m_Values);
+    used.swap(m_Used);
+    m_Mask = m_Keys.size() - 1;
+    m_Count = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (used[i]) {
+            Get(keys[i], values[i]);
+        }
+    }
+}
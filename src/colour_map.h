@@ -0,0 +1,48 @@
+#ifndef COLOUR_MAP_H
+#define COLOUR_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hash map from raw 32bit pixel values to ints, for building per-colour
+// tables (eg remap results, histograms).
+// Images tend to have far fewer distinct colours than pixels, so this
+// lets per-colour work be done just once per colour.
+class ColourMap
+{
+public:
+    ColourMap();
+
+    // Returns the value for key, adding it (with value init) if it's new.
+    int& Get(uint32_t key, int init = 0);
+    // Returns null if key isn't in the map.
+    int* Find(uint32_t key);
+    int const* Find(uint32_t key) const;
+
+    size_t Size() const { return m_Count; }
+    void Clear();
+
+    // Call fn(key, value) for every entry (value is a reference, so can
+    // be changed).
+    template<typename FN> void ForEach(FN fn)
+    {
+        for (size_t i = 0; i < m_Keys.size(); ++i) {
+            if (m_Used[i]) {
+                fn(m_Keys[i], m_Values[i]);
+            }
+        }
+    }
+
+private:
+    size_t Slot(uint32_t key) const;
+    void Grow();
+
+    std::vector<uint32_t> m_Keys;
+    std::vector<int> m_Values;
+    std::vector<uint8_t> m_Used;
+    size_t m_Count;
+    size_t m_Mask;
+};
+
+#endif // COLOUR_MAP_H
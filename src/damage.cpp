@@ -0,0 +1,87 @@
+#include "damage.h"
+
+#include <algorithm>
+#include <limits>
+
+static long area(Box const& b)
+{
+    return (long)b.w * (long)b.h;
+}
+
+static Box merged(Box a, Box const& b)
+{
+    a.Merge(b);
+    return a;
+}
+
+// How much undamaged area merging a and b would add.
+// Overlaps are counted twice, which just makes merging them more
+// attractive.
+static long waste(Box const& a, Box const& b)
+{
+    return area(merged(a, b)) - area(a) - area(b);
+}
+
+void DamageRegion::Add(Box const& box)
+{
+    if (box.Empty()) {
+        return;
+    }
+    Box b(box);
+    // merge with anything close, repeating until b stops growing
+    bool grown = true;
+    while (grown) {
+        grown = false;
+        for (size_t i = 0; i < m_Rects.size(); ++i) {
+            Box const& r = m_Rects[i];
+            if (r.Contains(b)) {
+                return;
+            }
+            // allow a little slack, so strokes of small boxes join up
+            if (waste(r, b) <= std::max(area(r), area(b)) / 2) {
+                b.Merge(r);
+                m_Rects.erase(m_Rects.begin() + i);
+                grown = true;
+                break;
+            }
+        }
+    }
+    m_Rects.push_back(b);
+
+    // too many? merge the cheapest pair.
+    while ((int)m_Rects.size() > MaxRects) {
+        size_t bestI = 0;
+        size_t bestJ = 1;
+        long best = std::numeric_limits<long>::max();
+        for (size_t i = 0; i < m_Rects.size(); ++i) {
+            for (size_t j = i + 1; j < m_Rects.size(); ++j) {
+                long w = waste(m_Rects[i], m_Rects[j]);
+                if (w < best) {
+                    best = w;
+                    bestI = i;
+                    bestJ = j;
+                }
+            }
+        }
+        m_Rects[bestI].Merge(m_Rects[bestJ]);
+        m_Rects.erase(m_Rects.begin() + bestJ);
+    }
+}
+
+Box DamageRegion::Bounds() const
+{
+    Box b(0, 0, 0, 0);
+    for (auto const& r : m_Rects) {
+        b.Merge(r);
+    }
+    return b;
+}
+
+long DamageRegion::Area() const
+{
+    long total = 0;
+    for (auto const& r : m_Rects) {
+        total += area(r);
+    }
+    return total;
+}
@@ -0,0 +1,33 @@
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+#include "box.h"
+
+#include <vector>
+
+// Accumulates damaged areas as a small set of rectangles.
+// Overlapping boxes are merged, as are nearby ones if the merged box doesn't
+// cover too much undamaged area. Past MaxRects, the closest pair is merged
+// regardless, so the cost of redrawing stays bounded no matter how many
+// boxes are added.
+class DamageRegion
+{
+public:
+    static const int MaxRects = 16;
+
+    void Add(Box const& b);
+    void Clear() { m_Rects.clear(); }
+    bool Empty() const { return m_Rects.empty(); }
+
+    // the rectangles making up the region (they may overlap)
+    std::vector<Box> const& Rects() const { return m_Rects; }
+    // a box enclosing the whole region
+    Box Bounds() const;
+    // total area of the rects (for stats)
+    long Area() const;
+
+private:
+    std::vector<Box> m_Rects;
+};
+
+#endif // DAMAGE_H
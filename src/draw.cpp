@@ -1,219 +1,486 @@
 #include "draw.h"
+#include "blit_simd.h"
+#include "box.h"
 #include "img.h"
 #include "palette.h"
 
 #include <algorithm>    // for min,max
+#include <cstdlib>
+#include <type_traits>
 #include <vector>
 
-static void FloodFill_I8( Img& img, Point const& start, I8 newcolour, Box& damage );
-static void FloodFill_RGBX8( Img& img, Point const& start, RGBX8 newcolour, Box& damage );
-static void FloodFill_RGBA8( Img& img, Point const& start, RGBA8 newcolour, Box& damage );
-
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#define FILL_SSE2
+#include <emmintrin.h>
+#endif
 
 
 //--------------------
+// Flood fill
 //
+// Scanline fill, working with spans rather than pixels: each entry on the
+// stack is a span of row y-dy which has just been filled, meaning row y
+// needs checking underneath it (dy is the direction we're travelling in).
+// Runs found on row y are filled, and pushed to carry on in the same
+// direction. Where a run pokes out past the ends of its parent span, the
+// overhanging bit is pushed back the other way too (to go round corners).
+// Filled pixels no longer match, so they're never visited again (if the
+// new colour would match, a mask of the matching pixels is filled instead).
+
+namespace {
+
+struct FillSpan {
+    int y;
+    int x1, x2;
+    int dy;
+};
+
+// Matches the colour being filled over.
+// (32bit pixels are compared as raw values - RGBX8 ignoring the pad byte).
+template<typename P> struct ExactMatch {
+    uint32_t mask;
+    uint32_t key;
+    explicit ExactMatch(P old) :
+        mask(std::is_same<P, RGBX8>::value ? 0x00ffffff : 0xffffffff),
+        key(RawPixel(old) & mask)
+        {}
+    bool operator()(P c) const { return (RawPixel(c) & mask) == key; }
+};
+template<> struct ExactMatch<I8> {
+    I8 old;
+    explicit ExactMatch(I8 old) : old(old) {}
+    bool operator()(I8 c) const { return c == old; }
+};
+
+// Matches colours within tolerance of the one being filled over, in every
+// channel.
+template<typename P> struct ToleranceMatch {
+    uint32_t mask;
+    uint32_t key;
+    int tolerance;
+    ToleranceMatch(P old, int tolerance) :
+        mask(std::is_same<P, RGBX8>::value ? 0x00ffffff : 0xffffffff),
+        key(RawPixel(old) & mask),
+        tolerance(std::min(std::max(tolerance, 0), 255))
+        {}
+    bool operator()(P c) const {
+        uint32_t v = RawPixel(c) & mask;
+        for (int shift = 0; shift < 32; shift += 8) {
+            int d = (int)((v >> shift) & 0xff) - (int)((key >> shift) & 0xff);
+            if (d > tolerance || d < -tolerance) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
 
+// Matches palette indices, via a table.
+struct IndexMatch {
+    bool table[256];
+    bool operator()(I8 c) const { return table[c]; }
+};
 
-void FloodFill( Img& img, Point const& start, PenColour const& newcolour, Box& damage )
+}   // namespace
+
+static inline bool closeEnough(Colour const& a, Colour const& b, int tolerance)
 {
-    switch(img.Fmt())
-    {
-        case FMT_I8:
-            FloodFill_I8(img,start,newcolour.idx(),damage);
-            break;
-        case FMT_RGBX8:
-            FloodFill_RGBX8(img,start,newcolour.rgb(),damage);
-            break;
-        case FMT_RGBA8:
-            FloodFill_RGBA8(img,start,newcolour.rgb(),damage);
-            break;
-        default:
-            assert(false);
-            break;
-    }
+    return std::abs(a.r - b.r) <= tolerance && std::abs(a.g - b.g) <= tolerance &&
+        std::abs(a.b - b.b) <= tolerance && std::abs(a.a - b.a) <= tolerance;
 }
 
-
-static void FloodFill_I8( Img& img, Point const& start, I8 newcolour, Box& damage )
+// Match indices whose palette colours are within tolerance of old's.
+static IndexMatch indexMatch(I8 old, int tolerance, Palette const* palette)
 {
-    assert(img.Fmt()==FMT_I8);
+    IndexMatch match;
+    for (int i = 0; i < 256; ++i) {
+        match.table[i] = (i == old);
+    }
+    if (palette && tolerance > 0) {
+        Colour oldColour = palette->GetColour(old);
+        for (int i = 0; i < palette->NumColours() && i < 256; ++i) {
+            match.table[i] = match.table[i] || closeEnough(palette->GetColour(i), oldColour, tolerance);
+        }
+    }
+    return match;
+}
 
-    damage.SetEmpty();
-    I8 oldcolour = img.Get_I8(start);
-    if( oldcolour == newcolour )
-        return;
 
-    std::vector< Point > q;
-    q.push_back( start );
-    while( !q.empty() )
-    {
-        Point pt = q.back();
-        q.pop_back();
-        if( img.Get_I8(pt) != oldcolour )
-            continue;
+// Fill matching pixels from x onward, stopping at the first one which
+// doesn't match. Returns the end of the run (exclusive).
+template<typename P, typename MATCH>
+static inline int fillRight(P* row, int x, int w, MATCH const& match, P newcolour)
+{
+    while (x < w && match(row[x])) {
+        row[x++] = newcolour;
+    }
+    return x;
+}
 
-        // scan left and right to find span
-        int y = pt.y;
-        int l = pt.x;
-        while( l>0 && img.Get_I8( Point(l-1,y)) == oldcolour )
-            --l;
-        int r = pt.x;
-        while( r<img.W()-1 && img.Get_I8( Point(r+1,y)) == oldcolour )
-            ++r;
-
-        // fill the span
-        I8* dest = img.Ptr_I8( l,y );
-        int x;
-        for( x=l; x<=r; ++x )
-            *dest++ = newcolour;
-        // expand the damage box to include the affected span
-        damage.Merge( Box( l,y, (r+1)-l,1) );
-        // add pixels above the span to the queue 
-        y = pt.y-1;
-        if( y>=0 )
-        {
-            for(x=l; x<=r; ++x)
-            {
-                if( img.Get_I8(Point(x,y)) == oldcolour )
-                    q.push_back( Point(x,y) );
-            }
-        }
+// Returns the first matching pixel at or after x (or w if none).
+template<typename P, typename MATCH>
+static inline int findMatch(P const* row, int x, int w, MATCH const& match)
+{
+    while (x < w && !match(row[x])) {
+        ++x;
+    }
+    return x;
+}
 
-        // add pixels below the span to the queue
-        y = pt.y+1;
-        if( y<img.H() )
-        {
-            for(x=l; x<=r; ++x)
-            {
-                if( img.Get_I8(Point(x,y)) == oldcolour )
-                    q.push_back( Point(x,y) );
-            }
+// Replace all the matching pixels from x onward.
+// Returns the end of the last one replaced (exclusive), or x if none were.
+template<typename P, typename MATCH>
+static inline int replaceRight(P* row, int x, int w, MATCH const& match, P newcolour)
+{
+    int end = x;
+    for (; x < w; ++x) {
+        if (match(row[x])) {
+            row[x] = newcolour;
+            end = x + 1;
         }
     }
+    return end;
 }
 
+#ifdef FILL_SSE2
+// The common cases, done a block at a time.
 
+// Which 32bit lanes of v match (all ones if so, else zero).
+template<typename P> static inline __m128i matchLanes(__m128i v, ExactMatch<P> const& match)
+{
+    v = _mm_and_si128(v, _mm_set1_epi32((int)match.mask));
+    return _mm_cmpeq_epi32(v, _mm_set1_epi32((int)match.key));
+}
+template<typename P> static inline __m128i matchLanes(__m128i v, ToleranceMatch<P> const& match)
+{
+    const __m128i key = _mm_set1_epi32((int)match.key);
+    v = _mm_and_si128(v, _mm_set1_epi32((int)match.mask));
+    __m128i diff = _mm_or_si128(_mm_subs_epu8(v, key), _mm_subs_epu8(key, v));
+    __m128i over = _mm_subs_epu8(diff, _mm_set1_epi8((char)match.tolerance));
+    return _mm_cmpeq_epi32(over, _mm_setzero_si128());
+}
+static inline __m128i matchLanes(__m128i v, ExactMatch<I8> const& match)
+{
+    return _mm_cmpeq_epi8(v, _mm_set1_epi8((char)match.old));
+}
 
-static void FloodFill_RGBX8( Img& img, Point const& start, RGBX8 newcolour, Box& damage )
+// Block size, in pixels.
+template<typename P> constexpr int simdPixels() { return 16 / (int)sizeof(P); }
+
+template<typename P, typename MATCH>
+static inline int fillRightSSE2(P* row, int x, int w, MATCH const& match, P newcolour)
 {
-    assert(img.Fmt()==FMT_RGBX8);
+    const int n = simdPixels<P>();
+    P fill[n];
+    std::fill(fill, fill + n, newcolour);
+    const __m128i vfill = _mm_loadu_si128((__m128i const*)fill);
+    while (x + n <= w) {
+        __m128i v = _mm_loadu_si128((__m128i const*)(row + x));
+        if (_mm_movemask_epi8(matchLanes(v, match)) != 0xffff) {
+            break;
+        }
+        _mm_storeu_si128((__m128i*)(row + x), vfill);
+        x += n;
+    }
+    while (x < w && match(row[x])) {
+        row[x++] = newcolour;
+    }
+    return x;
+}
 
-    damage.SetEmpty();
-    RGBX8 oldcolour = img.Get_RGBX8(start);
-    if( oldcolour == newcolour )
-        return;
+template<typename P, typename MATCH>
+static inline int findMatchSSE2(P const* row, int x, int w, MATCH const& match)
+{
+    const int n = simdPixels<P>();
+    while (x + n <= w) {
+        __m128i v = _mm_loadu_si128((__m128i const*)(row + x));
+        if (_mm_movemask_epi8(matchLanes(v, match)) != 0) {
+            break;
+        }
+        x += n;
+    }
+    while (x < w && !match(row[x])) {
+        ++x;
+    }
+    return x;
+}
 
-    std::vector< Point > q;
-    q.push_back( start );
-    while( !q.empty() )
-    {
-        Point pt = q.back();
-        q.pop_back();
-        if( img.Get_RGBX8(pt) != oldcolour )
-            continue;
+template<typename P, typename MATCH>
+static inline int replaceRightSSE2(P* row, int x, int w, MATCH const& match, P newcolour)
+{
+    const int n = simdPixels<P>();
+    P fill[n];
+    std::fill(fill, fill + n, newcolour);
+    const __m128i vfill = _mm_loadu_si128((__m128i const*)fill);
+    int end = x;
+    while (x + n <= w) {
+        __m128i v = _mm_loadu_si128((__m128i const*)(row + x));
+        __m128i hit = matchLanes(v, match);
+        int bits = _mm_movemask_epi8(hit);
+        if (bits != 0) {
+            v = _mm_or_si128(_mm_and_si128(hit, vfill), _mm_andnot_si128(hit, v));
+            _mm_storeu_si128((__m128i*)(row + x), v);
+            // find the last pixel replaced
+            int i = n - 1;
+            while (!(bits & (1 << (i * (int)sizeof(P))))) {
+                --i;
+            }
+            end = x + i + 1;
+        }
+        x += n;
+    }
+    for (; x < w; ++x) {
+        if (match(row[x])) {
+            row[x] = newcolour;
+            end = x + 1;
+        }
+    }
+    return end;
+}
 
-        // scan left and right to find span
-        int y = pt.y;
-        int l = pt.x;
-        while( l>0 && img.Get_RGBX8( Point(l-1,y)) == oldcolour )
+static inline int fillRight(RGBX8* row, int x, int w, ExactMatch<RGBX8> const& match, RGBX8 newcolour)
+    { return fillRightSSE2(row, x, w, match, newcolour); }
+static inline int fillRight(RGBA8* row, int x, int w, ExactMatch<RGBA8> const& match, RGBA8 newcolour)
+    { return fillRightSSE2(row, x, w, match, newcolour); }
+static inline int fillRight(I8* row, int x, int w, ExactMatch<I8> const& match, I8 newcolour)
+    { return fillRightSSE2(row, x, w, match, newcolour); }
+static inline int fillRight(RGBX8* row, int x, int w, ToleranceMatch<RGBX8> const& match, RGBX8 newcolour)
+    { return fillRightSSE2(row, x, w, match, newcolour); }
+static inline int fillRight(RGBA8* row, int x, int w, ToleranceMatch<RGBA8> const& match, RGBA8 newcolour)
+    { return fillRightSSE2(row, x, w, match, newcolour); }
+
+static inline int findMatch(I8 const* row, int x, int w, ExactMatch<I8> const& match)
+    { return findMatchSSE2(row, x, w, match); }
+static inline int findMatch(RGBX8 const* row, int x, int w, ToleranceMatch<RGBX8> const& match)
+    { return findMatchSSE2(row, x, w, match); }
+static inline int findMatch(RGBA8 const* row, int x, int w, ToleranceMatch<RGBA8> const& match)
+    { return findMatchSSE2(row, x, w, match); }
+
+static inline int replaceRight(I8* row, int x, int w, ExactMatch<I8> const& match, I8 newcolour)
+    { return replaceRightSSE2(row, x, w, match, newcolour); }
+static inline int replaceRight(RGBX8* row, int x, int w, ToleranceMatch<RGBX8> const& match, RGBX8 newcolour)
+    { return replaceRightSSE2(row, x, w, match, newcolour); }
+static inline int replaceRight(RGBA8* row, int x, int w, ToleranceMatch<RGBA8> const& match, RGBA8 newcolour)
+    { return replaceRightSSE2(row, x, w, match, newcolour); }
+#endif // FILL_SSE2
+
+
+template<typename P, typename MATCH>
+static void floodFill(Img& img, Point const& start, P newcolour, MATCH const& match, Box& damage)
+{
+    const int w = img.W();
+    const int h = img.H();
+    int minX = start.x;
+    int maxX = start.x;
+    int minY = start.y;
+    int maxY = start.y;
+    std::vector<FillSpan> stack;
+
+    // Fill the run of matching pixels containing x on row y (row[x] must
+    // match). Sets l and r to the ends of the run, and returns the (now
+    // writable) row.
+    auto fillRun = [&](int y, int x, int& l, int& r) -> P const* {
+        P* row = (P*)img.Ptr(0, y);
+        l = x;
+        while (l > 0 && match(row[l - 1])) {
             --l;
-        int r = pt.x;
-        while( r<img.W()-1 && img.Get_RGBX8( Point(r+1,y)) == oldcolour )
-            ++r;
-
-        // fill the span
-        RGBX8* dest = img.Ptr_RGBX8( l,y );
-        int x;
-        for( x=l; x<=r; ++x )
-            *dest++ = newcolour;
-        // expand the damage box to include the affected span
-        damage.Merge( Box( l,y, (r+1)-l,1) );
-        // add pixels above the span to the queue 
-        y = pt.y-1;
-        if( y>=0 )
-        {
-            for(x=l; x<=r; ++x)
-            {
-                if( img.Get_RGBX8(Point(x,y)) == oldcolour )
-                    q.push_back( Point(x,y) );
+        }
+        std::fill(row + l, row + x, newcolour);
+        r = fillRight(row, x, w, match, newcolour) - 1;
+        minX = std::min(minX, l);
+        maxX = std::max(maxX, r);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        return row;
+    };
+    auto push = [&](int y, int x1, int x2, int dy) {
+        if (y >= 0 && y < h) {
+            FillSpan span = {y, x1, x2, dy};
+            stack.push_back(span);
+        }
+    };
+
+    int l;
+    int r;
+    fillRun(start.y, start.x, l, r);
+    push(start.y - 1, l, r, -1);
+    push(start.y + 1, l, r, 1);
+
+    while (!stack.empty()) {
+        FillSpan span = stack.back();
+        stack.pop_back();
+        const int y = span.y;
+        // (only made writable if there's something to fill)
+        P const* row = (P const*)img.PtrConst(0, y);
+        int x = span.x1;
+        while (x <= span.x2) {
+            while (x <= span.x2 && !match(row[x])) {
+                ++x;
+            }
+            if (x > span.x2) {
+                break;
+            }
+            row = fillRun(y, x, l, r);
+            push(y + span.dy, l, r, span.dy);
+            // leaks round the ends of the parent span
+            if (l < span.x1) {
+                push(y - span.dy, l, span.x1 - 1, -span.dy);
             }
+            if (r > span.x2) {
+                push(y - span.dy, span.x2 + 1, r, -span.dy);
+            }
+            x = r + 2;  // (r+1 doesn't match)
         }
+    }
+    damage = Box(minX, minY, (maxX + 1) - minX, (maxY + 1) - minY);
+}
 
-        // add pixels below the span to the queue
-        y = pt.y+1;
-        if( y<img.H() )
-        {
-            for(x=l; x<=r; ++x)
-            {
-                if( img.Get_RGBX8(Point(x,y)) == oldcolour )
-                    q.push_back( Point(x,y) );
+// Fill for inexact matches. If the new colour matches too, the filled
+// pixels would be visited over and over, so fill a mask of the matching
+// pixels instead, then apply it.
+template<typename P, typename MATCH>
+static void toleranceFill(Img& img, Point const& start, P newcolour, MATCH const& match, Box& damage)
+{
+    if (!match(newcolour)) {
+        floodFill<P>(img, start, newcolour, match, damage);
+        return;
+    }
+    Img mask(FMT_I8, img.W(), img.H());
+    for (int y = 0; y < img.H(); ++y) {
+        P const* src = (P const*)img.PtrConst(0, y);
+        I8* m = mask.Ptr_I8(0, y);
+        for (int x = 0; x < img.W(); ++x) {
+            m[x] = match(src[x]) ? 1 : 0;
+        }
+    }
+    floodFill<I8>(mask, start, (I8)2, ExactMatch<I8>(1), damage);
+    for (int y = damage.YMin(); y <= damage.YMax(); ++y) {
+        I8 const* m = mask.PtrConst_I8(0, y);
+        P* row = (P*)img.Ptr(0, y);
+        for (int x = damage.XMin(); x <= damage.XMax(); ++x) {
+            if (m[x] == 2) {
+                row[x] = newcolour;
             }
         }
     }
 }
 
-// TODO: should fill across differing alpha value?
-static void FloodFill_RGBA8( Img& img, Point const& start, RGBA8 newcolour, Box& damage )
+// Replace every matching pixel in the image.
+template<typename P, typename MATCH>
+static void replaceAll(Img& img, P newcolour, MATCH const& match, Box& damage)
 {
-    assert(img.Fmt()==FMT_RGBA8);
+    const int w = img.W();
+    int minX = w;
+    int maxX = -1;
+    int minY = img.H();
+    int maxY = -1;
+    for (int y = 0; y < img.H(); ++y) {
+        int first = findMatch((P const*)img.PtrConst(0, y), 0, w, match);
+        if (first >= w) {
+            continue;
+        }
+        // (only rows with something to replace are made writable)
+        int end = replaceRight((P*)img.Ptr(0, y), first, w, match, newcolour);
+        minX = std::min(minX, first);
+        maxX = std::max(maxX, end - 1);
+        minY = std::min(minY, y);
+        maxY = y;
+    }
+    if (maxY >= 0) {
+        damage = Box(minX, minY, (maxX + 1) - minX, (maxY + 1) - minY);
+    }
+}
 
+
+void FloodFill(Img& img, Point const& start, PenColour const& newcolour, Box& damage,
+    int tolerance, Palette const* palette)
+{
     damage.SetEmpty();
-    RGBA8 oldcolour = img.Get_RGBA8(start);
-    if( oldcolour == newcolour )
+    if (!img.Bounds().Contains(start)) {
         return;
-
-    std::vector< Point > q;
-    q.push_back( start );
-    while( !q.empty() )
+    }
+    switch(img.Fmt())
     {
-        Point pt = q.back();
-        q.pop_back();
-        if( img.Get_RGBA8(pt) != oldcolour )
-            continue;
-
-        // scan left and right to find span
-        int y = pt.y;
-        int l = pt.x;
-        while( l>0 && img.Get_RGBA8( Point(l-1,y)) == oldcolour )
-            --l;
-        int r = pt.x;
-        while( r<img.W()-1 && img.Get_RGBA8( Point(r+1,y)) == oldcolour )
-            ++r;
-
-        // fill the span
-        RGBA8* dest = img.Ptr_RGBA8( l,y );
-        int x;
-        for( x=l; x<=r; ++x )
-            *dest++ = newcolour;
-        // expand the damage box to include the affected span
-        damage.Merge( Box( l,y, (r+1)-l,1) );
-        // add pixels above the span to the queue 
-        y = pt.y-1;
-        if( y>=0 )
-        {
-            for(x=l; x<=r; ++x)
+        case FMT_I8:
             {
-                if( img.Get_RGBA8(Point(x,y)) == oldcolour )
-                    q.push_back( Point(x,y) );
+                I8 old = img.Get_I8(start);
+                if (tolerance == 0) {
+                    ExactMatch<I8> match(old);
+                    if (!match(newcolour.idx())) {
+                        floodFill<I8>(img, start, newcolour.idx(), match, damage);
+                    }
+                } else {
+                    toleranceFill<I8>(img, start, newcolour.idx(), indexMatch(old, tolerance, palette), damage);
+                }
             }
-        }
-
-        // add pixels below the span to the queue
-        y = pt.y+1;
-        if( y<img.H() )
-        {
-            for(x=l; x<=r; ++x)
+            break;
+        case FMT_RGBX8:
             {
-                if( img.Get_RGBA8(Point(x,y)) == oldcolour )
-                    q.push_back( Point(x,y) );
+                RGBX8 old = img.Get_RGBX8(start);
+                if (tolerance == 0) {
+                    ExactMatch<RGBX8> match(old);
+                    if (!match(newcolour.toRGBX8())) {
+                        floodFill<RGBX8>(img, start, newcolour.toRGBX8(), match, damage);
+                    }
+                } else {
+                    toleranceFill<RGBX8>(img, start, newcolour.toRGBX8(), ToleranceMatch<RGBX8>(old, tolerance), damage);
+                }
             }
-        }
+            break;
+        // TODO: should fill across differing alpha value?
+        case FMT_RGBA8:
+            {
+                RGBA8 old = img.Get_RGBA8(start);
+                if (tolerance == 0) {
+                    ExactMatch<RGBA8> match(old);
+                    if (!match(newcolour.toRGBA8())) {
+                        floodFill<RGBA8>(img, start, newcolour.toRGBA8(), match, damage);
+                    }
+                } else {
+                    toleranceFill<RGBA8>(img, start, newcolour.toRGBA8(), ToleranceMatch<RGBA8>(old, tolerance), damage);
+                }
+            }
+            break;
+        default:
+            assert(false);
+            break;
     }
 }
 
 
-
+void ReplaceColour(Img& img, PenColour const& oldcolour, PenColour const& newcolour, Box& damage,
+    int tolerance, Palette const* palette)
+{
+    damage.SetEmpty();
+    switch(img.Fmt())
+    {
+        case FMT_I8:
+            {
+                I8 old = (I8)oldcolour.idx();
+                if (tolerance == 0) {
+                    if (old != newcolour.idx()) {
+                        replaceAll<I8>(img, newcolour.idx(), ExactMatch<I8>(old), damage);
+                    }
+                } else {
+                    replaceAll<I8>(img, newcolour.idx(), indexMatch(old, tolerance, palette), damage);
+                }
+            }
+            break;
+        case FMT_RGBX8:
+            if (tolerance > 0 || oldcolour.toRGBX8() != newcolour.toRGBX8()) {
+                replaceAll<RGBX8>(img, newcolour.toRGBX8(), ToleranceMatch<RGBX8>(oldcolour.toRGBX8(), tolerance), damage);
+            }
+            break;
+        case FMT_RGBA8:
+            if (tolerance > 0 || oldcolour.toRGBA8() != newcolour.toRGBA8()) {
+                replaceAll<RGBA8>(img, newcolour.toRGBA8(), ToleranceMatch<RGBA8>(oldcolour.toRGBA8(), tolerance), damage);
+            }
+            break;
+        default:
+            assert(false);
+            break;
+    }
+}
 
 
 
@@ -11,7 +11,17 @@ struct Palette;
 // Drawing fns
 
 // sets damage to bounding rect for affected area
-void FloodFill( Img& img, Point const& start, PenColour const& newcolour, Box& damage );
+// tolerance is the biggest difference allowed in any channel for a pixel to
+// count as the same colour as the one at start (0 means an exact match).
+// For FMT_I8, palette colours are compared, so palette is needed if there's
+// a tolerance.
+void FloodFill( Img& img, Point const& start, PenColour const& newcolour, Box& damage,
+    int tolerance = 0, Palette const* palette = nullptr );
+
+// Like FloodFill, but replaces oldcolour everywhere in the image rather
+// than just the contiguous area.
+void ReplaceColour( Img& img, PenColour const& oldcolour, PenColour const& newcolour, Box& damage,
+    int tolerance = 0, Palette const* palette = nullptr );
 
 //
 void RectFill(Img& destimg, Box& destbox, PenColour const& pen );
@@ -4,11 +4,19 @@
 #include "brush.h"
 #include "project.h"
 #include "app.h"
+#include "autosave.h"
 #include "cmd.h"
+#include "exception.h"
+#include "undo_journal.h"
 
 #include <cassert>
 #include <stdint.h>
 #include <cstdio>
+#include <iterator>
+
+// Number of cmds at the top of the undo and redo stacks which are left
+// uncompressed, so stepping through recent changes stays fast.
+static const int NUM_UNPACKED_CMDS = 4;
 
 
 Editor::Editor(Project* proj) :
@@ -17,7 +25,11 @@ Editor::Editor(Project* proj) :
     m_Mode(DrawMode::DM_NORMAL),
     m_Brush(0),
     m_GridActive(false),
-    m_CurrRange(0,0,0,0)
+    m_CurrRange(0,0,0,0),
+    m_UndoBytes(0),
+    m_UndoMemLimit(256*1024*1024),
+    m_UndoJournal(nullptr),
+    m_Autosave(nullptr)
 {
     m_Tool = new PencilTool(*this);
     m_Project->AddListener(this);
@@ -36,6 +48,8 @@ Editor::~Editor()
 {
     m_Project->RemoveListener(this);
     DiscardUndoAndRedos();
+    delete m_UndoJournal;
+    delete m_Autosave;
 
     // ugliness - tool dtor might call Editor::SetMouseStyle()
     // we really want it to call the one in the derived (GUI-specific) class
@@ -125,6 +139,13 @@ void Editor::ShowToolCursor()
     }
 }
 
+void Editor::ShowToolCursor(EditView& view)
+{
+    if( !m_Tool )
+        return;
+    m_Tool->DrawCursor(view);
+}
+
 void Editor::HideToolCursor()
 {
     std::set<EditView*>::iterator it;
@@ -168,11 +189,11 @@ void Editor::SetBGPen( PenColour const& pen )
 // Adds a command to the undo stack, and calls its Do() fn
 void Editor::AddCmd( Cmd* cmd )
 {
-    const int maxundos = 128;
-
-    m_UndoStack.push_back( cmd );
     if( cmd->State() == Cmd::NOT_DONE )
-        cmd->Do();
+        Apply( *cmd );
+    else if( m_Autosave )
+        m_Autosave->RecordApplied( *cmd );
+    PushUndo( cmd );
 
     // adding a new command renders the redo stack obsolete.
     while( !m_RedoStack.empty() )
@@ -181,32 +202,139 @@ void Editor::AddCmd( Cmd* cmd )
         m_RedoStack.pop_back();
     }
 
-    // limit amount of undos to something reasonable.
-    int trimcount = m_UndoStack.size() - maxundos;
-    while( trimcount > 0 )
+    TrimUndoStack();
+
+    m_Project->SetModifiedFlag( true );
+    OnUndoRedoChanged();
+}
+
+void Editor::TopCmdChanged()
+{
+    if( m_UndoStack.empty() )
+        return;
+    if( m_Autosave )
+        m_Autosave->RecordApplied( *TopCmd() );
+    Recount( m_UndoStack.back() );
+    TrimUndoStack();
+}
+
+// Do() or Undo() the cmd (whichever flips its state), keeping the autosave
+// journal up to date.
+void Editor::Apply( Cmd& cmd )
+{
+    bool recorded = m_Autosave && m_Autosave->Record( cmd );
+    if( cmd.State() == Cmd::NOT_DONE )
+        cmd.Do();
+    else
+        cmd.Undo();
+    if( m_Autosave && !recorded )
+        m_Autosave->Checkpoint();
+}
+
+void Editor::SetAutosave( Autosave* autosave )
+{
+    delete m_Autosave;
+    m_Autosave = autosave;
+}
+
+
+// compress any cmds which are no longer near the top of the stack
+static void packOld( std::list<Cmd*>& stack )
+{
+    if( (int)stack.size() <= NUM_UNPACKED_CMDS )
+        return;
+    std::list<Cmd*>::reverse_iterator it = stack.rbegin();
+    std::advance( it, NUM_UNPACKED_CMDS );
+    (*it)->Pack();
+}
+
+void Editor::PushUndo( Cmd* cmd )
+{
+    UndoEntry e = { cmd, cmd->MemUsage() };
+    m_UndoStack.push_back( e );
+    m_UndoBytes += e.bytes;
+}
+
+Cmd* Editor::PopUndo()
+{
+    UndoEntry e = m_UndoStack.back();
+    m_UndoStack.pop_back();
+    m_UndoBytes -= e.bytes;
+    return e.cmd;
+}
+
+// update the total after a cmd on the undo stack has changed size
+void Editor::Recount( UndoEntry& e )
+{
+    m_UndoBytes -= e.bytes;
+    e.bytes = e.cmd->MemUsage();
+    m_UndoBytes += e.bytes;
+}
+
+// compress older undos, and page the oldest ones out to disk if we've gone
+// over the memory limit.
+void Editor::TrimUndoStack()
+{
+    if( (int)m_UndoStack.size() > NUM_UNPACKED_CMDS )
+    {
+        std::list<UndoEntry>::reverse_iterator it = m_UndoStack.rbegin();
+        std::advance( it, NUM_UNPACKED_CMDS );
+        it->cmd->Pack();
+        Recount( *it );
+    }
+
+    while( m_UndoBytes > m_UndoMemLimit && m_UndoStack.size() > 1 )
     {
-        delete m_UndoStack.front();
+        Cmd* cmd = m_UndoStack.front().cmd;
+        m_UndoBytes -= m_UndoStack.front().bytes;
         m_UndoStack.pop_front();
-        --trimcount;
+
+        if( !m_UndoJournal )
+        {
+            try {
+                m_UndoJournal = new UndoJournal();
+            } catch( Exception const& e ) {
+                fprintf(stderr, "%s\n", e.what());
+            }
+        }
+        // If the cmd can't be paged out, anything older is unreachable.
+        if( m_UndoJournal && !m_UndoJournal->Push( *cmd ) )
+            m_UndoJournal->Clear();
+        delete cmd;
     }
+}
 
-    m_Project->SetModifiedFlag( true );
+void Editor::SetUndoMemLimit( size_t bytes )
+{
+    m_UndoMemLimit = bytes;
+    TrimUndoStack();
     OnUndoRedoChanged();
 }
 
 
+bool Editor::CanUndo() const
+{
+    return !m_UndoStack.empty() ||
+        (m_UndoJournal && !m_UndoJournal->Empty());
+}
+
 void Editor::Undo()
 {
-    if( m_UndoStack.empty() )
+    Cmd* cmd;
+    if( !m_UndoStack.empty() )
+        cmd = PopUndo();
+    else
     {
-        return;
+        // page in the next cmd from disk, if any
+        cmd = m_UndoJournal ? m_UndoJournal->Pop( Proj() ) : nullptr;
+        if( !cmd )
+            return;
     }
 //    HideToolCursor();
 
-    Cmd* cmd = m_UndoStack.back();
-    m_UndoStack.pop_back();
-    cmd->Undo();
+    Apply( *cmd );
     m_RedoStack.push_back( cmd );
+    packOld( m_RedoStack );
 
     OnUndoRedoChanged();
 //    ShowToolCursor();
@@ -219,8 +347,9 @@ void Editor::Redo()
 //    HideToolCursor();
     Cmd* cmd = m_RedoStack.back();
     m_RedoStack.pop_back();
-    cmd->Do();
-    m_UndoStack.push_back( cmd );
+    Apply( *cmd );
+    PushUndo( cmd );
+    TrimUndoStack();
 
     OnUndoRedoChanged();
 //    ShowToolCursor();
@@ -232,15 +361,14 @@ void Editor::DiscardUndoAndRedos()
 //    bool stacksempty = m_UndoStack.empty() && m_RedoStack.empty();
 
     while( !m_UndoStack.empty() )
-    {
-        delete m_UndoStack.back();
-        m_UndoStack.pop_back();
-    }
+        delete PopUndo();
     while( !m_RedoStack.empty() )
     {
         delete m_RedoStack.back();
         m_RedoStack.pop_back();
     }
+    if( m_UndoJournal )
+        m_UndoJournal->Clear();
 
     /* pointless - editor is going away anyway!
     if( !stacksempty )
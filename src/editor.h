@@ -4,7 +4,9 @@
 class EditView;
 class Brush;
 class Tool;
+class Autosave;
 class Cmd;
+class UndoJournal;
 
 #include "project.h"
 #include "projectlistener.h"
@@ -29,6 +31,15 @@ struct DrawMode {
     DrawMode(Mode m) : mode(m) {}
 };
 
+// settings for the fill tool
+struct FillMode {
+    int tolerance;  // 0 = exact colour only, else max difference per channel
+    bool global;    // replace the colour everywhere, not just the connected area
+    bool allFrames; // fill every frame of the layer
+
+    FillMode() : tolerance(0), global(false), allFrames(false) {}
+};
+
 
 // the core backend (non-gui) part of the editor
 class Editor : public ProjectListener
@@ -53,6 +64,9 @@ public:
     DrawMode const& Mode() const { return m_Mode; }
     void SetMode( DrawMode const& mode) { m_Mode= mode; }
 
+    FillMode const& Fill() const { return m_Fill; }
+    void SetFill( FillMode const& fill ) { m_Fill = fill; }
+
 	PenColour FGPen() const { return m_FGPen; }
 	PenColour BGPen() const { return m_BGPen; }
 	void SetFGPen( PenColour const& pen );
@@ -85,6 +99,8 @@ public:
     // show/hide the current tool cursor for all the views this editor has
     void ShowToolCursor();
     void HideToolCursor();
+    // redraw the tool cursor on just one view
+    void ShowToolCursor(EditView& view);
 
 	// Add a cmd to the undo stack.
 	// cmd->Do() will be called.
@@ -101,12 +117,32 @@ public:
     // it makes more sense to accumulate changes in a single cmd
     // than to add lots of new ones.
     Cmd* TopCmd()
-        { return m_UndoStack.empty() ? 0:m_UndoStack.back(); }
+        { return m_UndoStack.empty() ? 0:m_UndoStack.back().cmd; }
+
+    // Call after modifying TopCmd() in place.
+    void TopCmdChanged();
 
 
 	bool CanUndo() const;
 	bool CanRedo() const;
 
+    // Limit on the memory used by the undo stack, in bytes.
+    // The oldest cmds are paged out to disk to stay within it (but the most
+    // recent cmd is always kept, however big).
+    size_t UndoMemLimit() const { return m_UndoMemLimit; }
+    void SetUndoMemLimit( size_t bytes );
+    // Memory currently used by the undo stack, in bytes (image tiles which
+    // are still shared with the project aren't counted).
+    size_t UndoMemUsage() const { return m_UndoBytes; }
+
+    // The paged-out cmds (null if nothing's been paged out yet).
+    UndoJournal const* Journal() const { return m_UndoJournal; }
+
+    // Crash recovery (null if none). Editor takes ownership (deleting any
+    // previous one).
+    void SetAutosave( Autosave* autosave );
+    Autosave* GetAutosave() const { return m_Autosave; }
+
     // projectlistener implementation:
     // Not used by Editor itself, but GUI overrides some.
 
@@ -129,6 +165,7 @@ private:
     int m_CurrentToolType;
 
     DrawMode m_Mode;
+    FillMode m_Fill;
 
     int m_Brush; // StdBrush index, or -1 for custombrush
 
@@ -140,16 +177,27 @@ private:
     Box m_CurrRange;
 
     // undo/redo stuff
-	std::list< Cmd* > m_UndoStack;
+    struct UndoEntry
+    {
+        Cmd* cmd;
+        size_t bytes;   // cmd->MemUsage(), as counted in m_UndoBytes
+    };
+	std::list< UndoEntry > m_UndoStack;
 	std::list< Cmd* > m_RedoStack;
+    size_t m_UndoBytes;
+    size_t m_UndoMemLimit;
+    UndoJournal* m_UndoJournal;
+    Autosave* m_Autosave;
 
+    void Apply( Cmd& cmd );
     void DiscardUndoAndRedos();
+    void PushUndo( Cmd* cmd );
+    Cmd* PopUndo();
+    void Recount( UndoEntry& e );
+    void TrimUndoStack();
 };
 
 
-inline bool Editor::CanUndo() const
-    { return !m_UndoStack.empty(); }
-
 inline bool Editor::CanRedo() const
     { return !m_RedoStack.empty(); }
 
@@ -1,6 +1,12 @@
 #include "editview.h"
+#include "blit_simd.h"
+#include "blit_zoom.h"
 #include "editor.h"
+#include "parallel.h"
+
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
 
 
@@ -14,7 +20,9 @@ EditView::EditView(Editor& editor, NodePath const& focus, int frame, int w, int
     m_Zoom(4),
     m_Offset(0,0),
     m_Panning(false),
-    m_PanAnchor(0,0)
+    m_PanAnchor(0,0),
+    m_Flushing(false),
+    m_CheckedPaletteValid(false)
 {
     m_XZoom = m_Zoom*editor.Proj().Settings().PixW;
     m_YZoom = m_Zoom*editor.Proj().Settings().PixH;
@@ -53,8 +61,7 @@ void EditView::Resize( int w, int h )
     if( v.h>p.h)
         m_Offset.y = -(v.h - p.h) / 2;
 
-    DrawView(m_ViewBox);
-    Redraw(m_ViewBox);
+    Invalidate(m_ViewBox);
 }
 
 void EditView::SetZoom( int zoom )
@@ -69,25 +76,24 @@ void EditView::SetZoom( int zoom )
     m_XZoom = Proj().Settings().PixW*zoom;
     m_YZoom = Proj().Settings().PixH*zoom;
     ConfineView();
-    DrawView(m_ViewBox);
-    Redraw(m_ViewBox);
+    Invalidate(m_ViewBox);
 }
 
 void EditView::SetFocus(NodePath const& focus)
 {
     m_Focus = focus;
+    m_CheckedPaletteValid = false;
     ConfineView();
-    DrawView(m_ViewBox);
-    Redraw(m_ViewBox);
+    Invalidate(m_ViewBox);
 }
 
 void EditView::SetFrame(int frame)
 {
     //printf("EditView::SetFrame(%d->%d)\n", m_Frame, frame);
     m_Frame = frame;
+    m_CheckedPaletteValid = false;
     ConfineView();
-    DrawView(m_ViewBox);
-    Redraw(m_ViewBox);
+    Invalidate(m_ViewBox);
     //printf("end EditView::SetFrame()\n");
 }
 
@@ -96,8 +102,7 @@ void EditView::SetOffset( Point const& projpos )
 {
     m_Offset = projpos;
     ConfineView();
-    DrawView(m_ViewBox);
-    Redraw(m_ViewBox);
+    Invalidate(m_ViewBox);
 }
 
 // Offsets the view to make sure viewspace point viewp is over
@@ -212,28 +217,50 @@ void EditView::OnMouseDown( Point const& viewpos, Button button )
 
 void EditView::OnMouseMove( Point const& viewpos )
 {
-    Point p = ViewToProj( viewpos );
-    if( m_Panning && !(p == m_PrevPos) )
-    {
-        AlignView( viewpos, m_PanAnchor );
-        m_PrevPos = p;
+    OnMouseMoves(std::vector<Point>(1, viewpos));
+}
+
+void EditView::OnMouseMoves( std::vector<Point> const& viewposes )
+{
+    if (viewposes.empty()) {
         return;
     }
 
-    if( Ed().CurrentTool().ObeyGrid() )
-        Ed().GridSnap(p);
-
-    if( p == m_PrevPos )
+    if( m_Panning )
+    {
+        // only the latest position matters
+        Point const& viewpos = viewposes.back();
+        Point p = ViewToProj( viewpos );
+        if (!(p == m_PrevPos)) {
+            AlignView( viewpos, m_PanAnchor );
+            m_PrevPos = p;
+        }
         return;
+    }
 
-    Ed().UpdateMouseInfo( p );
+    bool snap = Ed().CurrentTool().ObeyGrid();
+    std::vector<Point> pts;
+    pts.reserve(viewposes.size());
+    Point prev = m_PrevPos;
+    for (auto const& viewpos : viewposes) {
+        Point p = ViewToProj( viewpos );
+        if (snap)
+            Ed().GridSnap(p);
+        if (p == prev)
+            continue;
+        pts.push_back(p);
+        prev = p;
+    }
+    if (pts.empty())
+        return;
 
+    Ed().UpdateMouseInfo( pts.back() );
 
     Ed().HideToolCursor();
-    Ed().CurrentTool().OnMove( *this, p );
+    Ed().CurrentTool().OnMoves( *this, pts );
     // NOTE: Tool might have changed!
     Ed().ShowToolCursor();
-    m_PrevPos = p;
+    m_PrevPos = pts.back();
 }
 
 void EditView::OnMouseUp( Point const & viewpos, Button button )
@@ -257,20 +284,48 @@ void EditView::OnMouseUp( Point const & viewpos, Button button )
 
 
 
-// within canvas
-static RGBX8 checker(int x,int y) {
-    if((x & 16) ^ (y & 16))
-        return RGBX8(192,192,192);
-    else
-        return RGBX8(224,224,224);
+// The checkerboard shown behind transparent pixels is made of 16x16
+// squares, in two shades. Outside the image it's darker.
+static const RGBX8 checkerShades[2] = {RGBX8(224,224,224), RGBX8(192,192,192)};
+static const RGBX8 borderShades[2] = {RGBX8(224/2,224/2,224/2), RGBX8(192/2,192/2,192/2)};
+
+// which shade the checkerboard is at x (given the shade at the start of the row)
+static inline int checkerShade(int x, int rowShade) {
+    return ((x >> 4) & 1) ^ rowShade;
 }
 
-// outside canvas
-static RGBX8 checker2(int x,int y) {
-    if((x & 16) ^ (y & 16))
-        return RGBX8(192/2,192/2,192/2);
-    else
-        return RGBX8(224/2,224/2,224/2);
+// Fill dest from x to xend with whichever of shades[] the checkerboard has
+// at each pixel. Returns the new dest.
+static inline RGBX8* fillChecked(RGBX8* dest, int x, int xend, int rowShade, RGBX8 const shades[2])
+{
+    while (x < xend) {
+        int stop = std::min(xend, (x | 15) + 1);
+        RGBX8 c = shades[checkerShade(x, rowShade)];
+        while (x < stop) {
+            *dest++ = c;
+            ++x;
+        }
+    }
+    return dest;
+}
+
+void EditView::PrepareDrawCache()
+{
+    if ((int)m_BorderRows[0].size() != m_ViewBox.w) {
+        for (int shade = 0; shade < 2; ++shade) {
+            m_BorderRows[shade].resize(m_ViewBox.w);
+            fillChecked(m_BorderRows[shade].data(), 0, m_ViewBox.w, shade, borderShades);
+        }
+    }
+    if (!m_CheckedPaletteValid) {
+        Palette const& pal = FocusedPaletteConst();
+        for (int i = 0; i < 256; ++i) {
+            RGBA8 c = pal.GetColour(i);
+            m_CheckedPalette[0][i] = Blend(c, checkerShades[0]);
+            m_CheckedPalette[1][i] = Blend(c, checkerShades[1]);
+        }
+        m_CheckedPaletteValid = true;
+    }
 }
 
 // Render project to canvas, with zooming.
@@ -278,8 +333,6 @@ void EditView::DrawView( Box const& viewbox, Box* affectedview )
 {
     // note: viewbox can be outside the project boundary
 
-//    Colour checkerboard[2] = { Colour(192,192,192), Colour(224,224,224) }; 
-
     Box vb(viewbox);
     vb.ClipAgainst(m_ViewBox);
 
@@ -287,98 +340,147 @@ void EditView::DrawView( Box const& viewbox, Box* affectedview )
     // get project bounds in view coords (unclipped)
     Box pbox(ProjToView(img.Bounds()));
 
+    // do this before going multithreaded!
+    PrepareDrawCache();
+
     // step x,y through view coords of the area to draw
-    int y;
-//    int xmin = std::min(pbox.XMin(), vb.XMax()+1);
     int xbegin = std::min(pbox.x, vb.x + vb.w);
     int xend = std::min(pbox.x + pbox.w, vb.x + vb.w);
-    for(y=vb.YMin(); y<=vb.YMax(); ++y) {
-        RGBX8* dest = m_Canvas->Ptr_RGBX8(vb.x,y);
-        int x=vb.XMin();
-
-        // scanline intersects canvas?
-        if(y<pbox.YMin() || y>pbox.YMax()) {
-            // line is above or below the project
-            while(x<=vb.XMax()) {
-                *dest++ = checker2(x,y);
-                ++x;
+    auto drawRows = [&](int ybegin, int yend) {
+        // local copies, so the compiler knows they don't change under us
+        const int xzoom = m_XZoom;
+        const int xoffset = m_Offset.x*m_XZoom;
+        RGBX8 const (&checkedPalette)[2][256] = m_CheckedPalette;
+        const size_t rowBytes = vb.w * sizeof(RGBX8);
+        // lit pixels for one checker square at a time, ready for zooming
+        uint32_t lit[16 + 2];
+        RGBX8 const* prevRow = nullptr;
+        int prevSrcY = 0;
+        int prevShade = 0;
+        for(int y=ybegin; y<yend; ++y) {
+            RGBX8* dest = m_Canvas->Ptr_RGBX8(vb.x,y);
+            int x=vb.XMin();
+            const int rowShade = (y >> 4) & 1;
+            RGBX8 const* border = m_BorderRows[rowShade].data();
+            RGBX8* rowStart = dest;
+
+            // scanline intersects canvas?
+            const bool onCanvas = (y >= pbox.YMin() && y <= pbox.YMax());
+            const int srcY = onCanvas ? ViewToProj(Point(0,y)).y : -1;
+
+            // With vertical zoom, the row is often the same as the one
+            // above, so just copy it.
+            if (prevRow && srcY == prevSrcY && rowShade == prevShade) {
+                memcpy(dest, prevRow, rowBytes);
+                prevRow = rowStart;
+                continue;
+            }
+            prevRow = rowStart;
+            prevSrcY = srcY;
+            prevShade = rowShade;
+
+            if(!onCanvas) {
+                // line is above or below the project
+                std::copy(border + x, border + vb.x + vb.w, dest);
+                continue;
             }
-            continue;
-        }
 
-        // left of project canvas
-        while(x<xbegin) {
-            *dest++ = checker2(x,y);
-            ++x;
-        }
+            // left of project canvas
+            if(x<xbegin) {
+                dest = std::copy(border + x, border + xbegin, dest);
+                x = xbegin;
+            }
 
-        if(x<xend) {
-            // on the project canvas
-            Point p( ViewToProj(Point(x,y)) );
-            switch( img.Fmt() ) {
-
-            case FMT_I8:
-                {
-                    Palette const& pal = FocusedPaletteConst();
-                    I8 const* src = img.PtrConst_I8( p.x,p.y );
-                    while(x<xend) {
-                        int cx = x + (m_Offset.x*m_XZoom);
-                        int pixstop = x + (m_XZoom-(cx%m_XZoom));
-                        if(pixstop>xend)
-                            pixstop=xend;
-                        RGBA8 c = pal.GetColour(*src++);
-                        while(x<pixstop)
-                        {
-                            //*dest++ = c;
-                            *dest++ = Blend(c,checker(x,y));
-                            ++x;
+            if(x<xend) {
+                // on the project canvas
+                Point p( ViewToProj(Point(x,y)) );
+                // first pixel might be partly scrolled off to the left
+                const int skip = (x + xoffset) % xzoom;
+                const int x0 = x;
+                switch( img.Fmt() ) {
+
+                case FMT_I8:
+                    {
+                        I8 const* src = img.PtrConst_I8( p.x,p.y );
+                        if (xzoom == 1) {
+                            for(; x<xend; ++x) {
+                                *dest++ = checkedPalette[checkerShade(x, rowShade)][*src++];
+                            }
                         }
-                    }
-                }
-                break;
-            case FMT_RGBX8:
-                {
-                    RGBX8 const* src = img.PtrConst_RGBX8( p.x,p.y );
-                    while(x<xend) {
-                        int cx = x + (m_Offset.x*m_XZoom);
-                        int pixstop = x + (m_XZoom-(cx%m_XZoom));
-                        if(pixstop>xend)
-                            pixstop=xend;
-                        RGBX8 c = *src++;
-                        while(x<pixstop) {
-                            *dest++ = c;
-                            ++x;
+                        // zoom each checker square separately
+                        while(x<xend) {
+                            int stop = std::min(xend, (x | 15) + 1);
+                            int rel = x - x0 + skip;
+                            int first = rel / xzoom;
+                            int n = (rel + (stop - x) + xzoom - 1) / xzoom - first;
+                            RGBX8 const* pal = checkedPalette[checkerShade(x, rowShade)];
+                            for (int i = 0; i < n; ++i) {
+                                lit[i] = RawPixel(pal[src[first + i]]);
+                            }
+                            ZoomRow(lit, (uint32_t*)dest, stop - x, xzoom, rel % xzoom);
+                            dest += stop - x;
+                            x = stop;
                         }
                     }
-                }
-                break;
-            case FMT_RGBA8:
-                {
-                    RGBA8 const* src = img.PtrConst_RGBA8( p.x,p.y );
-                    while(x<xend) {
-                        int cx = x + (m_Offset.x*m_XZoom);
-                        int pixstop = x + (m_XZoom-(cx%m_XZoom));
-                        if(pixstop>xend)
-                            pixstop=xend;
-                        RGBA8 c = *src++;
-                        while(x<pixstop) {
-                            *dest++ = Blend(c,checker(x,y));
-                            ++x;
+                    break;
+                case FMT_RGBX8:
+                    {
+                        RGBX8 const* src = img.PtrConst_RGBX8( p.x,p.y );
+                        ZoomRow((uint32_t const*)src, (uint32_t*)dest, xend - x, xzoom, skip);
+                        dest += xend - x;
+                        x = xend;
+                    }
+                    break;
+                case FMT_RGBA8:
+                    {
+                        RGBA8 const* src = img.PtrConst_RGBA8( p.x,p.y );
+                        if (xzoom == 1) {
+                            for(; x<xend; ++x) {
+                                *dest++ = Blend(*src++, checkerShades[checkerShade(x, rowShade)]);
+                            }
+                        }
+                        while(x<xend) {
+                            int stop = std::min(xend, (x | 15) + 1);
+                            int rel = x - x0 + skip;
+                            int first = rel / xzoom;
+                            int n = (rel + (stop - x) + xzoom - 1) / xzoom - first;
+                            RGBX8 shade = checkerShades[checkerShade(x, rowShade)];
+                            for (int i = 0; i < n; ++i) {
+                                lit[i] = RawPixel(Blend(src[first + i], shade));
+                            }
+                            ZoomRow(lit, (uint32_t*)dest, stop - x, xzoom, rel % xzoom);
+                            dest += stop - x;
+                            x = stop;
                         }
                     }
+                    break;
+                default:
+                    assert(false);
+                    break;
                 }
-                break;
-            default:
-                assert(false);
-                break;
+            }
+            // right of canvas
+            if(x < vb.x+vb.w) {
+                std::copy(border + x, border + vb.x + vb.w, dest);
             }
         }
-        // right of canvas
-        while(x < vb.x+vb.w)
-        {
-            *dest++ = checker2(x,y);
-            ++x;
-        }
+    };
+
+    // Rows are independent, so big areas are split into bands and drawn
+    // in parallel. Bands are made of whole canvas tiles, so no two threads
+    // write to the same tile.
+    if ((long)vb.w * vb.h < 256*256) {
+        drawRows(vb.y, vb.y + vb.h);
+    } else {
+        Img const& canvas = *m_Canvas;
+        int grain = std::max(1, 32 / canvas.TileRows());
+        ParallelFor(canvas.TileIndex(vb.YMin()), canvas.TileIndex(vb.YMax()) + 1, grain,
+            [&](int tbegin, int tend) {
+                Box first = canvas.TileBounds(tbegin);
+                Box last = canvas.TileBounds(tend - 1);
+                drawRows(std::max(vb.y, first.y),
+                    std::min(vb.y + vb.h, last.y + last.h));
+            });
     }
 
     if(affectedview)
@@ -397,19 +499,23 @@ void EditView::OnDamaged(NodePath const& target, int frame, Box const& projdmg)
     // TODO: ignore non-visible layers...
     // TODO: account for onionskinning.
 
-    Box viewdirtied;
-
     // just redraw the damaged part of the project...
-    Box area(ProjToView(projdmg));
-    DrawView(area, &viewdirtied );
-
-    // tell the gui to display damaged part
-    Redraw(viewdirtied);
+    Invalidate(ProjToView(projdmg));
 }
 
-void EditView::OnPaletteChanged(NodePath const& target, int frame, int /*index*/, Colour const&/*newColour*/)
+void EditView::OnPaletteChanged(NodePath const& target, int frame, int index, Colour const& newColour)
 {
-    OnPaletteReplaced(target, frame);
+    if (!Proj().SharesPalette(target, frame, m_Focus, m_Frame)) {
+        return;
+    }
+    // just the one entry to update
+    if (m_CheckedPaletteValid && index >= 0 && index < 256) {
+        RGBA8 c = newColour;
+        m_CheckedPalette[0][index] = Blend(c, checkerShades[0]);
+        m_CheckedPalette[1][index] = Blend(c, checkerShades[1]);
+    }
+    // redraw the whole project (don't need to redraw padding)
+    Invalidate(ProjToView(FocusedImgConst().Bounds()));
 }
 
 void EditView::OnPaletteReplaced(NodePath const& target, int frame)
@@ -417,11 +523,9 @@ void EditView::OnPaletteReplaced(NodePath const& target, int frame)
     if (!Proj().SharesPalette(target, frame, m_Focus, m_Frame)) {
         return;
     }
+    m_CheckedPaletteValid = false;
     // redraw the whole project (don't need to redraw padding)
-    Box area(ProjToView(FocusedImgConst().Bounds()));
-    Box affected;
-    DrawView(area,&affected);
-    Redraw(affected);
+    Invalidate(ProjToView(FocusedImgConst().Bounds()));
 }
 
 void EditView::OnModifiedFlagChanged(bool /*changed*/)
@@ -433,10 +537,9 @@ void EditView::OnFramesAdded(NodePath const& target, int /*first*/, int /*count*
     //Layer const& l = Proj().ResolveLayer(target);
     // TODO: ignore changes on non-visible layers.
 
+    m_CheckedPaletteValid = false;
     // redraw the whole view (including padding)
-    Box affected;
-    DrawView(m_ViewBox,&affected);
-    Redraw(affected);
+    Invalidate(m_ViewBox);
 }
 
 void EditView::OnFramesRemoved(NodePath const& target, int /*first*/, int /*count*/)
@@ -449,41 +552,93 @@ void EditView::OnFramesRemoved(NodePath const& target, int /*first*/, int /*coun
         m_Frame = (int)l.mFrames.size()-1;
     }
 
+    m_CheckedPaletteValid = false;
     // redraw the whole view (including padding)
-    Box affected;
-    DrawView(m_ViewBox,&affected);
-    Redraw(affected);
+    Invalidate(m_ViewBox);
 }
 
 void EditView::OnFramesBlatted(NodePath const& target, int /*first*/, int /*count*/)
 {
+    m_CheckedPaletteValid = false;
     // redraw the whole view (including padding)
-    Box affected;
-    DrawView(m_ViewBox,&affected);
-    Redraw(affected);
+    Invalidate(m_ViewBox);
 }
 
 // End of ProjectListener implementation
 
+void EditView::Invalidate(Box const& viewbox)
+{
+    Box b(viewbox);
+    b.ClipAgainst(m_ViewBox);
+    if (b.Empty()) {
+        return;
+    }
+    m_Damage.Add(b);
+    Redraw(b);
+}
+
+// The cursor is drawn directly onto the canvas, so it just needs displaying.
 void EditView::AddCursorDamage(Box const& viewdmg)
 {
     m_CursorDamage.push_back(viewdmg);
-    Redraw(viewdmg);
+    if (!m_Flushing) {
+        Redraw(viewdmg);
+    }
 }
 
 
+// The area under the cursor is restored at the next FlushDamage().
 void EditView::EraseCursor()
 {
-    std::vector<Box>::const_iterator it;
-    std::vector<Box>::const_iterator itend = m_CursorDamage.end();
-    for( it=m_CursorDamage.begin(); it!=itend; ++it )
-    {
-        Box clipped;
-        DrawView(*it, &clipped );
-        Redraw( clipped );
+    for (auto const& b : m_CursorDamage) {
+        Invalidate(b);
     }
-
     m_CursorDamage.clear();
 }
 
 
+static bool overlaps(Box const& a, Box const& b)
+{
+    Box tmp(a);
+    tmp.ClipAgainst(b);
+    return !tmp.Empty();
+}
+
+void EditView::FlushDamage()
+{
+    if (m_Damage.Empty()) {
+        return;
+    }
+
+    // Rendering will wipe out any part of the cursor in the damaged area,
+    // in which case the whole cursor is rendered over and redrawn (the
+    // cursor might be blended, so can't just be drawn again on top).
+    bool cursorHit = false;
+    for (auto const& c : m_CursorDamage) {
+        for (auto const& r : m_Damage.Rects()) {
+            if (overlaps(c, r)) {
+                cursorHit = true;
+            }
+        }
+    }
+    if (cursorHit) {
+        for (auto const& c : m_CursorDamage) {
+            Box b(c);
+            b.ClipAgainst(m_ViewBox);
+            m_Damage.Add(b);
+        }
+        m_CursorDamage.clear();
+    }
+
+    for (auto const& r : m_Damage.Rects()) {
+        DrawView(r);
+    }
+    m_Damage.Clear();
+
+    if (cursorHit) {
+        // the gui is already displaying all these areas
+        m_Flushing = true;
+        Ed().ShowToolCursor(*this);
+        m_Flushing = false;
+    }
+}
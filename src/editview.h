@@ -2,6 +2,7 @@
 #define EDITVIEW_H
 
 #include "box.h"
+#include "damage.h"
 #include "project.h"
 #include "projectlistener.h"
 #include "point.h"
@@ -52,6 +53,9 @@ public:
 
 	void OnMouseDown( Point const& viewpos, Button button );
 	void OnMouseMove( Point const& viewpos );
+    // A batch of mouse moves, oldest first. The tool gets them all in one
+    // go, and the cursor is only hidden and redrawn once.
+	void OnMouseMoves( std::vector<Point> const& viewposes );
 	void OnMouseUp( Point const& viewpos, Button button );
 
 	Img const& CanvasConst() const { return *m_Canvas; }
@@ -85,6 +89,11 @@ public:
 
     void EraseCursor();
 
+    // Render any outstanding damage to the canvas.
+    // Damage is collected up rather than rendered as it happens, so the GUI
+    // should call this before it displays the canvas.
+    void FlushDamage();
+
 
 protected:
     // Needs to be implemented by the GUI layer
@@ -115,7 +124,23 @@ private:
     // list of view rects affected by cursor drawing
     std::vector<Box> m_CursorDamage;
 
+    // view areas which need rendering at the next FlushDamage()
+    DamageRegion m_Damage;
+    bool m_Flushing;
+
+    // mark part of the view for rendering, and tell the gui
+    void Invalidate( Box const& viewbox );
     void DrawView( Box const& viewbox, Box* affectedview=0  );
+
+    // Lookups used by DrawView(), so it doesn't have to blend every pixel
+    // against the checkerboard:
+    // the focused palette, pre-blended with each of the checkerboard shades
+    RGBX8 m_CheckedPalette[2][256];
+    bool m_CheckedPaletteValid;
+    // rows of the (darker) checkerboard shown around the image, one for
+    // each vertical phase
+    std::vector<RGBX8> m_BorderRows[2];
+    void PrepareDrawCache();
     void ConfineView();
 };
 
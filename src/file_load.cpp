@@ -1,12 +1,16 @@
 #include <impy.h>
+#include <algorithm>
+#include <filesystem>
 #include <string>
 #include <vector>
 
 #include "file_load.h"
 #include "exception.h"
+#include "file_type.h"
 #include "img.h"
 #include "layer.h"
 #include "lexer.h"
+#include "parallel.h"
 #include "project.h"
 #include "util.h"
 
@@ -48,86 +52,419 @@ static Box parseGrid(std::string input)
 }
 
 
-Layer* LoadLayer(std::string const& filename, ProjSettings& projSettings)
+// True if both palettes hold the same colours.
+static bool samePalette(Palette const& a, Palette const& b)
 {
-    ImErr err;
+    if (a.NumColours() != b.NumColours()) {
+        return false;
+    }
+    for (int i = 0; i < a.NumColours(); ++i) {
+        if (a.GetColour(i) != b.GetColour(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Read in the current image from rdr (after im_read_img() has returned inf).
+// If the image has a palette, it's read into pal and hasPalette is set.
+static Img* readImg(im_read* rdr, im_imginfo const& inf, Palette& pal, bool& hasPalette)
+{
+    Img *img = nullptr;
+    if (im_fmt_is_indexed(inf.fmt)) {
+        im_read_set_fmt(rdr, IM_FMT_INDEX8);
+        img = new Img(FMT_I8, inf.w, inf.h);
+    } else if (im_fmt_has_rgb(inf.fmt)) {
+        // Our internal component ordering is set up to match QImage ARGB.
+        // (But Qt accesses it as uint32_t and we're little-endian specific
+        // at the moment, so bytewise it comes out as BGRA!).
+        // Luckily, impy can just supply whatever we ask for.
+        // TODO: handle big-endian!
+        if (im_fmt_has_alpha(inf.fmt)) {
+            im_read_set_fmt(rdr, IM_FMT_BGRA);
+            img = new Img(FMT_RGBA8, inf.w, inf.h);
+        } else {
+            im_read_set_fmt(rdr, IM_FMT_BGRX);
+            img = new Img(FMT_RGBX8, inf.w, inf.h);
+        }
+    }
+    if (!img) {
+        throw Exception("Unsupported pixel format.");
+    }
+
+    // read palette, if any.
+    hasPalette = false;
+    if (inf.pal_num_colours > 0) {
+        pal.SetNumColours(inf.pal_num_colours);
+        std::vector<uint8_t> buf(4 * inf.pal_num_colours);
+        im_read_palette(rdr, IM_FMT_RGBA, buf.data());
+        uint8_t* src = buf.data(); 
+        for (unsigned int i = 0; i < inf.pal_num_colours; ++i) {
+            pal.Colours[i] = RGBA8(src[0], src[1], src[2], src[3]);
+            src += 4;
+        }
+        hasPalette = true;
+    }
 
-    im_imginfo inf;
+    // read the image rows (a tile at a time - rows are only
+    // contiguous within a tile)
+    for (int y = 0; y < img->H(); y += img->RowsInTile(y)) {
+        im_read_rows(rdr, img->RowsInTile(y), img->Ptr(0,y), img->Pitch());
+    }
+    return img;
+}
+
+
+// Read the first image from a file.
+static Img* readFile(std::string const& filename, Palette& pal, bool& hasPalette)
+{
+    ImErr err;
     im_read* rdr = im_read_open_file(filename.c_str(), &err);
     if (!rdr) {
         throw Exception(std::string("Load failed: ") + impyErrToMsg(err));
     }
+    Img* img = nullptr;
+    try {
+        im_imginfo inf;
+        if (im_read_img(rdr, &inf)) {
+            img = readImg(rdr, inf, pal, hasPalette);
+        }
+    } catch (Exception const&) {
+        im_read_finish(rdr);
+        throw;
+    }
+    err = im_read_finish(rdr);
+    if (err != IM_ERR_NONE) {
+        delete img;
+        throw Exception(std::string("Load failed: ") + impyErrToMsg(err));
+    }
+    if (!img) {
+        throw Exception("Load failed: No images in file");
+    }
+    return img;
+}
 
-    Layer *layer = new Layer();
-    while (im_read_img(rdr, &inf)) {
-        Img *img = nullptr;
-        if (im_fmt_is_indexed(inf.fmt)) {
-            im_read_set_fmt(rdr, IM_FMT_INDEX8);
-            img = new Img(FMT_I8, inf.w, inf.h);
-        } else if (im_fmt_has_rgb(inf.fmt)) {
-            // Our internal component ordering is set up to match QImage ARGB.
-            // (But Qt accesses it as uint32_t and we're little-endian specific
-            // at the moment, so bytewise it comes out as BGRA!).
-            // Luckily, impy can just supply whatever we ask for.
-            // TODO: handle big-endian!
-            if (im_fmt_has_alpha(inf.fmt)) {
-                im_read_set_fmt(rdr, IM_FMT_BGRA);
-                img = new Img(FMT_RGBA8, inf.w, inf.h);
-            } else {
-                im_read_set_fmt(rdr, IM_FMT_BGRX);
-                img = new Img(FMT_RGBX8, inf.w, inf.h);
-            }
+
+// The image files in a directory, sorted by name.
+static std::vector<std::string> sequenceFiles(std::string const& dir)
+{
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (auto const& ent : std::filesystem::directory_iterator(dir, ec)) {
+        std::string name = ent.path().filename().string();
+        Filetype type = FiletypeFromFilename(name);
+        if (name[0] == '.' || type == FILETYPE_UNKNOWN ||
+            type == FILETYPE_EVILPIXIE || !ent.is_regular_file()) {
+            continue;
         }
-        if (!img) {
-            throw Exception("Unsupported pixel format.");
+        files.push_back(name);
+    }
+    if (ec) {
+        throw Exception("Load failed: " + ec.message());
+    }
+    std::sort(files.begin(), files.end());
+    for (auto& name : files) {
+        name = JoinPath(dir, name);
+    }
+    return files;
+}
+
+
+Layer* LoadLayer(std::string const& filename, ProjSettings& projSettings)
+{
+    LayerLoader loader(filename, projSettings);
+    Layer* layer = loader.TakeLayer();
+    bool paletteChanged;
+    loader.Collect(*layer, paletteChanged, true);
+    if (!loader.Error().empty()) {
+        delete layer;
+        throw Exception(loader.Error());
+    }
+    return layer;
+}
+
+
+LayerLoader::LayerLoader(std::string const& filename, ProjSettings& projSettings) :
+    m_Rdr(nullptr),
+    m_Layer(nullptr),
+    m_Cancel(false),
+    m_Done(false),
+    m_PendingPalette(nullptr),
+    m_Finished(false),
+    m_NextFile(0),
+    m_NextFrame(0),
+    m_LastPalette(nullptr),
+    m_Fmt(FMT_I8),
+    m_Bounds(0, 0, 0, 0)
+{
+    std::string first = filename;
+    std::error_code ec;
+    if (std::filesystem::is_directory(filename, ec)) {
+        m_Files = sequenceFiles(filename);
+        if (m_Files.empty()) {
+            throw Exception("Load failed: No images in folder");
+        }
+        first = m_Files[0];
+    }
+
+    ImErr err;
+    m_Rdr = im_read_open_file(first.c_str(), &err);
+    if (!m_Rdr) {
+        throw Exception(std::string("Load failed: ") + impyErrToMsg(err));
+    }
+
+    // Read the first frame here and now.
+    Img* img = nullptr;
+    Palette pal;
+    bool hasPalette = false;
+    try {
+        im_imginfo inf;
+        if (im_read_img(m_Rdr, &inf)) {
+            img = readImg(m_Rdr, inf, pal, hasPalette);
+        }
+    } catch (Exception const&) {
+        im_read_finish(m_Rdr);
+        throw;
+    }
+    if (!img) {
+        err = im_read_finish(m_Rdr);
+        if (err != IM_ERR_NONE) {
+            throw Exception(std::string("Load failed: ") + impyErrToMsg(err));
         }
+        throw Exception("Load failed: No images in file");
+    }
 
-        // read palette, if any.
-        if (inf.pal_num_colours > 0) {
-            Palette pal(inf.pal_num_colours);
-            std::vector<uint8_t> buf(4 * inf.pal_num_colours);
-            im_read_palette(rdr, IM_FMT_RGBA, buf.data());
-            uint8_t* src = buf.data(); 
-            for (unsigned int i = 0; i < inf.pal_num_colours; ++i) {
-                pal.Colours[i] = RGBA8(src[0], src[1], src[2], src[3]);
-                src += 4;
+    // check metadata
+    for (const im_kv* kv = im_read_kv(m_Rdr); kv->key; ++kv) {
+        std::string key(kv->key);
+        std::string payload(kv->value);
+        if (key == "SpriteSheet") {
+            SpriteGrid grid;
+            bool ok = grid.Parse(payload, img->Bounds());
+            if (ok) {
+                projSettings.SpriteSheetGrid = grid;
             }
-            // KLUDGE!!!
-            layer->mPalette = pal;
-        
-        }
-
-        // read the image rows
-        im_read_rows(rdr, img->H(), img->Ptr(0,0), img->Pitch());
-
-        // check metadata
-        for (const im_kv* kv = im_read_kv(rdr); kv->key; ++kv) {
-            std::string key(kv->key);
-            std::string payload(kv->value);
-            if (key == "SpriteSheet") {
-                SpriteGrid grid;
-                bool ok = grid.Parse(payload, img->Bounds());
-                if (ok) {
-                    projSettings.SpriteSheetGrid = grid;
-                }
+        }
+        if (key == "Grid") {
+            Box b = parseGrid(payload);
+            projSettings.Grid = b;
+        }
+    }
+
+    m_Layer = new Layer();
+    if (hasPalette) {
+        m_Layer->mPalette = pal;
+    }
+    m_Layer->mFrames.push_back(new Frame(img, 0));
+
+    // Leave the rest to the worker.
+    if (m_Files.empty()) {
+        m_Thread = std::thread(&LayerLoader::run, this, pal);
+    } else {
+        im_read_finish(m_Rdr);
+        m_Rdr = nullptr;
+        m_Fmt = img->Fmt();
+        m_Bounds = img->Bounds();
+        m_Thread = std::thread(&LayerLoader::runSequence, this, pal);
+    }
+}
+
+
+LayerLoader::~LayerLoader()
+{
+    m_Cancel = true;
+    if (m_Thread.joinable()) {
+        m_Thread.join();
+    }
+    for (auto img : m_Pending) {
+        delete img;
+    }
+    delete m_PendingPalette;
+    delete m_Layer;
+}
+
+
+Layer* LayerLoader::TakeLayer()
+{
+    Layer* l = m_Layer;
+    m_Layer = nullptr;
+    return l;
+}
+
+
+int LayerLoader::Collect(Layer& layer, bool& paletteChanged, bool wait)
+{
+    paletteChanged = false;
+    if (m_Done) {
+        return 0;
+    }
+
+    std::vector<Img*> imgs;
+    Palette* pal = nullptr;
+    bool finished;
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        if (wait) {
+            m_Cond.wait(lock, [this]{ return m_Finished; });
+        }
+        imgs.swap(m_Pending);
+        std::swap(pal, m_PendingPalette);
+        finished = m_Finished;
+        if (finished) {
+            m_Error = m_PendingError;
+        }
+    }
+
+    for (auto img : imgs) {
+        // TODO: duration!
+        layer.mFrames.push_back(new Frame(img, 0));
+    }
+    if (pal) {
+        // KLUDGE!!! Layer only has the one palette.
+        layer.mPalette = *pal;
+        delete pal;
+        paletteChanged = true;
+    }
+    if (finished) {
+        m_Thread.join();
+        m_Done = true;
+    }
+    return (int)imgs.size();
+}
+
+
+// Worker thread - decodes the rest of the frames.
+// lastPalette is the palette used by the previous frame.
+void LayerLoader::run(Palette lastPalette)
+{
+    std::string error;
+    try {
+        im_imginfo inf;
+        while (!m_Cancel && im_read_img(m_Rdr, &inf)) {
+            Palette pal;
+            bool hasPalette;
+            Img* img = readImg(m_Rdr, inf, pal, hasPalette);
+            // Most files (eg GIF with just a global palette) supply the same
+            // palette for each frame, so only pass on actual changes.
+            bool newPalette = hasPalette && !samePalette(pal, lastPalette);
+            if (newPalette) {
+                lastPalette = pal;
             }
-            if (key == "Grid") {
-                Box b = parseGrid(payload);
-                projSettings.Grid = b;
+
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Pending.push_back(img);
+            if (newPalette) {
+                delete m_PendingPalette;
+                m_PendingPalette = new Palette(pal);
             }
         }
+    } catch (Exception const& e) {
+        error = e.what();
+    }
 
-        //
-        Frame* frame = new Frame();
-        frame->mImg = img;
-        layer->mFrames.push_back(frame);
+    ImErr err = im_read_finish(m_Rdr);
+    m_Rdr = nullptr;
+    if (error.empty() && err != IM_ERR_NONE && !m_Cancel) {
+        error = std::string("Load failed: ") + impyErrToMsg(err);
     }
 
-    err = im_read_finish(rdr);
-    if (err != IM_ERR_NONE) {
-        throw Exception(std::string("Load failed: ") + impyErrToMsg(err));
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_PendingError = error;
+    m_Finished = true;
+    m_Cond.notify_all();
+}
+
+
+// Worker thread for a sequence - the files are independent, so they're
+// decoded by a few threads of our own (not ParallelFor(), which would hold
+// up the GUI's ParallelFor() calls until loading was done).
+// lastPalette is the palette used by the first frame.
+void LayerLoader::runSequence(Palette lastPalette)
+{
+    m_Decoded.resize(m_Files.size());
+    m_NextFile = 1;
+    m_NextFrame = 1;
+    m_LastPalette = new Palette(lastPalette);
+
+    int numThreads = std::min(NumWorkers(), (int)m_Files.size() - 1);
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < numThreads; ++i) {
+        helpers.emplace_back(&LayerLoader::decodeFiles, this);
+    }
+    decodeFiles();
+    for (auto& t : helpers) {
+        t.join();
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    // Anything not handed over (cancelled, or after a failed file).
+    for (auto& d : m_Decoded) {
+        delete d.img;
+        delete d.pal;
+    }
+    m_Decoded.clear();
+    delete m_LastPalette;
+    m_LastPalette = nullptr;
+    m_Finished = true;
+    m_Cond.notify_all();
+}
+
+
+// Decode files until they run out, handing over any frames which are
+// next in line.
+void LayerLoader::decodeFiles()
+{
+    while (!m_Cancel) {
+        int i = m_NextFile++;
+        if (i >= (int)m_Files.size()) {
+            break;
+        }
+        Decoded d;
+        try {
+            Palette pal;
+            bool hasPalette;
+            d.img = readFile(m_Files[i], pal, hasPalette);
+            // A layer's frames must all be alike.
+            if (d.img->Fmt() != m_Fmt || !(d.img->Bounds() == m_Bounds)) {
+                delete d.img;
+                d.img = nullptr;
+                throw Exception("Load failed: Format or size differs from the first image");
+            }
+            if (hasPalette) {
+                d.pal = new Palette(pal);
+            }
+        } catch (Exception const& e) {
+            d.error = BaseName(m_Files[i]) + ": " + e.what();
+            // Stop at the first failure (files before it are already
+            // being decoded).
+            m_NextFile = (int)m_Files.size();
+        }
+        d.ready = true;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Decoded[i] = d;
+        while (m_NextFrame < (int)m_Decoded.size() && m_Decoded[m_NextFrame].ready) {
+            Decoded& next = m_Decoded[m_NextFrame];
+            if (!next.error.empty()) {
+                m_PendingError = next.error;
+                m_NextFrame = (int)m_Decoded.size();
+                break;
+            }
+            // Only pass on actual palette changes (as run() does).
+            if (next.pal && !samePalette(*next.pal, *m_LastPalette)) {
+                *m_LastPalette = *next.pal;
+                delete m_PendingPalette;
+                m_PendingPalette = next.pal;
+                next.pal = nullptr;
+            }
+            delete next.pal;
+            next.pal = nullptr;
+            m_Pending.push_back(next.img);
+            next.img = nullptr;
+            ++m_NextFrame;
+        }
     }
-    return layer;
 }
 
 
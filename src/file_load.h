@@ -1,11 +1,98 @@
 #ifndef FILE_LOAD_H
 #define FILE_LOAD_H
 
+#include "box.h"
+#include "colours.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
+class Img;
 class Layer;
+struct Palette;
 struct ProjSettings;
+struct im_read;
 
+// Load a whole layer (waits for all the frames).
 Layer* LoadLayer(std::string const& filename, ProjSettings& projSettings);
 
+
+// Loads a layer in the background.
+// The first frame is read by the constructor, so there's something to show
+// straight away. The remaining frames are decoded on a worker thread, and
+// handed over by Collect(), which the GUI should call every so often.
+// Deleting the loader cancels any loading still in progress.
+//
+// filename can also be a directory holding a sequence of images (eg
+// frame0000.png, frame0001.png... as written by SaveSequence()), one per
+// frame, in filename order. Those are independent, so they're decoded in
+// parallel. Frames within a single file (GIF, ANIM) can depend on the
+// previous ones, and are always decoded in order.
+class LayerLoader
+{
+public:
+    // Throws an Exception if the first frame can't be loaded.
+    // projSettings is filled out from any metadata in the (first) file.
+    LayerLoader(std::string const& filename, ProjSettings& projSettings);
+    ~LayerLoader();
+
+    // The layer (holding the first frame). Caller takes ownership.
+    Layer* TakeLayer();
+
+    // Append any frames decoded so far to layer, and return how many
+    // were added. If wait is set, blocks until all the frames are in.
+    // If a frame came with a different palette, it replaces the layer
+    // palette and paletteChanged is set.
+    int Collect(Layer& layer, bool& paletteChanged, bool wait = false);
+
+    // Have all the frames been collected (or has loading failed)?
+    bool Done() const { return m_Done; }
+    // Description of any error which stopped the loading early.
+    std::string const& Error() const { return m_Error; }
+
+private:
+    LayerLoader(LayerLoader const&) = delete;
+    LayerLoader& operator=(LayerLoader const&) = delete;
+
+    void run(Palette lastPalette);
+    void runSequence(Palette lastPalette);
+    void decodeFiles();
+
+    // A decoded file from a sequence, waiting to be handed over in order.
+    struct Decoded {
+        Img* img {nullptr};
+        Palette* pal {nullptr};     // if the file had one
+        std::string error;
+        bool ready {false};
+    };
+
+    im_read* m_Rdr;
+    Layer* m_Layer;
+    std::thread m_Thread;
+    std::atomic<bool> m_Cancel;
+    bool m_Done;
+    std::string m_Error;
+
+    // Shared with the worker thread.
+    std::mutex m_Mutex;
+    std::condition_variable m_Cond;
+    std::vector<Img*> m_Pending;    // decoded, but not yet collected
+    Palette* m_PendingPalette;      // new palette, or null
+    bool m_Finished;                // worker has finished
+    std::string m_PendingError;
+
+    // For sequences.
+    std::vector<std::string> m_Files;
+    std::atomic<int> m_NextFile;    // next file to decode
+    std::vector<Decoded> m_Decoded; // indexed by frame (guarded by m_Mutex)
+    int m_NextFrame;                // next frame to hand over
+    Palette* m_LastPalette;         // palette of the last frame handed over
+    PixelFormat m_Fmt;              // every frame must match the first
+    Box m_Bounds;
+};
+
 #endif // FILE_LOAD_H
@@ -0,0 +1,518 @@
+#include "file_native.h"
+#include "exception.h"
+#include "img.h"
+#include "layer.h"
+#include "project.h"
+#include "serialise.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const uint8_t MAGIC[8] = {'E','V','P','R','O','J','\r','\n'};
+const uint32_t VERSION = 1;
+// Tiles are aligned to this. It's fixed rather than asking the OS, so
+// files come out the same everywhere.
+const uint64_t PAGE = 4096;
+
+enum {NODE_STACK = 0, NODE_LAYER = 1};
+
+// Rewrite the whole file once more than this fraction of it is dead space.
+const uint64_t MAX_WASTE_PERCENT = 50;
+
+uint64_t roundUp(uint64_t n)
+{
+    return (n + PAGE - 1) & ~(PAGE - 1);
+}
+
+int bytesPerPixel(PixelFormat fmt)
+{
+    return (fmt == FMT_I8) ? 1 : 4;
+}
+
+// Tile storage for a memory-mapped file.
+class MappedFile : public Img::TileStorage
+{
+public:
+    MappedFile(void* base, size_t len) : m_Base(base), m_Len(len) {}
+    virtual ~MappedFile() { munmap(m_Base, m_Len); }
+
+    uint8_t const* Base() const { return (uint8_t const*)m_Base; }
+    size_t Len() const { return m_Len; }
+private:
+    void* m_Base;
+    size_t m_Len;
+};
+
+
+void writeAt(int fd, void const* data, size_t len, uint64_t offset)
+{
+    uint8_t const* p = (uint8_t const*)data;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw Exception("Save failed: %s", strerror(errno));
+        }
+        p += n;
+        len -= n;
+        offset += n;
+    }
+}
+
+void syncFile(int fd)
+{
+    if (fsync(fd) != 0) {
+        throw Exception("Save failed: %s", strerror(errno));
+    }
+}
+
+void writeHeader(int fd, uint64_t indexOffset, uint64_t indexLen)
+{
+    BinWriter out;
+    out.Bytes(MAGIC, sizeof(MAGIC));
+    out.U32(VERSION);
+    out.U32((uint32_t)PAGE);
+    out.U64(indexOffset);
+    out.U64(indexLen);
+    writeAt(fd, out.Data().data(), out.Data().size(), 0);
+}
+
+// Returns false if it's not a header we understand.
+bool readHeader(uint8_t const* data, size_t len, uint64_t& indexOffset, uint64_t& indexLen)
+{
+    BinReader in(data, len);
+    uint8_t magic[sizeof(MAGIC)];
+    in.Bytes(magic, sizeof(magic));
+    if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        in.U32() != VERSION ||
+        in.U32() != PAGE) {
+        return false;
+    }
+    indexOffset = in.U64();
+    indexLen = in.U64();
+    return true;
+}
+
+void writeSettings(BinWriter& out, ProjSettings const& settings)
+{
+    Write(out, settings.Grid);
+    Write(out, settings.SpriteSheetGrid);
+    out.I32(settings.PixW);
+    out.I32(settings.PixH);
+}
+
+void readSettings(BinReader& in, ProjSettings& settings)
+{
+    Read(in, settings.Grid);
+    Read(in, settings.SpriteSheetGrid);
+    settings.PixW = in.I32();
+    settings.PixH = in.I32();
+}
+
+
+// Is the file still the one native describes (ie nobody else has been
+// writing to it)?
+bool unchanged(int fd, NativeFile const& native)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        (uint64_t)st.st_dev != native.dev ||
+        (uint64_t)st.st_ino != native.ino ||
+        (uint64_t)st.st_size < native.end) {
+        return false;
+    }
+    uint8_t buf[64];
+    if (pread(fd, buf, sizeof(buf), 0) != (ssize_t)sizeof(buf)) {
+        return false;
+    }
+    uint64_t indexOffset;
+    uint64_t indexLen;
+    return readHeader(buf, sizeof(buf), indexOffset, indexLen) &&
+        indexOffset == native.indexOffset;
+}
+
+
+// Writes out the tiles of a project, and builds up the index.
+class Saver
+{
+public:
+    // Tiles are written from pos onward. Any tiles already in old are
+    // assumed to still be in the file.
+    Saver(int fd, uint64_t pos, NativeFile const* old, NativeFile& state) :
+        m_FD(fd),
+        m_Pos(pos),
+        m_Old(old),
+        m_State(state)
+        {}
+
+    void WriteNode(BinWriter& out, BaseNode const& node);
+    uint64_t Pos() const { return m_Pos; }
+
+private:
+    void writeImg(BinWriter& out, Img const& img);
+
+    int m_FD;
+    uint64_t m_Pos;
+    NativeFile const* m_Old;
+    NativeFile& m_State;
+    std::unordered_set<uint64_t> m_Counted; // tiles counted in tileBytes
+};
+
+void Saver::WriteNode(BinWriter& out, BaseNode const& node)
+{
+    Layer const* l = node.ToLayerConst();
+    if (l) {
+        out.U8(NODE_LAYER);
+        WriteLayerProps(out, *l);
+        out.U32((uint32_t)l->mFrames.size());
+        for (Frame const* f : l->mFrames) {
+            out.I32(f->mDuration);
+            writeImg(out, *f->mImg);
+        }
+        out.U8(l->mSpare ? 1 : 0);
+        if (l->mSpare) {
+            out.I32(l->mSpare->mDuration);
+            writeImg(out, *l->mSpare->mImg);
+        }
+    } else {
+        out.U8(NODE_STACK);
+        out.String(node.mName);
+        out.I32(node.mOffset.x);
+        out.I32(node.mOffset.y);
+    }
+    out.U32((uint32_t)node.mChildren.size());
+    for (BaseNode const* child : node.mChildren) {
+        WriteNode(out, *child);
+    }
+}
+
+void Saver::writeImg(BinWriter& out, Img const& img)
+{
+    out.U8((uint8_t)img.Fmt());
+    out.I32(img.W());
+    out.I32(img.H());
+    out.I32(img.TileRows());
+    out.U32((uint32_t)img.NumTiles());
+    for (int t = 0; t < img.NumTiles(); ++t) {
+        Box tb = img.TileBounds(t);
+        size_t len = (size_t)tb.h * img.Pitch();
+        void const* id = img.TileID(t);
+        uint64_t offset;
+        auto done = m_State.tiles.find(id);
+        if (done != m_State.tiles.end()) {
+            // already written (shared with an earlier frame)
+            offset = done->second;
+        } else {
+            if (m_Old && m_Old->tiles.count(id)) {
+                // unchanged since the last save
+                offset = m_Old->tiles.at(id);
+            } else {
+                offset = m_Pos;
+                writeAt(m_FD, img.PtrConst(0, tb.y), len, offset);
+                m_Pos = roundUp(m_Pos + len);
+            }
+            m_State.tiles[id] = offset;
+        }
+        if (m_Counted.insert(offset).second) {
+            m_State.tileBytes += roundUp(len);
+        }
+        out.U64(offset);
+    }
+    // Hang onto the tiles, so their IDs stay valid (and the contents
+    // match the file).
+    m_State.imgs.push_back(new Img(img));
+}
+
+
+// Builds the project from a mapped file.
+class Loader
+{
+public:
+    Loader(MappedFile* mapped, NativeFile& state) :
+        m_Mapped(mapped),
+        m_State(state)
+        {}
+
+    BaseNode* ReadNode(BinReader& in, int depth);
+
+private:
+    Img* readImg(BinReader& in);
+
+    MappedFile* m_Mapped;
+    NativeFile& m_State;
+    std::unordered_set<uint64_t> m_Counted;
+};
+
+BaseNode* Loader::ReadNode(BinReader& in, int depth)
+{
+    if (depth > 100) {
+        throw Exception("Load failed: layers nested too deep");
+    }
+    std::unique_ptr<BaseNode> node;
+    int kind = in.U8();
+    if (kind == NODE_LAYER) {
+        Layer* l = new Layer();
+        node.reset(l);
+        ReadLayerProps(in, *l);
+        uint32_t numFrames = in.U32();
+        for (uint32_t i = 0; i < numFrames; ++i) {
+            int duration = in.I32();
+            l->mFrames.push_back(new Frame(readImg(in), duration));
+        }
+        if (in.U8()) {
+            int duration = in.I32();
+            l->mSpare = new Frame(readImg(in), duration);
+        }
+        if (l->mFrames.empty()) {
+            throw Exception("Load failed: layer has no frames");
+        }
+    } else if (kind == NODE_STACK) {
+        node.reset(new Stack());
+        node->mName = in.String();
+        node->mOffset.x = in.I32();
+        node->mOffset.y = in.I32();
+    } else {
+        throw Exception("Load failed: bad node type");
+    }
+
+    uint32_t numChildren = in.U32();
+    for (uint32_t i = 0; i < numChildren; ++i) {
+        BaseNode* child = ReadNode(in, depth + 1);
+        if (node->IsLayer()) {
+            delete child;
+            throw Exception("Load failed: layer has children");
+        }
+        node->AddChild(child);
+    }
+    return node.release();
+}
+
+Img* Loader::readImg(BinReader& in)
+{
+    PixelFormat fmt = (PixelFormat)in.U8();
+    int w = in.I32();
+    int h = in.I32();
+    int tileRows = in.I32();
+    uint32_t numTiles = in.U32();
+    if ((fmt != FMT_I8 && fmt != FMT_RGBX8 && fmt != FMT_RGBA8) ||
+        w < 0 || h < 0 || tileRows <= 0 ||
+        (int64_t)numTiles != ((int64_t)h + tileRows - 1) / tileRows) {
+        throw Exception("Load failed: bad image");
+    }
+
+    size_t pitch = (size_t)w * bytesPerPixel(fmt);
+    std::vector<uint64_t> offsets;
+    std::vector<uint8_t const*> tiles;
+    for (uint32_t t = 0; t < numTiles; ++t) {
+        uint64_t offset = in.U64();
+        size_t len = std::min(tileRows, h - (int)t * tileRows) * pitch;
+        if (offset < PAGE || offset > m_Mapped->Len() ||
+            len > m_Mapped->Len() - offset || (offset & 3) != 0) {
+            throw Exception("Load failed: bad tile offset");
+        }
+        if (m_Counted.insert(offset).second) {
+            m_State.tileBytes += roundUp(len);
+        }
+        offsets.push_back(offset);
+        tiles.push_back(m_Mapped->Base() + offset);
+    }
+
+    if (tileRows != Img::TileRowsFor(fmt, w)) {
+        // Tiled differently (by some other build?), so fall back to
+        // copying it all in.
+        Img* img = new Img(fmt, w, h);
+        for (int y = 0; y < h; ++y) {
+            memcpy(img->Ptr(0, y), tiles[y / tileRows] + (y % tileRows) * pitch, pitch);
+        }
+        return img;
+    }
+
+    Img* img = new Img(fmt, w, h, m_Mapped, tiles);
+    for (uint32_t t = 0; t < numTiles; ++t) {
+        m_State.tiles[img->TileID(t)] = offsets[t];
+    }
+    m_State.imgs.push_back(new Img(*img));
+    return img;
+}
+
+}   // anon namespace
+
+
+NativeFile::~NativeFile()
+{
+    for (Img* img : imgs) {
+        delete img;
+    }
+}
+
+
+Stack* LoadNative(std::string const& filename, ProjSettings& projSettings, NativeFile*& native)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw Exception("Load failed: %s", strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        throw Exception("Load failed: %s", strerror(err));
+    }
+    size_t len = (size_t)st.st_size;
+    if (len < PAGE) {
+        close(fd);
+        throw Exception("Load failed: Not an EvilPixie project");
+    }
+    void* base = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    int err = errno;
+    close(fd);
+    if (base == MAP_FAILED) {
+        throw Exception("Load failed: %s", strerror(err));
+    }
+
+    // The images take refs on the mapping as they're created. Hold one
+    // ourselves until we're done, so it doesn't disappear if we bail out.
+    MappedFile* mapped = new MappedFile(base, len);
+    mapped->refs.fetch_add(1);
+    std::unique_ptr<NativeFile> state(new NativeFile());
+    Stack* root = nullptr;
+    try {
+        uint64_t indexOffset;
+        uint64_t indexLen;
+        if (!readHeader(mapped->Base(), PAGE, indexOffset, indexLen)) {
+            throw Exception("Load failed: Not an EvilPixie project (or a newer version)");
+        }
+        if (indexOffset > len || indexLen > len - indexOffset) {
+            throw Exception("Load failed: File truncated");
+        }
+
+        BinReader in(mapped->Base() + indexOffset, indexLen);
+        ProjSettings settings;
+        readSettings(in, settings);
+        Loader loader(mapped, *state);
+        BaseNode* node = loader.ReadNode(in, 0);
+        root = node->ToStack();
+        if (!root) {
+            delete node;
+            throw Exception("Load failed: No root stack");
+        }
+
+        projSettings.Grid = settings.Grid;
+        projSettings.SpriteSheetGrid = settings.SpriteSheetGrid;
+        projSettings.PixW = settings.PixW;
+        projSettings.PixH = settings.PixH;
+
+        state->filename = filename;
+        state->dev = (uint64_t)st.st_dev;
+        state->ino = (uint64_t)st.st_ino;
+        state->indexOffset = indexOffset;
+        state->end = indexOffset + indexLen;
+    } catch (Exception const&) {
+        state.reset();
+        if (mapped->refs.fetch_sub(1) == 1) {
+            delete mapped;
+        }
+        throw;
+    }
+    if (mapped->refs.fetch_sub(1) == 1) {
+        delete mapped;
+    }
+
+    delete native;
+    native = state.release();
+    return root;
+}
+
+
+void SaveNative(Stack const& root, ProjSettings const& projSettings, std::string const& filename, NativeFile*& native)
+{
+    // Add to the existing file if we can. It's left intact until the
+    // header is updated at the very end.
+    NativeFile const* old = nullptr;
+    int fd = -1;
+    if (native && native->filename == filename) {
+        uint64_t waste = native->end - PAGE - native->tileBytes;
+        if (waste * 100 <= native->end * MAX_WASTE_PERCENT) {
+            fd = open(filename.c_str(), O_RDWR);
+            if (fd >= 0 && unchanged(fd, *native)) {
+                old = native;
+            } else if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+    }
+
+    // Otherwise write a new file alongside, and swap it in at the end.
+    // (Never rewrite the existing file in place - it might be mapped).
+    std::string tmpName;
+    if (!old) {
+        tmpName = filename + ".tmp";
+        fd = open(tmpName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0) {
+            throw Exception("Save failed: %s", strerror(errno));
+        }
+        struct stat existing;
+        if (stat(filename.c_str(), &existing) == 0) {
+            fchmod(fd, existing.st_mode & 07777);
+        }
+    }
+
+    std::unique_ptr<NativeFile> state(new NativeFile());
+    try {
+        Saver saver(fd, old ? roundUp(old->end) : PAGE, old, *state);
+        BinWriter index;
+        writeSettings(index, projSettings);
+        saver.WriteNode(index, root);
+        uint64_t indexOffset = saver.Pos();
+        uint64_t indexLen = index.Data().size();
+        writeAt(fd, index.Data().data(), indexLen, indexOffset);
+
+        // Make sure it's all on disk before pointing the header at it.
+        syncFile(fd);
+        writeHeader(fd, indexOffset, indexLen);
+        syncFile(fd);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            throw Exception("Save failed: %s", strerror(errno));
+        }
+        state->filename = filename;
+        state->dev = (uint64_t)st.st_dev;
+        state->ino = (uint64_t)st.st_ino;
+        state->indexOffset = indexOffset;
+        state->end = indexOffset + indexLen;
+
+        if (close(fd) != 0) {
+            fd = -1;
+            throw Exception("Save failed: %s", strerror(errno));
+        }
+        fd = -1;
+        if (!old && rename(tmpName.c_str(), filename.c_str()) != 0) {
+            throw Exception("Save failed: %s", strerror(errno));
+        }
+    } catch (Exception const&) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (!old) {
+            unlink(tmpName.c_str());
+        }
+        throw;
+    }
+
+    delete native;
+    native = state.release();
+}
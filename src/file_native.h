@@ -0,0 +1,63 @@
+#ifndef FILE_NATIVE_H
+#define FILE_NATIVE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Img;
+class Stack;
+struct ProjSettings;
+
+// EvilPixie's own project format (.evp).
+//
+// Holds the whole layer tree (palettes, ranges, project settings etc) along
+// with the raw pixels of every frame. The pixels are stored a tile at a time
+// (see Img), each tile in its own page-aligned chunk. Loading just maps the
+// file into memory and points the images at it, so nothing is actually read
+// until it's needed, and tiles are only copied into memory when drawn upon.
+//
+// Saving back to the same file only writes out the tiles which have changed.
+// They're appended to the file, followed by a new index, and then the header
+// is updated to point at the new index. Once the file holds too much dead
+// space it's rewritten from scratch (into a temp file, which then replaces
+// the original).
+//
+// Layout:
+//   header   - first page: magic, version, location of index
+//   tiles    - raw pixels, each tile starting on a page boundary
+//   index    - layer tree and settings, with the offset of each tile (see
+//              serialise.h)
+
+
+// What we know about the file a project was last loaded from or saved to,
+// so the next save can skip the tiles already in it.
+struct NativeFile
+{
+    std::string filename;
+    uint64_t dev {0};           // to spot the file being replaced
+    uint64_t ino {0};
+    uint64_t indexOffset {0};   // current index
+    uint64_t end {0};           // end of the used part of the file
+    uint64_t tileBytes {0};     // space used by the tiles in the index
+
+    // Copies of the images in the file, which keep the tiles alive and
+    // unmodified (anything drawn on the originals gets copied first).
+    std::vector<Img*> imgs;
+    // Where each of their tiles is in the file, by Img::TileID().
+    std::unordered_map<void const*, uint64_t> tiles;
+
+    ~NativeFile();
+};
+
+// Load a project. Throws an Exception upon error.
+// native is set up ready to pass into SaveNative() (any old one is deleted).
+Stack* LoadNative(std::string const& filename, ProjSettings& projSettings, NativeFile*& native);
+
+// Save a project. Throws an Exception upon error.
+// If native describes the file being saved to, only changes are written.
+// Upon success, native is updated to describe the new file.
+void SaveNative(Stack const& root, ProjSettings const& projSettings, std::string const& filename, NativeFile*& native);
+
+#endif // FILE_NATIVE_H
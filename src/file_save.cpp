@@ -1,6 +1,7 @@
 #include <impy.h>
 
 #include "file_save.h"
+#include "file_native.h"
 #include "file_type.h"
 #include "exception.h"
 #include "img.h"
@@ -8,16 +9,27 @@
 #include "project.h"
 #include "util.h"
 
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 // defined in file_load.cpp
 extern std::string const impyErrToMsg(ImErr err);
 
 SaveRequirements CheckSave(Stack const& stack, Filetype ft)
 {
     // Get capabilities of format (TODO: move this stuff into impy).
-    bool canSave = (ft == FILETYPE_PNG || ft == FILETYPE_GIF || ft == FILETYPE_BMP);
-    bool fmtSupportsLayers = false;
+    bool canSave = (ft == FILETYPE_PNG || ft == FILETYPE_GIF || ft == FILETYPE_BMP || ft == FILETYPE_EVILPIXIE);
+    bool fmtSupportsLayers = (ft == FILETYPE_EVILPIXIE);
     bool fmtIndexedOnly = (ft == FILETYPE_GIF || ft == FILETYPE_PCX || ft == FILETYPE_IFF_ILBM);
-    bool fmtSupportsAnim = (ft == FILETYPE_GIF);
+    bool fmtSupportsAnim = (ft == FILETYPE_GIF || ft == FILETYPE_EVILPIXIE);
 
     // Get characteristics of project.
     std::vector<Layer const*> layers;
@@ -44,7 +56,28 @@ SaveRequirements CheckSave(Stack const& stack, Filetype ft)
 }
 
 
-void SaveLayer(Layer const& layer, std::string const& filename, ProjSettings const& projSettings)
+// Name to write to before replacing filename.
+// Keeps the extension, as impy uses it to pick the file format.
+static std::string tempName(std::string const& filename)
+{
+    return JoinPath(DirName(filename), "~" + BaseName(filename));
+}
+
+// Make sure a file (or directory) is on disk.
+static void syncPath(std::string const& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw Exception("Save failed: %s", strerror(errno));
+    }
+    int err = (fsync(fd) == 0) ? 0 : errno;
+    close(fd);
+    if (err) {
+        throw Exception("Save failed: %s", strerror(err));
+    }
+}
+
+static void writeLayer(Layer const& layer, std::string const& filename, ProjSettings const& projSettings)
 {
     ImErr err;
     im_write* writer = im_write_open_file( filename.c_str(), &err);
@@ -116,7 +149,9 @@ void SaveLayer(Layer const& layer, std::string const& filename, ProjSettings con
             }
         }
 
-        im_write_rows(writer, img->H(), img->PtrConst(0, 0), img->Pitch());
+        for (int y = 0; y < img->H(); y += img->RowsInTile(y)) {
+            im_write_rows(writer, img->RowsInTile(y), img->PtrConst(0, y), img->Pitch());
+        }
     }
 
     err = im_write_finish(writer);
@@ -125,3 +160,97 @@ void SaveLayer(Layer const& layer, std::string const& filename, ProjSettings con
     }
 }
 
+
+
+void SaveLayer(Layer const& layer, std::string const& filename, ProjSettings const& projSettings)
+{
+    std::string tmp = tempName(filename);
+    try {
+        writeLayer(layer, tmp, projSettings);
+        // Keep the permissions of any file being replaced.
+        struct stat existing;
+        if (stat(filename.c_str(), &existing) == 0) {
+            chmod(tmp.c_str(), existing.st_mode & 07777);
+        }
+        // Make sure the new data is on disk before it replaces the old.
+        syncPath(tmp);
+    } catch (Exception const&) {
+        remove(tmp.c_str());
+        throw;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, filename, ec);
+    if (ec) {
+        remove(tmp.c_str());
+        throw Exception("Save failed: %s", ec.message().c_str());
+    }
+    // ...and that the rename is too.
+    syncPath(DirName(filename));
+}
+
+
+BackgroundSave::BackgroundSave(Layer const& layer, std::string const& filename, ProjSettings const& projSettings) :
+    m_Snapshot(CopyNode(&layer)),
+    m_WholeProject(false),
+    m_Filename(filename),
+    m_Settings(new ProjSettings(projSettings)),
+    m_Native(nullptr),
+    m_Finished(false)
+{
+    m_Thread = std::thread(&BackgroundSave::run, this);
+}
+
+BackgroundSave::BackgroundSave(Stack const& root, std::string const& filename, ProjSettings const& projSettings, NativeFile* native) :
+    m_Snapshot(CopyNode(&root)),
+    m_WholeProject(true),
+    m_Filename(filename),
+    m_Settings(new ProjSettings(projSettings)),
+    m_Native(native),
+    m_Finished(false)
+{
+    m_Thread = std::thread(&BackgroundSave::run, this);
+}
+
+BackgroundSave::~BackgroundSave()
+{
+    Done(true);
+    delete m_Native;
+    delete m_Settings;
+    delete m_Snapshot;
+}
+
+bool BackgroundSave::Done(bool wait)
+{
+    if (!wait && !m_Finished.load(std::memory_order_acquire)) {
+        return false;
+    }
+    if (m_Thread.joinable()) {
+        m_Thread.join();
+    }
+    return true;
+}
+
+NativeFile* BackgroundSave::TakeNative()
+{
+    assert(!m_Thread.joinable());
+    NativeFile* native = m_Native;
+    m_Native = nullptr;
+    return native;
+}
+
+// Runs on the worker thread.
+void BackgroundSave::run()
+{
+    try {
+        if (m_WholeProject) {
+            SaveNative(*m_Snapshot->ToStackConst(), *m_Settings, m_Filename, m_Native);
+        } else {
+            SaveLayer(*m_Snapshot->ToLayerConst(), m_Filename, *m_Settings);
+        }
+    } catch (Exception const& e) {
+        m_Error = e.what();
+    } catch (std::bad_alloc const&) {
+        m_Error = "Save failed: out of memory";
+    }
+    m_Finished.store(true, std::memory_order_release);
+}
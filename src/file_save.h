@@ -1,11 +1,15 @@
 #ifndef FILE_SAVE_H
 #define FILE_SAVE_H
 
+#include <atomic>
 #include <string>
+#include <thread>
 #include "file_type.h"
 
+class BaseNode;
 class Layer;
 class Stack;
+struct NativeFile;
 struct ProjSettings;
 
 struct SaveRequirements
@@ -21,6 +25,54 @@ struct SaveRequirements
 // Work out what operations are required to save the stack in the
 // given file format.
 SaveRequirements CheckSave(Stack const& stack, Filetype ft);
+
+// Save a layer (via impy). Throws an Exception upon error.
+// The file is written under a temporary name, synced to disk, then renamed
+// over the destination (keeping its permissions), so a failed save or a
+// crash leaves any existing file untouched.
 void SaveLayer(Layer const& layer, std::string const& filename, ProjSettings const& projSettings);
 
+
+// Saves in the background, so the GUI doesn't have to sit and wait.
+// The constructor takes a snapshot of whatever is to be saved. The images
+// share their data copy-on-write, so this is cheap, and the user is free to
+// carry on drawing - the snapshot just hangs on to the old tiles.
+// The encoding is done on a worker thread, and the GUI should check Done()
+// every so often. The destructor waits for any save still in progress.
+class BackgroundSave
+{
+public:
+    // Save a single layer (see SaveLayer()).
+    BackgroundSave(Layer const& layer, std::string const& filename, ProjSettings const& projSettings);
+    // Save the whole project in native format (see SaveNative()).
+    // Takes ownership of native, which can be reclaimed by TakeNative().
+    BackgroundSave(Stack const& root, std::string const& filename, ProjSettings const& projSettings, NativeFile* native);
+    ~BackgroundSave();
+
+    std::string const& Filename() const { return m_Filename; }
+
+    // Has the save finished? If wait is set, blocks until it has.
+    bool Done(bool wait = false);
+    // Description of the error if the save failed (only valid once Done()).
+    std::string const& Error() const { return m_Error; }
+    // Reclaim the native file state, updated if the save succeeded
+    // (only valid once Done()). Caller takes ownership.
+    NativeFile* TakeNative();
+
+private:
+    BackgroundSave(BackgroundSave const&) = delete;
+    BackgroundSave& operator=(BackgroundSave const&) = delete;
+
+    void run();
+
+    BaseNode* m_Snapshot;
+    bool m_WholeProject;
+    std::string m_Filename;
+    ProjSettings* m_Settings;
+    NativeFile* m_Native;
+    std::string m_Error;
+    std::atomic<bool> m_Finished;
+    std::thread m_Thread;
+};
+
 #endif // FILE_SAVE_H
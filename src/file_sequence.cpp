@@ -0,0 +1,85 @@
+#include "file_sequence.h"
+#include "file_save.h"
+#include "frame_changes.h"
+#include "img.h"
+#include "project.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstdio>
+
+
+SequenceFile::~SequenceFile()
+{
+    if (changes) {
+        proj->RemoveListener(changes);
+        delete changes;
+    }
+}
+
+std::string SequenceFilename(std::string const& dir, int frame, int digits)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "frame%0*d.png", digits, frame);
+    return JoinPath(dir, name);
+}
+
+int SequenceDigits(int numFrames)
+{
+    int digits = 1;
+    for (int n = numFrames - 1; n >= 10; n /= 10) {
+        ++digits;
+    }
+    return std::max(digits, 4);
+}
+
+int SaveSequence(Project& proj, NodePath const& target, std::string const& dir, SequenceFile*& seq)
+{
+    Layer const& layer = proj.ResolveLayer(target);
+    int numFrames = layer.NumFrames();
+    int digits = SequenceDigits(numFrames);
+
+    // If it's an update of the last save, we only need the changes.
+    bool update = seq && seq->dir == dir && seq->digits == digits &&
+        seq->changes && seq->changes->Target() == target;
+
+    int written = 0;
+    for (int i = 0; i < numFrames; ++i) {
+        if (update && !seq->changes->Changed(i)) {
+            continue;
+        }
+        Layer tmp;
+        tmp.mFPS = layer.mFPS;
+        tmp.mPalette = layer.mPalette;
+        Frame const* frame = layer.mFrames[i];
+        tmp.mFrames.push_back(new Frame(new Img(*frame->mImg), frame->mDuration));
+        SaveLayer(tmp, SequenceFilename(dir, i, digits), proj.mSettings);
+        ++written;
+    }
+
+    // Remove files from any frames which have gone away.
+    if (seq && seq->dir == dir) {
+        int first = (seq->digits == digits) ? numFrames : 0;
+        for (int i = first; i < seq->numFrames; ++i) {
+            remove(SequenceFilename(dir, i, seq->digits).c_str());
+        }
+    }
+
+    if (!seq) {
+        seq = new SequenceFile();
+    }
+    if (!seq->changes || seq->changes->Target() != target) {
+        if (seq->changes) {
+            seq->proj->RemoveListener(seq->changes);
+            delete seq->changes;
+        }
+        seq->proj = &proj;
+        seq->changes = new FrameChanges(target, numFrames);
+        proj.AddListener(seq->changes);
+    }
+    seq->changes->Reset(numFrames);
+    seq->dir = dir;
+    seq->numFrames = numFrames;
+    seq->digits = digits;
+    return written;
+}
@@ -0,0 +1,41 @@
+#ifndef FILE_SEQUENCE_H
+#define FILE_SEQUENCE_H
+
+#include "layer.h"
+
+#include <string>
+
+class FrameChanges;
+class Project;
+
+// Saving a layer as a sequence of numbered PNG files (frame0000.png,
+// frame0001.png...) in a directory, one file per frame.
+//
+// Changes to the layer are tracked between saves, so saving to the same
+// directory again only rewrites the frames which have changed (and removes
+// any files left over from deleted frames).
+
+// What was last saved where.
+struct SequenceFile
+{
+    std::string dir;
+    int numFrames {0};
+    int digits {0};
+    Project* proj {nullptr};
+    FrameChanges* changes {nullptr};    // since the save (listening to proj)
+
+    ~SequenceFile();
+};
+
+// Name of the file for a frame (digits as returned by SequenceDigits()).
+std::string SequenceFilename(std::string const& dir, int frame, int digits);
+// How many digits to use for frame numbers.
+int SequenceDigits(int numFrames);
+
+// Save the frames of the target layer into dir (which must exist).
+// If seq describes the last save to dir, only changed frames are written.
+// Upon success, seq is updated (or created). Returns the number of files
+// written. Throws an Exception upon error.
+int SaveSequence(Project& proj, NodePath const& target, std::string const& dir, SequenceFile*& seq);
+
+#endif // FILE_SEQUENCE_H
@@ -30,6 +30,9 @@ Filetype FiletypeFromFilename( std::string const& filename)
     if (ext == ".iff" || ext == ".ilbm" || ext == ".lbm") {
         return FILETYPE_IFF_ILBM;
     }
+    if (ext == ".evp") {
+        return FILETYPE_EVILPIXIE;
+    }
     return FILETYPE_UNKNOWN;
 }
 
@@ -11,7 +11,8 @@ enum Filetype {
     FILETYPE_JPEG,
     FILETYPE_TARGA,
     FILETYPE_PCX,
-    FILETYPE_IFF_ILBM
+    FILETYPE_IFF_ILBM,
+    FILETYPE_EVILPIXIE  // our own project format (see file_native.h)
 };
 
 
@@ -0,0 +1,86 @@
+#include "frame_changes.h"
+
+#include <algorithm>
+
+
+FrameChanges::FrameChanges(NodePath const& target, int numFrames) :
+    m_Target(target),
+    m_Changed(numFrames, true)
+{
+}
+
+void FrameChanges::Reset(int numFrames)
+{
+    m_Changed.assign(numFrames, false);
+}
+
+bool FrameChanges::Changed(int frame) const
+{
+    // anything we don't know about counts as changed
+    return frame < 0 || frame >= (int)m_Changed.size() || m_Changed[frame];
+}
+
+int FrameChanges::NumChanged() const
+{
+    return (int)std::count(m_Changed.begin(), m_Changed.end(), true);
+}
+
+// mark frames [first, first+count) as changed (ignoring the spare frame)
+void FrameChanges::mark(int first, int count)
+{
+    int end = std::min(first + count, (int)m_Changed.size());
+    for (int i = std::max(first, 0); i < end; ++i) {
+        m_Changed[i] = true;
+    }
+}
+
+void FrameChanges::OnDamaged(NodePath const& target, int frame, Box const& /*dmg*/)
+{
+    if (target == m_Target) {
+        mark(frame, 1);
+    }
+}
+
+void FrameChanges::OnPaletteChanged(NodePath const& target, int /*frame*/, int /*index*/, Colour const& /*c*/)
+{
+    if (target == m_Target) {
+        mark(0, (int)m_Changed.size());
+    }
+}
+
+void FrameChanges::OnPaletteReplaced(NodePath const& target, int /*frame*/)
+{
+    if (target == m_Target) {
+        mark(0, (int)m_Changed.size());
+    }
+}
+
+void FrameChanges::OnFramesAdded(NodePath const& target, int first, int count)
+{
+    if (target != m_Target || first < 0) {
+        return;
+    }
+    first = std::min(first, (int)m_Changed.size());
+    m_Changed.insert(m_Changed.begin() + first, count, true);
+    // everything after has moved
+    mark(first, (int)m_Changed.size() - first);
+}
+
+void FrameChanges::OnFramesRemoved(NodePath const& target, int first, int count)
+{
+    if (target != m_Target || first < 0) {
+        return;
+    }
+    first = std::min(first, (int)m_Changed.size());
+    int end = std::min(first + count, (int)m_Changed.size());
+    m_Changed.erase(m_Changed.begin() + first, m_Changed.begin() + end);
+    // everything after has moved
+    mark(first, (int)m_Changed.size() - first);
+}
+
+void FrameChanges::OnFramesBlatted(NodePath const& target, int first, int count)
+{
+    if (target == m_Target) {
+        mark(first, count);
+    }
+}
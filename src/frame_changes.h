@@ -0,0 +1,46 @@
+#ifndef FRAME_CHANGES_H
+#define FRAME_CHANGES_H
+
+#include "layer.h"
+#include "projectlistener.h"
+
+#include <vector>
+
+// Keeps track of which frames of a layer have changed since the last
+// Reset(), from the project's notifications (the owner needs to add it
+// as a listener to the project).
+// A frame counts as changed if it's been drawn on, replaced, inserted, or
+// has shifted position (due to frames being added or removed before it).
+// Palette changes count as a change to every frame.
+// The spare frame isn't tracked.
+class FrameChanges : public ProjectListener
+{
+public:
+    // Starts off with all frames marked as changed.
+    FrameChanges(NodePath const& target, int numFrames);
+
+    NodePath const& Target() const { return m_Target; }
+
+    // Mark all frames as unchanged.
+    void Reset(int numFrames);
+    bool Changed(int frame) const;
+    int NumChanged() const;
+
+    // ProjectListener implementation
+    virtual void OnDamaged(NodePath const& target, int frame, Box const& dmg) override;
+    virtual void OnPaletteChanged(NodePath const& target, int frame, int index, Colour const& c) override;
+    virtual void OnPaletteReplaced(NodePath const& target, int frame) override;
+    virtual void OnFramesAdded(NodePath const& target, int first, int count) override;
+    virtual void OnFramesRemoved(NodePath const& target, int first, int count) override;
+    virtual void OnFramesBlatted(NodePath const& target, int first, int count) override;
+
+private:
+    FrameChanges(FrameChanges const&);  // disallowed
+
+    void mark(int first, int count);
+
+    NodePath m_Target;
+    std::vector<bool> m_Changed;    // one per frame
+};
+
+#endif // FRAME_CHANGES_H
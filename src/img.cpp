@@ -6,20 +6,74 @@
 #include <cstring>
 #include <cstdio>
 #include <cassert>
-#include <algorithm>    // for reverse()
+#include <algorithm>    // for reverse(), min()
+
+// Rows are grouped into tiles of roughly this size.
+// Big enough to keep the per-tile overhead low, small enough that writing
+// a single pixel doesn't involve copying a huge swathe of image.
+static const int TARGET_TILE_BYTES = 32*1024;
+
+static int bytesPerPixel( PixelFormat fmt )
+{
+    switch(fmt)
+    {
+        case FMT_I8: return 1;
+        case FMT_RGBX8: return 4;
+        case FMT_RGBA8: return 4;
+    }
+    return 0;
+}
+
+// log2 of the number of rows to put in each tile
+static int tileShift( int bytesPerRow )
+{
+    int rows = (bytesPerRow>0) ? TARGET_TILE_BYTES/bytesPerRow : 1;
+    int shift = 0;
+    while( (2<<shift) <= rows )
+        ++shift;
+    return shift;
+}
 
 Img::Img( PixelFormat pixel_format, int w, int h, uint8_t const* initial ) :
     m_Format(pixel_format),
     m_BytesPerPixel(0),
     m_BytesPerRow(0),
     m_Bounds(0,0,w,h),
-    m_Pixels(0)
+    m_TileShift(0)
 {
     init();
-    if(initial) {
-        memcpy( m_Pixels, initial, H()*m_BytesPerRow );
-    } else {
-        memset( m_Pixels, 0, H()*m_BytesPerRow );
+    int y;
+    for( y=0; y<H(); y+=RowsInTile(y) )
+    {
+        size_t bytes = RowsInTile(y)*m_BytesPerRow;
+        if(initial) {
+            memcpy( Ptr(0,y), initial + (y*m_BytesPerRow), bytes );
+        } else {
+            memset( Ptr(0,y), 0, bytes );
+        }
+    }
+}
+
+Img::Img( PixelFormat pixel_format, int w, int h, TileStorage* storage,
+    std::vector<uint8_t const*> const& tilePixels ) :
+    m_Format(pixel_format),
+    m_BytesPerPixel(0),
+    m_BytesPerRow(0),
+    m_Bounds(0,0,w,h),
+    m_TileShift(0)
+{
+    initGeometry();
+    assert((int)tilePixels.size() == (H()+TileRows()-1)/TileRows());
+    for( uint8_t const* pixels : tilePixels )
+    {
+        // The extra ref (never released by an Img) means the tile always
+        // looks shared, so Ptr() will copy it before writing.
+        Tile* tile = new Tile;
+        tile->refs.store(2);
+        tile->pixels = const_cast<uint8_t*>(pixels);
+        tile->storage = storage;
+        storage->refs.fetch_add(1, std::memory_order_relaxed);
+        m_Tiles.push_back(tile);
     }
 }
 
@@ -28,11 +82,9 @@ Img::Img( Img const& other ) :
     m_BytesPerPixel(0),
     m_BytesPerRow(0),
     m_Bounds(other.m_Bounds),
-    m_Pixels(0)
+    m_TileShift(0)
 {
-    init();
-    Box b(m_Bounds);
-    Blit(other, other.Bounds(), *this, b);
+    share(other);
 }
 
 Img::Img( Img const& other, Box const& otherarea ) :
@@ -40,39 +92,151 @@ Img::Img( Img const& other, Box const& otherarea ) :
     m_BytesPerPixel(0),
     m_BytesPerRow(0),
     m_Bounds(0,0,otherarea.w,otherarea.h),
-    m_Pixels(0)
+    m_TileShift(0)
 {
+    if( otherarea == other.Bounds() )
+    {
+        share(other);
+        return;
+    }
     init();
     Box b(m_Bounds);
     Blit(other, otherarea, *this, b);
 }
 
+Img::~Img()
+{
+    release();
+}
 
-// set up stuff that depends on pixelformat 
-void Img::init()
+
+// set up stuff that depends on pixelformat and size
+void Img::initGeometry()
 {
     assert(m_Bounds.x==0 && m_Bounds.y==0);
 
-    switch(m_Format)
-    {
-        case FMT_I8: m_BytesPerPixel=1; break;
-        case FMT_RGBX8: m_BytesPerPixel=4; break;
-        case FMT_RGBA8: m_BytesPerPixel=4; break;
-    }
+    m_BytesPerPixel = bytesPerPixel(m_Format);
     assert(m_BytesPerPixel>0);
     m_BytesPerRow = m_Bounds.w*m_BytesPerPixel;
-    m_Pixels = new uint8_t[m_BytesPerRow*m_Bounds.h];
+    m_TileShift = tileShift(m_BytesPerRow);
+}
+
+// set up geometry, and allocate the tiles (pixels are left uninitialised)
+void Img::init()
+{
+    initGeometry();
+    assert(m_Tiles.empty());
+    int y;
+    for( y=0; y<H(); y+=TileRows() )
+    {
+        Tile* tile = new Tile;
+        tile->refs.store(1);
+        tile->pixels = new uint8_t[RowsInTile(y)*m_BytesPerRow];
+        tile->storage = nullptr;
+        m_Tiles.push_back(tile);
+    }
 }
 
+// static
+int Img::TileRowsFor( PixelFormat fmt, int w )
+{
+    return 1<<tileShift(w*bytesPerPixel(fmt));
+}
 
-void Img::Copy( Img const& other )
+// make this image use the same tiles as other
+void Img::share( Img const& other )
 {
-    delete [] m_Pixels;
+    assert(m_Tiles.empty());
     m_Format = other.m_Format;
+    m_BytesPerPixel = other.m_BytesPerPixel;
+    m_BytesPerRow = other.m_BytesPerRow;
     m_Bounds = other.m_Bounds;
-    init();
-    Box b(m_Bounds);
-    Blit(other, other.Bounds(), *this, b);
+    m_TileShift = other.m_TileShift;
+    m_Tiles = other.m_Tiles;
+    for( Tile* tile : m_Tiles )
+        tile->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+// drop all our tiles, freeing any no longer used by other images
+void Img::release()
+{
+    for( Tile* tile : m_Tiles )
+        releaseTile(tile);
+    m_Tiles.clear();
+}
+
+// drop a reference to a tile, freeing it if nobody else is using it
+// static
+void Img::releaseTile( Tile* tile )
+{
+    // (another thread might free the tile as soon as we let go of it)
+    TileStorage* storage = tile->storage;
+    int refs = tile->refs.fetch_sub(1, std::memory_order_acq_rel);
+    if( storage )
+    {
+        // tiles using external storage carry an extra ref
+        if( refs == 2 )
+        {
+            if( storage->refs.fetch_sub(1, std::memory_order_acq_rel) == 1 )
+                delete storage;
+            delete tile;
+        }
+    }
+    else if( refs == 1 )
+    {
+        delete [] tile->pixels;
+        delete tile;
+    }
+}
+
+// replace tile t with our own private copy (called before writing to a
+// shared tile)
+Img::Tile* Img::unshare( int t )
+{
+    Tile* old = m_Tiles[t];
+    size_t bytes = RowsInTile(t<<m_TileShift)*m_BytesPerRow;
+    Tile* tile = new Tile;
+    tile->refs.store(1);
+    tile->pixels = new uint8_t[bytes];
+    tile->storage = nullptr;
+    memcpy( tile->pixels, old->pixels, bytes );
+    // other owner(s) might have gone away in the meantime
+    releaseTile(old);
+    m_Tiles[t] = tile;
+    return tile;
+}
+
+
+Box Img::TileBounds( int t ) const
+{
+    int y = t<<m_TileShift;
+    return Box( 0, y, W(), RowsInTile(y) );
+}
+
+int Img::RowsInTile( int y ) const
+{
+    int end = ((y>>m_TileShift)+1)<<m_TileShift;
+    return std::min( end, H() ) - y;
+}
+
+size_t Img::UnsharedMemUsage() const
+{
+    size_t total = 0;
+    for( int t=0; t<NumTiles(); ++t )
+    {
+        if( !TileShared(t) )
+            total += (size_t)m_BytesPerRow*RowsInTile(t<<m_TileShift);
+    }
+    return total;
+}
+
+
+void Img::Copy( Img const& other )
+{
+    if( &other == this )
+        return;
+    release();
+    share(other);
 }
 
 
@@ -197,15 +361,11 @@ void Img::OutlineBox( PenColour const& pen, Box& b )
         HLine(pen, b.XMin(), b.XMax()+1, b.YMax());
 
         // draw sides (note: already draw top & bottom pixels)
-        RGBX8* pleft = Ptr_RGBX8(b.XMin(),b.YMin()+1);
-        RGBX8* pright = Ptr_RGBX8(b.XMax(),b.YMin()+1);
         int y;
         for( y=b.YMin()+1; y<=b.YMax()-1; ++y )
         {
-            *pleft = pen.rgb();
-            pleft += W();
-            *pright = pen.rgb();
-            pright += W();
+            *Ptr_RGBX8(b.XMin(),y) = pen.rgb();
+            *Ptr_RGBX8(b.XMax(),y) = pen.rgb();
         }
     } else {
         assert(false);// not implemented yet
@@ -217,19 +377,18 @@ Img* Rotate90Clockwise(Img const& srcImg)
 {
     int destW = srcImg.H(); // Flipped.
     int destH = srcImg.W(); // Flipped.
-    int srcPitch = srcImg.Pitch();
     size_t bytesPerPixel = PixelSize(srcImg.Fmt());
     Img* destImg = new Img(srcImg.Fmt(), destW, destH);
-    // Scan out destImg.
-    for (int y = 0; y < destH; ++y) {
-        uint8_t* dest = destImg->Ptr(0, y);
-        uint8_t const* src = srcImg.PtrConst(y, destW-1);   // Flipped!
-        for (int x = 0; x < destW; ++x) {
+    // Scan out srcImg, each row becoming a column of destImg.
+    for (int sy = 0; sy < destW; ++sy) {
+        uint8_t const* src = srcImg.PtrConst(0, sy);
+        int destx = (destW-1) - sy;  // Flipped!
+        for (int sx = 0; sx < destH; ++sx) {
+            uint8_t* dest = destImg->Ptr(destx, sx);
             for (size_t i=0; i<bytesPerPixel; ++i) {
                 dest[i] = src[i];
             }
-            dest += bytesPerPixel;
-            src -= srcPitch;
+            src += bytesPerPixel;
         }
     }
     return destImg;
@@ -5,25 +5,52 @@
 #include "colours.h"
 #include "point.h"
 
+#include <atomic>
 #include <cassert>
+#include <vector>
 
 struct Palette;
 
 
-
+// Img holds a bitmap.
+// The pixels are stored as a vertical stack of tiles, each tile being a
+// band of whole rows. Tiles are reference counted and shared between
+// copies of an image, and are only copied when written to (via Ptr()).
+// So copying an Img is cheap, and the copy only costs memory for the tiles
+// which end up being modified.
+//
+// Tiles can also point straight at read-only pixels held elsewhere (eg
+// a memory-mapped file, see TileStorage). Those tiles are always copied
+// upon write.
+//
+// Rows are always contiguous, but consecutive rows are only Pitch() bytes
+// apart within a single tile. Code which wants to step a pointer from row
+// to row needs to use RowsInTile() (or just call Ptr() for each row).
 class Img
 {
 public:
+    // Read-only memory which tiles can use directly (eg a memory-mapped
+    // file). Deleted once the last tile using it goes away.
+    class TileStorage
+    {
+    public:
+        virtual ~TileStorage() {}
+        std::atomic<int> refs {0};
+    };
+
     Img();   // disallowed
     Img( Img const& other );
     Img( Img const& other, Box const& otherarea );
 
 	Img( PixelFormat pixel_format, int w, int h, uint8_t const* initial=0 );
+    // Use existing pixels in storage, with one pointer per tile (tiles
+    // laid out as per TileRowsFor()).
+    Img( PixelFormat pixel_format, int w, int h, TileStorage* storage,
+        std::vector<uint8_t const*> const& tilePixels );
     // disallowed (use Copy() instead!)
     Img& operator=( Img const& other );
 
-	~Img()
-		{ delete [] m_Pixels; }
+	~Img();
     PixelFormat Fmt() const { return m_Format; }
 	int W() const
 		{ return m_Bounds.w; }
@@ -46,16 +73,50 @@ public:
 		{ assert(Fmt()==FMT_RGBA8); return (RGBA8*)PtrConst(x,y); }
 
     // Raw access.
-	uint8_t* Ptr( int x, int y )
-		{ return m_Pixels + (y*m_BytesPerRow) + (x*m_BytesPerPixel); }
-	uint8_t const* PtrConst( int x, int y ) const
-		{ return m_Pixels + (y*m_BytesPerRow) + (x*m_BytesPerPixel); }
+    // The returned pointer is valid to the end of row y. Ptr() will
+    // unshare the containing tile if required, so it is safe to write to.
+	uint8_t* Ptr( int x, int y );
+	uint8_t const* PtrConst( int x, int y ) const;
     int Pitch() const
         { return m_BytesPerRow; }
 
+    // Tile access, for code which wants to walk the image a tile at a time.
+    int NumTiles() const
+        { return (int)m_Tiles.size(); }
+    // Max number of rows in a tile (always a power of two).
+    int TileRows() const
+        { return 1<<m_TileShift; }
+    // Index of the tile holding row y.
+    int TileIndex( int y ) const
+        { return y>>m_TileShift; }
+    // The area of the image covered by tile t.
+    Box TileBounds( int t ) const;
+    // Number of rows, starting at y, which are stored in the same tile
+    // (ie how many times a pointer to row y can be advanced by Pitch()).
+    int RowsInTile( int y ) const;
+    // Max number of rows per tile for an image of the given width.
+    static int TileRowsFor( PixelFormat fmt, int w );
+    // Is tile t shared with another Img (ie will be copied upon write)?
+    bool TileShared( int t ) const
+        { return m_Tiles[t]->refs.load(std::memory_order_acquire) > 1; }
+    // Does tile t use the same storage as tile t in other?
+    bool SameTile( Img const& other, int t ) const
+        { return t < other.NumTiles() && m_Tiles[t] == other.m_Tiles[t]; }
+    // Identifies the storage of tile t. Tiles shared between images have
+    // the same ID, and no other tile will have it while this one exists.
+    void const* TileID( int t ) const
+        { return m_Tiles[t]; }
+
     Box const& Bounds() const
         { return m_Bounds; }
 
+    // bytes of pixel data (shared tiles are counted in full)
+    size_t MemUsage() const
+        { return (size_t)m_BytesPerRow*m_Bounds.h; }
+    // bytes of pixel data in tiles which aren't shared with another Img
+    // (ie the memory which would be freed by deleting this one)
+    size_t UnsharedMemUsage() const;
+
     // TODO: move all drawing ops out to somewhere else...
     void HLine( PenColour const& pen, int xbegin, int xend, int y);
     // rename to Clone
@@ -78,15 +139,43 @@ public:
 
 protected:
     void init();
+    void initGeometry();
+    void share( Img const& other );
+    void release();
+
+    struct Tile {
+        std::atomic<int> refs;
+        uint8_t* pixels;
+        TileStorage* storage;   // null if pixels are our own
+    };
+    Tile* unshare( int t );
+    static void releaseTile( Tile* tile );
 
     PixelFormat m_Format;
     int m_BytesPerPixel;
     int m_BytesPerRow;
     Box m_Bounds;   // TODO: should just be w & h.
-	uint8_t* m_Pixels;
+    int m_TileShift;    // log2 of rows per tile
+    std::vector<Tile*> m_Tiles;
 private:
 };
 
+
+inline uint8_t* Img::Ptr( int x, int y )
+{
+    int t = y>>m_TileShift;
+    Tile* tile = m_Tiles[t];
+    if (tile->refs.load(std::memory_order_acquire) > 1)
+        tile = unshare(t);
+    return tile->pixels + ((y & (TileRows()-1))*m_BytesPerRow) + (x*m_BytesPerPixel);
+}
+
+inline uint8_t const* Img::PtrConst( int x, int y ) const
+{
+    Tile const* tile = m_Tiles[y>>m_TileShift];
+    return tile->pixels + ((y & (TileRows()-1))*m_BytesPerRow) + (x*m_BytesPerPixel);
+}
+
 // Return a copy of the image, rotated 90 degrees clockwise.
 Img* Rotate90Clockwise(Img const& srcImg);
 
@@ -1,40 +1,258 @@
+#include "img_convert.h"
+#include "colour_map.h"
 #include "colours.h"
 #include "img.h"
+#include "layer.h"
 #include "palette.h"
+#include "palette_matcher.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <thread>
+#include <vector>
 
 
-Img* ConvertRGBA8toI8(Img const& srcImg, Palette const& destPalette) {
-    assert(srcImg.Fmt() == FMT_RGBA8);
-    Img* destImg = new Img(FMT_I8, srcImg.W(), srcImg.H());
+// The lossy conversions find the closest palette colour for each
+// distinct colour in the image, rather than for every pixel.
+// First pass gathers up the colours, then they're all resolved, then
+// a second pass applies the results.
 
-    for (int y=0; y<srcImg.H(); ++y) {
-        const RGBA8 *src = srcImg.PtrConst_RGBA8(0,y);
-        I8 *dest = destImg->Ptr_I8(0,y);
-        for (int x=0; x<srcImg.W(); ++x) {
+// ColourMap keys (RGBX8 ignores the pad byte).
+static inline uint32_t colourKey(RGBX8 c)
+    { return (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16); }
+static inline uint32_t colourKey(RGBA8 c)
+    { return (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16) | ((uint32_t)c.a << 24); }
 
-            *dest++ = (I8)destPalette.Closest(Colour(*src));
-            ++src;
+template<typename P> Colour keyColour(uint32_t key);
+template<> Colour keyColour<RGBX8>(uint32_t key)
+    { return Colour(key & 0xff, (key >> 8) & 0xff, (key >> 16) & 0xff); }
+template<> Colour keyColour<RGBA8>(uint32_t key)
+    { return Colour(key & 0xff, (key >> 8) & 0xff, (key >> 16) & 0xff, key >> 24); }
+
+// Past this many colours, the table costs more than it saves (the
+// PaletteMatcher cache does a decent job anyway).
+static const size_t maxTableColours = 1 << 16;
+
+// Build a table of the closest palette index for every colour in rows
+// y0..y1 of img.
+// Returns false if there are too many colours to bother.
+template<typename P>
+static bool buildRemapTable(Img const& img, int y0, int y1, PaletteMatcher& matcher, ColourMap& table)
+{
+    for (int y = y0; y < y1; ++y) {
+        P const* p = (P const*)img.PtrConst(0, y);
+        uint32_t prev = 0;
+        for (int x = 0; x < img.W(); ++x) {
+            uint32_t key = colourKey(p[x]);
+            // (runs of the same colour are common)
+            if (x == 0 || key != prev) {
+                table.Get(key, -1);
+                prev = key;
+            }
+        }
+        if (table.Size() > maxTableColours) {
+            return false;
         }
     }
-    return destImg;
+    table.ForEach([&](uint32_t key, int& idx) {
+        idx = matcher.Closest(keyColour<P>(key));
+    });
+    return true;
 }
 
-Img* ConvertRGBX8toI8(Img const& srcImg, Palette const& destPalette) {
-    assert(srcImg.Fmt() == FMT_RGBX8);
-    Img* destImg = new Img(FMT_I8, srcImg.W(), srcImg.H());
+// Looks up the closest palette index for pixels, using the table from
+// buildRemapTable() if there is one.
+// Remembers the last one, as runs of the same colour are common.
+class RemapLookup
+{
+public:
+    RemapLookup(ColourMap const* table, PaletteMatcher& matcher) :
+        m_Table(table), m_Matcher(matcher), m_Prev(0), m_Idx(-1) {}
+    template<typename P> int operator()(P c)
+    {
+        uint32_t key = colourKey(c);
+        if (m_Idx < 0 || key != m_Prev) {
+            m_Idx = m_Table ? *m_Table->Find(key) : m_Matcher.Closest(Colour(c));
+            m_Prev = key;
+        }
+        return m_Idx;
+    }
+private:
+    ColourMap const* m_Table;
+    PaletteMatcher& m_Matcher;
+    uint32_t m_Prev;
+    int m_Idx;
+};
 
-    for (int y=0; y<srcImg.H(); ++y) {
-        const RGBX8 *src = srcImg.PtrConst_RGBX8(0,y);
-        I8 *dest = destImg->Ptr_I8(0,y);
-        for (int x=0; x<srcImg.W(); ++x) {
-            *dest++ = (I8)destPalette.Closest(Colour(*src));
-            ++src;
+// Work out where each index in srcPalette maps to.
+static void buildRemapTableI8(Palette const& srcPalette, PaletteMatcher& matcher, I8 table[256])
+{
+    for (int i = 0; i < 256; ++i) {
+        table[i] = (I8)matcher.Closest(srcPalette.GetColour(i));
+    }
+}
+
+
+// Progress over all the rows being converted, which might be spread over
+// several images and threads. Rows are counted as they're finished, but
+// progress is only reported (and cancelling noticed) on the thread which
+// started the conversion.
+class RowProgress
+{
+public:
+    RowProgress(ProgressFn const& fn, int total) :
+        m_Fn(fn),
+        m_Total(total),
+        m_Caller(std::this_thread::get_id()),
+        m_Done(0),
+        m_Cancelled(false)
+    {}
+
+    void Add(int rows)
+    {
+        int done = (m_Done += rows);
+        if (m_Fn && !m_Cancelled && std::this_thread::get_id() == m_Caller) {
+            if (!m_Fn(done, m_Total)) {
+                m_Cancelled = true;
+            }
         }
     }
+
+    bool Cancelled() const { return m_Cancelled; }
+
+private:
+    ProgressFn const& m_Fn;
+    int m_Total;
+    std::thread::id m_Caller;
+    std::atomic<int> m_Done;
+    std::atomic<bool> m_Cancelled;
+};
+
+
+// Images bigger than this are split into bands of rows, done in parallel.
+static const long minParallelPixels = 512 * 512;
+
+// Call fn(matcher, y0, y1) for bands of rows covering img. Big images are
+// split up along tile boundaries (so no two threads write to the same
+// tile) and done in parallel, each band with its own copy of the matcher.
+// If prog is set, finished bands are added to it, and any bands not yet
+// started are skipped once it's cancelled.
+template<typename FN>
+static void forRowBands(Img const& img, PaletteMatcher& matcher, RowProgress* prog, FN const& body)
+{
+    auto fn = [&](PaletteMatcher& m, int y0, int y1) {
+        if (prog && prog->Cancelled()) {
+            return;
+        }
+        body(m, y0, y1);
+        if (prog) {
+            prog->Add(y1 - y0);
+        }
+    };
+    const int numTiles = img.NumTiles();
+    if ((long)img.W() * img.H() < minParallelPixels || numTiles < 2) {
+        fn(matcher, 0, img.H());
+        return;
+    }
+    // Bands of whole tiles, big enough to be worth handing out, but small
+    // enough that progress is reported as we go.
+    const long tilePixels = (long)img.W() * img.TileRows();
+    const int bandTiles = (int)std::max(1L, minParallelPixels / tilePixels);
+    const int numBands = (numTiles + bandTiles - 1) / bandTiles;
+    ParallelFor(0, numBands, 1, [&](int bbegin, int bend) {
+        auto doBands = [&](PaletteMatcher& m) {
+            for (int b = bbegin; b < bend; ++b) {
+                int y0 = img.TileBounds(b * bandTiles).y;
+                Box last = img.TileBounds(std::min(numTiles, (b + 1) * bandTiles) - 1);
+                fn(m, y0, last.y + last.h);
+            }
+        };
+        if (bbegin == 0 && bend == numBands) {
+            // not split up after all
+            doBands(matcher);
+        } else {
+            PaletteMatcher local(matcher);
+            doBands(local);
+        }
+    });
+}
+
+// Write the closest palette index for each pixel in rows y0..y1 of srcImg
+// to destImg.
+template<typename P>
+static void indexRows(Img const& srcImg, Img& destImg, PaletteMatcher& matcher, int y0, int y1)
+{
+    ColourMap table;
+    bool useTable = buildRemapTable<P>(srcImg, y0, y1, matcher, table);
+    RemapLookup lookup(useTable ? &table : nullptr, matcher);
+    for (int y = y0; y < y1; ++y) {
+        P const* src = (P const*)srcImg.PtrConst(0, y);
+        I8 *dest = destImg.Ptr_I8(0, y);
+        for (int x = 0; x < srcImg.W(); ++x) {
+            *dest++ = (I8)lookup(*src++);
+        }
+    }
+}
+
+// Replace each pixel in rows y0..y1 with the closest palette colour.
+template<typename P>
+static void remapRows(Img& img, PaletteMatcher& matcher, int y0, int y1)
+{
+    ColourMap table;
+    bool useTable = buildRemapTable<P>(img, y0, y1, matcher, table);
+    RemapLookup lookup(useTable ? &table : nullptr, matcher);
+    for (int y = y0; y < y1; ++y) {
+        P* p = (P*)img.Ptr(0, y);
+        for (int x = 0; x < img.W(); ++x) {
+            *p = matcher.GetColour(lookup(*p));
+            ++p;
+        }
+    }
+}
+
+
+Img* ConvertRGBA8toI8(Img const& srcImg, Palette const& destPalette) {
+    PaletteMatcher matcher(destPalette);
+    return ConvertRGBA8toI8(srcImg, matcher);
+}
+
+// Convert RGBX8 or RGBA8 to I8.
+template<typename P>
+static Img* indexImg(Img const& srcImg, PaletteMatcher& matcher, RowProgress* prog)
+{
+    Img* destImg = new Img(FMT_I8, srcImg.W(), srcImg.H());
+    forRowBands(srcImg, matcher, prog, [&](PaletteMatcher& m, int y0, int y1) {
+        indexRows<P>(srcImg, *destImg, m, y0, y1);
+    });
     return destImg;
 }
 
+// Remap RGBX8 or RGBA8 in place.
+template<typename P>
+static void remapImg(Img& img, PaletteMatcher& matcher, RowProgress* prog)
+{
+    forRowBands(img, matcher, prog, [&](PaletteMatcher& m, int y0, int y1) {
+        remapRows<P>(img, m, y0, y1);
+    });
+}
+
+Img* ConvertRGBA8toI8(Img const& srcImg, PaletteMatcher& matcher) {
+    assert(srcImg.Fmt() == FMT_RGBA8);
+    return indexImg<RGBA8>(srcImg, matcher, nullptr);
+}
+
+Img* ConvertRGBX8toI8(Img const& srcImg, Palette const& destPalette) {
+    PaletteMatcher matcher(destPalette);
+    return ConvertRGBX8toI8(srcImg, matcher);
+}
+
+Img* ConvertRGBX8toI8(Img const& srcImg, PaletteMatcher& matcher) {
+    assert(srcImg.Fmt() == FMT_RGBX8);
+    return indexImg<RGBX8>(srcImg, matcher, nullptr);
+}
+
 Img* ConvertI8toRGBX8(Img const& srcImg, Palette const& srcPalette) {
     assert(srcImg.Fmt() == FMT_I8);
     Img* destImg = new Img(FMT_RGBX8, srcImg.W(), srcImg.H());
@@ -100,14 +318,16 @@ Img* ConvertRGBX8toRGBA8(Img const& srcImg) {
 
 Img* ConvertI8toI8(Img const& srcImg, Palette const& srcPalette, Palette const& destPalette) {
     assert(srcImg.Fmt() == FMT_I8);
+    PaletteMatcher matcher(destPalette);
+    I8 table[256];
+    buildRemapTableI8(srcPalette, matcher, table);
     Img* destImg = new Img(FMT_I8, srcImg.W(), srcImg.H());
 
     for (int y=0; y<srcImg.H(); ++y) {
         const I8 *src = srcImg.PtrConst_I8(0,y);
         I8 *dest = destImg->Ptr_I8(0,y);
         for (int x=0; x<srcImg.W(); ++x) {
-            Colour c = srcPalette.GetColour((int)*src++);
-            *dest++ = (I8)destPalette.Closest(c);
+            *dest++ = table[*src++];
         }
     }
     return destImg;
@@ -115,42 +335,325 @@ Img* ConvertI8toI8(Img const& srcImg, Palette const& srcPalette, Palette const&
 
 
 void RemapI8(Img& img, Palette const& srcPalette, Palette const& destPalette)
+{
+    PaletteMatcher matcher(destPalette);
+    RemapI8(img, srcPalette, matcher);
+}
+
+void RemapI8(Img& img, Palette const& srcPalette, PaletteMatcher& matcher)
 {
     assert(img.Fmt() == FMT_I8);
+    I8 table[256];
+    buildRemapTableI8(srcPalette, matcher, table);
     for (int y = 0; y < img.H(); ++y) {
         I8* p = img.Ptr_I8(0, y);
         for (int x = 0; x < img.W(); ++x) {
-            Colour c = srcPalette.GetColour((int)*p);
-            *p = (I8)destPalette.Closest(c);
+            *p = table[*p];
             ++p;
         }
     }
 }
 
 void RemapRGBX8(Img& img, Palette const& destPalette)
+{
+    PaletteMatcher matcher(destPalette);
+    RemapRGBX8(img, matcher);
+}
+
+void RemapRGBX8(Img& img, PaletteMatcher& matcher)
 {
     assert(img.Fmt() == FMT_RGBX8);
-    for (int y = 0; y < img.H(); ++y) {
-        RGBX8 *p = img.Ptr_RGBX8(0, y);
-        for (int x=0; x < img.W(); ++x) {
-            I8 best = (I8)destPalette.Closest(Colour(*p));
-            *p = destPalette.GetColour((int)best);
-            ++p;
-        }
-    }
+    remapImg<RGBX8>(img, matcher, nullptr);
 }
 
 
 void RemapRGBA8(Img& img, Palette const& destPalette)
+{
+    PaletteMatcher matcher(destPalette);
+    RemapRGBA8(img, matcher);
+}
+
+void RemapRGBA8(Img& img, PaletteMatcher& matcher)
 {
     assert(img.Fmt() == FMT_RGBA8);
-    for (int y = 0; y < img.H(); ++y) {
-        RGBA8 *p = img.Ptr_RGBA8(0, y);
-        for (int x=0; x < img.W(); ++x) {
-            I8 best = (I8)destPalette.Closest(Colour(*p));
-            *p = destPalette.GetColour((int)best);
-            ++p;
+    remapImg<RGBA8>(img, matcher, nullptr);
+}
+
+
+// Dithering.
+// Done in fixed-size bands of rows, so the result is the same however many
+// threads there are. Error diffusion doesn't cross bands, so each band
+// starts a few rows early to pick up the error coming down from above
+// (without writing those rows), which hides the seams.
+static const int ditherBandRows = 64;
+static const int ditherWarmupRows = 8;
+
+// Source pixels as Colours.
+template<typename P> inline Colour pixelColour(P const* row, int x, Palette const&)
+    { return Colour(row[x]); }
+template<> inline Colour pixelColour<I8>(I8 const* row, int x, Palette const& pal)
+    { return pal.GetColour(row[x]); }
+
+static inline int clamp255(int v)
+    { return v < 0 ? 0 : (v > 255 ? 255 : v); }
+
+// Floyd-Steinberg, serpentine (alternate rows go right-to-left).
+template<typename P>
+static void diffuseRows(Img const& srcImg, Palette const& srcPalette, Img& destImg,
+    PaletteMatcher& matcher, int y0, int y1)
+{
+    const int w = srcImg.W();
+    // r,g,b error (in 16ths) for the current and next rows, with an
+    // extra pixel at each end to catch the overspill.
+    std::vector<int> cur((w + 2) * 3, 0);
+    std::vector<int> next((w + 2) * 3, 0);
+    for (int y = std::max(0, y0 - ditherWarmupRows); y < y1; ++y) {
+        P const* src = (P const*)srcImg.PtrConst(0, y);
+        I8* dest = (y >= y0) ? destImg.Ptr_I8(0, y) : nullptr;
+        const int dir = (y & 1) ? -1 : 1;
+        int x = (dir > 0) ? 0 : w - 1;
+        for (int i = 0; i < w; ++i, x += dir) {
+            Colour c = pixelColour(src, x, srcPalette);
+            int const* e = &cur[(x + 1) * 3];
+            int want[3] = {
+                clamp255(c.r + ((e[0] + 8) >> 4)),
+                clamp255(c.g + ((e[1] + 8) >> 4)),
+                clamp255(c.b + ((e[2] + 8) >> 4))};
+            int idx = matcher.Closest(Colour(want[0], want[1], want[2], c.a));
+            if (dest) {
+                dest[x] = (I8)idx;
+            }
+            Colour got = matcher.GetColour(idx);
+            int err[3] = {want[0] - got.r, want[1] - got.g, want[2] - got.b};
+            int* ahead = &cur[(x + 1 + dir) * 3];
+            int* below = &next[(x + 1) * 3];
+            for (int ch = 0; ch < 3; ++ch) {
+                ahead[ch] += err[ch] * 7;
+                below[ch - dir * 3] += err[ch] * 3;
+                below[ch] += err[ch] * 5;
+                below[ch + dir * 3] += err[ch];
+            }
+        }
+        std::swap(cur, next);
+        std::fill(next.begin(), next.end(), 0);
+    }
+}
+
+static const int bayer8[8][8] = {
+    { 0, 32,  8, 40,  2, 34, 10, 42},
+    {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44,  4, 36, 14, 46,  6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22},
+    { 3, 35, 11, 43,  1, 33,  9, 41},
+    {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47,  7, 39, 13, 45,  5, 37},
+    {63, 31, 55, 23, 61, 29, 53, 21}};
+
+// Ordered dither, with an 8x8 Bayer matrix.
+// spread is the size of the nudge (roughly the gap between palette colours).
+template<typename P>
+static void orderedRows(Img const& srcImg, Palette const& srcPalette, Img& destImg,
+    PaletteMatcher& matcher, int spread, int y0, int y1)
+{
+    for (int y = y0; y < y1; ++y) {
+        P const* src = (P const*)srcImg.PtrConst(0, y);
+        I8* dest = destImg.Ptr_I8(0, y);
+        int const* row = bayer8[y & 7];
+        for (int x = 0; x < srcImg.W(); ++x) {
+            Colour c = pixelColour(src, x, srcPalette);
+            int offset = ((row[x & 7] * 2 + 1 - 64) * spread) / 128;
+            Colour want(clamp255(c.r + offset), clamp255(c.g + offset),
+                clamp255(c.b + offset), c.a);
+            dest[x] = (I8)matcher.Closest(want);
         }
     }
 }
 
+template<typename P>
+static void ditherImg(Img const& srcImg, Palette const& srcPalette, Img& destImg,
+    PaletteMatcher& matcher, DitherMode dither, RowProgress* prog)
+{
+    // keep bands on tile boundaries, so no two threads write to the same tile
+    const int tileRows = destImg.TileRows();
+    const int bandRows = ((ditherBandRows + tileRows - 1) / tileRows) * tileRows;
+    const int numBands = (srcImg.H() + bandRows - 1) / bandRows;
+    // ordered dither spread: gap between levels, if the palette were an
+    // even rgb cube
+    const int levels = std::max(2, (int)std::lround(std::cbrt((double)matcher.NumColours())));
+    const int spread = 255 / (levels - 1);
+    auto doBands = [&](PaletteMatcher& m, int begin, int end) {
+        for (int b = begin; b < end; ++b) {
+            if (prog && prog->Cancelled()) {
+                return;
+            }
+            int y0 = b * bandRows;
+            int y1 = std::min(srcImg.H(), y0 + bandRows);
+            if (dither == DITHER_FLOYD_STEINBERG) {
+                diffuseRows<P>(srcImg, srcPalette, destImg, m, y0, y1);
+            } else {
+                orderedRows<P>(srcImg, srcPalette, destImg, m, spread, y0, y1);
+            }
+            if (prog) {
+                prog->Add(y1 - y0);
+            }
+        }
+    };
+    if ((long)srcImg.W() * srcImg.H() < minParallelPixels || numBands < 2) {
+        doBands(matcher, 0, numBands);
+        return;
+    }
+    ParallelFor(0, numBands, 1, [&](int begin, int end) {
+        PaletteMatcher local(matcher);
+        doBands(local, begin, end);
+    });
+}
+
+static Img* ditherToI8(Img const& srcImg, Palette const& srcPalette, PaletteMatcher& matcher,
+    DitherMode dither, RowProgress* prog)
+{
+    assert(dither != DITHER_NONE);
+    Img* destImg = new Img(FMT_I8, srcImg.W(), srcImg.H());
+    switch (srcImg.Fmt()) {
+    case FMT_I8:
+        ditherImg<I8>(srcImg, srcPalette, *destImg, matcher, dither, prog);
+        break;
+    case FMT_RGBX8:
+        ditherImg<RGBX8>(srcImg, srcPalette, *destImg, matcher, dither, prog);
+        break;
+    case FMT_RGBA8:
+        ditherImg<RGBA8>(srcImg, srcPalette, *destImg, matcher, dither, prog);
+        break;
+    default:
+        assert(false);
+        break;
+    }
+    return destImg;
+}
+
+
+Img* DitherToI8(Img const& srcImg, Palette const& srcPalette, PaletteMatcher& matcher, DitherMode dither)
+{
+    return ditherToI8(srcImg, srcPalette, matcher, dither, nullptr);
+}
+
+
+// The slow conversions (those which look up palette colours) add their rows
+// to prog as they go. The rest are quick, so just add the whole image at
+// the end.
+static Img* convertImg(Img const& srcImg, PixelFormat newFmt, Palette const& srcPalette, PaletteMatcher& matcher,
+    DitherMode dither, RowProgress* prog)
+{
+    if (newFmt == FMT_I8 && dither != DITHER_NONE) {
+        return ditherToI8(srcImg, srcPalette, matcher, dither, prog);
+    }
+    Img* destImg = nullptr;
+    bool quick = true;
+    switch (srcImg.Fmt()) {
+    case FMT_I8:
+        if (newFmt == FMT_I8) {
+            destImg = new Img(srcImg);
+            RemapI8(*destImg, srcPalette, matcher);
+        } else if (newFmt == FMT_RGBX8) {
+            destImg = ConvertI8toRGBX8(srcImg, srcPalette);
+        } else if (newFmt == FMT_RGBA8) {
+            destImg = ConvertI8toRGBA8(srcImg, srcPalette);
+        }
+        break;
+    case FMT_RGBX8:
+        if(newFmt == FMT_I8) {
+            destImg = indexImg<RGBX8>(srcImg, matcher, prog);
+            quick = false;
+        } else if (newFmt == FMT_RGBX8) {
+            destImg = new Img(srcImg);
+            remapImg<RGBX8>(*destImg, matcher, prog);
+            quick = false;
+        } else if (newFmt == FMT_RGBA8) {
+            destImg = ConvertRGBX8toRGBA8(srcImg);
+        }
+        break;
+    case FMT_RGBA8:
+        if(newFmt == FMT_I8) {
+            destImg = indexImg<RGBA8>(srcImg, matcher, prog);
+            quick = false;
+        } else if (newFmt == FMT_RGBX8) {
+            destImg = ConvertRGBA8toRGBX8(srcImg);
+        } else if (newFmt == FMT_RGBA8) {
+            destImg = new Img(srcImg);
+            remapImg<RGBA8>(*destImg, matcher, prog);
+            quick = false;
+        }
+        break;
+    default:
+        break;
+    }
+    assert(destImg);
+    if (quick && prog) {
+        prog->Add(srcImg.H());
+    }
+    return destImg;
+}
+
+Img* ConvertImg(Img const& srcImg, PixelFormat newFmt, Palette const& srcPalette, PaletteMatcher& matcher,
+    DitherMode dither)
+{
+    return convertImg(srcImg, newFmt, srcPalette, matcher, dither, nullptr);
+}
+
+
+bool ConvertLayerFrames(Layer const& srcLayer, Layer& destLayer, PixelFormat newFmt,
+    ProgressFn const& progress, DitherMode dither)
+{
+    // TODO: handle palette policies.
+    Palette const& srcPalette = srcLayer.mPalette;
+    // one matcher to copy for each chunk of frames, so they all start
+    // with the same palette
+    PaletteMatcher matcher(destLayer.mPalette);
+
+    // spare frame (if any) goes on the end
+    std::vector<Frame const*> srcFrames(srcLayer.mFrames.begin(), srcLayer.mFrames.end());
+    if (srcLayer.mSpare) {
+        srcFrames.push_back(srcLayer.mSpare);
+    }
+    const int total = (int)srcFrames.size();
+    std::vector<Frame*> destFrames(total, nullptr);
+
+    // Progress is counted in rows, so a single big frame still shows
+    // progress (and can be cancelled) as it goes.
+    int totalRows = 0;
+    for (auto f : srcFrames) {
+        totalRows += f->mImg->H();
+    }
+    RowProgress prog(progress, totalRows);
+
+    // Frames are independent, so do them in parallel. A single big frame
+    // will be split into bands by the conversion functions instead.
+    ParallelFor(0, total, 1, [&](int begin, int end) {
+        PaletteMatcher local(matcher);
+        for (int i = begin; i < end && !prog.Cancelled(); ++i) {
+            Frame const* srcFrame = srcFrames[i];
+            Frame* destFrame = new Frame();
+            destFrame->mDuration = srcFrame->mDuration;
+            destFrame->mImg = convertImg(*srcFrame->mImg, newFmt, srcPalette, local, dither, &prog);
+            destFrames[i] = destFrame;
+        }
+    });
+    const bool cancelled = prog.Cancelled();
+    if (!cancelled && progress) {
+        progress(totalRows, totalRows);
+    }
+
+    if (cancelled) {
+        for (auto f : destFrames) {
+            delete f;
+        }
+        return false;
+    }
+    if (srcLayer.mSpare) {
+        destLayer.mSpare = destFrames.back();
+        destFrames.pop_back();
+    }
+    for (auto f : destFrames) {
+        destLayer.mFrames.push_back(f);
+    }
+    return true;
+}
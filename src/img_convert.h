@@ -1,8 +1,13 @@
 #ifndef IMG_CONVERT_H
 #define IMG_CONVERT_H
 
+#include "colours.h"
+#include "parallel.h"
+
 class Img;
-class Palette;
+class Layer;
+struct Palette;
+class PaletteMatcher;
 
 // Helper functions to convert images into different formats.
 
@@ -29,5 +34,35 @@ void RemapRGBX8(Img& img, Palette const& destPalette);
 // Remap an RGBA8 to destPalette (picks the closest colours in destPalette).
 void RemapRGBA8(Img& img, Palette const& destPalette);
 
+// Versions of the lossy ones which take a PaletteMatcher (for the dest
+// palette), so it can be reused across multiple images.
+Img* ConvertRGBA8toI8(Img const& srcImg, PaletteMatcher& matcher);
+Img* ConvertRGBX8toI8(Img const& srcImg, PaletteMatcher& matcher);
+void RemapI8(Img& img, Palette const& srcPalette, PaletteMatcher& matcher);
+void RemapRGBX8(Img& img, PaletteMatcher& matcher);
+void RemapRGBA8(Img& img, PaletteMatcher& matcher);
+
+enum DitherMode { DITHER_NONE=0, DITHER_FLOYD_STEINBERG, DITHER_ORDERED };
+
+// Convert any format to I8, dithering to make up for the missing colours.
+// srcPalette is only used for I8 source images.
+Img* DitherToI8(Img const& srcImg, Palette const& srcPalette, PaletteMatcher& matcher, DitherMode dither);
+
+// Convert to newFmt, using whichever of the above is needed (remapping if
+// the format doesn't change).
+Img* ConvertImg(Img const& srcImg, PixelFormat newFmt, Palette const& srcPalette, PaletteMatcher& matcher,
+    DitherMode dither = DITHER_NONE);
+
+// Convert all the frames of srcLayer (including the spare frame) to
+// newFmt, adding them to destLayer, which should already have the new
+// palette set.
+// Frames are converted in parallel. progress (if set) is called as bands
+// of rows are finished (done and total count rows over all the frames).
+// Returns false (leaving destLayer's frames empty) if it was cancelled,
+// which is noticed between bands, even within a single frame.
+// dither applies to conversions to I8.
+bool ConvertLayerFrames(Layer const& srcLayer, Layer& destLayer, PixelFormat newFmt,
+    ProgressFn const& progress = ProgressFn(), DitherMode dither = DITHER_NONE);
+
 #endif // IMG_CONVERT_H
 
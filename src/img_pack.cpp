@@ -0,0 +1,272 @@
+#include "img_pack.h"
+#include "img.h"
+#include "layer.h"
+#include "serialise.h"
+#include "exception.h"
+
+#include <cassert>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+// The encoding is PackBits-style, but working with whole pixels rather
+// than bytes. Each row is encoded separately, as a series of chunks:
+//   0..127:   literal run of n+1 pixels follows.
+//   128..255: the next pixel is repeated n-126 times (2..129).
+
+template<typename PIXEL>
+static void packRow(PIXEL const* src, int w, std::vector<uint8_t>& out)
+{
+    int x = 0;
+    while (x < w) {
+        // how long a run do we have here?
+        int run = 1;
+        while (x + run < w && run < 129 && src[x + run] == src[x]) {
+            ++run;
+        }
+        if (run >= 2) {
+            out.push_back((uint8_t)(run + 126));
+            uint8_t const* p = (uint8_t const*)(src + x);
+            out.insert(out.end(), p, p + sizeof(PIXEL));
+            x += run;
+            continue;
+        }
+
+        // collect literals until the next run (or limit)
+        int n = 1;
+        while (x + n < w && n < 128) {
+            if (x + n + 1 < w && src[x + n] == src[x + n + 1]) {
+                break;
+            }
+            ++n;
+        }
+        out.push_back((uint8_t)(n - 1));
+        uint8_t const* p = (uint8_t const*)(src + x);
+        out.insert(out.end(), p, p + n * sizeof(PIXEL));
+        x += n;
+    }
+}
+
+// Decode one row. If dest is null, the data is just checked.
+// Throws an Exception if the data is bad.
+template<typename PIXEL>
+static uint8_t const* unpackRow(uint8_t const* in, uint8_t const* end, PIXEL* dest, int w)
+{
+    int x = 0;
+    while (x < w) {
+        if (in == end) {
+            throw Exception("Bad image data");
+        }
+        int n = *in++;
+        size_t len;
+        if (n < 128) {
+            n += 1;
+            len = n * sizeof(PIXEL);
+        } else {
+            n -= 126;
+            len = sizeof(PIXEL);
+        }
+        if (x + n > w || (size_t)(end - in) < len) {
+            throw Exception("Bad image data");
+        }
+        if (dest) {
+            if (len > sizeof(PIXEL)) {
+                memcpy(dest + x, in, len);
+            } else {
+                PIXEL c;
+                memcpy(&c, in, sizeof(PIXEL));
+                std::fill(dest + x, dest + x + n, c);
+            }
+        }
+        in += len;
+        x += n;
+    }
+    return in;
+}
+
+// Decode (or just check, if img is null) the whole image.
+static void unpackImg(std::vector<uint8_t> const& data, PixelFormat fmt, int w, int h, Img* img)
+{
+    uint8_t const* in = data.data();
+    uint8_t const* end = in + data.size();
+    for (int y = 0; y < h; ++y) {
+        if (PixelSize(fmt) == 1) {
+            in = unpackRow(in, end, img ? (uint8_t*)img->Ptr(0, y) : nullptr, w);
+        } else {
+            in = unpackRow(in, end, img ? (uint32_t*)img->Ptr(0, y) : nullptr, w);
+        }
+    }
+    if (in != end) {
+        throw Exception("Bad image data");
+    }
+}
+
+PackedImg::PackedImg(Img const& src) :
+    m_Format(src.Fmt()),
+    m_W(src.W()),
+    m_H(src.H())
+{
+    for (int y = 0; y < m_H; ++y) {
+        // Compare 4-byte pixels as uint32_t, so all bytes are preserved
+        // (RGBX8 equality ignores the pad byte).
+        if (PixelSize(m_Format) == 1) {
+            packRow((uint8_t const*)src.PtrConst(0, y), m_W, m_Data);
+        } else {
+            packRow((uint32_t const*)src.PtrConst(0, y), m_W, m_Data);
+        }
+    }
+    m_Data.shrink_to_fit();
+}
+
+Img* PackedImg::Unpack() const
+{
+    std::unique_ptr<Img> img(new Img(m_Format, m_W, m_H));
+    unpackImg(m_Data, m_Format, m_W, m_H, img.get());
+    return img.release();
+}
+
+void PackedImg::Write(BinWriter& out) const
+{
+    out.U8((uint8_t)m_Format);
+    out.I32(m_W);
+    out.I32(m_H);
+    out.U32((uint32_t)m_Data.size());
+    out.Bytes(m_Data.data(), m_Data.size());
+}
+
+PackedImg* PackedImg::Read(BinReader& in)
+{
+    std::unique_ptr<PackedImg> p(new PackedImg());
+    uint8_t fmt = in.U8();
+    p->m_W = in.I32();
+    p->m_H = in.I32();
+    uint32_t len = in.U32();
+    // (each row takes at least one chunk, and each chunk is at least 2
+    // bytes, for at most 129 pixels)
+    if (fmt > FMT_RGBA8 || p->m_W < 0 || p->m_H < 0 ||
+        (p->m_W == 0) != (p->m_H == 0) ||
+        len > in.Remaining() ||
+        (uint64_t)p->m_H * 2 > len ||
+        (uint64_t)p->m_W * p->m_H > (uint64_t)len * 129) {
+        throw Exception("Bad image data");
+    }
+    p->m_Format = (PixelFormat)fmt;
+    p->m_Data.resize(len);
+    in.Bytes(p->m_Data.data(), len);
+    // Check it now, rather than finding out halfway through an undo.
+    unpackImg(p->m_Data, p->m_Format, p->m_W, p->m_H, nullptr);
+    return p.release();
+}
+
+
+void PackFrames(std::vector<Frame*> const& frames, std::vector<PackedImg*>& packed)
+{
+    if (!packed.empty()) {
+        return; // already packed
+    }
+    for (auto f : frames) {
+        packed.push_back(new PackedImg(*f->mImg));
+        delete f->mImg;
+        f->mImg = nullptr;
+    }
+}
+
+void UnpackFrames(std::vector<Frame*> const& frames, std::vector<PackedImg*>& packed)
+{
+    if (packed.empty()) {
+        return; // not packed
+    }
+    assert(packed.size() == frames.size());
+    for (size_t i = 0; i < frames.size(); ++i) {
+        assert(!frames[i]->mImg);
+        frames[i]->mImg = packed[i]->Unpack();
+        delete packed[i];
+    }
+    packed.clear();
+}
+
+size_t FramesMemUsage(std::vector<Frame*> const& frames, std::vector<PackedImg*> const& packed)
+{
+    size_t total = 0;
+    if (!packed.empty()) {
+        for (auto p : packed) {
+            total += p->MemUsage();
+        }
+    } else {
+        for (auto f : frames) {
+            total += f->mImg->MemUsage();
+        }
+    }
+    return total;
+}
+
+
+static std::vector<Frame*> allFrames(Layer const& layer)
+{
+    std::vector<Frame*> frames(layer.mFrames);
+    if (layer.mSpare) {
+        frames.push_back(layer.mSpare);
+    }
+    return frames;
+}
+
+void PackLayerFrames(Layer const& layer, std::vector<PackedImg*>& packed)
+{
+    PackFrames(allFrames(layer), packed);
+}
+
+void UnpackLayerFrames(Layer const& layer, std::vector<PackedImg*>& packed)
+{
+    UnpackFrames(allFrames(layer), packed);
+}
+
+size_t LayerFramesMemUsage(Layer const& layer, std::vector<PackedImg*> const& packed)
+{
+    return FramesMemUsage(allFrames(layer), packed);
+}
+
+
+void WriteFrames(BinWriter& out, std::vector<Frame*> const& frames, std::vector<PackedImg*> const& packed)
+{
+    out.U32((uint32_t)frames.size());
+    for (size_t i = 0; i < frames.size(); ++i) {
+        out.I32(frames[i]->mDuration);
+        if (!packed.empty()) {
+            packed[i]->Write(out);
+        } else {
+            PackedImg(*frames[i]->mImg).Write(out);
+        }
+    }
+}
+
+void ReadFrames(BinReader& in, std::vector<Frame*>& frames, std::vector<PackedImg*>& packed)
+{
+    assert(frames.empty() && packed.empty());
+    uint32_t n = in.U32();
+    for (uint32_t i = 0; i < n; ++i) {
+        Frame* f = new Frame();
+        frames.push_back(f);
+        f->mDuration = in.I32();
+        packed.push_back(PackedImg::Read(in));
+    }
+}
+
+void WriteLayerFrames(BinWriter& out, Layer const& layer, std::vector<PackedImg*> const& packed)
+{
+    out.U8(layer.mSpare ? 1 : 0);
+    WriteFrames(out, allFrames(layer), packed);
+}
+
+void ReadLayerFrames(BinReader& in, Layer& layer, std::vector<PackedImg*>& packed)
+{
+    assert(layer.mFrames.empty() && !layer.mSpare);
+    bool hasSpare = in.U8() != 0;
+    ReadFrames(in, layer.mFrames, packed);
+    if (hasSpare) {
+        if (layer.mFrames.empty()) {
+            throw Exception("Missing spare frame");
+        }
+        layer.mSpare = layer.mFrames.back();
+        layer.mFrames.pop_back();
+    }
+}
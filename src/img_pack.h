@@ -0,0 +1,70 @@
+#ifndef IMG_PACK_H
+#define IMG_PACK_H
+
+#include "colours.h"
+
+#include <vector>
+#include <cstddef>
+
+class Img;
+class Frame;
+class Layer;
+class BinWriter;
+class BinReader;
+
+// A compressed copy of an image, for data which is likely to sit around
+// unused for a long time (eg on the undo stack).
+// Uses run-length encoding on whole pixels, which suits pixel art well.
+class PackedImg
+{
+public:
+    explicit PackedImg(Img const& src);
+
+    // Return a newly-allocated copy of the original image.
+    Img* Unpack() const;
+
+    PixelFormat Fmt() const { return m_Format; }
+    int W() const { return m_W; }
+    int H() const { return m_H; }
+
+    // bytes used by the compressed data
+    size_t MemUsage() const { return m_Data.size(); }
+
+    // Serialise the compressed data as-is.
+    void Write(BinWriter& out) const;
+    static PackedImg* Read(BinReader& in);
+
+private:
+    PackedImg() {}
+    PixelFormat m_Format;
+    int m_W;
+    int m_H;
+    std::vector<uint8_t> m_Data;
+};
+
+
+// Helpers for Cmds which hold frames.
+// PackFrames() compresses the images of the given frames, leaving them with
+// null mImg. UnpackFrames() restores them. Both do nothing if there's nothing
+// to do.
+void PackFrames(std::vector<Frame*> const& frames, std::vector<PackedImg*>& packed);
+void UnpackFrames(std::vector<Frame*> const& frames, std::vector<PackedImg*>& packed);
+
+// Memory used by a set of frames, packed or not.
+size_t FramesMemUsage(std::vector<Frame*> const& frames, std::vector<PackedImg*> const& packed);
+
+// Same again, for all the frames of a layer (including the spare frame).
+void PackLayerFrames(Layer const& layer, std::vector<PackedImg*>& packed);
+void UnpackLayerFrames(Layer const& layer, std::vector<PackedImg*>& packed);
+size_t LayerFramesMemUsage(Layer const& layer, std::vector<PackedImg*> const& packed);
+
+// Serialise a set of frames (packed or not). The images are always read
+// back in packed form, so the frames are left with null mImg.
+void WriteFrames(BinWriter& out, std::vector<Frame*> const& frames, std::vector<PackedImg*> const& packed);
+void ReadFrames(BinReader& in, std::vector<Frame*>& frames, std::vector<PackedImg*>& packed);
+
+// Same again for the frames of a layer (including the spare frame).
+void WriteLayerFrames(BinWriter& out, Layer const& layer, std::vector<PackedImg*> const& packed);
+void ReadLayerFrames(BinReader& in, Layer& layer, std::vector<PackedImg*>& packed);
+
+#endif // IMG_PACK_H
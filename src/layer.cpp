@@ -45,6 +45,34 @@ NodePath CalcPath(BaseNode *n)
     return out;
 }
 
+BaseNode* CopyNode(BaseNode const* n)
+{
+    BaseNode* out;
+    Layer const* l = n->ToLayerConst();
+    if (l) {
+        Layer* copy = new Layer();
+        for (Frame const* f : l->mFrames) {
+            copy->mFrames.push_back(new Frame(new Img(*f->mImg), f->mDuration));
+        }
+        if (l->mSpare) {
+            copy->mSpare = new Frame(new Img(*l->mSpare->mImg), l->mSpare->mDuration);
+        }
+        copy->mFPS = l->mFPS;
+        copy->mPalette = l->mPalette;
+        copy->mRanges = l->mRanges;
+        copy->mFilename = l->mFilename;
+        out = copy;
+    } else {
+        out = new Stack();
+    }
+    out->mName = n->mName;
+    out->mOffset = n->mOffset;
+    for (auto const child : n->mChildren) {
+        out->AddChild(CopyNode(child));
+    }
+    return out;
+}
+
 
 Layer::Layer() :
     mFPS(60),
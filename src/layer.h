@@ -118,6 +118,10 @@ Layer* FindLayer(BaseNode* n);
 // Return a path from root to the given node layer.
 NodePath CalcPath(BaseNode *n);
 
+// Copy a node and everything under it. The images share their data with
+// the originals (copy-on-write), so this is cheap even for big projects.
+BaseNode* CopyNode(BaseNode const* n);
+
 
 // A Stack groups multiple Layers (and/or other Stacks).
 class Stack : public BaseNode {
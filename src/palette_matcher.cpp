@@ -0,0 +1,121 @@
+#include "palette_matcher.h"
+#include "palette.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+
+PaletteMatcher::PaletteMatcher(Palette const& pal) :
+    m_Colours(pal.Colours, pal.Colours + pal.NumColours()),
+    m_Cells(RGBCells * RGBCells * RGBCells * AlphaCells, Cell{-1, 0}),
+    m_Cache(CacheSize, CacheEntry{0, -1})
+{
+}
+
+static inline uint32_t packColour(Colour const& c)
+{
+    return (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16) | ((uint32_t)c.a << 24);
+}
+
+int PaletteMatcher::Closest(Colour const& c)
+{
+    uint32_t key = packColour(c);
+    uint32_t h = (key * 2654435761u) >> 20;  // top 12 bits (CacheSize)
+    CacheEntry& e = m_Cache[h];
+    if (e.idx < 0 || e.key != key) {
+        e.key = key;
+        e.idx = Search(c);
+    }
+    return e.idx;
+}
+
+int PaletteMatcher::CellIndex(Colour const& c) const
+{
+    int alphaCell = (c.a == 255) ? AlphaCells - 1 : (c.a >> AlphaShift);
+    return ((alphaCell * RGBCells + (c.b >> RGBShift)) * RGBCells +
+        (c.g >> RGBShift)) * RGBCells + (c.r >> RGBShift);
+}
+
+int PaletteMatcher::Search(Colour const& c)
+{
+    if (m_Colours.empty()) {
+        return -1;
+    }
+    int cellIdx = CellIndex(c);
+    if (m_Cells[cellIdx].first < 0) {
+        BuildCell(cellIdx, c);
+    }
+    Cell const& cell = m_Cells[cellIdx];
+    // candidates are in palette order, so ties go to the lowest index,
+    // same as Palette::Closest()
+    int best = -1;
+    int bestdistsq = std::numeric_limits<int>::max();
+    for (int i = cell.first; i < cell.first + cell.count; ++i) {
+        int idx = m_Candidates[i];
+        int distsq = DistSq(c, m_Colours[idx]);
+        if (distsq < bestdistsq) {
+            best = idx;
+            bestdistsq = distsq;
+        }
+    }
+    assert(best != -1);
+    return best;
+}
+
+// Squared distance along one axis from v to the nearest and furthest
+// points of the range [lo,hi].
+static inline void axisDist(int v, int lo, int hi, int& nearsq, int& farsq)
+{
+    int n = (v < lo) ? lo - v : (v > hi) ? v - hi : 0;
+    int f = std::max(v - lo, hi - v);
+    nearsq = n * n;
+    farsq = f * f;
+}
+
+// Work out which palette entries could be closest to some colour in the
+// cell containing c.
+// Whatever the colour in the cell, its closest entry can't be further away
+// than the smallest worst-case distance (over all entries), so anything
+// which is always further than that can be ruled out.
+void PaletteMatcher::BuildCell(int cellIdx, Colour const& c)
+{
+    const int rgbSize = 1 << RGBShift;
+    const int alphaSize = 1 << AlphaShift;
+    int lo[4] = {
+        c.r & ~(rgbSize - 1), c.g & ~(rgbSize - 1), c.b & ~(rgbSize - 1),
+        c.a & ~(alphaSize - 1)};
+    int hi[4] = {
+        lo[0] + rgbSize - 1, lo[1] + rgbSize - 1, lo[2] + rgbSize - 1,
+        std::min(lo[3] + alphaSize - 1, 254)};
+    if (c.a == 255) {
+        lo[3] = hi[3] = 255;
+    }
+
+    const int n = (int)m_Colours.size();
+    std::vector<int> nearest(n);
+    int bound = std::numeric_limits<int>::max();
+    for (int i = 0; i < n; ++i) {
+        Colour const& p = m_Colours[i];
+        int v[4] = {p.r, p.g, p.b, p.a};
+        int nearsq = 0;
+        int farsq = 0;
+        for (int axis = 0; axis < 4; ++axis) {
+            int ns, fs;
+            axisDist(v[axis], lo[axis], hi[axis], ns, fs);
+            nearsq += ns;
+            farsq += fs;
+        }
+        nearest[i] = nearsq;
+        bound = std::min(bound, farsq);
+    }
+
+    Cell& cell = m_Cells[cellIdx];
+    cell.first = (int)m_Candidates.size();
+    for (int i = 0; i < n; ++i) {
+        if (nearest[i] <= bound) {
+            m_Candidates.push_back((uint16_t)i);
+        }
+    }
+    cell.count = (int)m_Candidates.size() - cell.first;
+}
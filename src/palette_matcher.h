@@ -0,0 +1,60 @@
+#ifndef PALETTE_MATCHER_H
+#define PALETTE_MATCHER_H
+
+#include "colours.h"
+
+#include <cstdint>
+#include <vector>
+
+struct Palette;
+
+// Finds the closest palette entry for lots of colours (eg when remapping
+// images), giving exactly the same answers as Palette::Closest().
+//
+// Colour space is divided up into a grid of cells, and each cell gets a
+// list of the only palette entries which could possibly be closest to
+// colours inside it. Cells are filled in on first use. On top of that,
+// recent lookups are remembered in a small cache.
+//
+// Takes a copy of the palette, so it won't notice later changes.
+// Not thread-safe - use one per thread.
+class PaletteMatcher
+{
+public:
+    explicit PaletteMatcher(Palette const& pal);
+
+    // Returns -1 if the palette is empty.
+    int Closest(Colour const& c);
+
+    int NumColours() const { return (int)m_Colours.size(); }
+    Colour GetColour(int idx) const { return m_Colours[idx]; }
+
+private:
+    // Cells are 16 values wide in r,g,b, and 64 in alpha - except that
+    // fully opaque colours (the usual case) get cells to themselves.
+    static const int RGBShift = 4;
+    static const int AlphaShift = 6;
+    static const int RGBCells = 256 >> RGBShift;
+    static const int AlphaCells = (256 >> AlphaShift) + 1;
+    static const int CacheSize = 4096;
+
+    struct Cell {
+        int first;  // offset into m_Candidates, or -1 if not built yet
+        int count;
+    };
+    struct CacheEntry {
+        uint32_t key;
+        int idx;
+    };
+
+    int CellIndex(Colour const& c) const;
+    void BuildCell(int cellIdx, Colour const& c);
+    int Search(Colour const& c);
+
+    std::vector<Colour> m_Colours;
+    std::vector<Cell> m_Cells;
+    std::vector<uint16_t> m_Candidates;
+    std::vector<CacheEntry> m_Cache;
+};
+
+#endif // PALETTE_MATCHER_H
@@ -0,0 +1,147 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// set for threads running jobs, to detect nested ParallelFor() calls
+thread_local bool inWorker = false;
+
+class WorkerPool
+{
+public:
+    WorkerPool();
+    ~WorkerPool();
+
+    int Threads() const { return (int)m_Threads.size(); }
+    void Submit(std::function<void()> const& job);
+
+private:
+    void Run();
+
+    std::vector<std::thread> m_Threads;
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    std::deque<std::function<void()>> m_Queue;
+    bool m_Quit;
+};
+
+WorkerPool::WorkerPool() :
+    m_Quit(false)
+{
+    int n = (int)std::thread::hardware_concurrency();
+    // leave one core for the calling thread
+    for (int i = 1; i < n; ++i) {
+        m_Threads.emplace_back([this]() { Run(); });
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Quit = true;
+    }
+    m_Wake.notify_all();
+    for (auto& t : m_Threads) {
+        t.join();
+    }
+}
+
+void WorkerPool::Submit(std::function<void()> const& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Queue.push_back(job);
+    }
+    m_Wake.notify_one();
+}
+
+void WorkerPool::Run()
+{
+    inWorker = true;
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Wake.wait(lock, [this]() { return m_Quit || !m_Queue.empty(); });
+            if (m_Quit) {
+                return;
+            }
+            job = m_Queue.front();
+            m_Queue.pop_front();
+        }
+        job();
+    }
+}
+
+WorkerPool& Pool()
+{
+    static WorkerPool pool;
+    return pool;
+}
+
+}   // namespace
+
+
+int NumWorkers()
+{
+    return Pool().Threads() + 1;
+}
+
+
+void ParallelFor(int begin, int end, int grain, std::function<void(int, int)> const& fn)
+{
+    if (end <= begin) {
+        return;
+    }
+    grain = std::max(grain, 1);
+    const int numChunks = (end - begin + grain - 1) / grain;
+    const int helpers = inWorker ? 0 : std::min(numChunks, NumWorkers()) - 1;
+    if (helpers <= 0) {
+        fn(begin, end);
+        return;
+    }
+
+    // Chunks are handed out on demand, so a slow chunk doesn't hold
+    // everything else up.
+    // Chunk size is rounded to a multiple of grain, with enough chunks
+    // to share the work out.
+    int chunk = grain * std::max(1, numChunks / ((helpers + 1) * 4));
+    std::atomic<int> next(begin);
+    auto work = [&]() {
+        while (true) {
+            int b = next.fetch_add(chunk);
+            if (b >= end) {
+                break;
+            }
+            fn(b, std::min(b + chunk, end));
+        }
+    };
+
+    std::mutex doneMutex;
+    std::condition_variable doneCond;
+    int running = helpers;
+    for (int i = 0; i < helpers; ++i) {
+        Pool().Submit([&]() {
+            work();
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (--running == 0) {
+                doneCond.notify_one();
+            }
+        });
+    }
+    // nested calls from our share of the work should stay on this thread
+    // too, rather than queuing up behind the busy workers
+    inWorker = true;
+    work();
+    inWorker = false;
+    std::unique_lock<std::mutex> lock(doneMutex);
+    doneCond.wait(lock, [&]() { return running == 0; });
+}
@@ -0,0 +1,27 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <functional>
+
+// Helpers for splitting work up across multiple threads.
+// A shared pool of worker threads is started on first use, sized to the
+// number of cores (the calling thread also does its share of the work).
+
+// Number of threads work will be split across (including the caller).
+int NumWorkers();
+
+// Calls fn(b, e) for consecutive chunks of [begin, end), in parallel,
+// and waits for them all to finish.
+// Chunks are at least grain long (apart from the last one), so each
+// chunk boundary falls on a multiple of grain from begin.
+// fn must be safe to call concurrently for different chunks.
+// If called from within a worker (ie nested), runs everything on the
+// current thread.
+void ParallelFor(int begin, int end, int grain, std::function<void(int, int)> const& fn);
+
+// Progress callback for long-running operations, called with the amount of
+// work done so far and the total. Return false to cancel.
+// Only called on the thread which started the operation.
+typedef std::function<bool(int done, int total)> ProgressFn;
+
+#endif // PARALLEL_H
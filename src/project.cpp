@@ -6,17 +6,30 @@
 #include "util.h"
 #include "exception.h"
 #include "file_load.h"
+#include "file_native.h"
+#include "file_sequence.h"
+#include "file_type.h"
 #include "global.h"
 
 #include <assert.h>
 #include <cstdio>
+#include <filesystem>
 
 Project::Project( std::string const& filename ) :
     mRoot(nullptr),
+    mNative(nullptr),
+    mSequence(nullptr),
     m_Expendable(false),
     m_Modified(false)
 {
-    mFilename = filename;
+    // A folder of frames has no single file to save back to.
+    if (!std::filesystem::is_directory(filename)) {
+        mFilename = filename;
+    }
+    if (FiletypeFromFilename(filename) == FILETYPE_EVILPIXIE) {
+        mRoot = LoadNative(filename, mSettings, mNative);
+        return;
+    }
     Layer* l = LoadLayer(filename.c_str(), mSettings);
     mRoot = new Stack();
     mRoot->AddChild(l);
@@ -26,6 +39,8 @@ Project::Project( std::string const& filename ) :
 // Create project from a single layer
 Project::Project(Layer* layer) :
     mRoot(nullptr),
+    mNative(nullptr),
+    mSequence(nullptr),
     m_Expendable(false),
     m_Modified( false )
 {
@@ -36,6 +51,8 @@ Project::Project(Layer* layer) :
 
 Project::Project() :
     mRoot(nullptr),
+    mNative(nullptr),
+    mSequence(nullptr),
     m_Expendable(true),
     m_Modified( false )
 {
@@ -54,6 +71,8 @@ Project::Project() :
 
 Project::Project( PixelFormat fmt, int w, int h, Palette* palette, int num_frames ) :
     mRoot(nullptr),
+    mNative(nullptr),
+    mSequence(nullptr),
     m_Expendable(false),
     m_Modified( false )
 {
@@ -76,6 +95,8 @@ Project::Project( PixelFormat fmt, int w, int h, Palette* palette, int num_frame
 Project::~Project()
 {
     delete mRoot;
+    delete mNative;
+    delete mSequence;
 }
 
 void Project::SetModifiedFlag( bool newmodifiedflag )
@@ -103,6 +124,9 @@ bool Project::SharesPalette(NodePath const& a, int /*frameA*/, NodePath const& b
 
 void Project::NotifyDamage(NodePath const& target, int frame, Box const& b )
 {
+    if (m_Muted) {
+        return;
+    }
     for (auto l : m_Listeners) {
         l->OnDamaged(target, frame, b);
     }
@@ -110,6 +134,9 @@ void Project::NotifyDamage(NodePath const& target, int frame, Box const& b )
 
 void Project::NotifyFramesAdded(NodePath const& target, int first, int count)
 {
+    if (m_Muted) {
+        return;
+    }
     for (auto l : m_Listeners) {
         l->OnFramesAdded(target, first, count);
     }
@@ -117,6 +144,9 @@ void Project::NotifyFramesAdded(NodePath const& target, int first, int count)
 
 void Project::NotifyFramesRemoved(NodePath const& target, int first, int count)
 {
+    if (m_Muted) {
+        return;
+    }
     for (auto l : m_Listeners) {
         l->OnFramesRemoved(target, first, count);
     }
@@ -124,6 +154,9 @@ void Project::NotifyFramesRemoved(NodePath const& target, int first, int count)
 
 void Project::NotifyFramesBlatted(NodePath const& target, int first, int count)
 {
+    if (m_Muted) {
+        return;
+    }
     for (auto l : m_Listeners) {
         l->OnFramesBlatted(target, first, count);
     }
@@ -131,6 +164,9 @@ void Project::NotifyFramesBlatted(NodePath const& target, int first, int count)
 
 void Project::NotifyPaletteChange(NodePath const& target, int frame, int first, int count )
 {
+    if (m_Muted) {
+        return;
+    }
     std::set<ProjectListener*>::iterator it;
     if (count == 1)
     {
@@ -148,6 +184,9 @@ void Project::NotifyPaletteChange(NodePath const& target, int frame, int first,
 
 void Project::NotifyPaletteReplaced(NodePath const& target, int frame)
 {
+    if (m_Muted) {
+        return;
+    }
     for (auto l: m_Listeners) {
         l->OnPaletteReplaced(target, frame);
     }
@@ -155,6 +194,9 @@ void Project::NotifyPaletteReplaced(NodePath const& target, int frame)
 
 void Project::NotifyRangesBlatted(NodePath const& target, int frame)
 {
+    if (m_Muted) {
+        return;
+    }
     for (auto l: m_Listeners) {
         l->OnRangesBlatted(target, frame);
     }
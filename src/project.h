@@ -17,6 +17,8 @@
 
 class Tool;
 class ProjectListener;
+struct NativeFile;
+struct SequenceFile;
 
 
 // General project settings
@@ -82,6 +84,22 @@ public:
         return *l;
     }
 
+    // Like ResolveLayer(), but returns null if target doesn't lead to a
+    // layer (eg a path read from a file).
+    Layer* LookupLayer(NodePath const& target) const {
+        if (target.IsEmpty()) {
+            return nullptr;
+        }
+        BaseNode *n = mRoot;
+        for (auto i : target.path) {
+            if (i < 0 || i >= (int)n->mChildren.size()) {
+                return nullptr;
+            }
+            n = n->mChildren[i];
+        }
+        return n->ToLayer();
+    }
+
     // shortcuts. Maybe kill these?
     Img& GetImg(NodePath const& target, int frame) const {
         return ResolveLayer(target).GetImg(frame);
@@ -126,6 +144,10 @@ public:
     void NotifyPaletteReplaced(NodePath const& target, int frame);
 
     void NotifyRangesBlatted(NodePath const& target, int frame);
+
+    // While muted, the Notify fns don't tell the listeners anything.
+    // For changes which are about to be reversed anyway (see Autosave).
+    void MuteNotifications(bool mute) { m_Muted = mute; }
  
     void SetModifiedFlag( bool newmodifiedflag );
 
@@ -143,6 +165,12 @@ public:
     std::string mFilename;
 
     ProjSettings mSettings;
+
+    // If project was loaded from (or saved to) a native file, what's
+    // in that file (see file_native.h).
+    NativeFile* mNative;
+    // Last save of frames as a PNG sequence, if any (see file_sequence.h).
+    SequenceFile* mSequence;
 private:
     Project( Project const& );  // disallowed
 
@@ -153,6 +181,8 @@ private:
     // has project been modified?
     bool m_Modified;
 
+    bool m_Muted {false};
+
 };
 
 
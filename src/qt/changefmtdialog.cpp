@@ -84,6 +84,26 @@ ChangeFmtDialog::ChangeFmtDialog(QWidget *parent, PixelFormat currFmt, int currN
         l->addRow("Change to:", w);
     }
 
+    // Options for when a new palette is calculated.
+    {
+        QCheckBox* w = new QCheckBox("Refine palette (slower)", this);
+        m_Refine = w;
+        refine_palette = false;
+        connect(w, SIGNAL(toggled(bool)), this, SLOT(refineChanged(bool)));
+        l->addRow("", w);
+    }
+    {
+        QComboBox* w = new QComboBox(this);
+        m_Dither = w;
+        w->addItem("None", DITHER_NONE);
+        w->addItem("Floyd-Steinberg", DITHER_FLOYD_STEINBERG);
+        w->addItem("Ordered", DITHER_ORDERED);
+        dither = DITHER_NONE;
+        connect(w, SIGNAL(currentIndexChanged(int)), this, SLOT(ditherChanged(int)));
+        l->addRow("Dither:", w);
+    }
+    enableOptions();
+
     QDialogButtonBox* buttonBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
     connect(buttonBox, SIGNAL(accepted()), this, SLOT(accept()));
     connect(buttonBox, SIGNAL(rejected()), this, SLOT(reject()));
@@ -103,5 +123,26 @@ void ChangeFmtDialog::formatChanged( int idx )
     modepreset const& pre = presets[n];
     pixel_format = pre.fmt;
     num_colours = pre.palette_cnt;
+    enableOptions();
+}
+
+void ChangeFmtDialog::refineChanged( bool checked )
+{
+    refine_palette = checked;
+}
+
+void ChangeFmtDialog::ditherChanged( int idx )
+{
+    enableOptions();
+}
+
+// Refining only applies when a new palette is calculated. Dithering applies
+// to any conversion to a palette (new or kept), and is off when disabled.
+void ChangeFmtDialog::enableOptions()
+{
+    bool toPalette = (pixel_format == FMT_I8);
+    m_Refine->setEnabled(toPalette && num_colours > 0);
+    m_Dither->setEnabled(toPalette);
+    dither = toPalette ? (DitherMode)m_Dither->currentData().toInt() : DITHER_NONE;
 }
 
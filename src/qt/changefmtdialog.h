@@ -4,12 +4,14 @@
 #include <QDialog>
 #include <QtWidgets/QDialog>
 #include "../colours.h"
+#include "../img_convert.h"
 
 //class QDialogButtonBox;
 //class QLabel;
 class QLineEdit;
 class QString;
 class QComboBox;
+class QCheckBox;
 
 // Dialog box to select params for changing to a different image format.
 class ChangeFmtDialog : public QDialog
@@ -21,10 +23,17 @@ public:
 
     PixelFormat pixel_format;
     int num_colours;
+    bool refine_palette;
+    DitherMode dither;
 private slots:
     void formatChanged( int idx );
+    void refineChanged( bool checked );
+    void ditherChanged( int idx );
 private:
+    void enableOptions();
     QComboBox *m_Format;
+    QCheckBox *m_Refine;
+    QComboBox *m_Dither;
 };
 
 #endif
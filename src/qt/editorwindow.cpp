@@ -1,10 +1,13 @@
 #include "../global.h"
+#include "../autosave.h"
 #include "../project.h"
 #include "../brush.h"
 #include "../scale2x.h"
 #include "../util.h"
 #include "../exception.h"
+#include "../file_native.h"
 #include "../file_save.h"
+#include "../file_sequence.h"
 #include "../file_type.h"
 #include "../cmd.h"
 #include "../cmd_changefmt.h"
@@ -30,6 +33,7 @@
 
 #include <algorithm>
 #include <memory>
+#include <new>
 #include <cassert>
 #ifdef WIN32
 #include <unistd.h> // for getcwd()
@@ -39,6 +43,7 @@
 
 #include <QPainter>
 #include <QDir>
+#include <QLockFile>
 
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QPushButton>
@@ -49,9 +54,11 @@
 #include <QtWidgets/QLabel>
 #include <QtWidgets/QFrame>
 #include <QtWidgets/QFileDialog>
+#include <QtWidgets/QInputDialog>
 #include <QtWidgets/QStatusBar>
 #include <QtWidgets/QMenuBar>
 #include <QtWidgets/QMessageBox>
+#include <QtWidgets/QProgressDialog>
 #include <QtWidgets/QTextEdit>
 
 #include <QAction>
@@ -59,6 +66,30 @@
 #include <QCursor>
 
 
+// Progress dialog for slow cmds (eg remapping long animations).
+// Only pops up if the job takes a while.
+class CmdProgress
+{
+public:
+    CmdProgress(QWidget* parent, QString const& label) :
+        m_Dlg(label, "Cancel", 0, 0, parent)
+    {
+        m_Dlg.setWindowModality(Qt::WindowModal);
+        m_Dlg.setMinimumDuration(500);
+    }
+
+    ProgressFn Fn()
+    {
+        return [this](int done, int total) -> bool {
+            m_Dlg.setMaximum(total);
+            m_Dlg.setValue(done);
+            return !m_Dlg.wasCanceled();
+        };
+    }
+private:
+    QProgressDialog m_Dlg;
+};
+
 
 void CurrentColourWidget::paintEvent(QPaintEvent *)
 {
@@ -94,6 +125,10 @@ void CurrentColourWidget::mousePressEvent(QMouseEvent *event )
 }
 
 
+// Undo memory limit chosen by the user, used for any new windows too
+// (0 for the Editor default).
+static size_t s_UndoMemLimit = 0;
+
 EditorWindow::EditorWindow( Project* proj, QWidget* parent ) :
     QWidget(parent),
     Editor(proj),
@@ -110,7 +145,13 @@ EditorWindow::EditorWindow( Project* proj, QWidget* parent ) :
     m_HelpWindow(0),
     m_ActionUndo(0),
     m_ActionRedo(0),
-    m_StatusViewInfo(0)
+    m_StatusViewInfo(0),
+    m_Loader(nullptr),
+    m_LoadTimer(nullptr),
+    m_Saver(nullptr),
+    m_SaveTimer(nullptr),
+    m_AutosaveLock(nullptr),
+    m_AutosaveTimer(nullptr)
 {
     // focus upon the first layer
     Layer *firstLayer = FindLayer(proj->mRoot);
@@ -120,6 +161,8 @@ EditorWindow::EditorWindow( Project* proj, QWidget* parent ) :
     m_Time = 0;
     m_Frame = 0;
     m_NonSpareFrame = 0;
+    if( s_UndoMemLimit )
+        SetUndoMemLimit( s_UndoMemLimit );
 
     // set up mouse cursors
     {
@@ -235,11 +278,17 @@ EditorWindow::EditorWindow( Project* proj, QWidget* parent ) :
 
 
     setAcceptDrops(true);
+    startAutosave();
     show();
 }
 
 EditorWindow::~EditorWindow()
 {
+    stopAutosave();
+    // cancels any loading still in progress
+    delete m_Loader;
+    // but lets any save run to completion
+    delete m_Saver;
     delete m_PaletteEditor;
     delete m_AboutBox;
     delete m_HelpWindow;
@@ -248,6 +297,174 @@ EditorWindow::~EditorWindow()
 }
 
 
+void EditorWindow::ContinueLoading(LayerLoader* loader)
+{
+    assert(!m_Loader);
+    m_Loader = loader;
+    m_LoadTarget = m_Focus;
+    m_LoadTimer = new QTimer(this);
+    connect(m_LoadTimer, &QTimer::timeout, this, &EditorWindow::pollLoader);
+    m_LoadTimer->start(50);
+    RethinkWindowTitle();
+}
+
+void EditorWindow::pollLoader()
+{
+    collectLoadedFrames(false);
+}
+
+void EditorWindow::finishLoading()
+{
+    if (!m_Loader) {
+        return;
+    }
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    collectLoadedFrames(true);
+    QApplication::restoreOverrideCursor();
+}
+
+void EditorWindow::collectLoadedFrames(bool wait)
+{
+    if (!m_Loader) {
+        return;
+    }
+    Layer& l = Proj().ResolveLayer(m_LoadTarget);
+    int first = (int)l.mFrames.size();
+    bool paletteChanged;
+    int n = m_Loader->Collect(l, paletteChanged, wait);
+    if (paletteChanged) {
+        Proj().NotifyPaletteReplaced(m_LoadTarget, 0);
+    }
+    if (n > 0) {
+        Proj().NotifyFramesAdded(m_LoadTarget, first, n);
+    }
+    if (m_Loader->Done()) {
+        std::string err = m_Loader->Error();
+        delete m_Loader;
+        m_Loader = nullptr;
+        m_LoadTimer->stop();
+        // The loaded frames weren't added via cmds, so the journal can't
+        // replay them. Checkpoint once they're all in, rather than on
+        // every batch (recovering before then stops at the first edit to
+        // a frame the checkpoint doesn't have).
+        if (GetAutosave()) {
+            GetAutosave()->Resync();
+        }
+        RethinkWindowTitle();
+        if (!err.empty()) {
+            GUIShowError(err.c_str());
+        }
+    }
+}
+
+
+static QString autosaveRoot()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/autosave";
+}
+
+void EditorWindow::startAutosave()
+{
+    static int count = 0;
+    QString dir = autosaveRoot() + QString("/%1-%2").arg(QCoreApplication::applicationPid()).arg(++count);
+    QLockFile* lock = new QLockFile(dir + "/lock");
+    if (!QDir().mkpath(dir) || !lock->tryLock(0)) {
+        delete lock;
+        QString msg = QString("Couldn't set up autosave in %1.\n"
+            "Unsaved work won't be recoverable after a crash.").arg(QDir::toNativeSeparators(dir));
+        GUIShowError(msg.toStdString().c_str());
+        return;
+    }
+    m_AutosaveDir = dir;
+    m_AutosaveLock = lock;
+    SetAutosave(new Autosave(Proj(), dir.toStdString()));
+    m_AutosaveTimer = new QTimer(this);
+    connect(m_AutosaveTimer, &QTimer::timeout, this, &EditorWindow::pollAutosave);
+    m_AutosaveTimer->start(1000);
+}
+
+// Autosaving happens in the background, so failures turn up later.
+void EditorWindow::pollAutosave()
+{
+    if (!GetAutosave()) {
+        return;
+    }
+    std::string err = GetAutosave()->TakeError();
+    if (!err.empty()) {
+        GUIShowError(err.c_str());
+    }
+}
+
+// Called on the way out, so there's nothing left to recover.
+void EditorWindow::stopAutosave()
+{
+    if (!m_AutosaveLock) {
+        return;
+    }
+    m_AutosaveTimer->stop();
+    SetAutosave(nullptr);
+    delete m_AutosaveLock;
+    m_AutosaveLock = nullptr;
+    QDir().rmdir(m_AutosaveDir);
+}
+
+// An autosave directory which isn't locked was left behind by an instance
+// of EvilPixie which didn't shut down properly.
+int EditorWindow::RecoverAutosaves()
+{
+    QDir root(autosaveRoot());
+    int cnt = 0;
+    for (QString const& name : root.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        QString dir = root.filePath(name);
+        QLockFile lock(dir + "/lock");
+        if (!lock.tryLock(0)) {
+            continue;   // still in use
+        }
+        std::string d = dir.toStdString();
+        if (Autosave::Recoverable(d)) {
+            int ret = QMessageBox::question(nullptr, tr("EvilPixie"),
+                tr("EvilPixie didn't shut down properly.\n"
+                   "Do you want to recover your unsaved work?"),
+                QMessageBox::Yes | QMessageBox::Discard, QMessageBox::Yes);
+            if (ret == QMessageBox::Yes) {
+                QString err;
+                EditorWindow* fenster = nullptr;
+                try {
+                    fenster = new EditorWindow(Autosave::Recover(d));
+                    ++cnt;
+                } catch (Exception const& e) {
+                    err = tr("Couldn't recover your work: %1").arg(e.what());
+                } catch (std::bad_alloc const&) {
+                    err = tr("Couldn't recover your work: Out of memory");
+                }
+                // The old files only go once the recovered project is
+                // safely autosaved again.
+                Autosave* autosave = fenster ? fenster->GetAutosave() : nullptr;
+                if (autosave) {
+                    autosave->Checkpoint();
+                    autosave->Flush();
+                }
+                if (fenster && (!autosave || autosave->Failed())) {
+                    err = tr("Your work was recovered, but couldn't be autosaved again.");
+                    if (autosave) {
+                        err += "\n" + QString::fromStdString(autosave->TakeError());
+                    }
+                }
+                if (!err.isEmpty()) {
+                    QMessageBox::warning(nullptr, "Error",
+                        err + "\n\n" + tr("The recovery files have been left in:\n%1").arg(QDir::toNativeSeparators(dir)));
+                    continue;   // (unlocks)
+                }
+            }
+        }
+        Autosave::Remove(d);
+        lock.unlock();
+        root.rmdir(name);
+    }
+    return cnt;
+}
+
+
 QLayout* EditorWindow::CreateToolButtons()
 {
     QGridLayout *grid = new QGridLayout();
@@ -654,6 +871,9 @@ void EditorWindow::update_menu_states()
     m_ActionFromSpritesheet->setEnabled(nframes==1);
 
     m_ActionToggleSpare->setChecked(m_Frame == SPARE_FRAME);
+
+    m_ActionFillGlobal->setChecked(Fill().global);
+    m_ActionFillAllFrames->setChecked(Fill().allFrames);
 }
 
 void EditorWindow::do_undo()
@@ -702,9 +922,50 @@ void EditorWindow::do_drawmodeChanged( QAction* act )
     RethinkWindowTitle();
 }
 
+void EditorWindow::do_fillglobal(bool checked)
+{
+    FillMode fm = Fill();
+    fm.global = checked;
+    SetFill(fm);
+}
+
+void EditorWindow::do_fillallframes(bool checked)
+{
+    FillMode fm = Fill();
+    fm.allFrames = checked;
+    SetFill(fm);
+}
+
+void EditorWindow::do_filltolerance()
+{
+    FillMode fm = Fill();
+    bool ok;
+    int tol = QInputDialog::getInt(this, "Fill Tolerance",
+        "Max difference per channel (0=exact colour only):",
+        fm.tolerance, 0, 255, 1, &ok);
+    if (ok) {
+        fm.tolerance = tol;
+        SetFill(fm);
+    }
+}
+
+void EditorWindow::do_undomemlimit()
+{
+    const size_t MB = 1024*1024;
+    bool ok;
+    int limit = QInputDialog::getInt(this, "Undo Memory Limit",
+        "Memory for undo history, in MB (older steps are kept on disk):",
+        (int)(UndoMemLimit() / MB), 16, 1024*1024, 16, &ok);
+    if (ok) {
+        s_UndoMemLimit = (size_t)limit * MB;
+        SetUndoMemLimit(s_UndoMemLimit);
+    }
+}
+
 // resize the currently-focused layer
 void EditorWindow::do_resize()
 {
+    finishLoading();
     // use the currently-focused frame to populate the resize dialog.
     Box b = m_ViewWidget->FocusedImgConst().Bounds();
     ResizeProjectDialog dlg(this,QRect(b.x,b.y,b.w,b.h));
@@ -728,6 +989,7 @@ void EditorWindow::do_resize()
 
 void EditorWindow::do_changefmt()
 {
+    finishLoading();
     int currColours = Proj().PaletteConst(m_Focus, m_Frame).NumColours();
     Layer const& l = Proj().ResolveLayer(m_Focus);
 
@@ -742,8 +1004,14 @@ void EditorWindow::do_changefmt()
             //   or to just remap using existing.
             // - give option of using brush palette or loading a palette?
             // TODO: use Cmd_Remap here?
-            Cmd* c = new Cmd_ChangeFmt(Proj(), m_Focus, dlg.pixel_format, dlg.num_colours);
-            AddCmd(c);
+            CmdProgress progress(this, "Converting frames...");
+            Cmd_ChangeFmt* c = new Cmd_ChangeFmt(Proj(), m_Focus, dlg.pixel_format, dlg.num_colours,
+                dlg.refine_palette, dlg.dither, progress.Fn());
+            if (c->Cancelled()) {
+                delete c;
+            } else {
+                AddCmd(c);
+            }
         }
     }
 }
@@ -777,10 +1045,16 @@ void EditorWindow::do_usebrushpalette()
         case QMessageBox::Yes:
             {
                 // Remap it.
+                finishLoading();
                 Layer& l = Proj().ResolveLayer(m_Focus);
                 // keep the same pixelformat
-                Cmd* cmd = new Cmd_Remap(Proj(), m_Focus, l.Fmt(), brushPalette);
-                AddCmd(cmd);
+                CmdProgress progress(this, "Remapping frames...");
+                Cmd_Remap* cmd = new Cmd_Remap(Proj(), m_Focus, l.Fmt(), brushPalette, progress.Fn());
+                if (cmd->Cancelled()) {
+                    delete cmd;
+                } else {
+                    AddCmd(cmd);
+                }
             }
             break;
         case QMessageBox::No:
@@ -1040,6 +1314,7 @@ void EditorWindow::setFrame(int frame)
 
 void EditorWindow::do_tospritesheet()
 {
+    finishLoading();
     SpriteGrid grid;
     Layer const& l = Proj().ResolveLayer(m_Focus);
 
@@ -1068,6 +1343,7 @@ void EditorWindow::do_tospritesheet()
 
 void EditorWindow::do_fromspritesheet()
 {
+    finishLoading();
     Layer& layer = Proj().ResolveLayer(m_Focus);
     Img const& srcImg = layer.GetImgConst(0);
     SpriteGrid grid;
@@ -1118,10 +1394,16 @@ void EditorWindow::do_loadpalette()
             case QMessageBox::Yes:
                 {
                     // Remap it.
+                    finishLoading();
                     Layer& l = Proj().ResolveLayer(m_Focus);
                     // keep the same pixelformat
-                    Cmd* cmd = new Cmd_Remap(Proj(), m_Focus, l.Fmt(), *newPalette);
-                    AddCmd(cmd);
+                    CmdProgress progress(this, "Remapping frames...");
+                    Cmd_Remap* cmd = new Cmd_Remap(Proj(), m_Focus, l.Fmt(), *newPalette, progress.Fn());
+                    if (cmd->Cancelled()) {
+                        delete cmd;
+                    } else {
+                        AddCmd(cmd);
+                    }
                 }
                 break;
             case QMessageBox::No:
@@ -1175,7 +1457,7 @@ void EditorWindow::do_open()
 {
 //    if( !CheckZappingOK() )
 //        return;
-    QString loadfilters = "Image files (*.anim *.bmp *.gif *.iff *.ilbm *.lbm *.pbm *.pcx *.png *.jpg *.jpeg *.tga);;Any files (*)";
+    QString loadfilters = "Image files (*.anim *.bmp *.evp *.gif *.iff *.ilbm *.lbm *.pbm *.pcx *.png *.jpg *.jpeg *.tga);;EvilPixie projects (*.evp);;Any files (*)";
 
     QString filename = QFileDialog::getOpenFileName(
                     this,
@@ -1197,8 +1479,26 @@ void EditorWindow::do_open()
     }
 }
 
+void EditorWindow::do_openframes()
+{
+    QString dir = QFileDialog::getExistingDirectory(this, "Open frames from folder", ProjDir());
+    if (dir.isNull()) {
+        return;
+    }
+
+    try {
+        EditorWindow* newFenster = static_cast<QTApp*>(g_App)->LoadProject(dir.toStdString());
+        if (newFenster && Proj().Expendable()) {
+            this->close();
+        }
+    } catch (Exception const& e) {
+        GUIShowError(e.what());
+    }
+}
+
 void EditorWindow::do_save()
 {
+    finishSaving();
     if( Proj().Filename().empty() )
     {
         do_saveas();
@@ -1209,7 +1509,7 @@ void EditorWindow::do_save()
 
 void EditorWindow::do_saveas()
 {
-    QString savefilters = "Image files (*.bmp *.gif *.png);;Any files (*)";
+    QString savefilters = "Image files (*.bmp *.gif *.png);;EvilPixie projects (*.evp);;Any files (*)";
     QString filename = QFileDialog::getSaveFileName(
                     this,
                     "Save image as",
@@ -1222,8 +1522,33 @@ void EditorWindow::do_saveas()
     SaveProject(filename.toStdString());
 }
 
+// Save the frames of the current layer as a PNG sequence.
+// Saving to the same folder again only writes the frames which have changed.
+void EditorWindow::do_saveframes()
+{
+    QString startDir = Proj().mSequence ? QString::fromStdString(Proj().mSequence->dir) : ProjDir();
+    QString dir = QFileDialog::getExistingDirectory(this, "Save frames to folder", startDir);
+    if (dir.isNull()) {
+        return;
+    }
+
+    finishLoading();
+    try {
+        int total = Proj().ResolveLayer(m_Focus).NumFrames();
+        int written = SaveSequence(Proj(), m_Focus, dir.toStdString(), Proj().mSequence);
+        m_StatusViewInfo->setText(QString("Wrote %1 of %2 frames").arg(written).arg(total));
+    } catch (Exception const& e) {
+        GUIShowError(e.what());
+    }
+}
+
+// Saving is done in the background (see BackgroundSave), so the user can
+// carry on drawing. The project is marked as unmodified straight away -
+// any further changes will set it again, and so will a failed save.
 void EditorWindow::SaveProject(std::string const& filename)
 {
+    finishLoading();
+    finishSaving();
     try
     {
         Filetype ft = FiletypeFromFilename(filename);
@@ -1266,37 +1591,86 @@ void EditorWindow::SaveProject(std::string const& filename)
                 grid.numFrames = l.mFrames.size();
             } 
             ToSpritesheetDialog dlg(this, grid, Proj(), m_Focus);
-            if( dlg.exec() == QDialog::Accepted )
+            if( dlg.exec() != QDialog::Accepted )
             {
-                // convert to spritesheet
-                Img* sheet = FramesToSpriteSheet(l.mFrames, dlg.getGrid());
-
-                Layer* tmpLayer = new Layer();
-                tmpLayer->mFPS = l.mFPS;
-                tmpLayer->mPalette = l.mPalette;
-                tmpLayer->mRanges = l.mRanges;
-                tmpLayer->mFrames.push_back(new Frame(sheet, 1000000/tmpLayer->mFPS));
-                tmpLayer->mSpare = nullptr;
-                Proj().mSettings.SpriteSheetGrid = dlg.getGrid();
-                SaveLayer(*tmpLayer, filename, Proj().mSettings);
-                // TODO: handle leak due to exceptions!!!!!!
-                delete tmpLayer;
+                return;
             }
+            // convert to spritesheet
+            Img* sheet = FramesToSpriteSheet(l.mFrames, dlg.getGrid());
+
+            Layer tmpLayer;
+            tmpLayer.mFPS = l.mFPS;
+            tmpLayer.mPalette = l.mPalette;
+            tmpLayer.mRanges = l.mRanges;
+            tmpLayer.mFrames.push_back(new Frame(sheet, 1000000/tmpLayer.mFPS));
+            Proj().mSettings.SpriteSheetGrid = dlg.getGrid();
+            m_Saver = new BackgroundSave(tmpLayer, filename, Proj().mSettings);
+        } else if (ft == FILETYPE_EVILPIXIE) {
+            // The whole project, all layers.
+            m_Saver = new BackgroundSave(*Proj().mRoot, filename, Proj().mSettings, Proj().mNative);
+            Proj().mNative = nullptr;
         } else {
             // Save directly - no processing required.
             Layer const& l = Proj().ResolveLayer(m_Focus);
-            SaveLayer(l, filename, Proj().mSettings);
+            m_Saver = new BackgroundSave(l, filename, Proj().mSettings);
         }
-        Proj().mFilename = filename;
-        Proj().SetModifiedFlag(false);
     }
     catch( Exception const& e )
     {
         GUIShowError( e.what() );
+        return;
+    }
+
+    if (!m_SaveTimer) {
+        m_SaveTimer = new QTimer(this);
+        connect(m_SaveTimer, &QTimer::timeout, this, &EditorWindow::pollSaver);
     }
+    m_SaveTimer->start(50);
+    Proj().SetModifiedFlag(false);
     RethinkWindowTitle();
 }
 
+void EditorWindow::pollSaver()
+{
+    if (m_Saver && m_Saver->Done()) {
+        savingFinished();
+    }
+}
+
+void EditorWindow::finishSaving()
+{
+    if (!m_Saver) {
+        return;
+    }
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    m_Saver->Done(true);
+    QApplication::restoreOverrideCursor();
+    savingFinished();
+}
+
+// Tidy up after a background save (which must be Done()).
+void EditorWindow::savingFinished()
+{
+    m_SaveTimer->stop();
+    NativeFile* native = m_Saver->TakeNative();
+    if (native) {
+        delete Proj().mNative;
+        Proj().mNative = native;
+    }
+    std::string err = m_Saver->Error();
+    if (err.empty()) {
+        Proj().mFilename = m_Saver->Filename();
+    } else {
+        Proj().SetModifiedFlag(true);
+    }
+    delete m_Saver;
+    m_Saver = nullptr;
+    RethinkWindowTitle();
+    if (!err.empty()) {
+        GUIShowError(err.c_str());
+    }
+}
+
 void EditorWindow::showHelp()
 {
     if(!m_HelpWindow)
@@ -1350,9 +1724,11 @@ QMenuBar* EditorWindow::CreateMenuBar()
 
         a = m->addAction( "&New...", this, SLOT( do_new()), QKeySequence::New );
         a = m->addAction( "&Open...", this, SLOT( do_open()), QKeySequence::Open );
+        a = m->addAction( "Open F&rames from Folder...", this, SLOT( do_openframes()) );
         m->addSeparator();
         a = m->addAction( "&Save", this, SLOT( do_save()), QKeySequence::Save );
         a = m->addAction( "Save &As", this, SLOT( do_saveas()), QKeySequence("CTRL+A") );
+        a = m->addAction( "Save &Frames to Folder...", this, SLOT( do_saveframes()) );
         m->addSeparator();
         a = m->addAction( "&Close", this, SLOT( close()), QKeySequence::Close );
 
@@ -1365,6 +1741,7 @@ QMenuBar* EditorWindow::CreateMenuBar()
         QMenu* m = menubar->addMenu("&Edit");
         m_ActionUndo = a = m->addAction( "&Undo", this, SLOT(do_undo()), QKeySequence::Undo );
         m_ActionRedo = a = m->addAction( "&Redo", this, SLOT(do_redo()), QKeySequence::Redo );
+        a = m->addAction( "Undo Memory Limit...", this, SLOT(do_undomemlimit()) );
         m->addSeparator();
 
         a = m->addAction( "Edit palette...", this, SLOT(togglepaletteeditor()));
@@ -1421,6 +1798,14 @@ QMenuBar* EditorWindow::CreateMenuBar()
         // TODO: REPLACE mode not yet working
         //m->addAction( m_ActionDrawmodeReplace);
         m->addAction( m_ActionDrawmodeRangeShift);
+        m->addSeparator();
+        m_ActionFillGlobal = a = m->addAction("Fill Everywhere?", this, SLOT(do_fillglobal(bool)));
+        a->setCheckable(true);
+        a->setStatusTip("Fill replaces the colour over the whole image");
+        m_ActionFillAllFrames = a = m->addAction("Fill All Frames?", this, SLOT(do_fillallframes(bool)));
+        a->setCheckable(true);
+        a->setStatusTip("Fill applies to every frame");
+        a = m->addAction("Fill Tolerance...", this, SLOT(do_filltolerance()));
         connect(m, SIGNAL(aboutToShow()), this, SLOT( update_menu_states()));
     }
 
@@ -1496,6 +1881,12 @@ void EditorWindow::RethinkWindowTitle()
     } else {
         sprintf( dim, " (%dx%d) frame %d/%d", w, h, m_Frame+1, (int)l.mFrames.size());
     }
+    if (m_Loader) {
+        strcat(dim, " (loading)");
+    }
+    if (m_Saver) {
+        strcat(dim, " (saving)");
+    }
 
     std::string title = "[*]";
     title += name;
@@ -1543,9 +1934,11 @@ bool EditorWindow::CheckZappingOK()
 
 void EditorWindow::closeEvent(QCloseEvent *event)
 {
+    finishSaving();
     if( CheckZappingOK() )
     {
         m_PaletteEditor->hide();
+        stopAutosave();
         event->accept();
     }
     else
@@ -1578,13 +1971,8 @@ void EditorWindow::dropEvent(QDropEvent *e)
             }
 
 
-            Project* new_proj = new Project(fileName.toStdString());
-            EditorWindow* fenster = new EditorWindow(new_proj);
-            fenster->show();
-            fenster->activateWindow();
-            fenster->raise();
-
-            if( Proj().Expendable() )
+            EditorWindow* fenster = static_cast<QTApp*>(g_App)->LoadProject(fileName.toStdString());
+            if (fenster && Proj().Expendable())
                 this->close();
 
         } catch( Exception const& e ) {
@@ -13,6 +13,9 @@
 #include <QColor>
 
 class EditViewWidget;
+class BackgroundSave;
+class LayerLoader;
+class QLockFile;
 class PaletteEditor;
 class PaletteWidget;
 class RangesWidget;
@@ -75,6 +78,14 @@ public:
 
     uint64_t Time() const { return m_Time; }
 
+    // Take over a loader which is still bringing in frames for the
+    // focused layer (see LayerLoader).
+    void ContinueLoading(LayerLoader* loader);
+
+    // Offer to recover any projects left behind by a crash (see Autosave).
+    // Returns the number of windows opened.
+    static int RecoverAutosaves();
+
     NodePath Focus() const { return m_Focus; };
 
     // Editor implementation
@@ -117,6 +128,7 @@ public slots:
     void update_menu_states();
     void do_undo();
     void do_redo();
+    void do_undomemlimit();
     void do_gridonoff(bool checked);
     void do_togglespare(bool checked);
     void do_gridconfig();
@@ -124,8 +136,10 @@ public slots:
     void do_changefmt();
     void do_new();
     void do_open();
+    void do_openframes();
     void do_save();
     void do_saveas();
+    void do_saveframes();
     void do_loadpalette();
     void do_savepalette();
     void do_usebrushpalette();
@@ -135,6 +149,9 @@ public slots:
     void do_scale2xbrush();
     void do_remapbrush();
     void do_drawmodeChanged(QAction* act);
+    void do_fillglobal(bool checked);
+    void do_fillallframes(bool checked);
+    void do_filltolerance();
 
     void do_tospritesheet();
     void do_fromspritesheet();
@@ -146,6 +163,11 @@ public slots:
     void do_prevframe();
     void do_nextframe();
 
+private slots:
+    void pollLoader();
+    void pollSaver();
+    void pollAutosave();
+
 private:
     uint64_t m_Time;
     NodePath m_Focus;
@@ -198,10 +220,27 @@ private:
     QAction* m_ActionDrawmodeColour;
     QAction* m_ActionDrawmodeReplace;
     QAction* m_ActionDrawmodeRangeShift;
+    QAction* m_ActionFillGlobal;
+    QAction* m_ActionFillAllFrames;
  
     // status bar items
     QLabel* m_StatusViewInfo;
 
+    // Background loading of frames (or null)
+    LayerLoader* m_Loader;
+    NodePath m_LoadTarget;  // layer being loaded
+    QTimer* m_LoadTimer;
+
+    // Save in progress (or null)
+    BackgroundSave* m_Saver;
+    QTimer* m_SaveTimer;
+
+    // Crash recovery. Each window keeps its autosave files in its own
+    // directory, locked for as long as the window is open.
+    QString m_AutosaveDir;
+    QLockFile* m_AutosaveLock;
+    QTimer* m_AutosaveTimer;    // checks for failures
+
     QCursor* m_MouseCursors[MOUSESTYLE_NUM];
 
     void RethinkWindowTitle();
@@ -212,6 +251,18 @@ private:
     void setFrame(int frame);
 
     void SaveProject(std::string const& filename);
+
+    // Wait for any background loading to finish (for operations which
+    // need all the frames).
+    void finishLoading();
+    void collectLoadedFrames(bool wait);
+
+    // Wait for any background save to finish.
+    void finishSaving();
+    void savingFinished();
+
+    void startAutosave();
+    void stopAutosave();
 };
 
 
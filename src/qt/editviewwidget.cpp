@@ -7,7 +7,9 @@
 #include <QImage>
 #include <QPainter>
 #include <QMouseEvent>
+#include <QPaintEvent>
 #include <QShortcut>
+#include <QTimer>
 #include <cassert>
 
 EditViewWidget::EditViewWidget(Editor& editor, NodePath const& focus, int frame) :
@@ -54,24 +56,43 @@ static Button translatebutton( QMouseEvent* event )
 
 void EditViewWidget::mousePressEvent(QMouseEvent *event)
 {
+    flushMoves();
     Point pos( event->pos().x(), event->pos().y() );
     OnMouseDown( pos, translatebutton(event) );
 }
 
+// Moves can come in far faster than the screen updates (eg tablets, or
+// high-rate mice), so they're queued up and handed over in one batch once
+// the event queue is clear.
 void EditViewWidget::mouseMoveEvent(QMouseEvent *event)
 {
     Point pos( event->pos().x(), event->pos().y() );
-    OnMouseMove( pos );
+    m_PendingMoves.push_back(pos);
+    if (m_PendingMoves.size() == 1) {
+        QTimer::singleShot(0, this, &EditViewWidget::flushMoves);
+    }
 }
 
 void EditViewWidget::mouseReleaseEvent(QMouseEvent *event)
 {
+    flushMoves();
     Point pos( event->pos().x(), event->pos().y() );
     OnMouseUp( pos, translatebutton(event) );
 }
 
+void EditViewWidget::flushMoves()
+{
+    if (m_PendingMoves.empty()) {
+        return;
+    }
+    std::vector<Point> moves;
+    moves.swap(m_PendingMoves);
+    OnMouseMoves(moves);
+}
+
 void EditViewWidget::wheelEvent(QWheelEvent *event)
 {
+    flushMoves();
     auto const wpos(event->position());
     Point viewpos((int)wpos.x(), (int)wpos.y());
     Point projpos = ViewToProj(viewpos);
@@ -83,13 +104,24 @@ void EditViewWidget::wheelEvent(QWheelEvent *event)
 	AlignView(viewpos, projpos);
 }
 
-void EditViewWidget::paintEvent(QPaintEvent * /* event */)
+void EditViewWidget::paintEvent(QPaintEvent *event)
 {
+    // render everything damaged since the last paint, in one go.
+    FlushDamage();
+
     Img const& src = Canvas();
-    QImage image( (const uchar *)src.PtrConst_RGBX8(0,0), Canvas().W(), Canvas().H(), QImage::Format_RGB32 );
+    QRect const& dirty = event->rect();
 
+    // canvas rows are only contiguous within a tile, so draw tile by tile.
     QPainter painter(this);
-    painter.drawImage(QPoint(0, 0), image);
+    for (int t = 0; t < src.NumTiles(); ++t) {
+        Box b = src.TileBounds(t);
+        if (b.YMax() < dirty.top() || b.YMin() > dirty.bottom()) {
+            continue;
+        }
+        QImage image( (const uchar *)src.PtrConst_RGBX8(0, b.y), b.w, b.h, src.Pitch(), QImage::Format_RGB32 );
+        painter.drawImage(QPoint(0, b.y), image);
+    }
 }
 
 void EditViewWidget::resizeEvent(QResizeEvent *event)
@@ -6,6 +6,7 @@
 #include "../editview.h"
 
 #include <QtWidgets/QWidget>
+#include <vector>
 
 class EditViewWidget : public QWidget, public EditView
 {
@@ -28,12 +29,18 @@ public slots:
     void zoomIn();
     void zoomOut();
 
+private slots:
+    void flushMoves();
+
 private:
 
 	Point m_Anchor;
 
     bool m_Panning;
 
+    // mouse moves waiting to be passed on to the EditView in one batch
+    std::vector<Point> m_PendingMoves;
+
 };
 
 #endif // EDITVIEWWIDGET_H
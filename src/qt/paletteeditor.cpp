@@ -298,6 +298,7 @@ void PaletteEditor::applyEdit(Colour const &c) {
         {
             if (mod->Merge(m_Focus, m_Frame, m_Selected, c))
             {
+                m_Ed.TopCmdChanged();
                 m_Applying = false;
                 return;
             }
@@ -4,6 +4,7 @@
 #include "../editor.h"
 #include "../exception.h"
 #include "../file_load.h"
+#include "../file_type.h"
 #include "../sheet.h"
 #include "../util.h"
 
@@ -12,6 +13,8 @@
 #include "spritesheetdialogs.h"
 
 #include <cstdio>
+#include <filesystem>
+#include <memory>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QMessageBox>
 
@@ -30,6 +33,9 @@ QTApp::~QTApp()
 
 int QTApp::Run( int argc, char* argv[] )
 {
+    // EditViewWidget batches up mouse moves itself, so let it see every one
+    // (Qt would otherwise drop the in-between positions).
+    QCoreApplication::setAttribute(Qt::AA_CompressHighFrequencyEvents, false);
     QApplication app(argc, argv);
 
 
@@ -41,16 +47,15 @@ int QTApp::Run( int argc, char* argv[] )
     {
 
         int i;
-        int cnt = 0;
+        int cnt = EditorWindow::RecoverAutosaves();
         for(i=1;i<args.size();++i)
         {
             try
             {
                 std::string filename( args.at(i).toStdString() );
-                Project* p = new Project(filename.c_str());
-                EditorWindow* fenster = new EditorWindow(p);
-                fenster->show();
-                ++cnt;
+                if (LoadProject(filename)) {
+                    ++cnt;
+                }
             }
             catch( Exception const& e )
             {
@@ -99,8 +104,20 @@ EditorWindow* QTApp::NewProject()
 
 EditorWindow* QTApp::LoadProject(std::string const& filename)
 {
+    if (FiletypeFromFilename(filename) == FILETYPE_EVILPIXIE) {
+        // Native files load (near enough) instantly anyway.
+        EditorWindow* fenster = new EditorWindow(new Project(filename));
+        fenster->show();
+        fenster->activateWindow();
+        fenster->raise();
+        return fenster;
+    }
+
     ProjSettings projSettings;
-    Layer* l = LoadLayer(filename, projSettings);
+    // Just the first frame to start with - the rest are loaded in the
+    // background.
+    std::unique_ptr<LayerLoader> loader(new LayerLoader(filename, projSettings));
+    Layer* l = loader->TakeLayer();
     assert(!l->mFrames.empty());
     // Check for hints of spritesheet, and prompt a conversion.
     if( projSettings.SpriteSheetGrid.numFrames > 1) {
@@ -109,6 +126,8 @@ EditorWindow* QTApp::LoadProject(std::string const& filename)
         FromSpritesheetDialog dlg(nullptr, srcImg, projSettings.SpriteSheetGrid);
         if (dlg.exec() == QDialog::Accepted) {
             projSettings.SpriteSheetGrid = dlg.getGrid();
+            // The sheet is the first frame - don't want any others.
+            loader.reset();
             std::vector<Img*> frames;
             FramesFromSpriteSheet(srcImg, projSettings.SpriteSheetGrid, frames);
             l->ZapFrames();
@@ -120,9 +139,15 @@ EditorWindow* QTApp::LoadProject(std::string const& filename)
     }
     Project* new_proj = new Project(l);
     new_proj->mSettings = projSettings;
-    new_proj->mFilename = filename;
+    // A folder of frames has no single file to save back to.
+    if (!std::filesystem::is_directory(filename)) {
+        new_proj->mFilename = filename;
+    }
 
     EditorWindow* fenster = new EditorWindow(new_proj);
+    if (loader) {
+        fenster->ContinueLoading(loader.release());
+    }
     fenster->show();
     fenster->activateWindow();
     fenster->raise();
@@ -1,11 +1,16 @@
 #include <algorithm>
+#include <mutex>
 #include <queue>
-#include <map>
+#include <tuple>
 #include "quantise.h"
+#include "colour_map.h"
 #include "colours.h"
 #include "img.h"
 #include "palette.h"
+#include "palette_matcher.h"
+#include "parallel.h"
 
+#include <climits>
 #include <cstdio>
 
 
@@ -15,34 +20,41 @@ struct Ent {
     int n;
 };
 
-// Comparators for sorting Ents by r,g,b or alpha.
-static bool cmp_r(Ent const& c1, Ent const& c2) { return c1.r < c2.r; }
-static bool cmp_g(Ent const& c1, Ent const& c2) { return c1.g < c2.g; }
-static bool cmp_b(Ent const& c1, Ent const& c2) { return c1.b < c2.b; }
-static bool cmp_a(Ent const& c1, Ent const& c2) { return c1.a < c2.a; }
+// Access Ent components by number (0=r, 1=g, 2=b, 3=a).
+template<int C> inline uint8_t component(Ent const& e);
+template<> inline uint8_t component<0>(Ent const& e) { return e.r; }
+template<> inline uint8_t component<1>(Ent const& e) { return e.g; }
+template<> inline uint8_t component<2>(Ent const& e) { return e.b; }
+template<> inline uint8_t component<3>(Ent const& e) { return e.a; }
 
 
 // A bucket of Ents. Supports std::span-style interface for iteration
 // and slicing. Doesn't own it's data - just a view of a larger array.
+// Keeps running totals, so the average colour comes for free.
 struct Bucket {
     Bucket(Ent* data, size_t n) :  data(data), cnt(n) {
         // calculate derived values
-        extentMin = Colour(255,255,255,255);
-        extentMax = Colour(0,0,0,0);
+        for (int i = 0; i < 4; ++i) {
+            sum[i] = 0;
+        }
         numPixels = 0;
         for (Ent e : *this) {
-            extentMin.r = std::min(extentMin.r, e.r);
-            extentMin.g = std::min(extentMin.g, e.g);
-            extentMin.b = std::min(extentMin.b, e.b);
-            extentMin.a = std::min(extentMin.a, e.a);
-            extentMax.r = std::max(extentMax.r, e.r);
-            extentMax.g = std::max(extentMax.g, e.g);
-            extentMax.b = std::max(extentMax.b, e.b);
-            extentMax.a = std::max(extentMax.a, e.a);
+            sum[0] += (int64_t)e.r * e.n;
+            sum[1] += (int64_t)e.g * e.n;
+            sum[2] += (int64_t)e.b * e.n;
+            sum[3] += (int64_t)e.a * e.n;
             numPixels += e.n;
         }
+        calcExtents();
+    }
 
-        //printf("box: %d ents, %d pixels\n",size(), numPixels);
+    // A bucket with known totals (so only the extents need working out).
+    Bucket(Ent* data, size_t n, int64_t const totals[4], int64_t pixels) :  data(data), cnt(n) {
+        for (int i = 0; i < 4; ++i) {
+            sum[i] = totals[i];
+        }
+        numPixels = pixels;
+        calcExtents();
     }
 
     Ent* data;
@@ -53,32 +65,34 @@ struct Bucket {
     Ent* end() const { return data + cnt; }
     size_t size() const { return cnt; }
     bool empty() const { return cnt==0; }
-    Bucket subspan( std::size_t offset, std::size_t count) const {
-        return Bucket(data + offset, count);
-    }
 
     // Values derived from content.
-    // Would be nice to ditch these, then could eventually switch to
-    // std::span when support is available.
-    int numPixels;
+    int64_t numPixels;
+    int64_t sum[4];    // r,g,b,a totals (weighted by pixel count)
     Colour extentMin;
     Colour extentMax;
 
-    Colour averageColour() const {
-        // TODO: possible overflow errors on 32bit?
-        int r = 0;
-        int g = 0;
-        int b = 0;
-        int a = 0;
-        int n = 0;  // total number of pixels
+    void calcExtents() {
+        extentMin = Colour(255,255,255,255);
+        extentMax = Colour(0,0,0,0);
         for (Ent e : *this) {
-            r += (int)e.r * e.n;
-            g += (int)e.g * e.n;
-            b += (int)e.b * e.n;
-            a += (int)e.a * e.n;
-            n += e.n;
+            extentMin.r = std::min(extentMin.r, e.r);
+            extentMin.g = std::min(extentMin.g, e.g);
+            extentMin.b = std::min(extentMin.b, e.b);
+            extentMin.a = std::min(extentMin.a, e.a);
+            extentMax.r = std::max(extentMax.r, e.r);
+            extentMax.g = std::max(extentMax.g, e.g);
+            extentMax.b = std::max(extentMax.b, e.b);
+            extentMax.a = std::max(extentMax.a, e.a);
         }
-        return Colour((uint8_t)(r/n), (uint8_t)(g/n), (uint8_t)(b/n), (uint8_t)(a/n));
+    }
+
+    Colour averageColour() const {
+        if (numPixels == 0) {
+            return Colour(0,0,0,0);
+        }
+        return Colour((uint8_t)(sum[0]/numPixels), (uint8_t)(sum[1]/numPixels),
+            (uint8_t)(sum[2]/numPixels), (uint8_t)(sum[3]/numPixels));
     }
 
     void dbug() const {
@@ -95,13 +109,14 @@ static bool operator<(Bucket const& lhs, Bucket const& rhs) {
 }
 
 static void medianCut(Bucket all, std::vector<Colour>& out, int numColours);
+static void refinePalette(std::vector<Ent> const& ents, std::vector<Colour>& colours);
 
 
-// Call fn for every pixel in the image.
+// Call fn for every pixel in rows y0..y1 of the image.
 // srcPalette is required if img is FMT_I8.
-template <typename PixFn> void IteratePixels(Img const& img, Palette const* srcPalette, PixFn fn)
+template <typename PixFn> void IteratePixels(Img const& img, int y0, int y1, Palette const* srcPalette, PixFn fn)
 {
-    for (int y = 0; y < img.H(); ++y) {
+    for (int y = y0; y < y1; ++y) {
         switch (img.Fmt()) {
             case FMT_RGBX8:
                 {
@@ -133,96 +148,232 @@ template <typename PixFn> void IteratePixels(Img const& img, Palette const* srcP
     }
 }
 
-// TODO: should be able to feed in multiple images here...
+// Pack a colour into a ColourMap key, and back.
+static inline uint32_t colourKey(Colour const& c)
+    { return (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16) | ((uint32_t)c.a << 24); }
+static inline Colour keyColour(uint32_t key)
+    { return Colour(key & 0xff, (key >> 8) & 0xff, (key >> 16) & 0xff, key >> 24); }
+
+
+// A run of rows from one of the source images.
+struct Band {
+    Img const* img;
+    int y0, y1;
+};
+
+// Histogram for a consecutive set of bands.
+struct Histogram {
+    int firstBand;
+    ColourMap counts;
+    // The first n colours, in the order they were seen.
+    std::vector<Colour> firstn;
+};
+
+// Below this many pixels in total, don't bother splitting up the histogram.
+static const long minParallelPixels = 512*512;
+
+static void buildHistogram(std::vector<Band> const& bands, int begin, int end,
+    int nColours, Palette const* srcPalette, Histogram& hist)
+{
+    hist.firstBand = begin;
+    uint32_t prev = 0;
+    int* prevCount = nullptr;
+    for (int i = begin; i < end; ++i) {
+        Band const& band = bands[i];
+        IteratePixels(*band.img, band.y0, band.y1, srcPalette, [&](Colour const& c) {
+            uint32_t key = colourKey(c);
+            // (runs of the same colour are common)
+            // (counts saturate, rather than wrap on huge animations)
+            if (prevCount && key == prev) {
+                if (*prevCount < INT_MAX) {
+                    ++*prevCount;
+                }
+                return;
+            }
+            size_t before = hist.counts.Size();
+            int& count = hist.counts.Get(key, 0);
+            if (count < INT_MAX) {
+                ++count;
+            }
+            if (hist.counts.Size() != before && hist.firstn.size() < (size_t)nColours) {
+                // Remember the ordering for the first n colours!
+                hist.firstn.push_back(c);
+            }
+            prev = key;
+            prevCount = &count;
+        });
+    }
+}
+
+// Fold src into dest. src must cover the bands following those in dest.
+static void mergeHistogram(Histogram& dest, Histogram& src, int nColours)
+{
+    for (Colour const& c : src.firstn) {
+        if (dest.firstn.size() >= (size_t)nColours) {
+            break;
+        }
+        if (!dest.counts.Find(colourKey(c))) {
+            dest.firstn.push_back(c);
+        }
+    }
+    src.counts.ForEach([&](uint32_t key, int n) {
+        int& count = dest.counts.Get(key, 0);
+        count = (int)std::min((int64_t)count + n, (int64_t)INT_MAX);
+    });
+    src.counts.Clear();
+}
+
+void CalculatePalette(Img const& srcImg, std::vector<Colour>& out, int nColours, Palette const* srcPalette /*= nullptr*/, bool refine /*= false*/)
+{
+    std::vector<Img const*> srcImgs(1, &srcImg);
+    CalculatePalette(srcImgs, out, nColours, srcPalette, refine);
+}
+
 // TODO: ditch srcPalette once images contain their own palette...
-void CalculatePalette(Img const& srcImg, std::vector<Colour>& out, int nColours, Palette const* srcPalette /*= nullptr*/)
+void CalculatePalette(std::vector<Img const*> const& srcImgs, std::vector<Colour>& out, int nColours, Palette const* srcPalette /*= nullptr*/, bool refine /*= false*/)
 {
     out.clear();
     out.reserve(nColours);
 
-    // build histogram
-    std::map<Colour, int> hist;
-    std::vector<Colour> firstn;
-    IteratePixels(srcImg, srcPalette, [&](Colour const& c) {
-        auto it = hist.find(c);
-        if (it == hist.end()) {
-            hist.insert({c,0});
-            // Remember the ordering for the first n colours!
-            if (firstn.size() < (size_t)nColours) {
-                firstn.push_back(c);
-            }
-        } else {
-            it->second++;
+    // Split the images up into bands (along tile boundaries, so
+    // threads don't compete for the same rows).
+    std::vector<Band> bands;
+    long numPixels = 0;
+    for (Img const* img : srcImgs) {
+        for (int t = 0; t < img->NumTiles(); ++t) {
+            Box b = img->TileBounds(t);
+            Band band = {img, b.y, b.y + b.h};
+            bands.push_back(band);
         }
-    });
+        numPixels += (long)img->W() * img->H();
+    }
+
+    // Build a histogram for each chunk of bands, then merge them in order,
+    // so the first n colours still come out in the order they appear.
+    // (If there are few enough colours that ordering matters, each chunk
+    // holds all of its colours in firstn, so the merged order is exact).
+    std::vector<Histogram*> parts;
+    if (numPixels < minParallelPixels) {
+        parts.push_back(new Histogram());
+        buildHistogram(bands, 0, (int)bands.size(), nColours, srcPalette, *parts.back());
+    } else {
+        std::mutex partsLock;
+        ParallelFor(0, (int)bands.size(), 1, [&](int begin, int end) {
+            Histogram* part = new Histogram();
+            buildHistogram(bands, begin, end, nColours, srcPalette, *part);
+            std::lock_guard<std::mutex> lock(partsLock);
+            parts.push_back(part);
+        });
+        std::sort(parts.begin(), parts.end(), [](Histogram const* a, Histogram const* b) {
+            return a->firstBand < b->firstBand;
+        });
+    }
+    for (size_t i = 1; i < parts.size(); ++i) {
+        mergeHistogram(*parts[0], *parts[i], nColours);
+        delete parts[i];
+    }
+    ColourMap& hist = parts[0]->counts;
+    std::vector<Colour>& firstn = parts[0]->firstn;
 
-    if (hist.size() <= (size_t)nColours) {
+    if (hist.Size() <= (size_t)nColours) {
         // No colour reduction needed. Preserve ordering seen in image.
         // Pad out if needed.
         while (firstn.size() < (size_t)nColours) {
             firstn.push_back(Colour(0,0,0,0));
         }
         out = firstn;
+        delete parts[0];
         return;
     }
 
     std::vector<Ent> ents;
-    for (auto const& dat : hist) {
-        Colour const& c = dat.first;
-        Ent ent = {c.r, c.g, c.b, c.a, dat.second };
+    ents.reserve(hist.Size());
+    hist.ForEach([&](uint32_t key, int n) {
+        Colour c = keyColour(key);
+        Ent ent = {c.r, c.g, c.b, c.a, n};
         ents.push_back(ent);
-    }
+    });
     // Done with histogram
-    hist.clear();
+    delete parts[0];
+    // The hashmap order depends on how the work was split up. Sort, so we
+    // get the same palette however many threads there are.
+    std::sort(ents.begin(), ents.end(), [](Ent const& a, Ent const& b) {
+        return std::tie(a.r, a.g, a.b, a.a) < std::tie(b.r, b.g, b.b, b.a);
+    });
 
     // Pick a set of colours
     Bucket all(&ents.front(), ents.size());
     medianCut(all, out, nColours);
+    if (refine) {
+        refinePalette(ents, out);
+    }
+}
+
+
+
+// Sort the ents of a bucket by component C, using a counting sort (it's
+// only 8 bits, so no need for a full comparison sort).
+// tmp is scratch space.
+template<int C>
+static void sortBucket(Bucket const& b, std::vector<Ent>& tmp)
+{
+    size_t offsets[256] = {0};
+    for (Ent const& e : b) {
+        ++offsets[component<C>(e)];
+    }
+    size_t pos = 0;
+    for (int v = 0; v < 256; ++v) {
+        size_t n = offsets[v];
+        offsets[v] = pos;
+        pos += n;
+    }
+    tmp.resize(b.size());
+    for (Ent const& e : b) {
+        tmp[offsets[component<C>(e)]++] = e;
+    }
+    std::copy(tmp.begin(), tmp.end(), b.begin());
 }
 
+// Split a bucket in half (by number of colours) along the component with
+// the biggest range.
+static void splitBucket(Bucket const& b, std::vector<Ent>& tmp, Bucket& lo, Bucket& hi)
+{
+    // find major axis
+    Colour const& minVal = b.extentMin;
+    Colour const& maxVal = b.extentMax;
+    int range[4] = {maxVal.r - minVal.r, maxVal.g - minVal.g, maxVal.b - minVal.b,
+        maxVal.a - minVal.a};
+    int axis = (int)(std::max_element(range, range + 4) - range);
+    switch (axis) {
+        case 0: sortBucket<0>(b, tmp); break;
+        case 1: sortBucket<1>(b, tmp); break;
+        case 2: sortBucket<2>(b, tmp); break;
+        default: sortBucket<3>(b, tmp); break;
+    }
 
+    size_t half = b.size() / 2;
+    lo = Bucket(b.begin(), half);
+    // totals for the other half are whatever's left over
+    int64_t sum[4];
+    for (int i = 0; i < 4; ++i) {
+        sum[i] = b.sum[i] - lo.sum[i];
+    }
+    hi = Bucket(b.begin() + half, b.size() - half, sum, b.numPixels - lo.numPixels);
+}
 
 static void medianCut(Bucket all, std::vector<Colour>& out, int numColours) {
     assert(all.size() >= (size_t)numColours);
     std::priority_queue<Bucket> buckets;
+    std::vector<Ent> tmp;
     buckets.push(all);
     while (buckets.size() < (size_t)numColours) {
         Bucket b = buckets.top();
-
-        // find major axis
-        Colour const& minVal = b.extentMin;
-        Colour const& maxVal = b.extentMax;
-        Colour r(maxVal.r - minVal.r, maxVal.g - minVal.g, maxVal.b - minVal.b,
-            maxVal.a - minVal.a);
-
-        // Sort bucket contents by the component with the largest range.
-        if (r.r > r.g && r.r > r.b && r.r > r.a) {
-            std::sort(b.begin(), b.end(), cmp_r);
-        } else if (r.g > r.r && r.g > r.b && r.g > r.a) {
-            std::sort(b.begin(), b.end(), cmp_g);
-        } else if (r.b > r.r && r.b > r.g && r.b > r.a) {
-            std::sort(b.begin(), b.end(), cmp_b);
-        } else if (r.a > r.r && r.a > r.g && r.a > r.b) {
-            std::sort(b.begin(), b.end(), cmp_a);
-        }
-
-        // Split bucket.
-        size_t half = b.size() / 2;
-        //printf("Split. %d => %d:%d\n", b.size(), half, b.size()-half);
         buckets.pop();
-        buckets.push(b.subspan(0,half));
-        buckets.push(b.subspan(half,b.size()-half));
-
-        // dump
-#if 0
-        std::priority_queue<Bucket> tmp = buckets;
-        while (!tmp.empty()) {
-            Bucket b = tmp.top();
-            tmp.pop();
-            b.dbug();
-        }
-        printf("----\n");
-#endif
+        Bucket lo(nullptr, 0);
+        Bucket hi(nullptr, 0);
+        splitBucket(b, tmp, lo, hi);
+        buckets.push(lo);
+        buckets.push(hi);
     }
 
     while(!buckets.empty()) {
@@ -232,6 +383,78 @@ static void medianCut(Bucket all, std::vector<Colour>& out, int numColours) {
     }
 }
 
+
+// Improve a palette using k-means: assign every colour to its closest
+// palette entry, move each entry to the (weighted) average of the colours
+// assigned to it, and repeat until nothing moves.
+// Sums are integers, so the result doesn't depend on how the work was
+// split up.
+static void refinePalette(std::vector<Ent> const& ents, std::vector<Colour>& colours)
+{
+    const int maxIterations = 20;
+    const int n = (int)colours.size();
+    std::vector<int> assigned(ents.size(), -1);
+    for (int iter = 0; iter < maxIterations; ++iter) {
+        Palette pal(n);
+        for (int i = 0; i < n; ++i) {
+            pal.SetColour(i, colours[i]);
+        }
+        PaletteMatcher matcher(pal);
+
+        // per entry: r,g,b,a sums and pixel count
+        std::vector<int64_t> sums(n * 5, 0);
+        int changed = 0;
+        std::mutex sumsLock;
+        ParallelFor(0, (int)ents.size(), 4096, [&](int begin, int end) {
+            PaletteMatcher local(matcher);
+            std::vector<int64_t> localSums(n * 5, 0);
+            int localChanged = 0;
+            for (int i = begin; i < end; ++i) {
+                Ent const& e = ents[i];
+                int idx = local.Closest(Colour(e.r, e.g, e.b, e.a));
+                if (idx != assigned[i]) {
+                    assigned[i] = idx;
+                    ++localChanged;
+                }
+                int64_t* s = &localSums[idx * 5];
+                s[0] += (int64_t)e.r * e.n;
+                s[1] += (int64_t)e.g * e.n;
+                s[2] += (int64_t)e.b * e.n;
+                s[3] += (int64_t)e.a * e.n;
+                s[4] += e.n;
+            }
+            std::lock_guard<std::mutex> lock(sumsLock);
+            for (int i = 0; i < n * 5; ++i) {
+                sums[i] += localSums[i];
+            }
+            changed += localChanged;
+        });
+        if (changed == 0) {
+            break;
+        }
+
+        // Move entries to their centroids (unused ones stay put).
+        bool moved = false;
+        for (int i = 0; i < n; ++i) {
+            int64_t const* s = &sums[i * 5];
+            if (s[4] == 0) {
+                continue;
+            }
+            Colour c((int)((s[0] + s[4] / 2) / s[4]),
+                (int)((s[1] + s[4] / 2) / s[4]),
+                (int)((s[2] + s[4] / 2) / s[4]),
+                (int)((s[3] + s[4] / 2) / s[4]));
+            if (!(c == colours[i])) {
+                colours[i] = c;
+                moved = true;
+            }
+        }
+        if (!moved) {
+            break;
+        }
+    }
+}
+
 #if 0
 int main() {
     Ent fook[7] = {
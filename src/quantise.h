@@ -6,6 +6,15 @@
 class Palette;
 class Img;
 
-void CalculatePalette(Img const& srcImg, std::vector<Colour>& out, int nColours, Palette const* srcPalette = nullptr);
+// Pick a palette of nColours to best represent the image(s).
+// If there are no more than nColours colours in use, they're returned in the
+// order they first appear (padded out with transparent black).
+// srcPalette is required for FMT_I8 images.
+// If refine is set, the palette is improved with a k-means pass afterward
+// (slower, but usually a closer match).
+void CalculatePalette(Img const& srcImg, std::vector<Colour>& out, int nColours, Palette const* srcPalette = nullptr, bool refine = false);
+// Pick a single palette to cover a set of images (eg all the frames in a
+// layer). The histogram is built in parallel for big jobs.
+void CalculatePalette(std::vector<Img const*> const& srcImgs, std::vector<Colour>& out, int nColours, Palette const* srcPalette = nullptr, bool refine = false);
 
 #endif // QUANTISE_H
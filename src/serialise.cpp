@@ -0,0 +1,242 @@
+#include "serialise.h"
+#include "exception.h"
+#include "layer.h"
+#include "palette.h"
+#include "ranges.h"
+#include "sheet.h"
+
+#include <cstring>
+
+
+void BinWriter::U32(uint32_t v)
+{
+    m_Data.push_back((uint8_t)(v));
+    m_Data.push_back((uint8_t)(v >> 8));
+    m_Data.push_back((uint8_t)(v >> 16));
+    m_Data.push_back((uint8_t)(v >> 24));
+}
+
+void BinWriter::Bytes(void const* p, size_t n)
+{
+    uint8_t const* b = (uint8_t const*)p;
+    m_Data.insert(m_Data.end(), b, b + n);
+}
+
+void BinWriter::String(std::string const& s)
+{
+    U32((uint32_t)s.size());
+    Bytes(s.data(), s.size());
+}
+
+
+void BinReader::need(size_t n)
+{
+    if ((size_t)(m_End - m_Cur) < n) {
+        throw Exception("Unexpected end of data");
+    }
+}
+
+uint8_t BinReader::U8()
+{
+    need(1);
+    return *m_Cur++;
+}
+
+uint32_t BinReader::U32()
+{
+    need(4);
+    uint32_t v = (uint32_t)m_Cur[0] |
+        ((uint32_t)m_Cur[1] << 8) |
+        ((uint32_t)m_Cur[2] << 16) |
+        ((uint32_t)m_Cur[3] << 24);
+    m_Cur += 4;
+    return v;
+}
+
+void BinReader::Bytes(void* p, size_t n)
+{
+    need(n);
+    memcpy(p, m_Cur, n);
+    m_Cur += n;
+}
+
+std::string BinReader::String()
+{
+    size_t n = U32();
+    need(n);
+    std::string s((char const*)m_Cur, n);
+    m_Cur += n;
+    return s;
+}
+
+
+void Write(BinWriter& out, Box const& b)
+{
+    out.I32(b.x);
+    out.I32(b.y);
+    out.I32(b.w);
+    out.I32(b.h);
+}
+
+void Read(BinReader& in, Box& b)
+{
+    b.x = in.I32();
+    b.y = in.I32();
+    b.w = in.I32();
+    b.h = in.I32();
+}
+
+void Write(BinWriter& out, NodePath const& path)
+{
+    out.U32((uint32_t)path.path.size());
+    for (auto i : path.path) {
+        out.I32(i);
+    }
+}
+
+void Read(BinReader& in, NodePath& path)
+{
+    uint32_t n = in.U32();
+    if (n > in.Remaining() / 4) {
+        throw Exception("Bad node path");
+    }
+    path.path.clear();
+    for (uint32_t i = 0; i < n; ++i) {
+        path.path.push_back(in.I32());
+    }
+}
+
+void Write(BinWriter& out, Colour const& c)
+{
+    out.U8(c.r);
+    out.U8(c.g);
+    out.U8(c.b);
+    out.U8(c.a);
+}
+
+void Read(BinReader& in, Colour& c)
+{
+    c.r = in.U8();
+    c.g = in.U8();
+    c.b = in.U8();
+    c.a = in.U8();
+}
+
+void Write(BinWriter& out, PenColour const& pen)
+{
+    Write(out, pen.rgb());
+    out.I32(pen.IdxValid() ? pen.idx() : -1);
+}
+
+void Read(BinReader& in, PenColour& pen, int numColours)
+{
+    Colour c;
+    Read(in, c);
+    int idx = in.I32();
+    if (idx < -1 || idx >= numColours) {
+        throw Exception("Bad pen colour");
+    }
+    pen = PenColour(c, idx);
+}
+
+void Write(BinWriter& out, Palette const& pal)
+{
+    out.U32((uint32_t)pal.NColours);
+    for (int i = 0; i < pal.NColours; ++i) {
+        Write(out, pal.Colours[i]);
+    }
+}
+
+void Read(BinReader& in, Palette& pal)
+{
+    uint32_t n = in.U32();
+    if (n > 256 || n > in.Remaining() / 4) {
+        throw Exception("Bad palette");
+    }
+    pal.SetNumColours((int)n);
+    for (int i = 0; i < (int)n; ++i) {
+        Read(in, pal.Colours[i]);
+    }
+}
+
+void Write(BinWriter& out, RangeGrid const& ranges)
+{
+    Box const& bound = ranges.Bound();
+    out.I32(bound.w);
+    out.I32(bound.h);
+    for (int y = bound.YMin(); y <= bound.YMax(); ++y) {
+        for (int x = bound.XMin(); x <= bound.XMax(); ++x) {
+            PenColour pen;
+            if (ranges.Get(Point(x, y), pen)) {
+                out.U8(1);
+                Write(out, pen);
+            } else {
+                out.U8(0);
+            }
+        }
+    }
+}
+
+void Read(BinReader& in, RangeGrid& ranges, int numColours)
+{
+    int w = in.I32();
+    int h = in.I32();
+    // (each entry is at least a flag byte)
+    if (w < 0 || h < 0 || (uint64_t)w * h > in.Remaining()) {
+        throw Exception("Bad range grid");
+    }
+    ranges = RangeGrid(w, h);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            if (in.U8()) {
+                PenColour pen;
+                Read(in, pen, numColours);
+                ranges.Set(Point(x, y), pen);
+            }
+        }
+    }
+}
+
+void Write(BinWriter& out, SpriteGrid const& grid)
+{
+    out.U32(grid.numColumns);
+    out.U32(grid.numRows);
+    out.U32(grid.padX);
+    out.U32(grid.padY);
+    out.U32(grid.cellW);
+    out.U32(grid.cellH);
+    out.U32(grid.numFrames);
+}
+
+void Read(BinReader& in, SpriteGrid& grid)
+{
+    grid.numColumns = in.U32();
+    grid.numRows = in.U32();
+    grid.padX = in.U32();
+    grid.padY = in.U32();
+    grid.cellW = in.U32();
+    grid.cellH = in.U32();
+    grid.numFrames = in.U32();
+}
+
+void WriteLayerProps(BinWriter& out, Layer const& layer)
+{
+    out.String(layer.mName);
+    out.I32(layer.mOffset.x);
+    out.I32(layer.mOffset.y);
+    out.I32(layer.mFPS);
+    Write(out, layer.mPalette);
+    Write(out, layer.mRanges);
+    out.String(layer.mFilename);
+}
+
+void ReadLayerProps(BinReader& in, Layer& layer)
+{
+    layer.mName = in.String();
+    layer.mOffset.x = in.I32();
+    layer.mOffset.y = in.I32();
+    layer.mFPS = in.I32();
+    Read(in, layer.mPalette);
+    Read(in, layer.mRanges, layer.mPalette.NColours);
+    layer.mFilename = in.String();
+}
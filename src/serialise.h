@@ -0,0 +1,87 @@
+#ifndef SERIALISE_H
+#define SERIALISE_H
+
+#include "box.h"
+#include "colours.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct NodePath;
+struct Palette;
+class Layer;
+struct SpriteGrid;
+class RangeGrid;
+
+// Simple binary serialisation, used to spill cmds out of memory (see
+// UndoJournal), for the crash recovery journal (see Autosave) and for the
+// index of native project files (see file_native.h). Values are
+// little-endian. There's no versioning here - anything which needs it has
+// to do it itself.
+
+class BinWriter
+{
+public:
+    void U8(uint8_t v) { m_Data.push_back(v); }
+    void U32(uint32_t v);
+    void I32(int32_t v) { U32((uint32_t)v); }
+    void U64(uint64_t v) { U32((uint32_t)v); U32((uint32_t)(v >> 32)); }
+    void Bytes(void const* p, size_t n);
+    void String(std::string const& s);
+
+    std::vector<uint8_t> const& Data() const { return m_Data; }
+    void Clear() { m_Data.clear(); }
+private:
+    std::vector<uint8_t> m_Data;
+};
+
+// Reads back data written by BinWriter.
+// Throws an Exception if it runs off the end of the data.
+class BinReader
+{
+public:
+    BinReader(uint8_t const* data, size_t len) :
+        m_Cur(data),
+        m_End(data + len)
+        {}
+    uint8_t U8();
+    uint32_t U32();
+    int32_t I32() { return (int32_t)U32(); }
+    uint64_t U64() { uint64_t lo = U32(); return lo | ((uint64_t)U32() << 32); }
+    void Bytes(void* p, size_t n);
+    std::string String();
+
+    bool AtEnd() const { return m_Cur == m_End; }
+    size_t Remaining() const { return m_End - m_Cur; }
+private:
+    void need(size_t n);
+    uint8_t const* m_Cur;
+    uint8_t const* m_End;
+};
+
+
+// Helpers for common types.
+void Write(BinWriter& out, Box const& b);
+void Write(BinWriter& out, NodePath const& path);
+void Write(BinWriter& out, Colour const& c);
+void Write(BinWriter& out, PenColour const& pen);
+void Write(BinWriter& out, Palette const& pal);
+void Write(BinWriter& out, RangeGrid const& ranges);
+void Write(BinWriter& out, SpriteGrid const& grid);
+// Everything except the frames (see WriteLayerFrames() in img_pack.h).
+void WriteLayerProps(BinWriter& out, Layer const& layer);
+
+// The Read() functions throw an Exception upon bad data.
+void Read(BinReader& in, Box& b);
+void Read(BinReader& in, NodePath& path);
+void Read(BinReader& in, Colour& c);
+// Pen indices must be below numColours (or -1, for none).
+void Read(BinReader& in, PenColour& pen, int numColours = 256);
+void Read(BinReader& in, Palette& pal);
+void Read(BinReader& in, RangeGrid& ranges, int numColours = 256);
+void Read(BinReader& in, SpriteGrid& grid);
+void ReadLayerProps(BinReader& in, Layer& layer);
+
+#endif // SERIALISE_H
@@ -0,0 +1,356 @@
+#include "stroke.h"
+#include "blit_kernels.h"
+#include "box.h"
+#include "img.h"
+#include "palette.h"
+#include "point.h"
+
+#include <algorithm>
+#include <type_traits>
+
+namespace {
+
+// A horizontal run of pixels, [x0,x1).
+struct Run
+{
+    int x0;
+    int x1;
+};
+
+// The opaque runs on each row of the brush.
+typedef std::vector<std::vector<Run>> BrushRuns;
+
+template<typename P>
+void findRuns(Img const& brush, SrcKey<P> const& key, BrushRuns& runs)
+{
+    runs.assign(brush.H(), std::vector<Run>());
+    for (int y = 0; y < brush.H(); ++y) {
+        P const* src = RowPtrConst<P>(brush, 0, y);
+        int x = 0;
+        while (x < brush.W()) {
+            while (x < brush.W() && key.Transparent(src[x])) {
+                ++x;
+            }
+            int x0 = x;
+            while (x < brush.W() && !key.Transparent(src[x])) {
+                ++x;
+            }
+            if (x > x0) {
+                runs[y].push_back(Run{x0, x});
+            }
+        }
+    }
+}
+
+void brushRuns(Img const& brush, PenColour const& transparent, BrushRuns& runs)
+{
+    switch (brush.Fmt()) {
+        case FMT_I8: findRuns<I8>(brush, BrushKey<I8>(transparent), runs); break;
+        case FMT_RGBX8: findRuns<RGBX8>(brush, BrushKey<RGBX8>(transparent), runs); break;
+        case FMT_RGBA8: findRuns<RGBA8>(brush, BrushKey<RGBA8>(transparent), runs); break;
+        default: assert(false); break;
+    }
+}
+
+// Add [a,b) to the (sorted, non-touching) runs already covered on a row,
+// calling emit() for each part of it which wasn't already covered.
+template<typename EMIT>
+void cover(std::vector<Run>& covered, int a, int b, EMIT const& emit)
+{
+    // usual case: only one run so far, and [a,b) overlaps it
+    if (covered.size() == 1 && covered[0].x0 <= b && covered[0].x1 >= a) {
+        Run& c = covered[0];
+        if (a < c.x0) {
+            emit(a, c.x0);
+            c.x0 = a;
+        }
+        if (b > c.x1) {
+            emit(c.x1, b);
+            c.x1 = b;
+        }
+        return;
+    }
+    // first run which overlaps or touches [a,b)
+    auto first = std::lower_bound(covered.begin(), covered.end(), a,
+        [](Run const& r, int x) -> bool { return r.x1 < x; });
+    auto it = first;
+    int x = a;
+    Run merged{a, b};
+    while (it != covered.end() && it->x0 <= b) {
+        if (it->x0 > x) {
+            emit(x, it->x0);
+        }
+        x = std::max(x, it->x1);
+        merged.x0 = std::min(merged.x0, it->x0);
+        merged.x1 = std::max(merged.x1, it->x1);
+        ++it;
+    }
+    if (x < b) {
+        emit(x, b);
+    }
+    if (first == it) {
+        covered.insert(first, merged);
+    } else {
+        *first = merged;
+        covered.erase(first + 1, it);
+    }
+}
+
+// A run of a brush row stamped onto a dest row: dest pixels [x0,x1),
+// taken from the brush starting at (sx,sy).
+struct Piece
+{
+    int x0;
+    int x1;
+    int sx;
+    int sy;
+};
+
+// Work out which parts of the stamps end up visible, calling
+// draw(y, piece) for each, row by row, so each dest pixel is only drawn
+// once.
+// If LAST_WINS, works through the stamps backwards, only keeping the bits
+// not already covered by later stamps. Otherwise (every stamp draws the
+// same thing, eg a matte) it just draws the union of the stamps, which is
+// a lot cheaper.
+// Returns the affected area, as a box per tile of dest.
+template<bool LAST_WINS, typename DRAW>
+void rasterise(BrushRuns const& runs, std::vector<Point> const& pts,
+    Img const& dest, std::vector<Box>& damage, DRAW const& draw)
+{
+    damage.clear();
+    if (pts.empty() || runs.empty()) {
+        return;
+    }
+    Box const& bounds = dest.Bounds();
+    const int xmin = bounds.XMin();
+    const int xmax = bounds.XMax() + 1;
+
+    // rows the stroke covers
+    const int brushH = (int)runs.size();
+    int y0 = pts[0].y;
+    int y1 = pts[0].y;
+    for (auto const& p : pts) {
+        y0 = std::min(y0, p.y);
+        y1 = std::max(y1, p.y);
+    }
+    y0 = std::max(y0, bounds.YMin());
+    y1 = std::min(y1 + brushH - 1, bounds.YMax());
+    if (y1 < y0) {
+        return;
+    }
+
+    // Sort every stamped brush run onto the dest row it lands on (a
+    // counting sort, which keeps the order of the stamps).
+    std::vector<int> start(y1 - y0 + 2, 0);
+    for (auto const& p : pts) {
+        int rfirst = std::max(0, y0 - p.y);
+        int rlast = std::min(brushH - 1, y1 - p.y);
+        for (int r = rfirst; r <= rlast; ++r) {
+            start[p.y + r - y0 + 1] += (int)runs[r].size();
+        }
+    }
+    for (size_t i = 1; i < start.size(); ++i) {
+        start[i] += start[i - 1];
+    }
+    std::vector<Piece> pieces(start.back());
+    std::vector<int> end(start.begin(), start.end() - 1);
+    auto add = [&](Point const& p) {
+        int rfirst = std::max(0, y0 - p.y);
+        int rlast = std::min(brushH - 1, y1 - p.y);
+        for (int r = rfirst; r <= rlast; ++r) {
+            int row = p.y + r - y0;
+            int& n = end[row];
+            for (auto const& run : runs[r]) {
+                int a = std::max(p.x + run.x0, xmin);
+                int b = std::min(p.x + run.x1, xmax);
+                if (a >= b) {
+                    continue;
+                }
+                if (!LAST_WINS && n > start[row]) {
+                    // consecutive stamps usually overlap, so just extend
+                    Piece& prev = pieces[n - 1];
+                    if (a <= prev.x1 && b >= prev.x0) {
+                        prev.x0 = std::min(prev.x0, a);
+                        prev.x1 = std::max(prev.x1, b);
+                        continue;
+                    }
+                }
+                pieces[n++] = Piece{a, b, a - p.x, r};
+            }
+        }
+    };
+    if constexpr (LAST_WINS) {
+        std::for_each(pts.rbegin(), pts.rend(), add);
+    } else {
+        std::for_each(pts.begin(), pts.end(), add);
+    }
+
+    // Now go through row by row, drawing what's visible.
+    std::vector<Run> covered;
+    int tile = -1;
+    for (int y = y0; y <= y1; ++y) {
+        auto first = pieces.begin() + start[y - y0];
+        auto last = pieces.begin() + end[y - y0];
+        if (first == last) {
+            continue;
+        }
+        int rowMin;
+        int rowMax;
+        if constexpr (LAST_WINS) {
+            covered.clear();
+            for (auto pc = first; pc != last; ++pc) {
+                cover(covered, pc->x0, pc->x1, [&](int x0, int x1) {
+                    draw(y, Piece{x0, x1, pc->sx + (x0 - pc->x0), pc->sy});
+                });
+            }
+            rowMin = covered.front().x0;
+            rowMax = covered.back().x1;
+        } else {
+            std::sort(first, last, [](Piece const& a, Piece const& b) -> bool { return a.x0 < b.x0; });
+            Piece merged = *first;
+            for (auto pc = first + 1; pc != last; ++pc) {
+                if (pc->x0 > merged.x1) {
+                    draw(y, merged);
+                    merged = *pc;
+                } else {
+                    merged.x1 = std::max(merged.x1, pc->x1);
+                }
+            }
+            draw(y, merged);
+            rowMin = first->x0;
+            rowMax = merged.x1;
+        }
+        Box b(rowMin, y, rowMax - rowMin, 1);
+        int t = dest.TileIndex(y);
+        if (t != tile) {
+            damage.push_back(b);
+            tile = t;
+        } else {
+            damage.back().Merge(b);
+        }
+    }
+}
+
+
+// Pixel copying for StrokeKeyed(). The spans only cover opaque brush
+// pixels, so there's no keying to do here.
+template<typename SRC, typename DEST>
+class CopyOp
+{
+public:
+    CopyOp(Palette const& pal)
+    {
+        if constexpr (std::is_same<SRC, I8>::value && !std::is_same<DEST, I8>::value) {
+            ExpandPalette(pal, FormatOf<DEST>(), m_Table);
+        }
+    }
+
+    void Row(SRC const* src, DEST* dest, int w) const
+    {
+        if constexpr (std::is_same<SRC, DEST>::value) {
+            std::copy(src, src + w, dest);
+        } else if constexpr (std::is_same<SRC, I8>::value) {
+            uint32_t* d = (uint32_t*)dest;
+            for (int x = 0; x < w; ++x) {
+                d[x] = m_Table[src[x]];
+            }
+        } else {
+            // RGBX8<->RGBA8 needs the top byte set (to alpha or pad),
+            // as with the keyed blits.
+            static_assert(!std::is_same<DEST, I8>::value);
+            uint32_t const* s = (uint32_t const*)src;
+            uint32_t* d = (uint32_t*)dest;
+            for (int x = 0; x < w; ++x) {
+                d[x] = s[x] | 0xff000000;
+            }
+        }
+    }
+
+private:
+    uint32_t m_Table[256];  // palette expanded to DEST, for I8 sources
+};
+
+template<typename SRC, typename DEST>
+void copyStroke(Img const& brush, Palette const& pal, BrushRuns const& runs,
+    std::vector<Point> const& pts, Img& dest, std::vector<Box>& damage)
+{
+    CopyOp<SRC, DEST> op(pal);
+    int rowY = -1;
+    DEST* row = nullptr;
+    rasterise<true>(runs, pts, dest, damage, [&](int y, Piece const& pc) {
+        if (y != rowY) {
+            rowY = y;
+            row = RowPtr<DEST>(dest, 0, y);
+        }
+        op.Row(RowPtrConst<SRC>(brush, pc.sx, pc.sy), row + pc.x0, pc.x1 - pc.x0);
+    });
+}
+
+template<typename SRC>
+void copyStrokeFrom(Img const& brush, Palette const& pal, BrushRuns const& runs,
+    std::vector<Point> const& pts, Img& dest, std::vector<Box>& damage)
+{
+    switch (dest.Fmt()) {
+        case FMT_I8:
+            if constexpr (std::is_same<SRC, I8>::value) {
+                copyStroke<SRC, I8>(brush, pal, runs, pts, dest, damage);
+            }
+            break;
+        case FMT_RGBX8: copyStroke<SRC, RGBX8>(brush, pal, runs, pts, dest, damage); break;
+        case FMT_RGBA8: copyStroke<SRC, RGBA8>(brush, pal, runs, pts, dest, damage); break;
+        default: assert(false); break;
+    }
+}
+
+template<typename DEST>
+void fillStroke(PenColour const& pen, BrushRuns const& runs,
+    std::vector<Point> const& pts, Img& dest, std::vector<Box>& damage)
+{
+    const DEST c = PenPixel<DEST>(pen);
+    int rowY = -1;
+    DEST* row = nullptr;
+    rasterise<false>(runs, pts, dest, damage, [&](int y, Piece const& pc) {
+        if (y != rowY) {
+            rowY = y;
+            row = RowPtr<DEST>(dest, 0, y);
+        }
+        std::fill(row + pc.x0, row + pc.x1, c);
+    });
+}
+
+}   // anonymous namespace
+
+
+void StrokeKeyed(Img const& brush, Palette const& brushPalette, PenColour const& transparent,
+    std::vector<Point> const& pts, Img& dest, std::vector<Box>& damage)
+{
+    damage.clear();
+    // BlitTransparent() doesn't draw RGB onto I8 either.
+    if (dest.Fmt() == FMT_I8 && brush.Fmt() != FMT_I8) {
+        return;
+    }
+
+    BrushRuns runs;
+    brushRuns(brush, transparent, runs);
+    switch (brush.Fmt()) {
+        case FMT_I8: copyStrokeFrom<I8>(brush, brushPalette, runs, pts, dest, damage); break;
+        case FMT_RGBX8: copyStrokeFrom<RGBX8>(brush, brushPalette, runs, pts, dest, damage); break;
+        case FMT_RGBA8: copyStrokeFrom<RGBA8>(brush, brushPalette, runs, pts, dest, damage); break;
+        default: assert(false); break;
+    }
+}
+
+
+void StrokeMatte(Img const& brush, PenColour const& transparent, PenColour const& matte,
+    std::vector<Point> const& pts, Img& dest, std::vector<Box>& damage)
+{
+    BrushRuns runs;
+    brushRuns(brush, transparent, runs);
+    switch (dest.Fmt()) {
+        case FMT_I8: fillStroke<I8>(matte, runs, pts, dest, damage); break;
+        case FMT_RGBX8: fillStroke<RGBX8>(matte, runs, pts, dest, damage); break;
+        case FMT_RGBA8: fillStroke<RGBA8>(matte, runs, pts, dest, damage); break;
+        default: assert(false); break;
+    }
+}
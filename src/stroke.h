@@ -0,0 +1,33 @@
+#ifndef STROKE_H_INCLUDED
+#define STROKE_H_INCLUDED
+
+#include "colours.h"
+#include <vector>
+
+class Img;
+struct Box;
+class Point;
+struct Palette;
+
+// Strokes - a brush stamped down at a series of points (eg every pixel
+// along a line).
+//
+// Rather than blitting the whole brush at each point, the footprint of the
+// stroke is worked out as spans on each dest row, and each dest pixel is
+// only written once. The result is the same as blitting the stamps one
+// after the other (where they overlap, later stamps win).
+//
+// pts are the top-left positions of each stamp, in order.
+// damage is set to the affected area, as one box per dest tile (see
+// Img::TileIndex()), so long diagonal strokes don't end up with a huge
+// bounding box.
+
+// Like BlitTransparent().
+void StrokeKeyed(Img const& brush, Palette const& brushPalette, PenColour const& transparent,
+    std::vector<Point> const& pts, Img& dest, std::vector<Box>& damage);
+
+// Like BlitMatte().
+void StrokeMatte(Img const& brush, PenColour const& transparent, PenColour const& matte,
+    std::vector<Point> const& pts, Img& dest, std::vector<Box>& damage);
+
+#endif // STROKE_H_INCLUDED
@@ -0,0 +1,227 @@
+// $ g++ -pthread -I .. autosave_test.cpp ../autosave.cpp ../cmd*.cpp ../project.cpp ../file_*.cpp ../frame_changes.cpp ../img*.cpp ../palette*.cpp ../colour_map.cpp ../quantise.cpp ../parallel.cpp ../serialise.cpp ../layer.cpp ../blit*.cpp ../draw.cpp ../box.cpp ../colours.cpp ../ranges.cpp ../sheet.cpp ../lexer.cpp ../util.cpp ../exception.cpp -limpy
+// $ ./a.out || echo "FAILED"
+
+#include "autosave.h"
+#include "cmd.h"
+#include "file_native.h"
+#include "layer.h"
+#include "project.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+// project.cpp wants this (normally in app.cpp)
+class App;
+App* g_App = nullptr;
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s\n", what);
+    }
+}
+
+static const char* DIR = "autosave_test_dir";
+static const char* CRASHED = "autosave_test_crashed";
+
+static bool sameProject(Project const& a, Project const& b)
+{
+    Layer const& la = *a.mRoot->mChildren[0]->ToLayerConst();
+    Layer const& lb = *b.mRoot->mChildren[0]->ToLayerConst();
+    if (la.NumFrames() != lb.NumFrames() ||
+        la.mPalette.NumColours() != lb.mPalette.NumColours()) {
+        return false;
+    }
+    for (int i = 0; i < la.mPalette.NumColours(); ++i) {
+        if (la.mPalette.GetColour(i) != lb.mPalette.GetColour(i)) {
+            return false;
+        }
+    }
+    for (int f = 0; f < la.NumFrames(); ++f) {
+        Img const& ia = la.GetImgConst(f);
+        Img const& ib = lb.GetImgConst(f);
+        if (ia.W() != ib.W() || ia.H() != ib.H()) {
+            return false;
+        }
+        for (int y = 0; y < ia.H(); ++y) {
+            if (memcmp(ia.PtrConst(0, y), ib.PtrConst(0, y), ia.Pitch()) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// What Editor does.
+static void apply(Autosave& autosave, Cmd& cmd)
+{
+    bool recorded = autosave.Record(cmd);
+    if (cmd.State() == Cmd::NOT_DONE) {
+        cmd.Do();
+    } else {
+        cmd.Undo();
+    }
+    if (!recorded) {
+        autosave.Checkpoint();
+    }
+}
+
+// Draw a box the way the tools do (change the image, then make a DONE cmd).
+static Cmd* draw(Project& proj, NodePath const& target, int frame, Box const& b, I8 c)
+{
+    Img& img = proj.GetImg(target, frame);
+    Img backup(img);
+    for (int y = b.y; y < b.y + b.h; ++y) {
+        I8* p = img.Ptr_I8(b.x, y);
+        for (int x = 0; x < b.w; ++x) {
+            *p++ = c;
+        }
+    }
+    return new Cmd_Draw(proj, target, frame, b, backup);
+}
+
+// Take a copy of the autosave files, as if we'd crashed.
+static void crash(Autosave& autosave)
+{
+    autosave.Flush();
+    std::filesystem::remove_all(CRASHED);
+    std::filesystem::copy(DIR, CRASHED);
+}
+
+int main(int argc, char* argv[]) {
+    std::filesystem::remove_all(DIR);
+    std::filesystem::create_directory(DIR);
+
+    Layer* l = new Layer();
+    l->mPalette.SetNumColours(16);
+    l->mFrames.push_back(new Frame(new Img(FMT_I8, 64, 200), 1000));
+    Project proj(l);
+    NodePath target = CalcPath(l);
+    std::vector<Cmd*> cmds;
+
+    Autosave* autosave = new Autosave(proj, DIR);
+    expect(!Autosave::Recoverable(DIR), "nothing written until first change");
+
+    Cmd* c = draw(proj, target, 0, Box(1, 2, 10, 20), 3);
+    autosave->RecordApplied(*c);
+    cmds.push_back(c);
+    c = new Cmd_InsertFrames(proj, target, 1, 2);
+    apply(*autosave, *c);
+    cmds.push_back(c);
+    c = draw(proj, target, 2, Box(5, 150, 30, 30), 7);
+    autosave->RecordApplied(*c);
+    cmds.push_back(c);
+    Colour red(255, 0, 0, 255);
+    c = new Cmd_PaletteModify(proj, target, 0, 3, 1, &red);
+    apply(*autosave, *c);
+    cmds.push_back(c);
+    c = draw(proj, target, 1, Box(0, 0, 64, 200), 9);
+    autosave->RecordApplied(*c);
+    cmds.push_back(c);
+    // undo and redo
+    apply(*autosave, *cmds[4]);
+    apply(*autosave, *cmds[4]);
+    apply(*autosave, *cmds[4]);
+    // A stroke, as the tools deliver it (a DONE batch of draws), then undo
+    // and redo.
+    Cmd_Batch* batch = new Cmd_Batch(proj, Cmd::DONE);
+    batch->Append(draw(proj, target, 0, Box(20, 30, 8, 8), 5));
+    batch->Append(draw(proj, target, 0, Box(24, 34, 8, 8), 6));
+    autosave->RecordApplied(*batch);
+    cmds.push_back(batch);
+    apply(*autosave, *batch);
+    expect(batch->State() == Cmd::NOT_DONE, "batch undone");
+    apply(*autosave, *batch);
+    expect(batch->State() == Cmd::DONE, "batch redone");
+    autosave->RecordApplied(*batch);
+    expect(batch->State() == Cmd::DONE, "batch still done");
+
+    crash(*autosave);
+    expect(Autosave::Recoverable(CRASHED), "recoverable");
+    Project* recovered = Autosave::Recover(CRASHED);
+    expect(sameProject(proj, *recovered), "recovered");
+    expect(recovered->ModifiedFlag(), "recovered project is modified");
+    delete recovered;
+
+    // A partly-written entry at the end is ignored.
+    for (auto const& ent : std::filesystem::directory_iterator(CRASHED)) {
+        if (ent.path().filename().string().rfind("journal-", 0) == 0) {
+            FILE* fp = fopen(ent.path().string().c_str(), "ab");
+            uint8_t junk[] = {200, 0, 0, 0, 1, 2, 3, 4, 5, 6};
+            fwrite(junk, 1, sizeof(junk), fp);
+            fclose(fp);
+        }
+    }
+    recovered = Autosave::Recover(CRASHED);
+    expect(sameProject(proj, *recovered), "torn entry ignored");
+    delete recovered;
+
+    // Long journals are replaced by a new checkpoint.
+    for (int i = 0; i < Autosave::MAX_JOURNAL_ENTRIES + 10; ++i) {
+        c = draw(proj, target, i % 3, Box(i % 50, i % 190, 5, 5), (I8)i);
+        autosave->RecordApplied(*c);
+        cmds.push_back(c);
+    }
+    crash(*autosave);
+    int files = 0;
+    for (auto const& ent : std::filesystem::directory_iterator(CRASHED)) {
+        (void)ent;
+        ++files;
+    }
+    expect(files == 2, "old generations removed");
+    recovered = Autosave::Recover(CRASHED);
+    expect(sameProject(proj, *recovered), "recovered after checkpoint");
+    delete recovered;
+
+    // Entries which don't fit the checkpoint aren't replayed (here, the
+    // draws are to an I8 image, but the checkpoint is RGBX8).
+    {
+        Stack other;
+        Layer* ol = new Layer();
+        ol->mFrames.push_back(new Frame(new Img(FMT_RGBX8, 64, 200), 1000));
+        other.AddChild(ol);
+        for (auto const& ent : std::filesystem::directory_iterator(CRASHED)) {
+            std::string name = ent.path().filename().string();
+            if (name.rfind("checkpoint-", 0) == 0) {
+                NativeFile* native = nullptr;
+                SaveNative(other, ProjSettings(), ent.path().string(), native);
+                delete native;
+            }
+        }
+        recovered = Autosave::Recover(CRASHED);
+        Layer const& rl = *recovered->mRoot->mChildren[0]->ToLayerConst();
+        expect(rl.NumFrames() == 1 && rl.Fmt() == FMT_RGBX8 &&
+            rl.GetImgConst(0).Get_RGBX8(Point(5, 5)) == RGBX8(0, 0, 0),
+            "mismatched entries skipped");
+        delete recovered;
+    }
+
+    // Failures are reported once.
+    {
+        Autosave broken(proj, "autosave_test_no_such_dir/x");
+        c = draw(proj, target, 0, Box(0, 0, 5, 5), 1);
+        broken.RecordApplied(*c);
+        broken.Flush();
+        cmds.push_back(c);
+        expect(broken.Failed(), "failure noted");
+        expect(!broken.TakeError().empty(), "failure reported");
+        expect(broken.TakeError().empty(), "failure only reported once");
+        broken.Checkpoint();
+        broken.Flush();
+        expect(broken.Failed() && broken.TakeError().empty(), "still failing, not nagging");
+    }
+
+    // A clean shutdown leaves nothing behind.
+    delete autosave;
+    expect(!Autosave::Recoverable(DIR), "removed on shutdown");
+
+    for (Cmd* cmd : cmds) {
+        delete cmd;
+    }
+    std::filesystem::remove_all(DIR);
+    std::filesystem::remove_all(CRASHED);
+    return (fails > 0) ? 1 : 0;
+}
@@ -0,0 +1,1126 @@
+#ifndef BLIT_BASELINE_H
+#define BLIT_BASELINE_H
+
+// The keyed, matte and range shift blitters as they were before the
+// templated kernels (blit_kernels.h) replaced them, copied unchanged apart
+// from being put in their own namespace. Only blit_bench uses these, to
+// time the current blitters against the code they replaced.
+
+#include "blit.h"
+#include "box.h"
+#include "img.h"
+#include "palette.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace baseline {
+
+
+// Keyed blits - blit I8 to dest, with a single transparent colour.
+
+static void scan_I8_I8_keyed(I8 const* src, I8* dest, int w, I8 transparent)
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        I8 c = *src++;
+        if( c != transparent)
+            *dest = c;
+        ++dest;
+    }
+}
+
+static void scan_I8_RGBX8_keyed(I8 const* src, Palette const& pal, RGBX8* dest, int w, I8 transparent)
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        I8 c = *src++;
+        if( c != transparent)
+            *dest = pal.GetColour(c);
+        ++dest;
+    }
+}
+
+static void scan_I8_RGBA8_keyed(I8 const* src, Palette const& pal, RGBA8* dest, int w, I8 transparent)
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        I8 c = *src++;
+        if( c != transparent)
+            *dest = pal.GetColour(c);
+        ++dest;
+    }
+}
+
+
+
+
+// blit from an I8 source to any target, with colourkey transparency
+void BlitI8Keyed(
+    Img const& srcimg, Box const& srcbox,
+    Palette const& srcpalette,
+    Img& destimg, Box& destbox,
+    int transparentIdx )
+{
+    assert(srcimg.Fmt()==FMT_I8);
+
+    Box destclipped( destbox );
+    Box srcclipped( srcbox );
+    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped );
+
+    const int w = destclipped.w;
+
+    int y;
+    for( y=0; y<destclipped.h; ++y )
+    {
+        I8 const* src = srcimg.PtrConst_I8( srcclipped.x+0, srcclipped.y+y );
+        switch(destimg.Fmt())
+        {
+        case FMT_I8:
+            scan_I8_I8_keyed(src, destimg.Ptr_I8(destclipped.x+0,destclipped.y+y), w, transparentIdx);
+            break;
+        case FMT_RGBX8:
+            scan_I8_RGBX8_keyed(src, srcpalette, destimg.Ptr_RGBX8(destclipped.x+0,destclipped.y+y), w, transparentIdx);
+            break;
+        case FMT_RGBA8:
+            scan_I8_RGBA8_keyed(src, srcpalette, destimg.Ptr_RGBA8(destclipped.x+0,destclipped.y+y), w, transparentIdx);
+            break;
+        default:
+            assert(false);
+            break;
+        }
+    }
+
+    destbox = destclipped;
+}
+
+
+static void scan_RGBA8_I8_keyed(RGBA8 const* src, I8* dest, int w )
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        RGBA8 c = *src++;
+        if( c.a > 0)
+            *dest = 1;      // TODO:!!!!
+        ++dest;
+    }
+}
+
+static void scan_RGBA8_RGBX8_keyed(RGBA8 const* src, RGBX8* dest, int w ) 
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        RGBA8 c = *src++;
+        if( c.a > 0)
+            *dest = RGBX8(c.r, c.g, c.b);
+        ++dest;
+    }
+}
+
+static void scan_RGBA8_RGBA8_keyed(RGBA8 const* src, RGBA8* dest, int w )
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        RGBA8 c = *src++;
+        if( c.a > 0)
+            *dest = c;
+        ++dest;
+    }
+}
+
+
+
+
+// blit from an RGBX8 source to any target, with colourkey transparency
+void BlitRGBA8Keyed(
+    Img const& srcimg, Box const& srcbox,
+    Img& destimg, Box& destbox )
+{
+    assert(srcimg.Fmt()==FMT_RGBA8);
+
+    Box destclipped( destbox );
+    Box srcclipped( srcbox );
+    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped );
+
+    const int w = destclipped.w;
+
+    int y;
+    for( y=0; y<destclipped.h; ++y )
+    {
+        RGBA8 const* src = srcimg.PtrConst_RGBA8( srcclipped.x+0, srcclipped.y+y );
+        switch(destimg.Fmt())
+        {
+        case FMT_I8:
+            scan_RGBA8_I8_keyed(src, destimg.Ptr_I8(destclipped.x+0,destclipped.y+y), w );
+            break;
+        case FMT_RGBX8:
+            scan_RGBA8_RGBX8_keyed(src, destimg.Ptr_RGBX8(destclipped.x+0,destclipped.y+y), w );
+            break;
+        case FMT_RGBA8:
+            scan_RGBA8_RGBA8_keyed(src, destimg.Ptr_RGBA8(destclipped.x+0,destclipped.y+y), w );
+            break;
+        default:
+            assert(false);
+            break;
+        }
+    }
+
+    destbox = destclipped;
+}
+
+//-------------------------------------------------------------------
+
+static void scan_RGBX8_I8_keyed(RGBX8 const* src, I8* dest, int w, RGBX8 transparent)
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        RGBX8 c = *src++;
+        if( c != transparent)
+            *dest = 1;      // TODO:!!!!
+        ++dest;
+    }
+}
+
+static void scan_RGBX8_RGBX8_keyed(RGBX8 const* src, RGBX8* dest, int w, RGBX8 transparent)
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        RGBX8 c = *src++;
+        if( c != transparent)
+            *dest = c;
+        ++dest;
+    }
+}
+
+static void scan_RGBX8_RGBA8_keyed(RGBX8 const* src, RGBA8* dest, int w, RGBX8 transparent)
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        RGBX8 c = *src++;
+        if( c != transparent)
+            *dest = c;
+        ++dest;
+    }
+}
+
+
+
+
+// blit from an RGBX8 source to any target, with colourkey transparency
+void BlitRGBX8Keyed(
+    Img const& srcimg, Box const& srcbox,
+    Img& destimg, Box& destbox,
+    RGBX8 transparent )
+{
+    assert(srcimg.Fmt()==FMT_RGBX8);
+
+    Box destclipped( destbox );
+    Box srcclipped( srcbox );
+    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped );
+
+    const int w = destclipped.w;
+
+    int y;
+    for( y=0; y<destclipped.h; ++y )
+    {
+        RGBX8 const* src = srcimg.PtrConst_RGBX8( srcclipped.x+0, srcclipped.y+y );
+        switch(destimg.Fmt())
+        {
+        case FMT_I8:
+            scan_RGBX8_I8_keyed(src, destimg.Ptr_I8(destclipped.x+0,destclipped.y+y), w, transparent);
+            break;
+        case FMT_RGBX8:
+            scan_RGBX8_RGBX8_keyed(src, destimg.Ptr_RGBX8(destclipped.x+0,destclipped.y+y), w, transparent);
+            break;
+        case FMT_RGBA8:
+            scan_RGBX8_RGBA8_keyed(src, destimg.Ptr_RGBA8(destclipped.x+0,destclipped.y+y), w, transparent);
+            break;
+        default:
+            assert(false);
+            break;
+        }
+    }
+
+    destbox = destclipped;
+}
+
+// TODO: - temporary?
+void BlitTransparent(
+    Img const& srcimg, Box const& srcbox,
+    Palette const& srcpalette,
+    Img& destimg, Box& destbox,
+    PenColour const& transparentcolour )
+{
+    switch(srcimg.Fmt())
+    {
+        case FMT_I8:
+            assert(transparentcolour.IdxValid());
+            //assert(srcpalette!=0);
+            BlitI8Keyed(srcimg,srcbox,srcpalette, destimg, destbox, transparentcolour.idx());
+            return;
+        case FMT_RGBX8:
+            if (destimg.Fmt() != FMT_I8)
+                BlitRGBX8Keyed(srcimg,srcbox, destimg, destbox, transparentcolour.rgb());
+            return;
+        case FMT_RGBA8:
+            if (destimg.Fmt() != FMT_I8)
+                BlitRGBA8Keyed(srcimg, srcbox, destimg, destbox);
+            return;
+        default:
+            assert(false);
+    }
+}
+
+
+
+static void scan_matte_I8_I8_keyed(I8 const* src, I8* dest, int w, I8 transparent, I8 matte)
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        I8 c = *src++;
+        if( c != transparent)
+            *dest = matte;
+        ++dest;
+    }
+}
+
+static void scan_matte_I8_RGBX8_keyed(I8 const* src, RGBX8* dest, int w, I8 transparent, RGBX8 matte)
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        I8 c = *src++;
+        if( c != transparent)
+            *dest = matte;
+        ++dest;
+    }
+}
+
+static void scan_matte_I8_RGBA8_keyed(I8 const* src, RGBA8* dest, int w, I8 transparent, RGBA8 matte )
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        I8 c = *src++;
+        if( c != transparent)
+            *dest = matte;
+        ++dest;
+    }
+}
+
+
+
+
+// blit from an I8 source to any target, with colourkey transparency
+void BlitMatteI8Keyed(
+    Img const& srcimg, Box const& srcbox,
+    Img& destimg, Box& destbox,
+    int transparentIdx,
+    PenColour const& mattecolour )
+{
+    assert(srcimg.Fmt()==FMT_I8);
+
+    Box destclipped( destbox );
+    Box srcclipped( srcbox );
+    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped );
+
+    const int w = destclipped.w;
+
+    int y;
+    for( y=0; y<destclipped.h; ++y )
+    {
+        I8 const* src = srcimg.PtrConst_I8( srcclipped.x+0, srcclipped.y+y );
+        switch(destimg.Fmt())
+        {
+        case FMT_I8:
+            scan_matte_I8_I8_keyed(src, destimg.Ptr_I8(destclipped.x+0,destclipped.y+y), w, transparentIdx, mattecolour.idx());
+            break;
+        case FMT_RGBX8:
+            scan_matte_I8_RGBX8_keyed(src, destimg.Ptr_RGBX8(destclipped.x+0,destclipped.y+y), w, transparentIdx, mattecolour.rgb());
+            break;
+        case FMT_RGBA8:
+            scan_matte_I8_RGBA8_keyed(src, destimg.Ptr_RGBA8(destclipped.x+0,destclipped.y+y), w, transparentIdx, mattecolour.rgb());
+            break;
+        default:
+            assert(false);
+            break;
+        }
+    }
+
+    destbox = destclipped;
+}
+
+
+//-----------------------------------------------------------
+
+static void scan_matte_RGBX8_I8_keyed(RGBX8 const* src, I8* dest, int w, RGBX8 transparent, I8 matte)
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        RGBX8 in = *src++;
+        if(in!=transparent) {
+            *dest = matte;
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_matte_RGBX8_RGBX8_keyed(RGBX8 const* src, RGBX8* dest, int w, RGBX8 transparent, RGBX8 matte)
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        RGBX8 in = *src++;
+        if(in!=transparent) {
+            *dest = matte;
+        }
+        ++dest;
+    }
+}
+
+static void scan_matte_RGBX8_RGBA8_keyed(RGBX8 const* src, RGBA8* dest, int w, RGBX8 transparent, RGBA8 matte)
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        RGBX8 in = *src++;
+        if(in!=transparent) {
+            *dest = matte;
+        }
+        ++dest;
+    }
+}
+
+
+// blit an RGBX img
+void BlitMatteRGBX8Keyed(
+    Img const& srcimg, Box const& srcbox,
+    Img& destimg, Box& destbox,
+    RGBX8 transparent,
+    PenColour const& matte )
+{
+    assert(srcimg.Fmt()==FMT_RGBX8);
+
+    Box destclipped( destbox );
+    Box srcclipped( srcbox );
+    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped );
+
+    const int w = destclipped.w;
+    int y;
+    for( y=0; y<destclipped.h; ++y )
+    {
+        RGBX8 const* src = srcimg.PtrConst_RGBX8( srcclipped.x+0, srcclipped.y+y );
+        switch(destimg.Fmt())
+        {
+            case FMT_I8:
+                scan_matte_RGBX8_I8_keyed(src, destimg.Ptr_I8(destclipped.x+0,destclipped.y+y), w, transparent, matte.idx());
+                break;
+            case FMT_RGBX8:
+                scan_matte_RGBX8_RGBX8_keyed(src, destimg.Ptr_RGBX8(destclipped.x+0,destclipped.y+y), w, transparent, matte.rgb());
+                break;
+            case FMT_RGBA8:
+                scan_matte_RGBX8_RGBA8_keyed(src, destimg.Ptr_RGBA8(destclipped.x+0,destclipped.y+y), w, transparent, matte.rgb());
+                break;
+            default:
+                assert(false);
+                break;
+        }
+    }
+    destbox = destclipped;
+}
+
+//-----------------------------------------------------------
+
+static void scan_matte_RGBA8_I8_keyed(RGBA8 const* src, I8* dest, int w, I8 matte)
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        RGBA8 in = *src++;
+        if(in.a>0) {
+            *dest = matte;
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_matte_RGBA8_RGBX8_keyed(RGBA8 const* src, RGBX8* dest, int w, RGBX8 matte)
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        RGBA8 in = *src++;
+        if(in.a>0) {
+            *dest = matte;
+        }
+        ++dest;
+    }
+}
+
+static void scan_matte_RGBA8_RGBA8_keyed(RGBA8 const* src, RGBA8* dest, int w, RGBA8 matte)
+{
+    int x;
+    for( x=0; x<w; ++x )
+    {
+        RGBA8 in = *src++;
+        if(in.a>0) {
+            *dest = matte;
+        }
+        ++dest;
+    }
+}
+
+
+// blit an RGBA img
+void BlitMatteRGBA8Keyed(
+    Img const& srcimg, Box const& srcbox,
+    Img& destimg, Box& destbox,
+    PenColour const& matte )
+{
+    assert(srcimg.Fmt()==FMT_RGBA8);
+
+    Box destclipped( destbox );
+    Box srcclipped( srcbox );
+    clip_blit( srcimg.Bounds(), srcclipped, destimg.Bounds(), destclipped );
+
+    const int w = destclipped.w;
+    int y;
+    for( y=0; y<destclipped.h; ++y )
+    {
+        RGBA8 const* src = srcimg.PtrConst_RGBA8( srcclipped.x+0, srcclipped.y+y );
+        switch(destimg.Fmt())
+        {
+            case FMT_I8:
+                scan_matte_RGBA8_I8_keyed(src, destimg.Ptr_I8(destclipped.x+0,destclipped.y+y), w, matte.idx());
+                break;
+            case FMT_RGBX8:
+                scan_matte_RGBA8_RGBX8_keyed(src, destimg.Ptr_RGBX8(destclipped.x+0,destclipped.y+y), w, matte.rgb());
+                break;
+            case FMT_RGBA8:
+                scan_matte_RGBA8_RGBA8_keyed(src, destimg.Ptr_RGBA8(destclipped.x+0,destclipped.y+y), w, matte.rgb());
+                break;
+            default:
+                assert(false);
+                break;
+        }
+    }
+    destbox = destclipped;
+}
+
+
+// blit the src as a matte
+void BlitMatte(
+    Img const& srcimg, Box const& srcbox,
+    Img& destimg, Box& destbox,
+    PenColour const& transparentcolour,
+    PenColour const& mattecolour )
+{
+    switch(srcimg.Fmt())
+    {
+        case FMT_I8:
+            BlitMatteI8Keyed(srcimg,srcbox,destimg,destbox,transparentcolour.idx(), mattecolour);
+            return;
+        case FMT_RGBX8:
+            BlitMatteRGBX8Keyed(srcimg,srcbox,destimg,destbox,transparentcolour.rgb(), mattecolour);
+            return;
+        case FMT_RGBA8: 
+            BlitMatteRGBA8Keyed(srcimg,srcbox,destimg,destbox, mattecolour);
+            return;
+        default:
+            assert(false);
+    }
+}
+
+//----
+// range inc/dec, using a src img as key.
+
+static void scan_rangeinc_keyed_I8_I8(I8 const* src, I8* dest, int w, I8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        I8 c = *src++;
+        if( c != transparent) {
+            I8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.idx() == pix;});
+            if (it < range.end()-1) {
+                *dest = (it+1)->idx();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangedec_keyed_I8_I8(I8 const* src, I8* dest, int w, I8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        I8 c = *src++;
+        if( c != transparent) {
+            I8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.idx() == pix;});
+
+            if (it != range.end() && it > range.begin()) {
+                *dest = (it-1)->idx();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangeinc_keyed_I8_RGBX8(I8 const* src, RGBX8* dest, int w, I8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        I8 c = *src++;
+        if( c != transparent) {
+            RGBX8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.toRGBX8() == pix;});
+            if (it < range.end()-1) {
+                *dest = (it+1)->toRGBX8();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangedec_keyed_I8_RGBX8(I8 const* src, RGBX8* dest, int w, I8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        I8 c = *src++;
+        if( c != transparent) {
+            RGBX8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.toRGBX8() == pix;});
+
+            if (it != range.end() && it > range.begin()) {
+                *dest = (it-1)->toRGBX8();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangeinc_keyed_I8_RGBA8(I8 const* src, RGBA8* dest, int w, I8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        I8 c = *src++;
+        if( c != transparent) {
+            RGBA8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.toRGBA8() == pix;});
+            if (it < range.end()-1) {
+                *dest = (it+1)->toRGBA8();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangedec_keyed_I8_RGBA8(I8 const* src, RGBA8* dest, int w, I8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        I8 c = *src++;
+        if( c != transparent) {
+            RGBA8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.toRGBA8() == pix;});
+
+            if (it != range.end() && it > range.begin()) {
+                *dest = (it-1)->toRGBA8();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void blit_rangeshift_keyed_I8(Img const& srcimg, Box const& srcbox,
+    Img& destimg, Box& destbox,
+    PenColour const& transparentPen,
+    std::vector<PenColour> const& range,
+    int direction)
+{
+    assert(srcimg.Fmt() == FMT_I8);
+    assert(transparentPen.IdxValid());
+    assert(!range.empty());
+
+    Box srcclipped(srcbox);
+    clip_blit(srcimg.Bounds(), srcclipped, destimg.Bounds(), destbox);
+
+    const int w = destbox.w;
+    int y;
+    const int x0 = destbox.x;
+    const int y0 = destbox.y;
+    for (y = 0; y < destbox.h; ++y)
+    {
+        I8 const* src = srcimg.PtrConst_I8(srcclipped.x + 0, srcclipped.y + y);
+        if (direction > 0) {
+            // Increment along range.
+            switch(destimg.Fmt())
+            {
+                case FMT_I8:
+                    scan_rangeinc_keyed_I8_I8(src, destimg.Ptr_I8(x0, y0 + y),
+                        w, transparentPen.idx(), range);
+                    break;
+                case FMT_RGBX8:
+                    scan_rangeinc_keyed_I8_RGBX8(src, destimg.Ptr_RGBX8(x0, y0 + y),
+                        w, transparentPen.idx(), range);
+                    break;
+                case FMT_RGBA8:
+                    scan_rangeinc_keyed_I8_RGBA8(src, destimg.Ptr_RGBA8(x0, y0 + y),
+                        w, transparentPen.idx(), range);
+                    break;
+                default:
+                    assert(false);
+                    break;
+            }
+        } else {
+            // Decrement along range.
+            switch(destimg.Fmt())
+            {
+                case FMT_I8:
+                    scan_rangedec_keyed_I8_I8(src, destimg.Ptr_I8(x0, y0 + y),
+                        w, transparentPen.idx(), range);
+                    break;
+                case FMT_RGBX8:
+                    scan_rangedec_keyed_I8_RGBX8(src, destimg.Ptr_RGBX8(x0, y0 + y),
+                        w, transparentPen.idx(), range);
+                    break;
+                case FMT_RGBA8:
+                    scan_rangedec_keyed_I8_RGBA8(src, destimg.Ptr_RGBA8(x0, y0 + y),
+                        w, transparentPen.idx(), range);
+                    break;
+                default:
+                    assert(false);
+                    break;
+            }
+        }
+    }
+}
+
+
+// RGBX8 -> ...
+
+static void scan_rangeinc_keyed_RGBX8_I8(RGBX8 const* src, I8* dest, int w, RGBX8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        RGBX8 c = *src++;
+        if( c != transparent) {
+            I8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.idx() == pix;});
+            if (it < range.end()-1) {
+                *dest = (it+1)->idx();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangedec_keyed_RGBX8_I8(RGBX8 const* src, I8* dest, int w, RGBX8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        RGBX8 c = *src++;
+        if( c != transparent) {
+            I8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.idx() == pix;});
+
+            if (it != range.end() && it > range.begin()) {
+                *dest = (it-1)->idx();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangeinc_keyed_RGBX8_RGBX8(RGBX8 const* src, RGBX8* dest, int w, RGBX8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        RGBX8 c = *src++;
+        if( c != transparent) {
+            RGBX8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.toRGBX8() == pix;});
+            if (it < range.end()-1) {
+                *dest = (it+1)->toRGBX8();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangedec_keyed_RGBX8_RGBX8(RGBX8 const* src, RGBX8* dest, int w, RGBX8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        RGBX8 c = *src++;
+        if( c != transparent) {
+            RGBX8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.toRGBX8() == pix;});
+
+            if (it != range.end() && it > range.begin()) {
+                *dest = (it-1)->toRGBX8();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangeinc_keyed_RGBX8_RGBA8(RGBX8 const* src, RGBA8* dest, int w, RGBX8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        RGBX8 c = *src++;
+        if( c != transparent) {
+            RGBA8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.toRGBA8() == pix;});
+            if (it < range.end()-1) {
+                *dest = (it+1)->toRGBA8();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangedec_keyed_RGBX8_RGBA8(RGBX8 const* src, RGBA8* dest, int w, RGBX8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        RGBX8 c = *src++;
+        if( c != transparent) {
+            RGBA8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.toRGBA8() == pix;});
+
+            if (it != range.end() && it > range.begin()) {
+                *dest = (it-1)->toRGBA8();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void blit_rangeshift_keyed_RGBX8(Img const& srcimg, Box const& srcbox,
+    Img& destimg, Box& destbox,
+    PenColour const& transparentPen,
+    std::vector<PenColour> const& range,
+    int direction)
+{
+    assert(srcimg.Fmt() == FMT_RGBX8);
+    assert(!range.empty());
+
+    Box srcclipped(srcbox);
+    clip_blit(srcimg.Bounds(), srcclipped, destimg.Bounds(), destbox);
+
+    const int w = destbox.w;
+    int y;
+    const int x0 = destbox.x;
+    const int y0 = destbox.y;
+    for (y = 0; y < destbox.h; ++y)
+    {
+        RGBX8 const* src = srcimg.PtrConst_RGBX8(srcclipped.x + 0, srcclipped.y + y);
+        if (direction > 0) {
+            // Increment along range.
+            switch(destimg.Fmt())
+            {
+                case FMT_I8:
+                    scan_rangeinc_keyed_RGBX8_I8(src, destimg.Ptr_I8(x0, y0 + y),
+                        w, transparentPen.toRGBX8(), range);
+                    break;
+                case FMT_RGBX8:
+                    scan_rangeinc_keyed_RGBX8_RGBX8(src, destimg.Ptr_RGBX8(x0, y0 + y),
+                        w, transparentPen.toRGBX8(), range);
+                    break;
+                case FMT_RGBA8:
+                    scan_rangeinc_keyed_RGBX8_RGBA8(src, destimg.Ptr_RGBA8(x0, y0 + y),
+                        w, transparentPen.toRGBX8(), range);
+                    break;
+                default:
+                    assert(false);
+                    break;
+            }
+        } else {
+            // Decrement along range.
+            switch(destimg.Fmt())
+            {
+                case FMT_I8:
+                    scan_rangedec_keyed_RGBX8_I8(src, destimg.Ptr_I8(x0, y0 + y),
+                        w, transparentPen.toRGBX8(), range);
+                    break;
+                case FMT_RGBX8:
+                    scan_rangedec_keyed_RGBX8_RGBX8(src, destimg.Ptr_RGBX8(x0, y0 + y),
+                        w, transparentPen.toRGBX8(), range);
+                    break;
+                case FMT_RGBA8:
+                    scan_rangedec_keyed_RGBX8_RGBA8(src, destimg.Ptr_RGBA8(x0, y0 + y),
+                        w, transparentPen.toRGBX8(), range);
+                    break;
+                default:
+                    assert(false);
+                    break;
+            }
+        }
+    }
+}
+
+
+// RGBA8 -> ...
+
+static void scan_rangeinc_keyed_RGBA8_I8(RGBA8 const* src, I8* dest, int w, RGBA8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        RGBA8 c = *src++;
+        if( c != transparent) {
+            I8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.idx() == pix;});
+            if (it < range.end()-1) {
+                *dest = (it+1)->idx();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangedec_keyed_RGBA8_I8(RGBA8 const* src, I8* dest, int w, RGBA8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        RGBA8 c = *src++;
+        if( c != transparent) {
+            I8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.idx() == pix;});
+
+            if (it != range.end() && it > range.begin()) {
+                *dest = (it-1)->idx();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangeinc_keyed_RGBA8_RGBX8(RGBA8 const* src, RGBX8* dest, int w, RGBA8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        RGBA8 c = *src++;
+        if( c != transparent) {
+            RGBX8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.toRGBX8() == pix;});
+            if (it < range.end()-1) {
+                *dest = (it+1)->toRGBX8();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangedec_keyed_RGBA8_RGBX8(RGBA8 const* src, RGBX8* dest, int w, RGBA8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        RGBA8 c = *src++;
+        if( c != transparent) {
+            RGBX8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.toRGBX8() == pix;});
+
+            if (it != range.end() && it > range.begin()) {
+                *dest = (it-1)->toRGBX8();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangeinc_keyed_RGBA8_RGBA8(RGBA8 const* src, RGBA8* dest, int w, RGBA8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        RGBA8 c = *src++;
+        if( c != transparent) {
+            RGBA8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.toRGBA8() == pix;});
+            if (it < range.end()-1) {
+                *dest = (it+1)->toRGBA8();
+            }
+        }
+        ++dest;
+    }
+}
+
+
+static void scan_rangedec_keyed_RGBA8_RGBA8(RGBA8 const* src, RGBA8* dest, int w, RGBA8 transparent, std::vector<PenColour> const& range)
+{
+    assert(!range.empty());
+    int x;
+    for( x=0; x<w; ++x ) {
+        RGBA8 c = *src++;
+        if( c != transparent) {
+            RGBA8 pix = *dest;
+            auto it = std::find_if(range.begin(), range.end(),
+                [pix](PenColour const& pen) -> bool { return pen.toRGBA8() == pix;});
+
+            if (it != range.end() && it > range.begin()) {
+                *dest = (it-1)->toRGBA8();
+            }
+        }
+        ++dest;
+    }
+}
+
+static void blit_rangeshift_keyed_RGBA8(Img const& srcimg, Box const& srcbox,
+    Img& destimg, Box& destbox,
+    PenColour const& transparentPen,
+    std::vector<PenColour> const& range,
+    int direction)
+{
+    assert(srcimg.Fmt() == FMT_RGBA8);
+    assert(!range.empty());
+
+    Box srcclipped(srcbox);
+    clip_blit(srcimg.Bounds(), srcclipped, destimg.Bounds(), destbox);
+
+    const int w = destbox.w;
+    int y;
+    const int x0 = destbox.x;
+    const int y0 = destbox.y;
+    for (y = 0; y < destbox.h; ++y)
+    {
+        RGBA8 const* src = srcimg.PtrConst_RGBA8(srcclipped.x + 0, srcclipped.y + y);
+        if (direction > 0) {
+            // Increment along range.
+            switch(destimg.Fmt())
+            {
+                case FMT_I8:
+                    scan_rangeinc_keyed_RGBA8_I8(src, destimg.Ptr_I8(x0, y0 + y),
+                        w, transparentPen.toRGBA8(), range);
+                    break;
+                case FMT_RGBX8:
+                    scan_rangeinc_keyed_RGBA8_RGBX8(src, destimg.Ptr_RGBX8(x0, y0 + y),
+                        w, transparentPen.toRGBA8(), range);
+                    break;
+                case FMT_RGBA8:
+                    scan_rangeinc_keyed_RGBA8_RGBA8(src, destimg.Ptr_RGBA8(x0, y0 + y),
+                        w, transparentPen.toRGBA8(), range);
+                    break;
+                default:
+                    assert(false);
+                    break;
+            }
+        } else {
+            // Decrement along range.
+            switch(destimg.Fmt())
+            {
+                case FMT_I8:
+                    scan_rangedec_keyed_RGBA8_I8(src, destimg.Ptr_I8(x0, y0 + y),
+                        w, transparentPen.toRGBA8(), range);
+                    break;
+                case FMT_RGBX8:
+                    scan_rangedec_keyed_RGBA8_RGBX8(src, destimg.Ptr_RGBX8(x0, y0 + y),
+                        w, transparentPen.toRGBA8(), range);
+                    break;
+                case FMT_RGBA8:
+                    scan_rangedec_keyed_RGBA8_RGBA8(src, destimg.Ptr_RGBA8(x0, y0 + y),
+                        w, transparentPen.toRGBA8(), range);
+                    break;
+                default:
+                    assert(false);
+                    break;
+            }
+        }
+    }
+}
+
+
+// Uses the srcimg as a mask, incrementing or decrementing pixels on destimg
+// up or down the the range.
+void BlitRangeShiftKeyed(Img const& srcimg, Box const& srcbox,
+    Img& destimg, Box& destbox,
+    PenColour const& transparentPen,
+    std::vector<PenColour> const& range,
+    int direction)
+{
+    if (range.empty()) {
+        destbox.w = 0;
+        destbox.h = 0;
+        return;
+    }
+    switch(srcimg.Fmt()) {
+        case FMT_I8:
+            blit_rangeshift_keyed_I8(srcimg, srcbox, destimg, destbox, transparentPen, range, direction);
+            break;
+        case FMT_RGBX8:
+            blit_rangeshift_keyed_RGBX8(srcimg, srcbox, destimg, destbox, transparentPen, range, direction);
+            break;
+        case FMT_RGBA8:
+            blit_rangeshift_keyed_RGBA8(srcimg, srcbox, destimg, destbox, transparentPen, range, direction);
+            break;
+    }
+}
+
+
+} // namespace baseline
+
+#endif // BLIT_BASELINE_H
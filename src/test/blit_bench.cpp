@@ -0,0 +1,220 @@
+// $ g++ -O2 -I .. blit_bench.cpp ../blit.cpp ../blit_keyed.cpp ../blit_matte.cpp ../blit_range.cpp ../blit_simd.cpp ../img.cpp ../box.cpp ../palette.cpp ../colours.cpp ../util.cpp ../exception.cpp
+// $ ./a.out || echo "FAILED"
+
+// Times the blitters for every op and format pair against the hand-written
+// scan functions they replaced (see blit_baseline.h). Fails if the results
+// differ, or if a blitter is slower than the old code.
+// Alpha blending had no old implementation, so it's only checked against a
+// simple per-pixel loop, not timed against it.
+
+#include "blit_baseline.h"
+#include "blit.h"
+#include "blit_keyed.h"
+#include "blit_matte.h"
+#include "blit_range.h"
+#include "box.h"
+#include "img.h"
+#include "palette.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+static int fails = 0;
+static const char* fmtNames[] = {"I8", "RGBX8", "RGBA8"};
+
+static void expect(bool cond, const char* op, const char* what, PixelFormat srcFmt, PixelFormat destFmt) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s %s->%s (%s)\n", op, fmtNames[srcFmt], fmtNames[destFmt], what);
+    }
+}
+
+static const int W = 512;
+static const int H = 512;
+static const int REPS = 50;
+
+static Palette pal(256);
+static PenColour transparent;
+static PenColour matte;
+static std::vector<PenColour> range;
+
+
+template<typename P> P* Row(Img& img, int y) { return (P*)img.Ptr(0, y); }
+template<typename P> P const* RowConst(Img const& img, int y) { return (P const*)img.PtrConst(0, y); }
+
+// Reference for the alpha blend, one pixel at a time.
+template<typename DEST>
+static void RefBlend(Img const& src, Img& dest)
+{
+    for (int y = 0; y < H; ++y) {
+        RGBA8 const* s = RowConst<RGBA8>(src, y);
+        DEST* d = Row<DEST>(dest, y);
+        for (int x = 0; x < W; ++x) {
+            d[x] = Blend(s[x], d[x]);
+        }
+    }
+}
+
+
+// Fill an image with a mix of range colours and other stuff, with runs of
+// transparency.
+static void Scribble(Img& img)
+{
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            bool clear = ((x / 13 + y / 7) % 3) == 0;
+            PenColour pen = clear ? transparent :
+                (rand() % 2) ? range[rand() % range.size()] : PenColour(pal.GetColour(rand() % 256), rand() % 256);
+            switch (img.Fmt()) {
+                case FMT_I8: *img.Ptr_I8(x, y) = pen.idx(); break;
+                case FMT_RGBX8: *img.Ptr_RGBX8(x, y) = pen.toRGBX8(); break;
+                case FMT_RGBA8:
+                    {
+                        RGBA8 c = pen.toRGBA8();
+                        c.a = clear ? 0 : (x % 5 == 0) ? 255 : (uint8_t)rand();
+                        *img.Ptr_RGBA8(x, y) = c;
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+static bool Same(Img const& a, Img const& b)
+{
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            Point pt(x, y);
+            bool same = true;
+            switch (a.Fmt()) {
+                case FMT_I8: same = a.Get_I8(pt) == b.Get_I8(pt); break;
+                case FMT_RGBX8: same = a.Get_RGBX8(pt) == b.Get_RGBX8(pt); break;
+                case FMT_RGBA8: same = a.Get_RGBA8(pt) == b.Get_RGBA8(pt); break;
+            }
+            if (!same) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Time the old code and the blitter alternately, so they see the same
+// conditions. Returns the best time for each, and the results of the first
+// runs.
+static void Time(std::function<void(Img&)> const& old, std::function<void(Img&)> const& blitter,
+    Img const& orig, double& oldMS, double& newMS, Img*& oldOut, Img*& newOut)
+{
+    oldMS = 1e9;
+    newMS = 1e9;
+    for (int i = 0; i < REPS; ++i) {
+        for (int which = 0; which < 2; ++which) {
+            Img dest(orig);
+            auto start = std::chrono::steady_clock::now();
+            (which == 0 ? old : blitter)(dest);
+            std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - start;
+            double& best = (which == 0) ? oldMS : newMS;
+            best = std::min(best, elapsed.count());
+            if (i == 0) {
+                (which == 0 ? oldOut : newOut) = new Img(dest);
+            }
+        }
+    }
+}
+
+// Compare a blitter with the old code it replaced.
+static void Bench(const char* op, Img const& src, Img const& orig,
+    std::function<void(Img&)> const& old, std::function<void(Img&)> const& blitter)
+{
+    Img* oldOut = nullptr;
+    Img* newOut = nullptr;
+    double oldMS, newMS;
+    Time(old, blitter, orig, oldMS, newMS, oldOut, newOut);
+    bool slower = newMS > oldMS * 1.05;
+    printf("%-10s %5s -> %-5s  old %7.3fms  new %7.3fms  %5.1fx%s\n", op,
+        fmtNames[src.Fmt()], fmtNames[orig.Fmt()], oldMS, newMS, oldMS / newMS,
+        slower ? "  SLOWER" : "");
+    expect(Same(*oldOut, *newOut), op, "result", src.Fmt(), orig.Fmt());
+    expect(!slower, op, "speed", src.Fmt(), orig.Fmt());
+    delete oldOut;
+    delete newOut;
+}
+
+// Check a blitter with no old code against a reference loop (results only).
+static void Check(const char* op, Img const& src, Img const& orig,
+    std::function<void(Img&)> const& ref, std::function<void(Img&)> const& blitter)
+{
+    Img refOut(orig);
+    Img newOut(orig);
+    ref(refOut);
+    blitter(newOut);
+    printf("%-10s %5s -> %-5s  (no old code to compare with)\n", op,
+        fmtNames[src.Fmt()], fmtNames[orig.Fmt()]);
+    expect(Same(refOut, newOut), op, "result", src.Fmt(), orig.Fmt());
+}
+
+template<typename SRC, typename DEST>
+static void BenchPair(Img const& src, Img const& orig)
+{
+    Box all(0, 0, W, H);
+    // (BlitTransparent doesn't draw RGB onto I8)
+    if constexpr (std::is_same<SRC, I8>::value || !std::is_same<DEST, I8>::value) {
+        Bench("keyed", src, orig,
+            [&](Img& d) { Box b(all); baseline::BlitTransparent(src, all, pal, d, b, transparent); },
+            [&](Img& d) { Box b(all); BlitTransparent(src, all, pal, d, b, transparent); });
+    }
+    Bench("matte", src, orig,
+        [&](Img& d) { Box b(all); baseline::BlitMatte(src, all, d, b, transparent, matte); },
+        [&](Img& d) { Box b(all); BlitMatte(src, all, d, b, transparent, matte); });
+    Bench("range-inc", src, orig,
+        [&](Img& d) { Box b(all); baseline::BlitRangeShiftKeyed(src, all, d, b, transparent, range, 1); },
+        [&](Img& d) { Box b(all); BlitRangeShiftKeyed(src, all, d, b, transparent, range, 1); });
+    Bench("range-dec", src, orig,
+        [&](Img& d) { Box b(all); baseline::BlitRangeShiftKeyed(src, all, d, b, transparent, range, -1); },
+        [&](Img& d) { Box b(all); BlitRangeShiftKeyed(src, all, d, b, transparent, range, -1); });
+    if constexpr (std::is_same<SRC, RGBA8>::value && !std::is_same<DEST, I8>::value) {
+        Check("blend", src, orig,
+            [&](Img& d) { RefBlend<DEST>(src, d); },
+            [&](Img& d) { Box b(all); BlitRGBA8(src, all, d, b); });
+    }
+}
+
+template<typename SRC>
+static void BenchFrom(PixelFormat srcFmt)
+{
+    Img src(srcFmt, W, H);
+    Scribble(src);
+    Img i8(FMT_I8, W, H);
+    Img rgbx8(FMT_RGBX8, W, H);
+    Img rgba8(FMT_RGBA8, W, H);
+    Scribble(i8);
+    Scribble(rgbx8);
+    Scribble(rgba8);
+    BenchPair<SRC, I8>(src, i8);
+    BenchPair<SRC, RGBX8>(src, rgbx8);
+    BenchPair<SRC, RGBA8>(src, rgba8);
+}
+
+int main(int argc, char* argv[]) {
+    srand(1234);
+    for (int i = 0; i < 256; ++i) {
+        pal.SetColour(i, Colour(rand() % 256, rand() % 256, rand() % 256));
+    }
+    transparent = PenColour(pal.GetColour(0), 0);
+    matte = PenColour(pal.GetColour(42), 42);
+    for (int i = 16; i < 32; ++i) {
+        range.push_back(PenColour(pal.GetColour(i), i));
+    }
+
+    BenchFrom<I8>(FMT_I8);
+    BenchFrom<RGBX8>(FMT_RGBX8);
+    BenchFrom<RGBA8>(FMT_RGBA8);
+
+    return (fails > 0) ? 1 : 0;
+}
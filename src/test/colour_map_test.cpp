@@ -0,0 +1,60 @@
+// $ g++ -I .. colour_map_test.cpp ../colour_map.cpp
+// $ ./a.out || echo "FAILED"
+
+#include "colour_map.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s\n", what);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    ColourMap m;
+    std::map<uint32_t, int> ref;
+    expect(m.Size() == 0, "empty");
+    expect(m.Find(0) == nullptr, "find in empty");
+
+    // plenty of keys, to make it grow a few times (and include 0 and ~0)
+    for (int i = 0; i < 100000; ++i) {
+        uint32_t key = (i == 0) ? 0 : (i == 1) ? 0xffffffff : (uint32_t)rand() * 2654435761u;
+        if (i % 3 == 0) {
+            key &= 0x000000ff;    // lots of repeats
+        }
+        m.Get(key, 7) += 1;
+        if (ref.find(key) == ref.end()) {
+            ref[key] = 7;
+        }
+        ref[key] += 1;
+    }
+    expect(m.Size() == ref.size(), "size");
+
+    bool ok = true;
+    for (auto const& it : ref) {
+        int const* v = m.Find(it.first);
+        if (!v || *v != it.second) {
+            ok = false;
+        }
+    }
+    expect(ok, "values");
+
+    size_t n = 0;
+    m.ForEach([&](uint32_t key, int& value) {
+        ++n;
+        if (ref[key] != value) {
+            ok = false;
+        }
+    });
+    expect(ok && n == ref.size(), "ForEach");
+
+    m.Clear();
+    expect(m.Size() == 0 && m.Find(0) == nullptr, "Clear");
+    return (fails > 0) ? 1 : 0;
+}
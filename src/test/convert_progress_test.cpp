@@ -0,0 +1,77 @@
+// $ g++ -pthread -I .. convert_progress_test.cpp ../img_convert.cpp ../palette_matcher.cpp ../colour_map.cpp ../parallel.cpp ../layer.cpp ../ranges.cpp ../img.cpp ../box.cpp ../palette.cpp ../colours.cpp ../util.cpp ../exception.cpp ../blit.cpp ../blit_keyed.cpp ../blit_matte.cpp ../blit_range.cpp ../blit_simd.cpp
+// $ ./a.out || echo "FAILED"
+
+#include "img_convert.h"
+#include "img.h"
+#include "layer.h"
+#include "palette.h"
+
+#include <cstdio>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s\n", what);
+    }
+}
+
+// A layer with one big RGBX8 frame, full of different colours.
+static Layer* bigLayer()
+{
+    const int w = 1024;
+    const int h = 1024;
+    Layer* l = new Layer();
+    Img* img = new Img(FMT_RGBX8, w, h);
+    for (int y = 0; y < h; ++y) {
+        RGBX8* p = img->Ptr_RGBX8(0, y);
+        for (int x = 0; x < w; ++x) {
+            *p++ = RGBX8((uint8_t)x, (uint8_t)y, (uint8_t)(x ^ y));
+        }
+    }
+    l->mFrames.push_back(new Frame(img, 1000));
+    return l;
+}
+
+static void check(DitherMode dither, const char* name)
+{
+    Layer* src = bigLayer();
+
+    // Progress is reported during a single frame, not just at the end.
+    {
+        Layer dest;
+        dest.mPalette = Palette(256);
+        int calls = 0;
+        int last = 0;
+        bool ok = ConvertLayerFrames(*src, dest, FMT_I8, [&](int done, int total) {
+            ++calls;
+            expect(done >= last && done <= total, name);
+            last = done;
+            return true;
+        }, dither);
+        expect(ok && dest.mFrames.size() == 1, name);
+        expect(calls > 2, name);
+    }
+
+    // Cancelling in the middle of a single frame stops it.
+    {
+        Layer dest;
+        dest.mPalette = Palette(256);
+        int calls = 0;
+        bool ok = ConvertLayerFrames(*src, dest, FMT_I8, [&](int done, int total) {
+            ++calls;
+            return false;
+        }, dither);
+        expect(!ok && dest.mFrames.empty(), name);
+        expect(calls == 1, name);
+    }
+    delete src;
+}
+
+int main(int argc, char* argv[]) {
+    check(DITHER_NONE, "closest colour");
+    check(DITHER_FLOYD_STEINBERG, "floyd-steinberg");
+    check(DITHER_ORDERED, "ordered");
+    return (fails > 0) ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+// $ g++ -I .. damage_test.cpp ../damage.cpp ../box.cpp
+// $ ./a.out || echo "FAILED"
+
+#include "damage.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s\n", what);
+    }
+}
+
+// every added box must be covered by the region
+static bool covers(DamageRegion const& region, std::vector<Box> const& added)
+{
+    for (auto const& b : added) {
+        for (int y = b.YMin(); y <= b.YMax(); ++y) {
+            for (int x = b.XMin(); x <= b.XMax(); ++x) {
+                bool hit = false;
+                for (auto const& r : region.Rects()) {
+                    if (r.Contains(Point(x, y))) {
+                        hit = true;
+                        break;
+                    }
+                }
+                if (!hit) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    {
+        DamageRegion r;
+        expect(r.Empty(), "starts empty");
+        r.Add(Box(0, 0, 0, 0));
+        expect(r.Empty(), "empty boxes ignored");
+        r.Add(Box(10, 10, 20, 20));
+        r.Add(Box(12, 12, 4, 4));
+        r.Add(Box(10, 10, 20, 20));
+        expect(r.Rects().size() == 1, "contained boxes merged");
+        expect(r.Bounds() == Box(10, 10, 20, 20), "bounds unchanged");
+        r.Clear();
+        expect(r.Empty(), "clear");
+    }
+
+    {
+        // a stroke of small overlapping boxes (eg a pencil line)
+        DamageRegion r;
+        std::vector<Box> added;
+        for (int i = 0; i < 200; ++i) {
+            Box b(i * 2, 100 + i / 4, 4, 4);
+            r.Add(b);
+            added.push_back(b);
+        }
+        expect(r.Rects().size() <= 4, "stroke coalesced");
+        expect(covers(r, added), "stroke covered");
+    }
+
+    {
+        // scattered boxes are kept separate, up to a limit
+        DamageRegion r;
+        r.Add(Box(0, 0, 4, 4));
+        r.Add(Box(500, 500, 4, 4));
+        expect(r.Rects().size() == 2, "distant boxes kept separate");
+        expect(r.Area() == 32, "area");
+
+        std::vector<Box> added;
+        srand(42);
+        for (int i = 0; i < 1000; ++i) {
+            Box b(rand() % 1000, rand() % 1000, 1 + rand() % 8, 1 + rand() % 8);
+            r.Add(b);
+            added.push_back(b);
+            if ((int)r.Rects().size() > DamageRegion::MaxRects) {
+                expect(false, "too many rects");
+                break;
+            }
+        }
+        expect(covers(r, added), "scattered boxes covered");
+    }
+
+    return (fails > 0) ? 1 : 0;
+}
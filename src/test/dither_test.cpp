@@ -0,0 +1,99 @@
+// $ g++ -I .. dither_test.cpp ../img_convert.cpp ../palette_matcher.cpp ../colour_map.cpp ../parallel.cpp ../img.cpp ../box.cpp ../palette.cpp ../colours.cpp ../util.cpp ../exception.cpp ../blit.cpp ../blit_keyed.cpp ../blit_matte.cpp ../blit_range.cpp ../blit_simd.cpp
+// $ ./a.out || echo "FAILED"
+
+#include "img_convert.h"
+#include "img.h"
+#include "palette.h"
+#include "palette_matcher.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s\n", what);
+    }
+}
+
+// Dither a horizontal grey ramp down to black and white. The proportion of
+// white in each group of columns should follow the ramp, and every group
+// of rows (including those at band boundaries) should average out to
+// mid-grey. (Groups of 8, as single rows and columns of an ordered dither
+// aren't balanced).
+static void checkRamp(DitherMode dither, const char* name)
+{
+    const int w = 256;
+    const int h = 296;
+    Img src(FMT_RGBX8, w, h);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            *src.Ptr_RGBX8(x, y) = RGBX8(x, x, x);
+        }
+    }
+    Palette pal(2);
+    pal.SetColour(0, Colour(0, 0, 0));
+    pal.SetColour(1, Colour(255, 255, 255));
+    PaletteMatcher matcher(pal);
+    Img* out = DitherToI8(src, pal, matcher, dither);
+
+    double worstCol = 0.0;
+    for (int x0 = 0; x0 < w; x0 += 8) {
+        int whites = 0;
+        for (int y = 0; y < h; ++y) {
+            for (int x = x0; x < x0 + 8; ++x) {
+                whites += *out->PtrConst_I8(x, y);
+            }
+        }
+        worstCol = std::max(worstCol, std::fabs((double)whites / (h * 8) - (x0 + 3.5) / 255.0));
+    }
+    double worstRow = 0.0;
+    for (int y0 = 0; y0 < h; y0 += 8) {
+        int whites = 0;
+        for (int y = y0; y < y0 + 8; ++y) {
+            for (int x = 0; x < w; ++x) {
+                whites += *out->PtrConst_I8(x, y);
+            }
+        }
+        worstRow = std::max(worstRow, std::fabs((double)whites / (w * 8) - 0.5));
+    }
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%s columns", name);
+    expect(worstCol < 0.05, buf);
+    snprintf(buf, sizeof(buf), "%s rows", name);
+    expect(worstRow < 0.02, buf);
+    delete out;
+}
+
+int main(int argc, char* argv[]) {
+    checkRamp(DITHER_FLOYD_STEINBERG, "floyd-steinberg");
+    checkRamp(DITHER_ORDERED, "ordered");
+
+    // exact palette colours come through untouched
+    {
+        Palette pal(4);
+        for (int i = 0; i < 4; ++i) {
+            pal.SetColour(i, Colour(i * 80, 255 - i * 80, 40));
+        }
+        Img src(FMT_I8, 50, 50);
+        for (int y = 0; y < 50; ++y) {
+            for (int x = 0; x < 50; ++x) {
+                *src.Ptr_I8(x, y) = (x / 7 + y / 5) % 4;
+            }
+        }
+        PaletteMatcher matcher(pal);
+        Img* out = DitherToI8(src, pal, matcher, DITHER_FLOYD_STEINBERG);
+        bool same = true;
+        for (int y = 0; y < 50; ++y) {
+            for (int x = 0; x < 50; ++x) {
+                same = same && *out->PtrConst_I8(x, y) == *src.PtrConst_I8(x, y);
+            }
+        }
+        expect(same, "exact colours");
+        delete out;
+    }
+    return (fails > 0) ? 1 : 0;
+}
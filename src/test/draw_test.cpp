@@ -0,0 +1,189 @@
+// $ g++ -I .. draw_test.cpp ../draw.cpp ../img.cpp ../box.cpp ../palette.cpp ../colours.cpp ../util.cpp ../exception.cpp ../blit.cpp ../blit_keyed.cpp ../blit_matte.cpp ../blit_range.cpp ../blit_simd.cpp
+// $ ./a.out || echo "FAILED"
+
+#include "draw.h"
+#include "blit_kernels.h"
+#include "box.h"
+#include "img.h"
+#include "palette.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what, PixelFormat fmt, int seed) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s (fmt %d, seed %d)\n", what, (int)fmt, seed);
+    }
+}
+
+// A palette of colours close to each other, so tolerance matters.
+static Palette pal(8);
+
+template<typename P>
+static P const& pixelAt(Img const& img, int x, int y)
+    { return *(P const*)img.PtrConst(x, y); }
+
+// Does pixel c count as the same as old?
+static bool refMatch(I8 c, I8 old, int tolerance) {
+    Colour a = pal.GetColour(c);
+    Colour b = pal.GetColour(old);
+    return c == old || (tolerance > 0 &&
+        std::abs(a.r - b.r) <= tolerance && std::abs(a.g - b.g) <= tolerance &&
+        std::abs(a.b - b.b) <= tolerance && std::abs(a.a - b.a) <= tolerance);
+}
+static bool refMatch(RGBX8 c, RGBX8 old, int tolerance) {
+    return std::abs(c.r - old.r) <= tolerance && std::abs(c.g - old.g) <= tolerance &&
+        std::abs(c.b - old.b) <= tolerance;
+}
+static bool refMatch(RGBA8 c, RGBA8 old, int tolerance) {
+    return std::abs(c.r - old.r) <= tolerance && std::abs(c.g - old.g) <= tolerance &&
+        std::abs(c.b - old.b) <= tolerance && std::abs(c.a - old.a) <= tolerance;
+}
+
+// Straightforward pixel-at-a-time 4-way fill, to check against.
+template<typename P>
+static void refFill(Img& img, Point const& start, P newcolour, int tolerance, Box& damage)
+{
+    damage.SetEmpty();
+    P old = pixelAt<P>(img, start.x, start.y);
+    if (tolerance == 0 && refMatch(newcolour, old, 0)) {
+        return;
+    }
+    Img orig(img);
+    std::vector<bool> done(img.W() * img.H(), false);
+    std::vector<Point> q(1, start);
+    while (!q.empty()) {
+        Point pt = q.back();
+        q.pop_back();
+        if (!img.Bounds().Contains(pt) || done[pt.y * img.W() + pt.x] ||
+            !refMatch(pixelAt<P>(orig, pt.x, pt.y), old, tolerance)) {
+            continue;
+        }
+        done[pt.y * img.W() + pt.x] = true;
+        *(P*)img.Ptr(pt.x, pt.y) = newcolour;
+        damage.Merge(Box(pt.x, pt.y, 1, 1));
+        q.push_back(Point(pt.x - 1, pt.y));
+        q.push_back(Point(pt.x + 1, pt.y));
+        q.push_back(Point(pt.x, pt.y - 1));
+        q.push_back(Point(pt.x, pt.y + 1));
+    }
+}
+
+template<typename P>
+static void refReplace(Img& img, P old, P newcolour, int tolerance, Box& damage)
+{
+    damage.SetEmpty();
+    if (tolerance == 0 && refMatch(newcolour, old, 0)) {
+        return;
+    }
+    for (int y = 0; y < img.H(); ++y) {
+        for (int x = 0; x < img.W(); ++x) {
+            if (refMatch(pixelAt<P>(img, x, y), old, tolerance)) {
+                *(P*)img.Ptr(x, y) = newcolour;
+                damage.Merge(Box(x, y, 1, 1));
+            }
+        }
+    }
+}
+
+template<typename P>
+static bool same(Img const& a, Img const& b)
+{
+    for (int y = 0; y < a.H(); ++y) {
+        for (int x = 0; x < a.W(); ++x) {
+            if (!(pixelAt<P>(a, x, y) == pixelAt<P>(b, x, y))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Pixels to draw the test patterns with. RGBX8 gets junk in the pad byte,
+// which should be ignored.
+static void setPixel(Img& img, int x, int y, int idx)
+{
+    switch (img.Fmt()) {
+        case FMT_I8: *img.Ptr_I8(x, y) = idx; break;
+        case FMT_RGBX8:
+            {
+                RGBX8 c = pal.GetColour(idx);
+                c.pad = rand();
+                *img.Ptr_RGBX8(x, y) = c;
+            }
+            break;
+        case FMT_RGBA8: *img.Ptr_RGBA8(x, y) = pal.GetColour(idx); break;
+    }
+}
+
+// Random blobs and mazes, with the start point all over the place.
+template<typename P>
+static void checkRandom(PixelFormat fmt)
+{
+    const int tolerances[8] = {0, 5, 6, 11, 12, 19, 20, 40};
+    for (int seed = 0; seed < 400; ++seed) {
+        srand(seed);
+        int w = 1 + rand() % 70;
+        int h = 1 + rand() % 70;
+        int density = 1 + rand() % 6;
+        int tolerance = tolerances[rand() % 8];
+        int a = rand() % 8;
+        int b = rand() % 8;
+        Img img(fmt, w, h);
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                setPixel(img, x, y, (rand() % 10 < density) ? a : b);
+            }
+        }
+        Point start(rand() % w, rand() % h);
+        int n = rand() % 8;
+        PenColour pen(pal.GetColour(n), n);
+
+        Img ref(img);
+        Box refDamage;
+        Box damage;
+        refFill<P>(ref, start, PenPixel<P>(pen), tolerance, refDamage);
+        Img filled(img);
+        FloodFill(filled, start, pen, damage, tolerance, &pal);
+        expect(same<P>(filled, ref), "fill pixels", fmt, seed);
+        expect(damage == refDamage, "fill damage", fmt, seed);
+
+        Img refReplaced(img);
+        PenColour old(pal.GetColour(a), a);
+        refReplace<P>(refReplaced, PenPixel<P>(old), PenPixel<P>(pen), tolerance, refDamage);
+        Img replaced(img);
+        ReplaceColour(replaced, old, pen, damage, tolerance, &pal);
+        expect(same<P>(replaced, refReplaced), "replace pixels", fmt, seed);
+        expect(damage == refDamage, "replace damage", fmt, seed);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 0; i < 8; ++i) {
+        pal.SetColour(i, Colour(100 + i * 6, 50 + i * 3, 20 + (i & 1) * 20));
+    }
+    checkRandom<I8>(FMT_I8);
+    checkRandom<RGBX8>(FMT_RGBX8);
+    checkRandom<RGBA8>(FMT_RGBA8);
+
+    // whole canvas, in each format
+    {
+        const PixelFormat fmts[3] = {FMT_I8, FMT_RGBX8, FMT_RGBA8};
+        for (PixelFormat fmt : fmts) {
+            Img img(fmt, 300, 200);
+            Box damage;
+            FloodFill(img, Point(150, 100), PenColour(Colour(10, 20, 30), 5), damage);
+            expect(damage == img.Bounds(), "whole canvas", fmt, 0);
+            Point pt(299, 199);
+            bool ok = (fmt == FMT_I8) ? img.Get_I8(pt) == 5 :
+                (fmt == FMT_RGBX8) ? img.Get_RGBX8(pt) == RGBX8(10, 20, 30) :
+                img.Get_RGBA8(pt) == RGBA8(10, 20, 30, 255);
+            expect(ok, "whole canvas pixels", fmt, 0);
+        }
+    }
+    return (fails > 0) ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+// $ g++ -pthread -I .. file_load_test.cpp ../file_load.cpp ../file_save.cpp ../file_native.cpp ../file_type.cpp ../serialise.cpp ../parallel.cpp ../layer.cpp ../img.cpp ../blit*.cpp ../box.cpp ../palette.cpp ../colours.cpp ../ranges.cpp ../sheet.cpp ../lexer.cpp ../util.cpp ../exception.cpp -limpy
+// $ ./a.out || echo "FAILED"
+
+#include "file_load.h"
+#include "file_save.h"
+#include "exception.h"
+#include "layer.h"
+#include "project.h"
+
+#include <cstdio>
+#include <filesystem>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s\n", what);
+    }
+}
+
+static const char* DIR = "file_load_test_seq";
+static const int NUM_FRAMES = 40;
+
+static std::string frameFile(int frame)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%s/frame%04d.png", DIR, frame);
+    return name;
+}
+
+// Write out a sequence of single-frame files, each filled with its frame
+// number. The palette changes halfway through.
+static void writeSequence()
+{
+    std::filesystem::remove_all(DIR);
+    std::filesystem::create_directory(DIR);
+    ProjSettings settings;
+    for (int i = 0; i < NUM_FRAMES; ++i) {
+        Layer l;
+        l.mPalette.SetNumColours(64);
+        if (i >= NUM_FRAMES / 2) {
+            l.mPalette.SetColour(1, Colour(255, 0, 0));
+        }
+        Img* img = new Img(FMT_I8, 64, 300);
+        for (int y = 0; y < img->H(); ++y) {
+            I8* p = img->Ptr_I8(0, y);
+            for (int x = 0; x < img->W(); ++x) {
+                *p++ = (I8)i;
+            }
+        }
+        l.mFrames.push_back(new Frame(img, 1000));
+        SaveLayer(l, frameFile(i), settings);
+    }
+    // Not an image - should be skipped.
+    FILE* fp = fopen((std::string(DIR) + "/notes.txt").c_str(), "w");
+    fputs("hello", fp);
+    fclose(fp);
+}
+
+int main(int argc, char* argv[]) {
+    writeSequence();
+
+    // All the frames come in, in order.
+    {
+        ProjSettings settings;
+        Layer* l = LoadLayer(DIR, settings);
+        expect(l->NumFrames() == NUM_FRAMES, "all frames loaded");
+        bool inOrder = true;
+        for (int i = 0; i < l->NumFrames(); ++i) {
+            inOrder = inOrder && l->GetImgConst(i).Get_I8(Point(10, 299)) == i;
+        }
+        expect(inOrder, "frames in order");
+        expect(l->mPalette.GetColour(1) == Colour(255, 0, 0), "palette change picked up");
+        delete l;
+    }
+
+    // Same thing in the background.
+    {
+        ProjSettings settings;
+        LayerLoader loader(DIR, settings);
+        Layer* l = loader.TakeLayer();
+        expect(l->NumFrames() == 1, "first frame up front");
+        bool paletteChanged;
+        loader.Collect(*l, paletteChanged, true);
+        expect(loader.Done() && loader.Error().empty(), "background load done");
+        expect(l->NumFrames() == NUM_FRAMES, "background load got all frames");
+        delete l;
+    }
+
+    // Frames which don't match the first are rejected like bad files.
+    {
+        ProjSettings settings;
+        Img* imgs[] = {new Img(FMT_I8, 64, 200), new Img(FMT_RGBX8, 64, 300)};
+        for (Img* img : imgs) {
+            Layer odd;
+            odd.mPalette.SetNumColours(64);
+            odd.mFrames.push_back(new Frame(img, 1000));
+            SaveLayer(odd, frameFile(5), settings);
+            LayerLoader loader(DIR, settings);
+            Layer* l = loader.TakeLayer();
+            bool paletteChanged;
+            loader.Collect(*l, paletteChanged, true);
+            expect(!loader.Error().empty(), "mismatched frame reported");
+            expect(l->NumFrames() == 5, "frames before mismatch kept");
+            delete l;
+        }
+        writeSequence();
+    }
+
+    // A bad file stops the loading, but the frames before it are kept.
+    {
+        FILE* fp = fopen(frameFile(10).c_str(), "w");
+        fputs("rubbish", fp);
+        fclose(fp);
+        ProjSettings settings;
+        LayerLoader loader(DIR, settings);
+        Layer* l = loader.TakeLayer();
+        bool paletteChanged;
+        loader.Collect(*l, paletteChanged, true);
+        expect(!loader.Error().empty(), "bad file reported");
+        expect(l->NumFrames() == 10, "frames before bad file kept");
+        delete l;
+
+        bool threw = false;
+        try {
+            delete LoadLayer(DIR, settings);
+        } catch (Exception const&) {
+            threw = true;
+        }
+        expect(threw, "LoadLayer() throws on bad file");
+    }
+
+    // Cancelling part way through is fine.
+    {
+        ProjSettings settings;
+        LayerLoader* loader = new LayerLoader(DIR, settings);
+        delete loader->TakeLayer();
+        delete loader;
+    }
+
+    // Nothing to load.
+    {
+        std::filesystem::remove_all(DIR);
+        std::filesystem::create_directory(DIR);
+        bool threw = false;
+        try {
+            ProjSettings settings;
+            LayerLoader loader(DIR, settings);
+        } catch (Exception const&) {
+            threw = true;
+        }
+        expect(threw, "empty folder rejected");
+    }
+
+    std::filesystem::remove_all(DIR);
+    return (fails > 0) ? 1 : 0;
+}
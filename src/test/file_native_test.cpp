@@ -0,0 +1,286 @@
+// $ g++ -I .. file_native_test.cpp ../file_native.cpp ../serialise.cpp ../layer.cpp ../img.cpp ../blit*.cpp ../box.cpp ../palette.cpp ../colours.cpp ../ranges.cpp ../sheet.cpp ../lexer.cpp ../util.cpp ../exception.cpp
+// $ ./a.out || echo "FAILED"
+
+#include "file_native.h"
+#include "exception.h"
+#include "layer.h"
+#include "project.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s\n", what);
+    }
+}
+
+static const char* FILENAME = "file_native_test.evp";
+
+static long fileSize(const char* filename)
+{
+    struct stat st;
+    return (stat(filename, &st) == 0) ? (long)st.st_size : -1;
+}
+
+static Img* patternImg(PixelFormat fmt, int w, int h, int seed)
+{
+    Img* img = new Img(fmt, w, h);
+    for (int y = 0; y < h; ++y) {
+        uint8_t* p = img->Ptr(0, y);
+        for (int x = 0; x < img->Pitch(); ++x) {
+            *p++ = (uint8_t)(x * 7 + y * 13 + seed);
+        }
+    }
+    return img;
+}
+
+static bool sameImg(Img const& a, Img const& b)
+{
+    if (a.Fmt() != b.Fmt() || a.W() != b.W() || a.H() != b.H()) {
+        return false;
+    }
+    for (int y = 0; y < a.H(); ++y) {
+        if (memcmp(a.PtrConst(0, y), b.PtrConst(0, y), a.Pitch()) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool sameLayer(Layer const& a, Layer const& b)
+{
+    if (a.mName != b.mName || a.mOffset.x != b.mOffset.x ||
+        a.mOffset.y != b.mOffset.y || a.mFPS != b.mFPS ||
+        a.mFrames.size() != b.mFrames.size() ||
+        a.mPalette.NumColours() != b.mPalette.NumColours() ||
+        (a.mSpare == nullptr) != (b.mSpare == nullptr)) {
+        return false;
+    }
+    for (size_t i = 0; i < a.mFrames.size(); ++i) {
+        if (a.mFrames[i]->mDuration != b.mFrames[i]->mDuration ||
+            !sameImg(*a.mFrames[i]->mImg, *b.mFrames[i]->mImg)) {
+            return false;
+        }
+    }
+    if (a.mSpare && !sameImg(*a.mSpare->mImg, *b.mSpare->mImg)) {
+        return false;
+    }
+    for (int i = 0; i < a.mPalette.NumColours(); ++i) {
+        if (a.mPalette.GetColour(i) != b.mPalette.GetColour(i)) {
+            return false;
+        }
+    }
+    Box const& rb = a.mRanges.Bound();
+    if (!(rb == b.mRanges.Bound())) {
+        return false;
+    }
+    for (int y = 0; y < rb.h; ++y) {
+        for (int x = 0; x < rb.w; ++x) {
+            PenColour pa, pb;
+            bool sa = a.mRanges.Get(Point(x, y), pa);
+            bool sb = b.mRanges.Get(Point(x, y), pb);
+            if (sa != sb || (sa && !(pa == pb))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool sameStack(Stack const& a, Stack const& b)
+{
+    if (a.mChildren.size() != b.mChildren.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.mChildren.size(); ++i) {
+        Layer const* la = a.mChildren[i]->ToLayerConst();
+        Layer const* lb = b.mChildren[i]->ToLayerConst();
+        if (!la || !lb || !sameLayer(*la, *lb)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Save proj, overwrite a U32 in the first layer's properties (offset
+// bytes after the start of its name) and try to load it again.
+// Returns true if the load was rejected with an Exception.
+static bool corruptLayerProps(Stack const& proj, long offset, uint32_t val)
+{
+    const char* CORRUPT = "file_native_test_corrupt.evp";
+    unlink(CORRUPT);
+    NativeFile* tmp = nullptr;
+    SaveNative(proj, ProjSettings(), CORRUPT, tmp);
+    delete tmp;
+    tmp = nullptr;
+
+    FILE* fp = fopen(CORRUPT, "r+b");
+    std::vector<uint8_t> buf(fileSize(CORRUPT));
+    if (fread(buf.data(), 1, buf.size(), fp) != buf.size()) {
+        fclose(fp);
+        return false;
+    }
+    // Name is stored as a length then the chars.
+    const uint8_t name[] = {7, 0, 0, 0, 'i', 'n', 'd', 'e', 'x', 'e', 'd'};
+    auto it = std::search(buf.begin(), buf.end(), name, name + sizeof(name));
+    long pos = (long)(it - buf.begin()) + offset;
+    fseek(fp, pos, SEEK_SET);
+    fwrite(&val, 4, 1, fp);  // (little-endian, as is the file)
+    fclose(fp);
+
+    bool threw = false;
+    try {
+        ProjSettings s;
+        delete LoadNative(CORRUPT, s, tmp);
+        delete tmp;
+    } catch (Exception const&) {
+        threw = true;
+    }
+    unlink(CORRUPT);
+    return threw;
+}
+
+static Stack* buildProject()
+{
+    Stack* root = new Stack();
+
+    // indexed, tall enough for lots of tiles
+    Layer* a = new Layer();
+    a->mName = "indexed";
+    a->mFPS = 12;
+    a->mPalette.SetNumColours(16);
+    for (int i = 0; i < 16; ++i) {
+        a->mPalette.SetColour(i, Colour(i * 16, 255 - i, i, 255));
+    }
+    a->mRanges = RangeGrid(4, 2);
+    a->mRanges.Set(Point(1, 1), PenColour(Colour(1, 2, 3, 255), 3));
+    for (int i = 0; i < 3; ++i) {
+        a->mFrames.push_back(new Frame(patternImg(FMT_I8, 300, 500, i), 1000 * i));
+    }
+    // a frame sharing tiles with another
+    a->mFrames.push_back(new Frame(new Img(*a->mFrames[0]->mImg), 5));
+    a->mSpare = new Frame(patternImg(FMT_I8, 300, 500, 99), 0);
+    root->AddChild(a);
+
+    Layer* b = new Layer();
+    b->mName = "rgba";
+    b->mOffset = Point(3, -4);
+    b->mFrames.push_back(new Frame(patternImg(FMT_RGBA8, 100, 100, 7), 40));
+    root->AddChild(b);
+    return root;
+}
+
+int main(int argc, char* argv[]) {
+    unlink(FILENAME);
+    Stack* orig = buildProject();
+    ProjSettings settings;
+    settings.Grid = Box(1, 2, 16, 24);
+    settings.PixW = 2;
+
+    // round trip
+    NativeFile* saved = nullptr;
+    SaveNative(*orig, settings, FILENAME, saved);
+    expect(saved != nullptr, "save state");
+    long firstSize = fileSize(FILENAME);
+
+    NativeFile* native = nullptr;
+    ProjSettings loadedSettings;
+    Stack* loaded = LoadNative(FILENAME, loadedSettings, native);
+    expect(sameStack(*orig, *loaded), "round trip");
+    expect(loadedSettings.Grid == settings.Grid, "settings grid");
+    expect(loadedSettings.PixW == 2 && loadedSettings.PixH == 1, "settings pixel ratio");
+
+    // Writing to a loaded image copies the tile, leaving the file alone.
+    Layer* la = loaded->mChildren[0]->ToLayer();
+    Img& img = *la->mFrames[1]->mImg;
+    *img.Ptr_I8(10, 450) = 200;
+    expect(img.Get_I8(Point(10, 450)) == 200, "write to loaded image");
+    {
+        NativeFile* tmp = nullptr;
+        ProjSettings s;
+        Stack* again = LoadNative(FILENAME, s, tmp);
+        expect(sameStack(*orig, *again), "file untouched by write");
+        delete again;
+        delete tmp;
+    }
+
+    // Saving back only appends the changed tile (plus a new index).
+    SaveNative(*loaded, loadedSettings, FILENAME, native);
+    long grown = fileSize(FILENAME) - firstSize;
+    long tileBytes = img.TileRows() * img.Pitch();
+    expect(grown > 0 && grown <= tileBytes + 2 * 4096, "incremental save only writes changes");
+    {
+        NativeFile* tmp = nullptr;
+        ProjSettings s;
+        Stack* again = LoadNative(FILENAME, s, tmp);
+        expect(sameStack(*loaded, *again), "incremental save round trip");
+        delete again;
+        delete tmp;
+    }
+
+    // Lots of changes - file is rewritten rather than growing forever.
+    for (int i = 0; i < 40; ++i) {
+        for (Frame* f : la->mFrames) {
+            *f->mImg->Ptr_I8(i, i * 12) = (I8)i;
+        }
+        SaveNative(*loaded, loadedSettings, FILENAME, native);
+    }
+    expect(fileSize(FILENAME) < firstSize * 3, "dead space reclaimed");
+    {
+        NativeFile* tmp = nullptr;
+        ProjSettings s;
+        Stack* again = LoadNative(FILENAME, s, tmp);
+        expect(sameStack(*loaded, *again), "round trip after many saves");
+        delete again;
+        delete tmp;
+    }
+
+    // Rubbish is rejected.
+    FILE* fp = fopen(FILENAME, "r+b");
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, len - 20, SEEK_SET);
+    for (int i = 0; i < 20; ++i) {
+        fputc(0xff, fp);
+    }
+    fclose(fp);
+    bool threw = false;
+    try {
+        NativeFile* tmp = nullptr;
+        ProjSettings s;
+        delete LoadNative(FILENAME, s, tmp);
+        delete tmp;
+    } catch (Exception const&) {
+        threw = true;
+    }
+    expect(threw, "corrupt file rejected");
+
+    // Bad sizes and indices in the layer properties are rejected, rather
+    // than trusted. After the name come the offset and fps (12 bytes),
+    // then the palette (count, 16 colours), then the range grid (w, h,
+    // then 8 entries, of which only (1,1) is set).
+    const long palOffset = 11 + 12;
+    const long rangesOffset = palOffset + 4 + 16 * 4;
+    const long penOffset = rangesOffset + 8 + 5 + 1 + 4;
+    expect(!corruptLayerProps(*orig, penOffset, 3), "uncorrupted file loads");
+    expect(corruptLayerProps(*orig, palOffset, 0xffffffff), "huge palette rejected");
+    expect(corruptLayerProps(*orig, palOffset, 257), "oversized palette rejected");
+    expect(corruptLayerProps(*orig, rangesOffset, 0x7fffffff), "huge range grid rejected");
+    expect(corruptLayerProps(*orig, rangesOffset, 0xffffffff), "negative range grid rejected");
+    expect(corruptLayerProps(*orig, penOffset, 16), "pen outside palette rejected");
+
+    delete loaded;
+    delete native;
+    delete saved;
+    delete orig;
+    unlink(FILENAME);
+    return (fails > 0) ? 1 : 0;
+}
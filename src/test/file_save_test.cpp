@@ -0,0 +1,120 @@
+// $ g++ -pthread -I .. file_save_test.cpp ../file_save.cpp ../file_native.cpp ../file_load.cpp ../file_type.cpp ../serialise.cpp ../parallel.cpp ../layer.cpp ../img.cpp ../blit*.cpp ../box.cpp ../palette.cpp ../colours.cpp ../ranges.cpp ../sheet.cpp ../lexer.cpp ../util.cpp ../exception.cpp -limpy
+// $ ./a.out || echo "FAILED"
+
+#include "file_save.h"
+#include "file_native.h"
+#include "exception.h"
+#include "layer.h"
+#include "project.h"
+
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s\n", what);
+    }
+}
+
+static const char* FILENAME = "file_save_test.evp";
+
+static void fill(Img& img, Box const& b, I8 c)
+{
+    for (int y = b.y; y < b.y + b.h; ++y) {
+        I8* p = img.Ptr_I8(b.x, y);
+        for (int x = 0; x < b.w; ++x) {
+            *p++ = c;
+        }
+    }
+}
+
+static Stack* buildProject()
+{
+    Stack* root = new Stack();
+    Layer* l = new Layer();
+    l->mName = "main";
+    l->mPalette.SetNumColours(16);
+    for (int i = 0; i < 4; ++i) {
+        Img* img = new Img(FMT_I8, 200, 300);
+        fill(*img, img->Bounds(), (I8)i);
+        l->mFrames.push_back(new Frame(img, 1000));
+    }
+    root->AddChild(l);
+    return root;
+}
+
+static int pixelInFile(int frame, Point const& pt)
+{
+    NativeFile* native = nullptr;
+    ProjSettings settings;
+    Stack* root = LoadNative(FILENAME, settings, native);
+    int c = root->mChildren[0]->ToLayer()->GetImg(frame).Get_I8(pt);
+    delete root;
+    delete native;
+    return c;
+}
+
+int main(int argc, char* argv[]) {
+    unlink(FILENAME);
+    Stack* root = buildProject();
+    Layer& l = *root->mChildren[0]->ToLayer();
+    ProjSettings settings;
+
+    // Drawing after the save has started doesn't affect what's saved.
+    BackgroundSave* save = new BackgroundSave(*root, FILENAME, settings, nullptr);
+    fill(l.GetImg(2), Box(0, 0, 10, 10), 9);
+    l.mFrames.push_back(new Frame(new Img(FMT_I8, 8, 8), 1000));
+    save->Done(true);
+    expect(save->Error().empty(), "save succeeded");
+    NativeFile* native = save->TakeNative();
+    expect(native != nullptr, "native state handed back");
+    delete save;
+    expect(pixelInFile(2, Point(5, 5)) == 2, "snapshot unaffected by drawing");
+    expect(l.GetImg(2).Get_I8(Point(5, 5)) == 9, "project keeps its drawing");
+
+    // Saving again picks up the change.
+    save = new BackgroundSave(*root, FILENAME, settings, native);
+    save->Done(true);
+    expect(save->Error().empty(), "second save succeeded");
+    native = save->TakeNative();
+    delete save;
+    expect(pixelInFile(2, Point(5, 5)) == 9, "second save has the drawing");
+
+    // Failures are reported, and the native state is handed back unchanged.
+    save = new BackgroundSave(*root, "no/such/dir/x.evp", settings, native);
+    while (!save->Done()) {
+        usleep(1000);
+    }
+    expect(!save->Error().empty(), "failure reported");
+    expect(save->TakeNative() == native, "native state returned after failure");
+    delete save;
+
+    // Deleting a save in progress waits for it.
+    save = new BackgroundSave(*root, FILENAME, settings, native);
+    delete save;
+    expect(pixelInFile(3, Point(0, 0)) == 3, "save completes before delete");
+
+    // Saving a layer over an existing file keeps its permissions, and
+    // leaves no temporary file behind.
+    {
+        const char* PNGNAME = "file_save_test.png";
+        Layer single;
+        single.mPalette.SetNumColours(16);
+        single.mFrames.push_back(new Frame(new Img(FMT_I8, 32, 32), 1000));
+        SaveLayer(single, PNGNAME, settings);
+        chmod(PNGNAME, 0640);
+        SaveLayer(single, PNGNAME, settings);
+        struct stat st;
+        expect(stat(PNGNAME, &st) == 0 && (st.st_mode & 07777) == 0640, "permissions kept");
+        expect(stat("~file_save_test.png", &st) != 0, "temp file gone");
+        unlink(PNGNAME);
+    }
+
+    delete root;
+    unlink(FILENAME);
+    return (fails > 0) ? 1 : 0;
+}
@@ -0,0 +1,72 @@
+// $ g++ -I .. frame_changes_test.cpp ../frame_changes.cpp
+// $ ./a.out || echo "FAILED"
+
+#include "frame_changes.h"
+
+#include <cstdio>
+#include <string>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s\n", what);
+    }
+}
+
+// changed frames as a string, eg "..X.."
+static std::string changes(FrameChanges const& fc, int numFrames) {
+    std::string s;
+    for (int i = 0; i < numFrames; ++i) {
+        s += fc.Changed(i) ? 'X' : '.';
+    }
+    return s;
+}
+
+int main(int argc, char* argv[]) {
+    NodePath target;
+    target.path = {0};
+    NodePath other;
+    other.path = {1};
+    Box dmg(0, 0, 1, 1);
+
+    FrameChanges fc(target, 5);
+    expect(changes(fc, 5) == "XXXXX", "all changed to start with");
+    fc.Reset(5);
+    expect(changes(fc, 5) == "....." && fc.NumChanged() == 0, "reset");
+    expect(fc.Changed(5), "unknown frames count as changed");
+
+    fc.OnDamaged(target, 2, dmg);
+    fc.OnDamaged(other, 3, dmg);
+    fc.OnDamaged(target, SPARE_FRAME, dmg);
+    expect(changes(fc, 5) == "..X..", "damage");
+
+    fc.Reset(5);
+    fc.OnFramesBlatted(target, 1, 2);
+    expect(changes(fc, 5) == ".XX..", "blatted");
+
+    // added frames shift the ones after
+    fc.Reset(5);
+    fc.OnFramesAdded(target, 3, 2);
+    expect(changes(fc, 7) == "...XXXX" && fc.NumChanged() == 4, "added");
+    fc.Reset(7);
+    fc.OnFramesAdded(target, 7, 1);
+    expect(changes(fc, 8) == ".......X", "appended");
+
+    // as do removed ones
+    fc.Reset(8);
+    fc.OnDamaged(target, 7, dmg);
+    fc.OnFramesRemoved(target, 7, 1);
+    expect(changes(fc, 7) == "......." && fc.NumChanged() == 0, "removed last");
+    fc.OnFramesRemoved(target, 2, 2);
+    expect(changes(fc, 5) == "..XXX" && fc.NumChanged() == 3, "removed");
+
+    fc.Reset(5);
+    fc.OnPaletteReplaced(other, 0);
+    expect(fc.NumChanged() == 0, "other palette");
+    fc.OnPaletteChanged(target, 0, 3, Colour(1, 2, 3));
+    expect(changes(fc, 5) == "XXXXX", "palette change");
+
+    return (fails > 0) ? 1 : 0;
+}
@@ -0,0 +1,103 @@
+// $ g++ -I .. img_test.cpp ../img.cpp ../blit.cpp ../box.cpp
+// $ ./a.out || echo "FAILED"
+
+#include "img.h"
+
+#include <cstdio>
+#include <vector>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s\n", what);
+    }
+}
+
+// Storage which notes when it's freed.
+struct TestStorage : public Img::TileStorage {
+    bool* freed;
+    explicit TestStorage(bool* f) : freed(f) {}
+    ~TestStorage() { *freed = true; }
+};
+
+static RGBA8 pattern(int x, int y) {
+    return RGBA8(x & 0xff, y & 0xff, (x ^ y) & 0xff, 255);
+}
+
+int main(int argc, char* argv[]) {
+    // big enough to need lots of tiles
+    Img a(FMT_RGBA8, 3000, 200);
+    expect(a.NumTiles() > 1, "multiple tiles");
+    for (int y = 0; y < a.H(); ++y) {
+        RGBA8* p = a.Ptr_RGBA8(0, y);
+        for (int x = 0; x < a.W(); ++x) {
+            *p++ = pattern(x, y);
+        }
+    }
+
+    // copies share all tiles...
+    Img b(a);
+    for (int t = 0; t < a.NumTiles(); ++t) {
+        expect(a.SameTile(b, t), "copy shares tiles");
+    }
+
+    // ...until written to.
+    int t = b.TileIndex(150);
+    *b.Ptr_RGBA8(10, 150) = RGBA8(1, 2, 3, 4);
+    expect(a.Get_RGBA8(Point(10, 150)) == pattern(10, 150), "original untouched");
+    expect(b.Get_RGBA8(Point(10, 150)) == RGBA8(1, 2, 3, 4), "copy modified");
+    expect(!a.SameTile(b, t), "written tile unshared");
+    expect(a.SameTile(b, 0), "other tiles still shared");
+    expect(b.Get_RGBA8(Point(11, 150)) == pattern(11, 150), "rest of tile copied");
+    size_t tileBytes = (size_t)b.Pitch() * b.TileBounds(t).h;
+    expect(b.UnsharedMemUsage() == tileBytes, "only unshared tile counted");
+    expect(a.UnsharedMemUsage() == tileBytes, "original counts its own tile");
+
+    // tile bounds cover the image
+    int rows = 0;
+    for (int i = 0; i < a.NumTiles(); ++i) {
+        Box tb = a.TileBounds(i);
+        expect(tb.y == rows && tb.w == a.W(), "tile bounds");
+        rows += tb.h;
+    }
+    expect(rows == a.H(), "tiles cover all rows");
+
+    // rotation has to cope with rows in separate tiles
+    Img* r = Rotate90Clockwise(a);
+    expect(r->W() == a.H() && r->H() == a.W(), "rotated size");
+    expect(r->Get_RGBA8(Point(r->W() - 1, 0)) == pattern(0, 0), "rotated pixel");
+    expect(r->Get_RGBA8(Point(0, 5)) == pattern(5, a.H() - 1), "rotated pixel");
+    delete r;
+
+    // images using external storage
+    {
+        int w = 500;
+        int h = 300;
+        int tileRows = Img::TileRowsFor(FMT_I8, w);
+        std::vector<uint8_t> pixels(w * h);
+        for (size_t i = 0; i < pixels.size(); ++i) {
+            pixels[i] = (uint8_t)(i * 7);
+        }
+        std::vector<uint8_t const*> tiles;
+        for (int y = 0; y < h; y += tileRows) {
+            tiles.push_back(pixels.data() + y * w);
+        }
+        bool freed = false;
+        Img* ext = new Img(FMT_I8, w, h, new TestStorage(&freed), tiles);
+        expect(ext->TileRows() == tileRows, "external tile layout");
+        expect(ext->Get_I8(Point(3, 200)) == (uint8_t)((200 * w + 3) * 7), "external pixels");
+        expect(ext->TileShared(0), "external tiles copied upon write");
+        Img* copy = new Img(*ext);
+        *ext->Ptr_I8(3, 200) = 42;
+        expect(ext->Get_I8(Point(3, 200)) == 42, "write to external");
+        expect(pixels[200 * w + 3] == (uint8_t)((200 * w + 3) * 7), "storage untouched");
+        delete ext;
+        expect(!freed, "storage kept while in use");
+        delete copy;
+        expect(freed, "storage freed");
+    }
+
+    return (fails > 0) ? 1 : 0;
+}
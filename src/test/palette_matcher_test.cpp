@@ -0,0 +1,74 @@
+// $ g++ -I .. palette_matcher_test.cpp ../palette_matcher.cpp ../palette.cpp ../colours.cpp ../util.cpp ../exception.cpp
+// $ ./a.out || echo "FAILED"
+
+#include "palette.h"
+#include "palette_matcher.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what, int ncolours) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s (%d colours)\n", what, ncolours);
+    }
+}
+
+static Colour randomColour(bool opaque)
+{
+    return Colour(rand() % 256, rand() % 256, rand() % 256, opaque ? 255 : rand() % 256);
+}
+
+// PaletteMatcher should pick exactly the same entries as Palette::Closest(),
+// including which of several equally-close entries wins.
+static void check(int ncolours, bool opaque, bool clumpy)
+{
+    Palette pal(ncolours);
+    for (int i = 0; i < ncolours; ++i) {
+        Colour c = randomColour(opaque);
+        if (clumpy) {
+            // lots of near/exact duplicates
+            c.r &= 0xe0;
+            c.g &= 0xe0;
+            c.b &= 0xc0;
+        }
+        pal.SetColour(i, c);
+    }
+    PaletteMatcher matcher(pal);
+    bool ok = true;
+    for (int n = 0; n < 50000; ++n) {
+        Colour c = randomColour(opaque && (n % 4) != 0);
+        if (matcher.Closest(c) != pal.Closest(c)) {
+            ok = false;
+        }
+        // again, from the cache this time
+        if (matcher.Closest(c) != pal.Closest(c)) {
+            ok = false;
+        }
+    }
+    // corners of colour space
+    for (int i = 0; i < 16; ++i) {
+        Colour c((i & 1) ? 255 : 0, (i & 2) ? 255 : 0, (i & 4) ? 255 : 0, (i & 8) ? 255 : 0);
+        if (matcher.Closest(c) != pal.Closest(c)) {
+            ok = false;
+        }
+    }
+    expect(ok, clumpy ? "clumpy" : (opaque ? "opaque" : "alpha"), ncolours);
+}
+
+int main(int argc, char* argv[]) {
+    srand(42);
+    const int sizes[] = {1, 2, 16, 256};
+    for (int n : sizes) {
+        check(n, true, false);
+        check(n, false, false);
+        check(n, true, true);
+    }
+
+    Palette empty(0);
+    PaletteMatcher matcher(empty);
+    expect(matcher.Closest(Colour(1, 2, 3)) == -1, "empty", 0);
+    return (fails > 0) ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+// $ g++ -pthread -I .. parallel_test.cpp ../parallel.cpp
+// $ ./a.out || echo "FAILED"
+
+#include "parallel.h"
+
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s\n", what);
+    }
+}
+
+// Check every index in [begin,end) is visited exactly once, and chunks
+// start on a grain boundary.
+static void check(int begin, int end, int grain, const char* what)
+{
+    std::vector<std::atomic<int>> hits(end > begin ? end - begin : 0);
+    std::atomic<bool> aligned(true);
+    ParallelFor(begin, end, grain, [&](int b, int e) {
+        if ((b - begin) % grain != 0 || e <= b) {
+            aligned = false;
+        }
+        for (int i = b; i < e; ++i) {
+            ++hits[i - begin];
+        }
+    });
+    bool once = true;
+    for (auto const& h : hits) {
+        if (h != 1) {
+            once = false;
+        }
+    }
+    expect(once, what);
+    expect(aligned, what);
+}
+
+int main(int argc, char* argv[]) {
+    expect(NumWorkers() >= 1, "at least one worker");
+
+    check(0, 0, 1, "empty range");
+    check(0, 1, 1, "single item");
+    check(0, 1000, 1, "grain 1");
+    check(5, 1003, 7, "odd grain");
+    check(-50, 50, 16, "negative begin");
+    check(0, 100000, 64, "big range");
+
+    // nested calls run on the calling thread, rather than deadlocking
+    std::atomic<int> total(0);
+    ParallelFor(0, 64, 1, [&](int b, int e) {
+        for (int i = b; i < e; ++i) {
+            ParallelFor(0, 100, 1, [&](int b2, int e2) {
+                total += e2 - b2;
+            });
+        }
+    });
+    expect(total == 6400, "nested");
+
+    return (fails > 0) ? 1 : 0;
+}
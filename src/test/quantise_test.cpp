@@ -0,0 +1,134 @@
+// $ g++ -I .. quantise_test.cpp ../quantise.cpp ../colour_map.cpp ../palette_matcher.cpp ../img.cpp ../box.cpp ../palette.cpp ../colours.cpp ../util.cpp ../exception.cpp ../parallel.cpp ../blit.cpp ../blit_keyed.cpp ../blit_matte.cpp ../blit_range.cpp ../blit_simd.cpp
+// $ ./a.out || echo "FAILED"
+
+#include "quantise.h"
+#include "img.h"
+#include "palette.h"
+#include "palette_matcher.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s\n", what);
+    }
+}
+
+// Sum of squared distances from each pixel to its closest palette colour.
+static int64_t totalError(Img const& img, std::vector<Colour> const& colours)
+{
+    Palette pal((int)colours.size());
+    for (int i = 0; i < (int)colours.size(); ++i) {
+        pal.SetColour(i, colours[i]);
+    }
+    PaletteMatcher matcher(pal);
+    int64_t total = 0;
+    for (int y = 0; y < img.H(); ++y) {
+        for (int x = 0; x < img.W(); ++x) {
+            Colour c(*img.PtrConst_RGBX8(x, y));
+            total += DistSq(c, colours[matcher.Closest(c)]);
+        }
+    }
+    return total;
+}
+
+int main(int argc, char* argv[]) {
+    // few enough colours: kept as-is, in the order they appear
+    {
+        Img img(FMT_RGBX8, 8, 8);
+        for (int y = 0; y < 8; ++y) {
+            for (int x = 0; x < 8; ++x) {
+                *img.Ptr_RGBX8(x, y) = RGBX8(y * 10, 0, 0);
+            }
+        }
+        std::vector<Colour> out;
+        CalculatePalette(img, out, 16);
+        bool ok = out.size() == 16;
+        for (int i = 0; ok && i < 8; ++i) {
+            ok = out[i] == Colour(i * 10, 0, 0);
+        }
+        expect(ok, "order preserved");
+    }
+
+    // reduction, with every colour appearing only once
+    {
+        Img img(FMT_RGBA8, 64, 64);
+        for (int y = 0; y < 64; ++y) {
+            for (int x = 0; x < 64; ++x) {
+                *img.Ptr_RGBA8(x, y) = RGBA8(x * 4, y * 4, (x ^ y) * 4, (x + y) * 2);
+            }
+        }
+        std::vector<Colour> out;
+        CalculatePalette(img, out, 32);
+        expect(out.size() == 32, "reduced to 32 colours");
+    }
+
+    // two clumps of colours: reducing to two should give one from each
+    {
+        Img img(FMT_RGBX8, 100, 100);
+        const RGBX8 cols[4] = {RGBX8(255, 0, 0), RGBX8(0, 0, 255), RGBX8(250, 0, 0), RGBX8(0, 0, 240)};
+        for (int y = 0; y < 100; ++y) {
+            for (int x = 0; x < 100; ++x) {
+                *img.Ptr_RGBX8(x, y) = cols[(x + y) % 4];
+            }
+        }
+        std::vector<Colour> out;
+        CalculatePalette(img, out, 2);
+        bool ok = out.size() == 2;
+        int reds = 0;
+        int blues = 0;
+        for (Colour const& c : out) {
+            reds += (c.r >= 250 && c.b == 0) ? 1 : 0;
+            blues += (c.b >= 240 && c.r == 0) ? 1 : 0;
+        }
+        expect(ok && reds == 1 && blues == 1, "clumps");
+    }
+
+    // multiple frames, big enough to be split up: colours from all frames,
+    // still in the order they first appear
+    {
+        std::vector<Img*> frames;
+        std::vector<Img const*> srcImgs;
+        for (int f = 0; f < 4; ++f) {
+            Img* img = new Img(FMT_RGBX8, 256, 256);
+            for (int y = 0; y < 256; ++y) {
+                for (int x = 0; x < 256; ++x) {
+                    *img->Ptr_RGBX8(x, y) = RGBX8(f * 4 + y / 64, 0, 0);
+                }
+            }
+            frames.push_back(img);
+            srcImgs.push_back(img);
+        }
+        std::vector<Colour> out;
+        CalculatePalette(srcImgs, out, 20);
+        bool ok = out.size() == 20;
+        for (int i = 0; ok && i < 16; ++i) {
+            ok = out[i] == Colour(i, 0, 0);
+        }
+        expect(ok, "multiple frames");
+        for (Img* img : frames) {
+            delete img;
+        }
+    }
+    // k-means refinement should never make the match worse
+    {
+        Img img(FMT_RGBX8, 128, 128);
+        for (int y = 0; y < 128; ++y) {
+            for (int x = 0; x < 128; ++x) {
+                *img.Ptr_RGBX8(x, y) = RGBX8(x * 2, (y * 2) ^ (x & 0x30), (x * y) & 0xff);
+            }
+        }
+        std::vector<Colour> plain;
+        std::vector<Colour> refined;
+        CalculatePalette(img, plain, 16);
+        CalculatePalette(img, refined, 16, nullptr, true);
+        expect(refined.size() == 16, "refined size");
+        expect(totalError(img, plain) >= totalError(img, refined), "refined error");
+    }
+    return (fails > 0) ? 1 : 0;
+}
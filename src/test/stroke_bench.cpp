@@ -0,0 +1,138 @@
+// $ g++ -O2 -I .. stroke_bench.cpp ../stroke.cpp ../draw.cpp ../blit.cpp ../blit_keyed.cpp ../blit_matte.cpp ../blit_range.cpp ../blit_simd.cpp ../img.cpp ../box.cpp ../palette.cpp ../colours.cpp ../util.cpp ../exception.cpp
+// $ ./a.out || echo "FAILED"
+
+// Times strokes (StrokeKeyed() and StrokeMatte()) against stamping the
+// brush at each point with BlitTransparent() and BlitMatte(), for a long
+// diagonal line with round brushes of a few sizes, in each format.
+// Fails if the results differ. The timings are just printed, as they're
+// too noisy on a busy machine to fail on.
+
+#include "stroke.h"
+#include "blit_keyed.h"
+#include "blit_matte.h"
+#include "box.h"
+#include "draw.h"
+#include "img.h"
+#include "palette.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static int fails = 0;
+static const char* fmtNames[] = {"I8", "RGBX8", "RGBA8"};
+
+static void expect(bool cond, const char* what, PixelFormat fmt, int size) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s %s %dpx\n", what, fmtNames[fmt], size);
+    }
+}
+
+static const int REPS = 10;
+
+static void plot(int x, int y, void* user)
+{
+    ((std::vector<Point>*)user)->push_back(Point(x, y));
+}
+
+static bool sameImg(Img const& a, Img const& b)
+{
+    for (int y = 0; y < a.H(); ++y) {
+        if (memcmp(a.PtrConst(0, y), b.PtrConst(0, y), a.Pitch()) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A filled circle, transparent (zero) outside.
+static Img* roundBrush(PixelFormat fmt, int size)
+{
+    Img* brush = new Img(fmt, size, size);
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            int dx = 2 * x - size + 1;
+            int dy = 2 * y - size + 1;
+            if (dx * dx + dy * dy > size * size) {
+                continue;
+            }
+            switch (fmt) {
+            case FMT_I8: *brush->Ptr_I8(x, y) = 5; break;
+            case FMT_RGBX8: *brush->Ptr_RGBX8(x, y) = RGBX8(1, 2, 3); break;
+            case FMT_RGBA8: *brush->Ptr_RGBA8(x, y) = RGBA8(1, 2, 3, 255); break;
+            }
+        }
+    }
+    return brush;
+}
+
+template<typename FN>
+static double bestOf(FN const& fn)
+{
+    double best = 1e9;
+    for (int rep = 0; rep < REPS; ++rep) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+static void bench(PixelFormat fmt, int size, std::vector<Point> const& pts)
+{
+    Palette pal(256);
+    PenColour transparent(Colour(0, 0, 0), 0);
+    PenColour matte(Colour(9, 9, 9), 9);
+    Img* brush = roundBrush(fmt, size);
+    Img stamped(fmt, 2048, 2048);
+    Img stroked(fmt, 2048, 2048);
+    std::vector<Box> damage;
+
+    double keyedStamps = bestOf([&]() {
+        for (auto const& p : pts) {
+            Box b(p.x, p.y, size, size);
+            BlitTransparent(*brush, brush->Bounds(), pal, stamped, b, transparent);
+        }
+    });
+    double keyedStroke = bestOf([&]() {
+        StrokeKeyed(*brush, pal, transparent, pts, stroked, damage);
+    });
+    expect(sameImg(stamped, stroked), "keyed result", fmt, size);
+
+    double matteStamps = bestOf([&]() {
+        for (auto const& p : pts) {
+            Box b(p.x, p.y, size, size);
+            BlitMatte(*brush, brush->Bounds(), stamped, b, transparent, matte);
+        }
+    });
+    double matteStroke = bestOf([&]() {
+        StrokeMatte(*brush, transparent, matte, pts, stroked, damage);
+    });
+    expect(sameImg(stamped, stroked), "matte result", fmt, size);
+
+    printf("%-6s %3dpx  keyed: stamps %7.3fms stroke %7.3fms (x%.2f)   matte: stamps %7.3fms stroke %7.3fms (x%.2f)\n",
+        fmtNames[fmt], size,
+        keyedStamps, keyedStroke, keyedStamps / keyedStroke,
+        matteStamps, matteStroke, matteStamps / matteStroke);
+    delete brush;
+}
+
+int main(int argc, char* argv[]) {
+    // a 2000-ish point diagonal line
+    std::vector<Point> pts;
+    WalkLine(10, 10, 1900, 1500, plot, &pts);
+
+    const PixelFormat fmts[] = {FMT_I8, FMT_RGBX8, FMT_RGBA8};
+    const int sizes[] = {4, 16, 64};
+    for (PixelFormat fmt : fmts) {
+        for (int size : sizes) {
+            bench(fmt, size, pts);
+        }
+    }
+    return (fails > 0) ? 1 : 0;
+}
@@ -0,0 +1,150 @@
+// $ g++ -I .. stroke_test.cpp ../stroke.cpp ../draw.cpp ../img.cpp ../box.cpp ../palette.cpp ../colours.cpp ../util.cpp ../exception.cpp ../blit.cpp ../blit_keyed.cpp ../blit_matte.cpp ../blit_range.cpp ../blit_simd.cpp
+// $ ./a.out || echo "FAILED"
+
+#include "stroke.h"
+#include "blit_keyed.h"
+#include "blit_matte.h"
+#include "box.h"
+#include "draw.h"
+#include "img.h"
+#include "palette.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what, PixelFormat brushFmt, PixelFormat destFmt, int seed) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s (brush fmt %d, dest fmt %d, seed %d)\n", what, (int)brushFmt, (int)destFmt, seed);
+    }
+}
+
+static Palette pal(256);
+static PenColour transparent;
+
+static bool samePixel(Img const& a, Img const& b, int x, int y)
+{
+    Point pt(x, y);
+    switch (a.Fmt()) {
+        case FMT_I8: return a.Get_I8(pt) == b.Get_I8(pt);
+        case FMT_RGBX8: return a.Get_RGBX8(pt) == b.Get_RGBX8(pt);
+        case FMT_RGBA8: return a.Get_RGBA8(pt) == b.Get_RGBA8(pt);
+    }
+    return false;
+}
+
+// Random pixels, with the odd transparent hole.
+static void scribble(Img& img, int holes)
+{
+    for (int y = 0; y < img.H(); ++y) {
+        for (int x = 0; x < img.W(); ++x) {
+            bool clear = (rand() % 10) < holes;
+            int i = clear ? transparent.idx() : 1 + rand() % 255;
+            Colour c = pal.GetColour(i);
+            switch (img.Fmt()) {
+                case FMT_I8: *img.Ptr_I8(x, y) = i; break;
+                case FMT_RGBX8: *img.Ptr_RGBX8(x, y) = c; break;
+                case FMT_RGBA8:
+                    {
+                        RGBA8 rgba = c;
+                        rgba.a = clear ? 0 : 1 + rand() % 255;
+                        *img.Ptr_RGBA8(x, y) = rgba;
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+static void plot_cb(int x, int y, void* user)
+{
+    ((std::vector<Point>*)user)->push_back(Point(x, y));
+}
+
+// Compare strokes against blitting the brush at each point in turn.
+static void check(PixelFormat brushFmt, PixelFormat destFmt)
+{
+    for (int seed = 0; seed < 200; ++seed) {
+        srand(seed);
+        Img brush(brushFmt, 1 + rand() % 20, 1 + rand() % 20);
+        scribble(brush, rand() % 8);
+        Img orig(destFmt, 1 + rand() % 90, 1 + rand() % 90);
+        scribble(orig, 0);
+
+        // a polyline, wandering off the edges now and then
+        std::vector<Point> pts;
+        int n = 1 + rand() % 4;
+        Point prev(rand() % 120 - 30, rand() % 120 - 30);
+        pts.push_back(prev);
+        for (int i = 0; i < n; ++i) {
+            Point p(rand() % 120 - 30, rand() % 120 - 30);
+            WalkLine(prev.x, prev.y, p.x, p.y, plot_cb, &pts);
+            prev = p;
+        }
+        PenColour matte(pal.GetColour(42), 42);
+
+        for (int mode = 0; mode < 2; ++mode) {
+            Img ref(orig);
+            for (auto const& p : pts) {
+                Box dmg(p.x, p.y, brush.W(), brush.H());
+                if (mode == 0) {
+                    BlitTransparent(brush, brush.Bounds(), pal, ref, dmg, transparent);
+                } else {
+                    BlitMatte(brush, brush.Bounds(), ref, dmg, transparent, matte);
+                }
+            }
+
+            Img out(orig);
+            std::vector<Box> damage;
+            if (mode == 0) {
+                StrokeKeyed(brush, pal, transparent, pts, out, damage);
+            } else {
+                StrokeMatte(brush, transparent, matte, pts, out, damage);
+            }
+
+            bool same = true;
+            bool covered = true;
+            for (int y = 0; y < out.H(); ++y) {
+                for (int x = 0; x < out.W(); ++x) {
+                    same = same && samePixel(out, ref, x, y);
+                    if (!samePixel(out, orig, x, y)) {
+                        bool in = false;
+                        for (auto const& b : damage) {
+                            in = in || b.Contains(Point(x, y));
+                        }
+                        covered = covered && in;
+                    }
+                }
+            }
+            expect(same, mode == 0 ? "keyed pixels" : "matte pixels", brushFmt, destFmt, seed);
+            expect(covered, "damage", brushFmt, destFmt, seed);
+            bool inBounds = true;
+            for (auto const& b : damage) {
+                Box clipped(b);
+                clipped.ClipAgainst(out.Bounds());
+                inBounds = inBounds && !b.Empty() && clipped == b &&
+                    out.TileIndex(b.YMin()) == out.TileIndex(b.YMax());
+            }
+            expect(inBounds, "damage boxes", brushFmt, destFmt, seed);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    srand(1234);
+    for (int i = 0; i < 256; ++i) {
+        pal.SetColour(i, Colour(rand() % 256, rand() % 256, rand() % 256));
+    }
+    transparent = PenColour(pal.GetColour(0), 0);
+
+    const PixelFormat fmts[3] = {FMT_I8, FMT_RGBX8, FMT_RGBA8};
+    for (PixelFormat brushFmt : fmts) {
+        for (PixelFormat destFmt : fmts) {
+            check(brushFmt, destFmt);
+        }
+    }
+    return (fails > 0) ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+// $ g++ -O2 -pthread -I .. undo_journal_bench.cpp ../undo_journal.cpp ../cmd*.cpp ../project.cpp ../file_*.cpp ../frame_changes.cpp ../img*.cpp ../palette*.cpp ../colour_map.cpp ../quantise.cpp ../parallel.cpp ../serialise.cpp ../layer.cpp ../blit*.cpp ../draw.cpp ../box.cpp ../colours.cpp ../ranges.cpp ../sheet.cpp ../lexer.cpp ../util.cpp ../exception.cpp -limpy
+// $ ./a.out || echo "FAILED"
+
+// Times paging cmds back in from an UndoJournal (UndoJournal::Pop()), for
+// a few typical cmds. Fails if a page-in takes longer than a frame at 60Hz
+// (so undo would visibly stall), or if the paged-in cmd doesn't restore the
+// image properly.
+
+#include "undo_journal.h"
+#include "cmd.h"
+#include "cmd_remap.h"
+#include "layer.h"
+#include "project.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// project.cpp wants this (normally in app.cpp)
+class App;
+App* g_App = nullptr;
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s\n", what);
+    }
+}
+
+static bool sameImg(Img const& a, Img const& b)
+{
+    for (int y = 0; y < a.H(); ++y) {
+        if (memcmp(a.PtrConst(0, y), b.PtrConst(0, y), a.Pitch()) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Page cmd out and back in a few times, reporting the worst page-in.
+static Cmd* pageInOut(const char* name, Project& proj, Cmd* cmd)
+{
+    const int RUNS = 20;
+    UndoJournal journal;
+    size_t diskUsage = 0;
+    for (int i = 0; i < RUNS; ++i) {
+        cmd->Pack();
+        expect(journal.Push(*cmd), name);
+        diskUsage = journal.DiskUsage();
+        delete cmd;
+        cmd = journal.Pop(proj);
+        if (!cmd) {
+            expect(false, name);
+            return nullptr;
+        }
+    }
+    UndoJournal::Stats const& stats = journal.GetStats();
+    printf("%-24s avg %.3fms  max %.3fms  (%zu bytes on disk)\n", name,
+        stats.totalMS / stats.pageIns, stats.maxMS, diskUsage);
+    expect(stats.maxMS < 16.0, name);
+    return cmd;
+}
+
+int main(int argc, char* argv[]) {
+    const int W = 2000;
+    const int H = 2000;
+    Layer* l = new Layer();
+    l->mPalette.SetNumColours(256);
+    l->mFrames.push_back(new Frame(new Img(FMT_I8, W, H), 1000));
+    Project proj(l);
+    NodePath target = CalcPath(l);
+    Img& img = proj.GetImg(target, 0);
+
+    // A big pixel-art-ish drawing (runs of colour).
+    Img before(img);
+    for (int y = 0; y < H; ++y) {
+        I8* p = img.Ptr_I8(0, y);
+        for (int x = 0; x < W; ++x) {
+            *p++ = (I8)((x / 7 + y / 5) & 15);
+        }
+    }
+    Img after(img);
+    Cmd* cmd = new Cmd_Draw(proj, target, 0, img.Bounds(), before);
+    cmd = pageInOut("2000x2000 draw", proj, cmd);
+    if (cmd) {
+        cmd->Undo();
+        expect(sameImg(img, before), "draw undo");
+        cmd->Do();
+        expect(sameImg(img, after), "draw redo");
+        delete cmd;
+    }
+
+    // A palette edit.
+    Colour red(255, 0, 0, 255);
+    cmd = new Cmd_PaletteModify(proj, target, 0, 3, 1, &red);
+    cmd->Do();
+    delete pageInOut("palette edit", proj, cmd);
+
+    // A remap, in a batch with a palette edit (as the palette tools do).
+    Palette pal(l->mPalette);
+    Cmd_Batch* batch = new Cmd_Batch(proj, Cmd::DONE);
+    Cmd* remap = new Cmd_Remap(proj, target, FMT_I8, pal);
+    remap->Do();
+    batch->Append(remap);
+    Cmd* modify = new Cmd_PaletteModify(proj, target, 0, 4, 1, &red);
+    modify->Do();
+    batch->Append(modify);
+    delete pageInOut("remap batch", proj, batch);
+
+    return (fails > 0) ? 1 : 0;
+}
@@ -0,0 +1,89 @@
+// $ g++ -I .. zoom_test.cpp ../blit_zoom.cpp ../blit.cpp ../blit_keyed.cpp ../blit_matte.cpp ../blit_range.cpp ../blit_simd.cpp ../img.cpp ../box.cpp ../palette.cpp ../colours.cpp ../util.cpp ../exception.cpp
+// $ ./a.out || echo "FAILED"
+
+#include "blit_zoom.h"
+#include "box.h"
+#include "img.h"
+#include "palette.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static int fails = 0;
+
+static void expect(bool cond, const char* what, int xzoom, int skip, int w) {
+    if (!cond) {
+        ++fails;
+        fprintf(stderr, "Failed: %s (xzoom=%d skip=%d w=%d)\n", what, xzoom, skip, w);
+    }
+}
+
+template<typename P>
+static void checkZoomRow(const char* what)
+{
+    std::vector<P> src(64);
+    for (auto& c : src) {
+        c = (P)rand();
+    }
+    for (int xzoom = 1; xzoom <= 17; ++xzoom) {
+        for (int skip = 0; skip < xzoom; ++skip) {
+            for (int w = 0; w < 40; ++w) {
+                std::vector<P> expected(w + 1, 0xaa);
+                for (int x = 0; x < w; ++x) {
+                    expected[x] = src[(x + skip) / xzoom];
+                }
+                std::vector<P> got(w + 1, 0xaa);
+                ZoomRow(src.data(), got.data(), w, xzoom, skip);
+                expect(got == expected, what, xzoom, skip, w);
+            }
+        }
+    }
+}
+
+// Zoomed blits at all sorts of positions (including clipped on all edges)
+// should match a plain zoom of the whole src.
+static void checkBlitZoom()
+{
+    Palette pal(256);
+    for (int i = 0; i < 256; ++i) {
+        pal.SetColour(i, Colour(rand() % 256, rand() % 256, rand() % 256));
+    }
+    Img src(FMT_I8, 16, 12);
+    for (int y = 0; y < src.H(); ++y) {
+        for (int x = 0; x < src.W(); ++x) {
+            *src.Ptr_I8(x, y) = (I8)rand();
+        }
+    }
+    const int xzoom = 3;
+    const int yzoom = 2;
+    const Box srcbox(2, 1, 11, 9);
+    for (int t = 0; t < 200; ++t) {
+        Img dest(FMT_RGBX8, 40, 30);
+        Box destbox(rand() % 60 - 30, rand() % 40 - 20, srcbox.w * xzoom, srcbox.h * yzoom);
+        BlitZoom(src, srcbox, dest, destbox, pal, xzoom, yzoom);
+        bool ok = true;
+        for (int y = 0; y < dest.H(); ++y) {
+            for (int x = 0; x < dest.W(); ++x) {
+                RGBX8 expected(0, 0, 0);
+                Point pt(x, y);
+                if (destbox.Contains(pt)) {
+                    Point s(srcbox.x + (x - destbox.x) / xzoom, srcbox.y + (y - destbox.y) / yzoom);
+                    expected = pal.GetColour(src.Get_I8(s));
+                }
+                if (!(dest.Get_RGBX8(pt) == expected)) {
+                    ok = false;
+                }
+            }
+        }
+        expect(ok, "BlitZoom", xzoom, destbox.x, destbox.y);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    checkZoomRow<I8>("ZoomRow I8");
+    checkZoomRow<uint32_t>("ZoomRow 32bit");
+    checkBlitZoom();
+    return (fails > 0) ? 1 : 0;
+}
@@ -13,6 +13,7 @@
 #include "cmd.h"
 #include "global.h"
 #include "brush.h"
+#include "stroke.h"
 
 #include <algorithm>    // for min,max
 #include <cstdlib>      // for std::abs
@@ -23,8 +24,12 @@
 // ---------------------
 // helper class to collect multiple drawing ops into a single Cmd_Draw.
 // Upon creation, DrawTransaction takes a backup of the image being drawn to.
+// (this is cheap - the backup shares the image tiles, and the originals are
+// only duplicated as they are drawn upon).
 // As the image is draw upon, BeginDamage()/EndDamage() should be called to
 // keep track of the area which has been modified.
+// Damage is tracked per image tile, so the Cmd only has to hold on to the
+// pixels actually touched (rather than the bounding box of a whole stroke).
 // When drawing is complete, Commit() will return a Cmd object in the DONE
 // state (ie the drawing has already been performed).
 // The returned cmd is ready to place upon the undo stack.
@@ -37,6 +42,8 @@ public:
     // call AddDamage as often as needed, within Begin/End pairs
     void BeginDamage(NodePath const& target, int frame);
     void AddDamage(Box const& affected);
+    // several areas at once, with a single notification
+    void AddDamage(std::vector<Box> const& affected);
     void EndDamage();
 
     // Commit() returns a Cmd (in the DONE state) which encapsulates the
@@ -48,12 +55,14 @@ public:
 
 private:
     void flush();
+    void addTileDamage(Box const& affected);
 
     Project& m_Proj;
     NodePath m_Target;
     int m_Frame;
     Img* m_Backup;
-    Box m_Affected;
+    // affected area within each tile of m_Backup
+    std::vector<Box> m_TileDamage;
 
     Cmd_Batch* m_Batch;
 };
@@ -62,7 +71,6 @@ DrawTransaction::DrawTransaction( Project& proj) :
     m_Proj(proj),
     m_Frame(0),
     m_Backup(nullptr),
-    m_Affected( 0,0,0,0 ),           // start with nothing affected
     m_Batch( new Cmd_Batch(proj, Cmd::DONE))
 {
 }
@@ -83,12 +91,14 @@ void DrawTransaction::BeginDamage(NodePath const& target, int frame)
 {
     // if we're changing target (eg drawing to another frame), we need
     // to wrap up the previous one first.
-    if (target != m_Target) {
+    if (target != m_Target || frame != m_Frame) {
         flush();
 
         m_Target = target;
         m_Frame = frame;
         m_Backup = new Img(m_Proj.GetImgConst(target, frame));
+        // start with nothing affected
+        m_TileDamage.assign(m_Backup->NumTiles(), Box(0,0,0,0));
     }
 }
 
@@ -100,7 +110,34 @@ void DrawTransaction::AddDamage(Box const& affected)
     }
     assert(m_Backup->Bounds().Contains(affected));
     m_Proj.NotifyDamage(m_Target, m_Frame, affected);
-    m_Affected.Merge(affected);
+    addTileDamage(affected);
+}
+
+void DrawTransaction::AddDamage(std::vector<Box> const& affected)
+{
+    assert(!m_Target.IsEmpty());
+    Box all(0, 0, 0, 0);
+    for (Box const& b : affected) {
+        if (b.Empty()) {
+            continue;
+        }
+        assert(m_Backup->Bounds().Contains(b));
+        all.Merge(b);
+        addTileDamage(b);
+    }
+    if (!all.Empty()) {
+        m_Proj.NotifyDamage(m_Target, m_Frame, all);
+    }
+}
+
+void DrawTransaction::addTileDamage(Box const& affected)
+{
+    int tmax = m_Backup->TileIndex(affected.YMax());
+    for (int t = m_Backup->TileIndex(affected.YMin()); t <= tmax; ++t) {
+        Box b(affected);
+        b.ClipAgainst(m_Backup->TileBounds(t));
+        m_TileDamage[t].Merge(b);
+    }
 }
 
 void DrawTransaction::EndDamage()
@@ -119,18 +156,35 @@ Cmd* DrawTransaction::Commit()
 
 void DrawTransaction::flush()
 {
-    if (!m_Affected.Empty()) {
-        assert(m_Backup);
+    if (!m_Backup) {
+        return;
+    }
 
-        Cmd* c = new Cmd_Draw(m_Proj, m_Target, m_Frame, m_Affected, *m_Backup);
-        m_Batch->Append(c);
-        m_Affected.SetEmpty();
+    // collect up the damage, merging vertically-adjacent tiles which
+    // cover the same columns (eg a big filled rectangle)
+    std::vector<Box> affected;
+    for (Box const& b : m_TileDamage) {
+        if (b.Empty()) {
+            continue;
+        }
+        if (!affected.empty()) {
+            Box& prev = affected.back();
+            if (prev.x == b.x && prev.w == b.w && prev.y + prev.h == b.y) {
+                prev.h += b.h;
+                continue;
+            }
+        }
+        affected.push_back(b);
     }
-    if (m_Backup) {
-        delete m_Backup;
-        m_Backup = nullptr;
-        m_Target = NodePath();  // null
+
+    if (!affected.empty()) {
+        Cmd* c = new Cmd_Draw(m_Proj, m_Target, m_Frame, affected, *m_Backup);
+        m_Batch->Append(c);
     }
+    m_TileDamage.clear();
+    delete m_Backup;
+    m_Backup = nullptr;
+    m_Target = NodePath();  // null
 }
 
 void DrawTransaction::Rollback()
@@ -220,20 +274,12 @@ static void PlonkBrushToView( EditView& view, Point const& pos, Box& viewdmg, Bu
 
 
 
-// helper to draw the current brush on the project, using the current editor settings
-static void PlonkBrushToProj(EditView& view, Point const& pos, Box& projdmg, Button button)
+// helper to work out how the current brush is really drawn onto target
+static DrawMode BrushDrawMode(Editor& ed, Img const& target, Button button)
 {
-    Editor& ed = view.Ed();
     Brush const& brush = ed.CurrentBrush();
-    Box dmg = brush.Bounds();
-    dmg.Translate(pos);
-    dmg.Translate(-brush.Handle());
-
-    Img& target = view.FocusedImg();
     DrawMode dm = ed.Mode();
 
-    PenColour pen = (button==DRAW) ? ed.FGPen() : ed.BGPen();
-
     if (dm.mode == DrawMode::DM_NORMAL)
     {
         if (button==ERASE)
@@ -249,8 +295,24 @@ static void PlonkBrushToProj(EditView& view, Point const& pos, Box& projdmg, But
         if (target.Fmt()==FMT_I8 && brush.Fmt()!=FMT_I8)
             dm.mode = DrawMode::DM_COLOUR;
     }
+    return dm;
+}
+
+
+// helper to draw the current brush on the project, using the current editor settings
+static void PlonkBrushToProj(EditView& view, Point const& pos, Box& projdmg, Button button)
+{
+    Editor& ed = view.Ed();
+    Brush const& brush = ed.CurrentBrush();
+    Box dmg = brush.Bounds();
+    dmg.Translate(pos);
+    dmg.Translate(-brush.Handle());
+
+    Img& target = view.FocusedImg();
+    DrawMode dm = BrushDrawMode(ed, target, button);
+
+    PenColour pen = (button==DRAW) ? ed.FGPen() : ed.BGPen();
 
- 
     switch (dm.mode)
     {
         case DrawMode::DM_NORMAL:
@@ -283,6 +345,57 @@ static void PlonkBrushToProj(EditView& view, Point const& pos, Box& projdmg, But
 }
 
 
+// helper to draw the current brush at each of pts in turn (eg along a
+// line), using the current editor settings.
+// Apart from range mode (where every stamp shifts the colours again), each
+// pixel is only drawn once, rather than the whole brush being blitted at
+// every point (see stroke.h).
+static void StrokeBrushToProj(EditView& view, std::vector<Point> const& pts, std::vector<Box>& projdmg, Button button)
+{
+    Editor& ed = view.Ed();
+    Brush const& brush = ed.CurrentBrush();
+    Img& target = view.FocusedImg();
+    DrawMode dm = BrushDrawMode(ed, target, button);
+    PenColour pen = (button==DRAW) ? ed.FGPen() : ed.BGPen();
+
+    projdmg.clear();
+    if (dm.mode == DrawMode::DM_RANGE) {
+        for (auto const& p : pts) {
+            Box dmg;
+            PlonkBrushToProj(view, p, dmg, button);
+            projdmg.push_back(dmg);
+        }
+        return;
+    }
+
+    // stroke positions are for the top-left of the brush
+    std::vector<Point> tl;
+    tl.reserve(pts.size());
+    for (auto const& p : pts) {
+        tl.push_back(p - brush.Handle());
+    }
+    switch (dm.mode)
+    {
+        case DrawMode::DM_NORMAL:
+            StrokeKeyed(brush, brush.GetPalette(), brush.TransparentColour(),
+                tl, target, projdmg);
+            break;
+        case DrawMode::DM_COLOUR:
+            StrokeMatte(brush, brush.TransparentColour(), pen,
+                tl, target, projdmg);
+            break;
+        default:
+            break;
+    }
+}
+
+// callback for collecting up points (eg from WalkLine())
+static void AddPoint_cb(int x, int y, void* user)
+{
+    ((std::vector<Point>*)user)->push_back(Point(x, y));
+}
+
+
 // helper - draw a crosshair cursor, centred on the given point (project coords)
 void DrawCrossHairCursor( EditView& view, Point const& centre, Colour const& c )
 {
@@ -337,31 +450,54 @@ void PencilTool::OnDown( EditView& view, Point const& p, Button b )
     m_Tx = new DrawTransaction(view.Proj());
 
     // draw 1st pixel
+    std::vector<Box> dmg;
     m_Tx->BeginDamage(view.Focus(), view.Frame());
-    Plot_cb( p.x, p.y, (void*)this );
+    StrokeBrushToProj(view, std::vector<Point>(1, p), dmg, m_DownButton);
+    m_Tx->AddDamage(dmg);
     m_Tx->EndDamage();
 }
 
 void PencilTool::OnMove( EditView& view, Point const& p)
 {
+    OnMoves(view, std::vector<Point>(1, p));
+}
+
+// Draw the whole polyline in one go.
+void PencilTool::OnMoves( EditView& view, std::vector<Point> const& pts )
+{
+    if (pts.empty()) {
+        return;
+    }
     if( m_DownButton == NONE )
     {
-        m_Pos = p;  // for cursor
+        m_Pos = pts.back();  // for cursor
         return;
     }
 
+    // collect up all the points to plot
+    std::vector<Point> stroke;
+    for (auto const& p : pts) {
+        // feels 'wrong' to do continuous lines if grid is on...
+        if( Owner().GridActive() )
+            stroke.push_back(p);
+        else
+        {
+            // (skipping the first point (m_Pos) - it's already been drawn)
+            size_t n = stroke.size();
+            WalkLine( m_Pos.x, m_Pos.y, p.x, p.y, AddPoint_cb, &stroke );
+            if (stroke.size() > n && stroke[n] == m_Pos) {
+                stroke.erase(stroke.begin() + n);
+            }
+        }
+        m_Pos = p;
+    }
+
     assert(m_Tx);
+    std::vector<Box> dmg;
     m_Tx->BeginDamage(view.Focus(), view.Frame());
-    // feels 'wrong' to do continuous lines if grid is on...
-    if( Owner().GridActive() )
-        Plot_cb( p.x, p.y, (void*)this );
-    else
-    {
-        // TODO: should not draw first point (m_Pos) - it's already been drawn.
-        WalkLine( m_Pos.x, m_Pos.y, p.x, p.y, Plot_cb, this );
-    }
+    StrokeBrushToProj(view, stroke, dmg, m_DownButton);
+    m_Tx->AddDamage(dmg);
     m_Tx->EndDamage();
-    m_Pos = p;
 }
 
 void PencilTool::OnUp( EditView& , Point const& p, Button b )
@@ -387,19 +523,6 @@ void PencilTool::DrawCursor( EditView& view )
     view.AddCursorDamage( viewdmg );
 }
 
-//static
-void PencilTool::Plot_cb( int x, int y, void* user )
-{
-
-    PencilTool* that = (PencilTool*)user;
-    EditView& view = *that->m_View;
-
-    Box dmg;
-    PlonkBrushToProj(view, Point(x,y), dmg, that->m_DownButton );
-
-    assert(that->m_Tx != 0);
-    that->m_Tx->AddDamage( dmg );
-}
 
 
 //------------------------------
@@ -410,14 +533,12 @@ LineTool::LineTool( Editor& owner ) :
     m_From(0,0),
     m_To(0,0),
     m_DownButton(NONE),
-    m_View(0),
-    m_Tx(0)
+    m_View(0)
 {
 }
 
 LineTool::~LineTool()
 {
-    assert(m_Tx==0);
 }
 
 
@@ -447,11 +568,13 @@ void LineTool::OnUp( EditView& view, Point const& p, Button b )
     {
         DrawTransaction tx(view.Proj());
         m_To = p;
-        m_Tx = &tx; // to give plot_cb access
-        m_Tx->BeginDamage(view.Focus(), view.Frame());
-        WalkLine( m_From.x, m_From.y, m_To.x, m_To.y, Plot_cb, this );
+        std::vector<Point> stroke;
+        WalkLine( m_From.x, m_From.y, m_To.x, m_To.y, AddPoint_cb, &stroke );
+        std::vector<Box> dmg;
+        tx.BeginDamage(view.Focus(), view.Frame());
+        StrokeBrushToProj(view, stroke, dmg, m_DownButton);
+        tx.AddDamage(dmg);
         tx.EndDamage();
-        m_Tx = 0;
         Cmd* c = tx.Commit();
         Owner().AddCmd(c);
         m_DownButton = NONE;
@@ -460,17 +583,6 @@ void LineTool::OnUp( EditView& view, Point const& p, Button b )
     }
 }
 
-//static
-void LineTool::Plot_cb( int x, int y, void* user )
-{
-    LineTool* that = (LineTool*)user;
-    EditView& view = *that->m_View;
-
-    Box dmg;
-    PlonkBrushToProj(view, Point(x,y), dmg, that->m_DownButton);
-
-    that->m_Tx->AddDamage(dmg);
-}
 
 
 
@@ -639,14 +751,36 @@ void FloodFillTool::OnDown( EditView& view, Point const& p, Button b )
     if( b == ERASE )
         fillcolour = Owner().BGPen();
 
+    FillMode const& fm = Owner().Fill();
+    NodePath const& focus = view.Focus();
+    Palette const& pal = proj.PaletteConst(focus, view.Frame());
+    // global fills replace the colour under the cursor in the current frame
+    PenColour target = proj.PickUpPen(focus, view.Frame(), p);
+
+    int first = view.Frame();
+    int last = view.Frame();
+    if (fm.allFrames && view.Frame() != SPARE_FRAME) {
+        first = 0;
+        last = proj.ResolveLayer(focus).NumFrames() - 1;
+    }
+
     {
         DrawTransaction tx(proj);
-        Box dmg;
-        tx.BeginDamage(view.Focus(), view.Frame());
-        FloodFill(view.FocusedImg(), p, fillcolour, dmg);
-        tx.AddDamage( dmg );
-        tx.EndDamage();
-        if( !dmg.Empty() ) {
+        bool changed = false;
+        for (int f = first; f <= last; ++f) {
+            Box dmg;
+            tx.BeginDamage(focus, f);
+            Img& img = proj.GetImg(focus, f);
+            if (fm.global) {
+                ReplaceColour(img, target, fillcolour, dmg, fm.tolerance, &pal);
+            } else {
+                FloodFill(img, p, fillcolour, dmg, fm.tolerance, &pal);
+            }
+            tx.AddDamage( dmg );
+            tx.EndDamage();
+            changed = changed || !dmg.Empty();
+        }
+        if( changed ) {
             Cmd* c = tx.Commit();
             Owner().AddCmd(c);
         }
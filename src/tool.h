@@ -44,6 +44,15 @@ public:
 	virtual void OnUp( EditView& view, Point const& p, Button b ) = 0;
 	virtual void DrawCursor( EditView& view )=0;
     virtual bool ObeyGrid() { return true; }
+
+    // A batch of moves, oldest first (eg all the mouse movement since the
+    // last screen update). By default, just calls OnMove() for each.
+    virtual void OnMoves( EditView& view, std::vector<Point> const& pts )
+    {
+        for (auto const& p : pts) {
+            OnMove(view, p);
+        }
+    }
 protected:
     Editor& Owner() { return m_Owner; }
 private:
@@ -58,10 +67,10 @@ public:
 	~PencilTool();
 	virtual void OnDown( EditView& view, Point const& p, Button b );
 	virtual void OnMove( EditView& view, Point const& p);
+	virtual void OnMoves( EditView& view, std::vector<Point> const& pts );
 	virtual void OnUp( EditView& view, Point const& p, Button b );
 	virtual void DrawCursor( EditView& view );
 private:
-    static void Plot_cb( int x, int y, void* user );
 	Point m_Pos;
 	Button m_DownButton;
     EditView* m_View;
@@ -80,14 +89,12 @@ public:
 	virtual void OnUp( EditView& view, Point const& p, Button b );
     virtual void DrawCursor( EditView& view );
 private:
-    static void Plot_cb( int x, int y, void* user );
     static void PlotCursor_cb( int x, int y, void* user );
     Point m_From;
     Point m_To;
     Button m_DownButton;
     EditView* m_View;
     Box m_CursorDamage;
-    DrawTransaction *m_Tx;
 };
 
 
@@ -0,0 +1,87 @@
+#include "undo_journal.h"
+#include "cmd.h"
+#include "exception.h"
+#include "serialise.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+
+UndoJournal::UndoJournal() :
+    m_FP(tmpfile())
+{
+    if (!m_FP) {
+        throw Exception("Couldn't create undo journal: %s", strerror(errno));
+    }
+}
+
+UndoJournal::~UndoJournal()
+{
+    fclose(m_FP);
+}
+
+size_t UndoJournal::DiskUsage() const
+{
+    if (m_Entries.empty()) {
+        return 0;
+    }
+    return (size_t)m_Entries.back().offset + m_Entries.back().len;
+}
+
+// Entries are written one after another, so the file is used as a stack.
+// Space freed by Pop() is just reused by the next Push().
+bool UndoJournal::Push(Cmd const& cmd)
+{
+    BinWriter out;
+    if (!cmd.Save(out)) {
+        return false;
+    }
+    Entry e;
+    e.offset = (long)DiskUsage();
+    e.len = out.Data().size();
+    if (fseek(m_FP, e.offset, SEEK_SET) != 0 ||
+        fwrite(out.Data().data(), 1, e.len, m_FP) != e.len) {
+        return false;
+    }
+    m_Entries.push_back(e);
+    return true;
+}
+
+Cmd* UndoJournal::Pop(Project& proj)
+{
+    if (m_Entries.empty()) {
+        return nullptr;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    Entry e = m_Entries.back();
+    m_Entries.pop_back();
+    std::vector<uint8_t> buf(e.len);
+    if (fseek(m_FP, e.offset, SEEK_SET) != 0 ||
+        fread(buf.data(), 1, e.len, m_FP) != e.len) {
+        Clear();
+        return nullptr;
+    }
+    Cmd* cmd = nullptr;
+    try {
+        BinReader in(buf.data(), buf.size());
+        cmd = Cmd::Load(proj, in);
+    } catch (Exception const&) {
+        Clear();
+        return nullptr;
+    }
+
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    ++m_Stats.pageIns;
+    m_Stats.totalMS += elapsed.count();
+    m_Stats.maxMS = std::max(m_Stats.maxMS, elapsed.count());
+    return cmd;
+}
+
+void UndoJournal::Clear()
+{
+    m_Entries.clear();
+}
@@ -0,0 +1,59 @@
+#ifndef UNDO_JOURNAL_H
+#define UNDO_JOURNAL_H
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+class Cmd;
+class Project;
+
+// Disk-backed overflow for the undo stack.
+// The Editor pushes its oldest cmds onto the journal when the undo stack
+// gets too big, and pages them back in again (most recent first) when the
+// user undoes far enough back.
+// Data is kept in an anonymous temp file, which goes away with the journal.
+class UndoJournal
+{
+public:
+    // Throws an Exception if the temp file can't be created.
+    UndoJournal();
+    ~UndoJournal();
+
+    // Write cmd out to the journal. The caller still owns cmd.
+    // Returns false (leaving the journal unchanged) if the cmd can't be
+    // serialised or the write fails.
+    bool Push(Cmd const& cmd);
+
+    // Read back the most recently pushed cmd (or null if the journal is
+    // empty or the data is bad - in which case the journal is cleared).
+    Cmd* Pop(Project& proj);
+
+    bool Empty() const { return m_Entries.empty(); }
+    int Count() const { return (int)m_Entries.size(); }
+    void Clear();
+
+    // bytes currently in use in the file
+    size_t DiskUsage() const;
+
+    // page-in timings, in milliseconds
+    struct Stats {
+        int pageIns {0};
+        double totalMS {0.0};
+        double maxMS {0.0};
+    };
+    Stats const& GetStats() const { return m_Stats; }
+
+private:
+    UndoJournal( UndoJournal const& );  // disallowed
+
+    struct Entry {
+        long offset;
+        size_t len;
+    };
+    FILE* m_FP;
+    std::vector<Entry> m_Entries;
+    Stats m_Stats;
+};
+
+#endif // UNDO_JOURNAL_H